@@ -49,6 +49,10 @@
 #include <locale.h>
 #endif
 
+#ifdef CJSON_HASH_CACHE
+#include <stdatomic.h>
+#endif
+
 #if defined(_MSC_VER)
 #pragma warning (pop)
 #endif
@@ -155,35 +159,44 @@ static int case_insensitive_strcmp(const unsigned char *string1, const unsigned
 
 typedef struct internal_hooks
 {
-    void *(CJSON_CDECL *allocate)(size_t size);
-    void (CJSON_CDECL *deallocate)(void *pointer);
-    void *(CJSON_CDECL *reallocate)(void *pointer, size_t size);
+    void *(CJSON_CDECL *allocate)(void *userdata, size_t size);
+    void (CJSON_CDECL *deallocate)(void *userdata, void *pointer);
+    void *(CJSON_CDECL *reallocate)(void *userdata, void *pointer, size_t size);
+    void *userdata;
 } internal_hooks;
 
-#if defined(_MSC_VER)
-/* work around MSVC error C2322: '...' address of dllimport '...' is not static */
-static void * CJSON_CDECL internal_malloc(size_t size)
+/* the global hooks keep the malloc/free style functions supplied through cJSON_InitHooks here */
+static cJSON_Hooks global_malloc_hooks = { NULL, NULL };
+
+static void * CJSON_CDECL internal_malloc(void *userdata, size_t size)
 {
+    const cJSON_Hooks *hooks = (const cJSON_Hooks*)userdata;
+    if ((hooks != NULL) && (hooks->malloc_fn != NULL))
+    {
+        return hooks->malloc_fn(size);
+    }
     return malloc(size);
 }
-static void CJSON_CDECL internal_free(void *pointer)
+static void CJSON_CDECL internal_free(void *userdata, void *pointer)
 {
+    const cJSON_Hooks *hooks = (const cJSON_Hooks*)userdata;
+    if ((hooks != NULL) && (hooks->free_fn != NULL))
+    {
+        hooks->free_fn(pointer);
+        return;
+    }
     free(pointer);
 }
-static void * CJSON_CDECL internal_realloc(void *pointer, size_t size)
+static void * CJSON_CDECL internal_realloc(void *userdata, void *pointer, size_t size)
 {
+    (void)userdata;
     return realloc(pointer, size);
 }
-#else
-#define internal_malloc malloc
-#define internal_free free
-#define internal_realloc realloc
-#endif
 
 /* strlen of character literals resolved at compile time */
 #define static_strlen(string_literal) (sizeof(string_literal) - sizeof(""))
 
-static internal_hooks global_hooks = { internal_malloc, internal_free, internal_realloc };
+static internal_hooks global_hooks = { internal_malloc, internal_free, internal_realloc, &global_malloc_hooks };
 
 static unsigned char* cJSON_strdup(const unsigned char* string, const internal_hooks * const hooks)
 {
@@ -196,7 +209,7 @@ static unsigned char* cJSON_strdup(const unsigned char* string, const internal_h
     }
 
     length = strlen((const char*)string) + sizeof("");
-    copy = (unsigned char*)hooks->allocate(length);
+    copy = (unsigned char*)hooks->allocate(hooks->userdata, length);
     if (copy == NULL)
     {
         return NULL;
@@ -208,39 +221,43 @@ static unsigned char* cJSON_strdup(const unsigned char* string, const internal_h
 
 CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
 {
+    global_malloc_hooks.malloc_fn = NULL;
+    global_malloc_hooks.free_fn = NULL;
+    global_hooks.reallocate = internal_realloc;
+
     if (hooks == NULL)
     {
         /* Reset hooks */
-        global_hooks.allocate = malloc;
-        global_hooks.deallocate = free;
-        global_hooks.reallocate = realloc;
         return;
     }
 
-    global_hooks.allocate = malloc;
-    if (hooks->malloc_fn != NULL)
-    {
-        global_hooks.allocate = hooks->malloc_fn;
-    }
-
-    global_hooks.deallocate = free;
-    if (hooks->free_fn != NULL)
-    {
-        global_hooks.deallocate = hooks->free_fn;
-    }
+    global_malloc_hooks.malloc_fn = hooks->malloc_fn;
+    global_malloc_hooks.free_fn = hooks->free_fn;
 
     /* use realloc only if both free and malloc are used */
-    global_hooks.reallocate = NULL;
-    if ((global_hooks.allocate == malloc) && (global_hooks.deallocate == free))
+    if ((hooks->malloc_fn != NULL) || (hooks->free_fn != NULL))
     {
-        global_hooks.reallocate = realloc;
+        global_hooks.reallocate = NULL;
     }
 }
 
+/* build internal hooks from the allocator of a context */
+static internal_hooks context_hooks(const cJSON_Context * const context)
+{
+    internal_hooks hooks;
+
+    hooks.allocate = context->allocator.malloc_fn;
+    hooks.deallocate = context->allocator.free_fn;
+    hooks.reallocate = context->allocator.realloc_fn;
+    hooks.userdata = context->allocator.userdata;
+
+    return hooks;
+}
+
 /* Internal constructor. */
 static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
 {
-    cJSON* node = (cJSON*)hooks->allocate(sizeof(cJSON));
+    cJSON* node = (cJSON*)hooks->allocate(hooks->userdata, sizeof(cJSON));
     if (node)
     {
         memset(node, '\0', sizeof(cJSON));
@@ -249,8 +266,156 @@ static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
     return node;
 }
 
-/* Delete a cJSON structure. */
-CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
+#ifdef CJSON_ARRAY_INDEX
+#ifndef CJSON_ARRAY_INDEX_MIN
+#define CJSON_ARRAY_INDEX_MIN 16
+#endif
+
+/* children by position, with room to append more, allocated with and freed through the hooks of the tree */
+struct cJSON_Index
+{
+    internal_hooks hooks;
+    size_t count;
+    size_t capacity;
+    cJSON *items[1];
+};
+
+#define index_size(capacity) (sizeof(struct cJSON_Index) + (((capacity) - 1) * sizeof(cJSON*)))
+
+/* build the index of an array with count children */
+static struct cJSON_Index *build_array_index(cJSON * const array, size_t count, const internal_hooks * const hooks)
+{
+    struct cJSON_Index *index = NULL;
+    cJSON *child = NULL;
+    size_t capacity = count + (count / 2);
+    size_t i = 0;
+
+    if (capacity < CJSON_ARRAY_INDEX_MIN)
+    {
+        capacity = CJSON_ARRAY_INDEX_MIN;
+    }
+    index = (struct cJSON_Index*)hooks->allocate(hooks->userdata, index_size(capacity));
+    if (index == NULL)
+    {
+        /* not fatal, the list can still be walked */
+        return NULL;
+    }
+    index->hooks = *hooks;
+    index->count = count;
+    index->capacity = capacity;
+    for (child = array->child; child != NULL; child = child->next)
+    {
+        index->items[i++] = child;
+    }
+
+    array->index = index;
+    return index;
+}
+
+/* append to the index, growing it with the hooks it was built with */
+static void append_to_index(cJSON * const array, cJSON * const item)
+{
+    struct cJSON_Index *index = array->index;
+    struct cJSON_Index *grown = NULL;
+    size_t capacity = 0;
+
+    if (index == NULL)
+    {
+        return;
+    }
+    if (index->count == index->capacity)
+    {
+        capacity = index->capacity * 2;
+        if (index->hooks.reallocate != NULL)
+        {
+            grown = (struct cJSON_Index*)index->hooks.reallocate(index->hooks.userdata, index, index_size(capacity));
+        }
+        else
+        {
+            grown = (struct cJSON_Index*)index->hooks.allocate(index->hooks.userdata, index_size(capacity));
+            if (grown != NULL)
+            {
+                memcpy(grown, index, index_size(index->capacity));
+                index->hooks.deallocate(index->hooks.userdata, index);
+            }
+        }
+        if (grown == NULL)
+        {
+            /* a failed reallocate leaves the old block in place */
+            cJSON_InvalidateIndex(array);
+            return;
+        }
+        grown->capacity = capacity;
+        array->index = index = grown;
+    }
+    index->items[index->count++] = item;
+}
+#else
+#define append_to_index(array, item)
+#endif
+
+CJSON_PUBLIC(void) cJSON_InvalidateIndex(cJSON * const array)
+{
+#ifdef CJSON_ARRAY_INDEX
+    if ((array != NULL) && (array->index != NULL))
+    {
+        array->index->hooks.deallocate(array->index->hooks.userdata, array->index);
+        array->index = NULL;
+    }
+#else
+    (void)array;
+#endif
+}
+
+/* index the children of array with the given hooks, false if there is no index afterwards */
+static cJSON_bool index_array(cJSON * const array, const internal_hooks * const hooks)
+{
+#ifdef CJSON_ARRAY_INDEX
+    cJSON *child = NULL;
+    size_t count = 0;
+
+    if ((array == NULL) || !(array->type & (cJSON_Array | cJSON_Object)) || (array->type & cJSON_Packed))
+    {
+        return false;
+    }
+    if (array->index != NULL)
+    {
+        return true;
+    }
+
+    for (child = array->child; child != NULL; child = child->next)
+    {
+        count++;
+    }
+
+    return build_array_index(array, count, hooks) != NULL;
+#else
+    (void)array;
+    (void)hooks;
+    return false;
+#endif
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_IndexArray(cJSON * const array)
+{
+    return index_array(array, &global_hooks);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_IndexArrayCtx(cJSON_Context * const context, cJSON * const array)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return false;
+    }
+    hooks = context_hooks(context);
+
+    return index_array(array, &hooks);
+}
+
+/* Delete a cJSON structure using the given hooks. */
+static void delete_item(cJSON *item, const internal_hooks * const hooks)
 {
     cJSON *next = NULL;
     while (item != NULL)
@@ -258,21 +423,28 @@ CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
         next = item->next;
         if (!(item->type & cJSON_IsReference) && (item->child != NULL))
         {
-            cJSON_Delete(item->child);
+            delete_item(item->child, hooks);
         }
         if (!(item->type & cJSON_IsReference) && (item->valuestring != NULL))
         {
-            global_hooks.deallocate(item->valuestring);
+            hooks->deallocate(hooks->userdata, item->valuestring);
         }
         if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
         {
-            global_hooks.deallocate(item->string);
+            hooks->deallocate(hooks->userdata, item->string);
         }
-        global_hooks.deallocate(item);
+        cJSON_InvalidateIndex(item);
+        hooks->deallocate(hooks->userdata, item);
         item = next;
     }
 }
 
+/* Delete a cJSON structure. */
+CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
+{
+    delete_item(item, &global_hooks);
+}
+
 /* get the decimal point character of the current locale */
 static unsigned char get_decimal_point(void)
 {
@@ -290,6 +462,7 @@ typedef struct
     size_t length;
     size_t offset;
     size_t depth; /* How deeply nested (in arrays/objects) is the input at the current offset. */
+    size_t max_depth; /* Nesting limit, normally CJSON_NESTING_LIMIT */
     internal_hooks hooks;
 } parse_buffer;
 
@@ -381,6 +554,8 @@ loop_end:
 /* don't ask me, but the original cJSON_SetNumberValue returns an integer or double */
 CJSON_PUBLIC(double) cJSON_SetNumberHelper(cJSON *object, double number)
 {
+    cJSON_InvalidateHash(object);
+
     if (number >= INT_MAX)
     {
         object->valueint = INT_MAX;
@@ -405,6 +580,7 @@ CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
     {
         return NULL;
     }
+    cJSON_InvalidateHash(object);
     if (strlen(valuestring) <= strlen(object->valuestring))
     {
         strcpy(object->valuestring, valuestring);
@@ -433,6 +609,8 @@ typedef struct
     cJSON_bool noalloc;
     cJSON_bool format; /* is this print a formatted print */
     internal_hooks hooks;
+    cJSON_WriteFn flush; /* when set, a full buffer is handed to flush and reused instead of growing */
+    void *flush_userdata;
 } printbuffer;
 
 /* realloc printbuffer if necessary to have at least "needed" bytes more */
@@ -464,6 +642,24 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
         return p->buffer + p->offset;
     }
 
+    if (p->flush != NULL)
+    {
+        /* streaming: write out what has been printed so far and start over at the beginning of the chunk */
+        if ((p->offset > 0) && !p->flush(p->flush_userdata, (char*)p->buffer, p->offset))
+        {
+            return NULL;
+        }
+        needed -= p->offset;
+        p->offset = 0;
+        if (needed > p->length)
+        {
+            /* a single token does not fit into the chunk */
+            return NULL;
+        }
+
+        return p->buffer;
+    }
+
     if (p->noalloc) {
         return NULL;
     }
@@ -489,10 +685,10 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
     if (p->hooks.reallocate != NULL)
     {
         /* reallocate with realloc if available */
-        newbuffer = (unsigned char*)p->hooks.reallocate(p->buffer, newsize);
+        newbuffer = (unsigned char*)p->hooks.reallocate(p->hooks.userdata, p->buffer, newsize);
         if (newbuffer == NULL)
         {
-            p->hooks.deallocate(p->buffer);
+            p->hooks.deallocate(p->hooks.userdata, p->buffer);
             p->length = 0;
             p->buffer = NULL;
 
@@ -502,10 +698,10 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
     else
     {
         /* otherwise reallocate manually */
-        newbuffer = (unsigned char*)p->hooks.allocate(newsize);
+        newbuffer = (unsigned char*)p->hooks.allocate(p->hooks.userdata, newsize);
         if (!newbuffer)
         {
-            p->hooks.deallocate(p->buffer);
+            p->hooks.deallocate(p->hooks.userdata, p->buffer);
             p->length = 0;
             p->buffer = NULL;
 
@@ -513,7 +709,7 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
         }
 
         memcpy(newbuffer, p->buffer, p->offset + 1);
-        p->hooks.deallocate(p->buffer);
+        p->hooks.deallocate(p->hooks.userdata, p->buffer);
     }
     p->length = newsize;
     p->buffer = newbuffer;
@@ -541,11 +737,73 @@ static cJSON_bool compare_double(double a, double b)
     return (fabs(a - b) <= maxVal * DBL_EPSILON);
 }
 
-/* Render the number nicely from the given item into a string. */
-static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
+/* Packed arrays keep their elements in valuestring and the element count in valueint, the element type is stored in
+ * the type bits above cJSON_Packed. */
+#define packed_type_shift 11
+#define packed_element_type(item) (((item)->type >> packed_type_shift) & 3)
+static const size_t packed_element_size[4] = { sizeof(short), sizeof(int), sizeof(float), sizeof(double) };
+
+/* read element index of a packed array, memcpy because a referenced buffer need not be aligned */
+static double get_packed_number(const cJSON * const array, size_t index)
+{
+    const unsigned char *element = (const unsigned char*)array->valuestring + (index * packed_element_size[packed_element_type(array)]);
+
+    switch (packed_element_type(array))
+    {
+        case cJSON_PackedInt16:
+        {
+            short value = 0;
+            memcpy(&value, element, sizeof(value));
+            return (double)value;
+        }
+
+        case cJSON_PackedInt32:
+        {
+            int value = 0;
+            memcpy(&value, element, sizeof(value));
+            return (double)value;
+        }
+
+        case cJSON_PackedFloat:
+        {
+            float value = 0;
+            memcpy(&value, element, sizeof(value));
+            return (double)value;
+        }
+
+        default:
+        {
+            double value = 0;
+            memcpy(&value, element, sizeof(value));
+            return value;
+        }
+    }
+}
+
+/* get the number at index of a packed or ordinary array, cursor walks the children of an ordinary one and must start at
+ * its first child with index 0, indices must then be visited in order */
+static cJSON_bool get_array_number(const cJSON * const array, cJSON ** const cursor, size_t index, double * const number)
+{
+    if (array->type & cJSON_Packed)
+    {
+        *number = get_packed_number(array, index);
+        return true;
+    }
+
+    if ((*cursor == NULL) || !cJSON_IsNumber(*cursor))
+    {
+        return false;
+    }
+    *number = (*cursor)->valuedouble;
+    *cursor = (*cursor)->next;
+
+    return true;
+}
+
+/* Render the number nicely into a string, valueint is the saturated integer value of d. */
+static cJSON_bool print_number_value(const double d, const int valueint, printbuffer * const output_buffer)
 {
     unsigned char *output_pointer = NULL;
-    double d = item->valuedouble;
     int length = 0;
     size_t i = 0;
     unsigned char number_buffer[26] = {0}; /* temporary buffer to print the number into */
@@ -562,9 +820,9 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     {
         length = sprintf((char*)number_buffer, "null");
     }
-	else if(d == (double)item->valueint)
+	else if(d == (double)valueint)
 	{
-		length = sprintf((char*)number_buffer, "%d", item->valueint);
+		length = sprintf((char*)number_buffer, "%d", valueint);
 	}
     else
     {
@@ -611,6 +869,12 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     return true;
 }
 
+/* Render the number nicely from the given item into a string. */
+static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
+{
+    return print_number_value(item->valuedouble, item->valueint, output_buffer);
+}
+
 /* parse 4 digit hexadecimal number */
 static unsigned parse_hex4(const unsigned char * const input)
 {
@@ -809,7 +1073,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
 
         /* This is at most how much we need for the output */
         allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+        output = (unsigned char*)input_buffer->hooks.allocate(input_buffer->hooks.userdata, allocation_length + sizeof(""));
         if (output == NULL)
         {
             goto fail; /* allocation failure */
@@ -887,7 +1151,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
 fail:
     if (output != NULL)
     {
-        input_buffer->hooks.deallocate(output);
+        input_buffer->hooks.deallocate(input_buffer->hooks.userdata, output);
     }
 
     if (input_pointer != NULL)
@@ -1091,15 +1355,15 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return
     return cJSON_ParseWithLengthOpts(value, buffer_length, return_parse_end, require_null_terminated);
 }
 
-/* Parse an object - create a new root, and populate. */
-CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+/* Parse an object - create a new root, and populate, allocating with the given hooks. */
+static cJSON *parse_with_hooks(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated, const internal_hooks * const hooks, size_t max_depth, error * const parse_error)
 {
-    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 } };
+    parse_buffer buffer = { 0, 0, 0, 0, 0, { 0, 0, 0, 0 } };
     cJSON *item = NULL;
 
     /* reset error position */
-    global_error.json = NULL;
-    global_error.position = 0;
+    parse_error->json = NULL;
+    parse_error->position = 0;
 
     if (value == NULL || 0 == buffer_length)
     {
@@ -1109,9 +1373,10 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer
     buffer.content = (const unsigned char*)value;
     buffer.length = buffer_length;
     buffer.offset = 0;
-    buffer.hooks = global_hooks;
+    buffer.max_depth = max_depth;
+    buffer.hooks = *hooks;
 
-    item = cJSON_New_Item(&global_hooks);
+    item = cJSON_New_Item(hooks);
     if (item == NULL) /* memory fail */
     {
         goto fail;
@@ -1142,7 +1407,7 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer
 fail:
     if (item != NULL)
     {
-        cJSON_Delete(item);
+        delete_item(item, hooks);
     }
 
     if (value != NULL)
@@ -1165,12 +1430,17 @@ fail:
             *return_parse_end = (const char*)local_error.json + local_error.position;
         }
 
-        global_error = local_error;
+        *parse_error = local_error;
     }
 
     return NULL;
 }
 
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+{
+    return parse_with_hooks(value, buffer_length, return_parse_end, require_null_terminated, &global_hooks, CJSON_NESTING_LIMIT, &global_error);
+}
+
 /* Default options for cJSON_Parse */
 CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value)
 {
@@ -1182,67 +1452,494 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
     return cJSON_ParseWithLengthOpts(value, buffer_length, 0, 0);
 }
 
-#define cjson_min(a, b) (((a) < (b)) ? (a) : (b))
+/* Validation: check the input against the JSON grammar without building a tree or allocating. */
+typedef enum
+{
+    validate_value,
+    validate_key,
+    validate_after_value
+} validate_state;
 
-static unsigned char *print(const cJSON * const item, cJSON_bool format, const internal_hooks * const hooks)
+/* Utility to jump whitespace without the end of buffer adjustment of buffer_skip_whitespace */
+static void validate_skip_whitespace(parse_buffer * const buffer)
 {
-    static const size_t default_buffer_size = 256;
-    printbuffer buffer[1];
-    unsigned char *printed = NULL;
+    while (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] <= 32) && (buffer_at_offset(buffer)[0] != '\0'))
+    {
+        buffer->offset++;
+    }
+}
 
-    memset(buffer, 0, sizeof(buffer));
+static cJSON_bool validate_hex4(const unsigned char * const input)
+{
+    size_t i = 0;
 
-    /* create buffer */
-    buffer->buffer = (unsigned char*) hooks->allocate(default_buffer_size);
-    buffer->length = default_buffer_size;
-    buffer->format = format;
-    buffer->hooks = *hooks;
-    if (buffer->buffer == NULL)
+    for (i = 0; i < 4; i++)
     {
-        goto fail;
+        if (!(((input[i] >= '0') && (input[i] <= '9')) || ((input[i] >= 'A') && (input[i] <= 'F')) || ((input[i] >= 'a') && (input[i] <= 'f'))))
+        {
+            return false;
+        }
     }
 
-    /* print the value */
-    if (!print_value(item, buffer))
+    return true;
+}
+
+/* Check a string literal, leaving the offset behind the closing quote */
+static cJSON_bool validate_string(parse_buffer * const buffer)
+{
+    if (cannot_access_at_index(buffer, 0) || (buffer_at_offset(buffer)[0] != '\"'))
     {
-        goto fail;
+        return false;
     }
-    update_offset(buffer);
+    buffer->offset++;
 
-    /* check if reallocate is available */
-    if (hooks->reallocate != NULL)
+    while (can_access_at_index(buffer, 0))
     {
-        printed = (unsigned char*) hooks->reallocate(buffer->buffer, buffer->offset + 1);
-        if (printed == NULL) {
-            goto fail;
+        const unsigned char *input = buffer_at_offset(buffer);
+        unsigned int code = 0;
+
+        if (input[0] == '\"')
+        {
+            buffer->offset++;
+            return true;
         }
-        buffer->buffer = NULL;
-    }
-    else /* otherwise copy the JSON over to a new buffer */
-    {
-        printed = (unsigned char*) hooks->allocate(buffer->offset + 1);
-        if (printed == NULL)
+        if (input[0] == '\0')
         {
-            goto fail;
+            return false;
+        }
+        if (input[0] != '\\')
+        {
+            buffer->offset++;
+            continue;
         }
-        memcpy(printed, buffer->buffer, cjson_min(buffer->length, buffer->offset + 1));
-        printed[buffer->offset] = '\0'; /* just to be sure */
 
-        /* free the buffer */
-        hooks->deallocate(buffer->buffer);
+        /* escape sequence */
+        if (cannot_access_at_index(buffer, 1))
+        {
+            return false;
+        }
+        switch (input[1])
+        {
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+            case '\"':
+            case '\\':
+            case '/':
+                buffer->offset += 2;
+                break;
+
+            case 'u':
+                if (cannot_access_at_index(buffer, 5) || !validate_hex4(input + 2))
+                {
+                    return false;
+                }
+                code = parse_hex4(input + 2);
+                if ((code >= 0xDC00) && (code <= 0xDFFF))
+                {
+                    /* lone second half of a surrogate pair */
+                    return false;
+                }
+                if ((code >= 0xD800) && (code <= 0xDBFF))
+                {
+                    /* the second half of the surrogate pair has to follow */
+                    if (cannot_access_at_index(buffer, 11) || (input[6] != '\\') || (input[7] != 'u') || !validate_hex4(input + 8))
+                    {
+                        return false;
+                    }
+                    code = parse_hex4(input + 8);
+                    if ((code < 0xDC00) || (code > 0xDFFF))
+                    {
+                        return false;
+                    }
+                    buffer->offset += 6;
+                }
+                buffer->offset += 6;
+                break;
+
+            default:
+                return false;
+        }
     }
 
-    return printed;
+    /* string ended unexpectedly */
+    return false;
+}
 
-fail:
-    if (buffer->buffer != NULL)
+/* Check a number against the JSON grammar: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? */
+static cJSON_bool validate_number(parse_buffer * const buffer)
+{
+    size_t digits = 0;
+
+    if (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] == '-'))
     {
-        hooks->deallocate(buffer->buffer);
+        buffer->offset++;
     }
 
-    if (printed != NULL)
+    if (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] == '0'))
     {
-        hooks->deallocate(printed);
+        buffer->offset++;
+    }
+    else
+    {
+        for (digits = 0; can_access_at_index(buffer, 0) && isdigit(buffer_at_offset(buffer)[0]); digits++)
+        {
+            buffer->offset++;
+        }
+        if (digits == 0)
+        {
+            return false;
+        }
+    }
+
+    if (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] == '.'))
+    {
+        buffer->offset++;
+        for (digits = 0; can_access_at_index(buffer, 0) && isdigit(buffer_at_offset(buffer)[0]); digits++)
+        {
+            buffer->offset++;
+        }
+        if (digits == 0)
+        {
+            return false;
+        }
+    }
+
+    if (can_access_at_index(buffer, 0) && ((buffer_at_offset(buffer)[0] == 'e') || (buffer_at_offset(buffer)[0] == 'E')))
+    {
+        buffer->offset++;
+        if (can_access_at_index(buffer, 0) && ((buffer_at_offset(buffer)[0] == '+') || (buffer_at_offset(buffer)[0] == '-')))
+        {
+            buffer->offset++;
+        }
+        for (digits = 0; can_access_at_index(buffer, 0) && isdigit(buffer_at_offset(buffer)[0]); digits++)
+        {
+            buffer->offset++;
+        }
+        if (digits == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static cJSON_bool validate_literal(parse_buffer * const buffer, const char * const literal, size_t length)
+{
+    if (can_read(buffer, length) && (strncmp((const char*)buffer_at_offset(buffer), literal, length) == 0))
+    {
+        buffer->offset += length;
+        return true;
+    }
+
+    return false;
+}
+
+static cJSON_bool validate(const char *value, size_t buffer_length, size_t max_depth, cJSON_Validation * const result)
+{
+    /* one bit per nesting level, set for objects and clear for arrays */
+    unsigned char containers[(CJSON_NESTING_LIMIT + 7) / 8];
+    parse_buffer buffer = { 0, 0, 0, 0, 0, { 0, 0, 0, 0 } };
+    validate_state state = validate_value;
+    size_t key_start = 0;
+
+    memset(result, 0, sizeof(*result));
+    if ((value == NULL) || (buffer_length == 0))
+    {
+        return false;
+    }
+    if ((max_depth == 0) || (max_depth > CJSON_NESTING_LIMIT))
+    {
+        max_depth = CJSON_NESTING_LIMIT;
+    }
+
+    buffer.content = (const unsigned char*)value;
+    buffer.length = buffer_length;
+    skip_utf8_bom(&buffer);
+
+    for (;;)
+    {
+        unsigned char current = 0;
+
+        if ((state == validate_after_value) && (buffer.depth == 0))
+        {
+            break; /* the top level value is complete */
+        }
+
+        validate_skip_whitespace(&buffer);
+        if (cannot_access_at_index(&buffer, 0))
+        {
+            goto fail; /* input ended unexpectedly */
+        }
+        current = buffer_at_offset(&buffer)[0];
+
+        if (state == validate_key)
+        {
+            key_start = buffer.offset + 1;
+            if (!validate_string(&buffer))
+            {
+                goto fail;
+            }
+            if (buffer.depth == 1)
+            {
+                /* remember the top level keys */
+                if (result->key_count < CJSON_VALIDATE_MAX_KEYS)
+                {
+                    result->keys[result->key_count].start = value + key_start;
+                    result->keys[result->key_count].length = buffer.offset - key_start - 1;
+                }
+                result->key_count++;
+            }
+            validate_skip_whitespace(&buffer);
+            if (cannot_access_at_index(&buffer, 0) || (buffer_at_offset(&buffer)[0] != ':'))
+            {
+                goto fail;
+            }
+            buffer.offset++;
+            state = validate_value;
+            continue;
+        }
+
+        if (state == validate_value)
+        {
+            if (buffer.depth == 0)
+            {
+                result->type = cJSON_Invalid;
+            }
+
+            if ((current == '{') || (current == '['))
+            {
+                if (buffer.depth >= max_depth)
+                {
+                    goto fail; /* too deeply nested */
+                }
+                if (current == '{')
+                {
+                    containers[buffer.depth / 8] = (unsigned char)(containers[buffer.depth / 8] | (1 << (buffer.depth % 8)));
+                }
+                else
+                {
+                    containers[buffer.depth / 8] = (unsigned char)(containers[buffer.depth / 8] & ~(1 << (buffer.depth % 8)));
+                }
+                if (buffer.depth == 0)
+                {
+                    result->type = (current == '{') ? cJSON_Object : cJSON_Array;
+                }
+                buffer.depth++;
+                if (buffer.depth > result->max_depth)
+                {
+                    result->max_depth = buffer.depth;
+                }
+                buffer.offset++;
+
+                /* empty containers close straight away */
+                validate_skip_whitespace(&buffer);
+                if (can_access_at_index(&buffer, 0) && (buffer_at_offset(&buffer)[0] == ((current == '{') ? '}' : ']')))
+                {
+                    buffer.depth--;
+                    buffer.offset++;
+                    state = validate_after_value;
+                }
+                else
+                {
+                    state = (current == '{') ? validate_key : validate_value;
+                }
+                continue;
+            }
+
+            if (current == '\"')
+            {
+                result->type = (buffer.depth == 0) ? cJSON_String : result->type;
+                if (!validate_string(&buffer))
+                {
+                    goto fail;
+                }
+            }
+            else if ((current == '-') || isdigit(current))
+            {
+                result->type = (buffer.depth == 0) ? cJSON_Number : result->type;
+                if (!validate_number(&buffer))
+                {
+                    goto fail;
+                }
+            }
+            else if (validate_literal(&buffer, "null", 4))
+            {
+                result->type = (buffer.depth == 0) ? cJSON_NULL : result->type;
+            }
+            else if (validate_literal(&buffer, "false", 5))
+            {
+                result->type = (buffer.depth == 0) ? cJSON_False : result->type;
+            }
+            else if (validate_literal(&buffer, "true", 4))
+            {
+                result->type = (buffer.depth == 0) ? cJSON_True : result->type;
+            }
+            else
+            {
+                goto fail;
+            }
+            state = validate_after_value;
+            continue;
+        }
+
+        /* validate_after_value: inside a container a separator or closing bracket has to follow */
+        {
+            const cJSON_bool in_object = (containers[(buffer.depth - 1) / 8] & (1 << ((buffer.depth - 1) % 8))) != 0;
+            if (current == ',')
+            {
+                buffer.offset++;
+                state = in_object ? validate_key : validate_value;
+            }
+            else if (current == (in_object ? '}' : ']'))
+            {
+                buffer.offset++;
+                buffer.depth--;
+            }
+            else
+            {
+                goto fail;
+            }
+        }
+    }
+
+    /* only whitespace or a null terminator may follow the value */
+    result->end = buffer.offset;
+    validate_skip_whitespace(&buffer);
+    if (can_access_at_index(&buffer, 0) && (buffer_at_offset(&buffer)[0] != '\0'))
+    {
+        goto fail;
+    }
+
+    return true;
+
+fail:
+    result->end = (buffer.offset < buffer.length) ? buffer.offset : buffer.length;
+    result->type = cJSON_Invalid;
+    return false;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_Validate(const char *value, size_t buffer_length, cJSON_Validation * const result)
+{
+    cJSON_Validation local_result;
+
+    return validate(value, buffer_length, CJSON_NESTING_LIMIT, (result != NULL) ? result : &local_result);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_ValidateCtx(cJSON_Context * const context, const char *value, size_t buffer_length, cJSON_Validation * const result)
+{
+    cJSON_Validation local_result;
+    cJSON_Validation *validation = (result != NULL) ? result : &local_result;
+
+    if (context == NULL)
+    {
+        return false;
+    }
+
+    context->error_json = NULL;
+    context->error_position = 0;
+
+    if ((context->max_length > 0) && (buffer_length > context->max_length))
+    {
+        memset(validation, 0, sizeof(*validation));
+        validation->end = context->max_length;
+    }
+    else if (validate(value, buffer_length, context->max_depth, validation))
+    {
+        return true;
+    }
+
+    context->error_json = value;
+    context->error_position = validation->end;
+    return false;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_ValidationHasKey(const cJSON_Validation * const result, const char * const key)
+{
+    size_t i = 0;
+    size_t key_length = 0;
+
+    if ((result == NULL) || (key == NULL))
+    {
+        return false;
+    }
+
+    key_length = strlen(key);
+    for (i = 0; (i < result->key_count) && (i < CJSON_VALIDATE_MAX_KEYS); i++)
+    {
+        if ((result->keys[i].length == key_length) && (strncmp(result->keys[i].start, key, key_length) == 0))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#define cjson_min(a, b) (((a) < (b)) ? (a) : (b))
+
+static unsigned char *print(const cJSON * const item, cJSON_bool format, const internal_hooks * const hooks)
+{
+    static const size_t default_buffer_size = 256;
+    printbuffer buffer[1];
+    unsigned char *printed = NULL;
+
+    memset(buffer, 0, sizeof(buffer));
+
+    /* create buffer */
+    buffer->buffer = (unsigned char*) hooks->allocate(hooks->userdata, default_buffer_size);
+    buffer->length = default_buffer_size;
+    buffer->format = format;
+    buffer->hooks = *hooks;
+    if (buffer->buffer == NULL)
+    {
+        goto fail;
+    }
+
+    /* print the value */
+    if (!print_value(item, buffer))
+    {
+        goto fail;
+    }
+    update_offset(buffer);
+
+    /* check if reallocate is available */
+    if (hooks->reallocate != NULL)
+    {
+        printed = (unsigned char*) hooks->reallocate(hooks->userdata, buffer->buffer, buffer->offset + 1);
+        if (printed == NULL) {
+            goto fail;
+        }
+        buffer->buffer = NULL;
+    }
+    else /* otherwise copy the JSON over to a new buffer */
+    {
+        printed = (unsigned char*) hooks->allocate(hooks->userdata, buffer->offset + 1);
+        if (printed == NULL)
+        {
+            goto fail;
+        }
+        memcpy(printed, buffer->buffer, cjson_min(buffer->length, buffer->offset + 1));
+        printed[buffer->offset] = '\0'; /* just to be sure */
+
+        /* free the buffer */
+        hooks->deallocate(hooks->userdata, buffer->buffer);
+    }
+
+    return printed;
+
+fail:
+    if (buffer->buffer != NULL)
+    {
+        hooks->deallocate(hooks->userdata, buffer->buffer);
+    }
+
+    if (printed != NULL)
+    {
+        hooks->deallocate(hooks->userdata, printed);
     }
 
     return NULL;
@@ -1261,14 +1958,14 @@ CJSON_PUBLIC(char *) cJSON_PrintUnformatted(const cJSON *item)
 
 CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0, 0 }, 0, 0 };
 
     if (prebuffer < 0)
     {
         return NULL;
     }
 
-    p.buffer = (unsigned char*)global_hooks.allocate((size_t)prebuffer);
+    p.buffer = (unsigned char*)global_hooks.allocate(global_hooks.userdata, (size_t)prebuffer);
     if (!p.buffer)
     {
         return NULL;
@@ -1282,7 +1979,7 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
 
     if (!print_value(item, &p))
     {
-        global_hooks.deallocate(p.buffer);
+        global_hooks.deallocate(global_hooks.userdata, p.buffer);
         return NULL;
     }
 
@@ -1291,7 +1988,7 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
 
 CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0, 0 }, 0, 0 };
 
     if ((length < 0) || (buffer == NULL))
     {
@@ -1308,6 +2005,40 @@ CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, cons
     return print_value(item, &p);
 }
 
+CJSON_PUBLIC(cJSON_bool) cJSON_PrintStreamed(const cJSON *item, char *chunk, size_t chunk_size, const cJSON_bool format, cJSON_WriteFn write_fn, void *userdata)
+{
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0, 0 }, 0, 0 };
+
+    /* one byte of the chunk is always taken by the null terminator */
+    if ((item == NULL) || (chunk == NULL) || (chunk_size < 2) || (chunk_size > INT_MAX) || (write_fn == NULL))
+    {
+        return false;
+    }
+
+    p.buffer = (unsigned char*)chunk;
+    p.length = chunk_size;
+    p.offset = 0;
+    p.noalloc = true;
+    p.format = format;
+    p.hooks = global_hooks;
+    p.flush = write_fn;
+    p.flush_userdata = userdata;
+
+    if (!print_value(item, &p))
+    {
+        return false;
+    }
+    update_offset(&p);
+
+    /* write out the last, partially filled chunk */
+    if (p.offset > 0)
+    {
+        return write_fn(userdata, chunk, p.offset);
+    }
+
+    return true;
+}
+
 /* Parser core - when encountering text, process appropriately. */
 static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buffer)
 {
@@ -1442,8 +2173,9 @@ static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buf
 {
     cJSON *head = NULL; /* head of the linked list */
     cJSON *current_item = NULL;
+    size_t count = 0;
 
-    if (input_buffer->depth >= CJSON_NESTING_LIMIT)
+    if (input_buffer->depth >= input_buffer->max_depth)
     {
         return false; /* to deeply nested */
     }
@@ -1495,6 +2227,7 @@ static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buf
             new_item->prev = current_item;
             current_item = new_item;
         }
+        count++;
 
         /* parse next value */
         input_buffer->offset++;
@@ -1521,6 +2254,15 @@ success:
 
     item->type = cJSON_Array;
     item->child = head;
+#ifdef CJSON_ARRAY_INDEX
+    /* large arrays are indexed here, where the hooks of the tree are known */
+    if (count >= CJSON_ARRAY_INDEX_MIN)
+    {
+        build_array_index(item, count, &(input_buffer->hooks));
+    }
+#else
+    (void)count;
+#endif
 
     input_buffer->offset++;
 
@@ -1529,25 +2271,84 @@ success:
 fail:
     if (head != NULL)
     {
-        cJSON_Delete(head);
+        delete_item(head, &input_buffer->hooks);
     }
 
     return false;
 }
 
 /* Render an array to text */
-static cJSON_bool print_array(const cJSON * const item, printbuffer * const output_buffer)
+/* Render a packed array to text, exactly like the equivalent array of number items. */
+static cJSON_bool print_packed_array(const cJSON * const item, printbuffer * const output_buffer)
 {
     unsigned char *output_pointer = NULL;
-    size_t length = 0;
-    cJSON *current_element = item->child;
+    size_t length = (size_t) (output_buffer->format ? 2 : 1);
+    size_t i = 0;
 
-    if (output_buffer == NULL)
+    output_pointer = ensure(output_buffer, 1);
+    if (output_pointer == NULL)
     {
         return false;
     }
+    *output_pointer = '[';
+    output_buffer->offset++;
 
-    /* Compose the output array. */
+    for (i = 0; i < (size_t)item->valueint; i++)
+    {
+        const double number = get_packed_number(item, i);
+        /* only whole numbers within range print as integers, so there is no need to saturate */
+        const int integer = ((number < INT_MAX) && (number > (double)INT_MIN)) ? (int)number : 0;
+
+        if (i > 0)
+        {
+            output_pointer = ensure(output_buffer, length + 1);
+            if (output_pointer == NULL)
+            {
+                return false;
+            }
+            *output_pointer++ = ',';
+            if (output_buffer->format)
+            {
+                *output_pointer++ = ' ';
+            }
+            *output_pointer = '\0';
+            output_buffer->offset += length;
+        }
+
+        if (!print_number_value(number, integer, output_buffer))
+        {
+            return false;
+        }
+    }
+
+    output_pointer = ensure(output_buffer, 2);
+    if (output_pointer == NULL)
+    {
+        return false;
+    }
+    *output_pointer++ = ']';
+    *output_pointer = '\0';
+
+    return true;
+}
+
+static cJSON_bool print_array(const cJSON * const item, printbuffer * const output_buffer)
+{
+    unsigned char *output_pointer = NULL;
+    size_t length = 0;
+    cJSON *current_element = item->child;
+
+    if (output_buffer == NULL)
+    {
+        return false;
+    }
+
+    if (item->type & cJSON_Packed)
+    {
+        return print_packed_array(item, output_buffer);
+    }
+
+    /* Compose the output array. */
     /* opening square bracket */
     output_pointer = ensure(output_buffer, 1);
     if (output_pointer == NULL)
@@ -1603,7 +2404,7 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
     cJSON *head = NULL; /* linked list head */
     cJSON *current_item = NULL;
 
-    if (input_buffer->depth >= CJSON_NESTING_LIMIT)
+    if (input_buffer->depth >= input_buffer->max_depth)
     {
         return false; /* to deeply nested */
     }
@@ -1704,7 +2505,7 @@ success:
 fail:
     if (head != NULL)
     {
-        cJSON_Delete(head);
+        delete_item(head, &input_buffer->hooks);
     }
 
     return false;
@@ -1835,6 +2636,18 @@ CJSON_PUBLIC(int) cJSON_GetArraySize(const cJSON *array)
         return 0;
     }
 
+    if (array->type & cJSON_Packed)
+    {
+        return array->valueint;
+    }
+
+#ifdef CJSON_ARRAY_INDEX
+    if (array->index != NULL)
+    {
+        return (int)array->index->count;
+    }
+#endif
+
     child = array->child;
 
     while(child != NULL)
@@ -1857,6 +2670,13 @@ static cJSON* get_array_item(const cJSON *array, size_t index)
         return NULL;
     }
 
+#ifdef CJSON_ARRAY_INDEX
+    if (array->index != NULL)
+    {
+        return (index < array->index->count) ? array->index->items[index] : NULL;
+    }
+#endif
+
     current_child = array->child;
     while ((current_child != NULL) && (index > 0))
     {
@@ -1948,6 +2768,9 @@ static cJSON *create_reference(const cJSON *item, const internal_hooks * const h
 
     memcpy(reference, item, sizeof(cJSON));
     reference->string = NULL;
+#ifdef CJSON_ARRAY_INDEX
+    reference->index = NULL;
+#endif
     reference->type |= cJSON_IsReference;
     reference->next = reference->prev = NULL;
     return reference;
@@ -1957,11 +2780,13 @@ static cJSON_bool add_item_to_array(cJSON *array, cJSON *item)
 {
     cJSON *child = NULL;
 
-    if ((item == NULL) || (array == NULL) || (array == item))
+    if ((item == NULL) || (array == NULL) || (array == item) || (array->type & cJSON_Packed))
     {
         return false;
     }
 
+    cJSON_InvalidateHash(array);
+    append_to_index(array, item);
     child = array->child;
     /*
      * To find the last item in array quickly, we use prev in array
@@ -2036,7 +2861,7 @@ static cJSON_bool add_item_to_object(cJSON * const object, const char * const st
 
     if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
     {
-        hooks->deallocate(item->string);
+        hooks->deallocate(hooks->userdata, item->string);
     }
 
     item->string = new_key;
@@ -2191,6 +3016,8 @@ CJSON_PUBLIC(cJSON *) cJSON_DetachItemViaPointer(cJSON *parent, cJSON * const it
         return NULL;
     }
 
+    cJSON_InvalidateHash(parent);
+    cJSON_InvalidateIndex(parent);
     if (item != parent->child)
     {
         /* not the first element */
@@ -2275,6 +3102,8 @@ CJSON_PUBLIC(cJSON_bool) cJSON_InsertItemInArray(cJSON *array, int which, cJSON
         return add_item_to_array(array, newitem);
     }
 
+    cJSON_InvalidateHash(array);
+    cJSON_InvalidateIndex(array);
     newitem->next = after_inserted;
     newitem->prev = after_inserted->prev;
     after_inserted->prev = newitem;
@@ -2301,6 +3130,8 @@ CJSON_PUBLIC(cJSON_bool) cJSON_ReplaceItemViaPointer(cJSON * const parent, cJSON
         return true;
     }
 
+    cJSON_InvalidateHash(parent);
+    cJSON_InvalidateIndex(parent);
     replacement->next = item->next;
     replacement->prev = item->prev;
 
@@ -2426,9 +3257,9 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateBool(cJSON_bool boolean)
     return item;
 }
 
-CJSON_PUBLIC(cJSON *) cJSON_CreateNumber(double num)
+static cJSON *create_number(double num, const internal_hooks * const hooks)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    cJSON *item = cJSON_New_Item(hooks);
     if(item)
     {
         item->type = cJSON_Number;
@@ -2452,16 +3283,21 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateNumber(double num)
     return item;
 }
 
-CJSON_PUBLIC(cJSON *) cJSON_CreateString(const char *string)
+CJSON_PUBLIC(cJSON *) cJSON_CreateNumber(double num)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
+    return create_number(num, &global_hooks);
+}
+
+static cJSON *create_string(const char *string, const internal_hooks * const hooks)
+{
+    cJSON *item = cJSON_New_Item(hooks);
     if(item)
     {
         item->type = cJSON_String;
-        item->valuestring = (char*)cJSON_strdup((const unsigned char*)string, &global_hooks);
+        item->valuestring = (char*)cJSON_strdup((const unsigned char*)string, hooks);
         if(!item->valuestring)
         {
-            cJSON_Delete(item);
+            delete_item(item, hooks);
             return NULL;
         }
     }
@@ -2469,6 +3305,11 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateString(const char *string)
     return item;
 }
 
+CJSON_PUBLIC(cJSON *) cJSON_CreateString(const char *string)
+{
+    return create_string(string, &global_hooks);
+}
+
 CJSON_PUBLIC(cJSON *) cJSON_CreateStringReference(const char *string)
 {
     cJSON *item = cJSON_New_Item(&global_hooks);
@@ -2519,26 +3360,25 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateRaw(const char *raw)
     return item;
 }
 
-CJSON_PUBLIC(cJSON *) cJSON_CreateArray(void)
+static cJSON *create_container(int type, const internal_hooks * const hooks)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
-    if(item)
+    cJSON *item = cJSON_New_Item(hooks);
+    if (item)
     {
-        item->type=cJSON_Array;
+        item->type = type;
     }
 
     return item;
 }
 
-CJSON_PUBLIC(cJSON *) cJSON_CreateObject(void)
+CJSON_PUBLIC(cJSON *) cJSON_CreateArray(void)
 {
-    cJSON *item = cJSON_New_Item(&global_hooks);
-    if (item)
-    {
-        item->type = cJSON_Object;
-    }
+    return create_container(cJSON_Array, &global_hooks);
+}
 
-    return item;
+CJSON_PUBLIC(cJSON *) cJSON_CreateObject(void)
+{
+    return create_container(cJSON_Object, &global_hooks);
 }
 
 /* Create Arrays: */
@@ -2662,6 +3502,186 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateDoubleArray(const double *numbers, int count)
     return a;
 }
 
+static cJSON *create_packed_array(const void *data, int count, int element_type, const cJSON_bool reference, const internal_hooks * const hooks)
+{
+    cJSON *a = NULL;
+    size_t size = 0;
+
+    if ((count < 0) || (element_type < cJSON_PackedInt16) || (element_type > cJSON_PackedDouble) || ((data == NULL) && (count > 0)))
+    {
+        return NULL;
+    }
+
+    a = cJSON_New_Item(hooks);
+    if (a == NULL)
+    {
+        return NULL;
+    }
+    a->type = cJSON_Array | cJSON_Packed | (element_type << packed_type_shift);
+    a->valueint = count;
+
+    if (reference)
+    {
+        a->type |= cJSON_IsReference;
+        a->valuestring = (char*)cast_away_const(data);
+        return a;
+    }
+
+    size = (size_t)count * packed_element_size[element_type];
+    if (size > 0)
+    {
+        a->valuestring = (char*)hooks->allocate(hooks->userdata, size);
+        if (a->valuestring == NULL)
+        {
+            delete_item(a, hooks);
+            return NULL;
+        }
+        memcpy(a->valuestring, data, size);
+    }
+
+    return a;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreatePackedArray(const void *data, int count, int element_type)
+{
+    return create_packed_array(data, count, element_type, false, &global_hooks);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreatePackedArrayReference(const void *data, int count, int element_type)
+{
+    return create_packed_array(data, count, element_type, true, &global_hooks);
+}
+
+static cJSON_bool pack_array(cJSON * const array, int element_type, const internal_hooks * const hooks)
+{
+    cJSON *child = NULL;
+    unsigned char *data = NULL;
+    size_t count = 0;
+    size_t i = 0;
+
+    if (!cJSON_IsArray(array) || (array->type & (cJSON_Packed | cJSON_IsReference)) || (element_type < cJSON_PackedInt16) || (element_type > cJSON_PackedDouble))
+    {
+        return false;
+    }
+
+    /* refuse anything that does not survive the conversion, so a packed array always prints as what was parsed */
+    cJSON_ArrayForEach(child, array)
+    {
+        const double number = child->valuedouble;
+        if (!cJSON_IsNumber(child))
+        {
+            return false;
+        }
+        switch (element_type)
+        {
+            case cJSON_PackedInt16:
+                if (isnan(number) || (number < SHRT_MIN) || (number > SHRT_MAX) || (number != (double)(short)number))
+                {
+                    return false;
+                }
+                break;
+
+            case cJSON_PackedInt32:
+                if (isnan(number) || (number < INT_MIN) || (number > INT_MAX) || (number != (double)(int)number))
+                {
+                    return false;
+                }
+                break;
+
+            case cJSON_PackedFloat:
+                if (!isnan(number) && (number != (double)(float)number))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                break;
+        }
+        count++;
+    }
+    if (count > INT_MAX)
+    {
+        return false;
+    }
+
+    if (count > 0)
+    {
+        data = (unsigned char*)hooks->allocate(hooks->userdata, count * packed_element_size[element_type]);
+        if (data == NULL)
+        {
+            return false;
+        }
+    }
+
+    cJSON_ArrayForEach(child, array)
+    {
+        unsigned char *element = data + (i++ * packed_element_size[element_type]);
+        switch (element_type)
+        {
+            case cJSON_PackedInt16:
+            {
+                short value = (short)child->valuedouble;
+                memcpy(element, &value, sizeof(value));
+                break;
+            }
+
+            case cJSON_PackedInt32:
+            {
+                int value = (int)child->valuedouble;
+                memcpy(element, &value, sizeof(value));
+                break;
+            }
+
+            case cJSON_PackedFloat:
+            {
+                float value = (float)child->valuedouble;
+                memcpy(element, &value, sizeof(value));
+                break;
+            }
+
+            default:
+                memcpy(element, &child->valuedouble, sizeof(double));
+                break;
+        }
+    }
+
+    /* the contents are unchanged, so the cached hash stays valid */
+    delete_item(array->child, hooks);
+    array->child = NULL;
+    cJSON_InvalidateIndex(array);
+    array->type |= cJSON_Packed | (element_type << packed_type_shift);
+    array->valuestring = (char*)data;
+    array->valueint = (int)count;
+
+    return true;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_PackArray(cJSON * const array, int element_type)
+{
+    return pack_array(array, element_type, &global_hooks);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_IsPackedArray(const cJSON * const item)
+{
+    if (item == NULL)
+    {
+        return false;
+    }
+
+    return (item->type & (0xFF | cJSON_Packed)) == (cJSON_Array | cJSON_Packed);
+}
+
+CJSON_PUBLIC(double) cJSON_GetPackedNumber(const cJSON * const array, int index)
+{
+    if (!cJSON_IsPackedArray(array) || (index < 0) || (index >= array->valueint))
+    {
+        return (double) NAN;
+    }
+
+    return get_packed_number(array, (size_t)index);
+}
+
 CJSON_PUBLIC(cJSON *) cJSON_CreateStringArray(const char *const *strings, int count)
 {
     size_t i = 0;
@@ -2725,7 +3745,20 @@ CJSON_PUBLIC(cJSON *) cJSON_Duplicate(const cJSON *item, cJSON_bool recurse)
     newitem->type = item->type & (~cJSON_IsReference);
     newitem->valueint = item->valueint;
     newitem->valuedouble = item->valuedouble;
-    if (item->valuestring)
+    if (item->type & cJSON_Packed)
+    {
+        const size_t size = (size_t)item->valueint * packed_element_size[packed_element_type(item)];
+        if (size > 0)
+        {
+            newitem->valuestring = (char*)global_hooks.allocate(global_hooks.userdata, size);
+            if (!newitem->valuestring)
+            {
+                goto fail;
+            }
+            memcpy(newitem->valuestring, item->valuestring, size);
+        }
+    }
+    else if (item->valuestring)
     {
         newitem->valuestring = (char*)cJSON_strdup((unsigned char*)item->valuestring, &global_hooks);
         if (!newitem->valuestring)
@@ -2774,6 +3807,13 @@ CJSON_PUBLIC(cJSON *) cJSON_Duplicate(const cJSON *item, cJSON_bool recurse)
     {
         newitem->child->prev = newchild;
     }
+#ifdef CJSON_ARRAY_INDEX
+    /* a copy of an indexed array is indexed too */
+    if (item->index != NULL)
+    {
+        index_array(newitem, &global_hooks);
+    }
+#endif
 
     return newitem;
 
@@ -3046,6 +4086,29 @@ CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * cons
             cJSON *a_element = a->child;
             cJSON *b_element = b->child;
 
+            if ((a->type | b->type) & cJSON_Packed)
+            {
+                /* packed arrays only hold numbers, so compare number by number (against ordinary arrays too) */
+                const int size = cJSON_GetArraySize(a);
+                int i = 0;
+                if (size != cJSON_GetArraySize(b))
+                {
+                    return false;
+                }
+                for (i = 0; i < size; i++)
+                {
+                    double a_number = 0;
+                    double b_number = 0;
+                    if (!get_array_number(a, &a_element, (size_t)i, &a_number) || !get_array_number(b, &b_element, (size_t)i, &b_number)
+                        || !compare_double(a_number, b_number))
+                    {
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
             for (; (a_element != NULL) && (b_element != NULL);)
             {
                 if (!cJSON_Compare(a_element, b_element, case_sensitive))
@@ -3108,12 +4171,549 @@ CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * cons
     }
 }
 
+#ifdef CJSON_HASH_CACHE
+/* Cached hashes are valid while their generation is the current one. Items don't know their parents, so instead of
+ * invalidating the path to the root a change moves the generation on, invalidating every cache at once. Hashing fills
+ * in children before their parent, so an item can only have a valid hash if all of its descendants do: a change only
+ * needs to move the generation on if the changed item's own hash is valid. 0 is never a valid generation.
+ * The generation is shared by every tree and thread; relaxed ordering is enough since each tree is only ever used by one
+ * thread at a time, the generation only has to be read and moved on without a data race. */
+static atomic_ulong current_hash_generation = 1;
+#endif
+
+#define hash_fnv_offset 2166136261UL
+#define hash_fnv_prime 16777619UL
+
+static unsigned long hash_bytes(unsigned long hash, const unsigned char *bytes, size_t length, const cJSON_bool fold_case)
+{
+    size_t i = 0;
+    for (i = 0; i < length; i++)
+    {
+        hash ^= fold_case ? (unsigned long)tolower(bytes[i]) : (unsigned long)bytes[i];
+        hash = (hash * hash_fnv_prime) & 0xFFFFFFFFUL;
+    }
+
+    return hash;
+}
+
+/* finalizer spreading every input bit over the whole hash, so member hashes can be combined by addition */
+static unsigned long hash_mix(unsigned long hash)
+{
+    hash &= 0xFFFFFFFFUL;
+    hash ^= hash >> 16;
+    hash = (hash * 0x85EBCA6BUL) & 0xFFFFFFFFUL;
+    hash ^= hash >> 13;
+    hash = (hash * 0xC2B2AE35UL) & 0xFFFFFFFFUL;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+/* hash of a number item, also used for the elements of packed arrays */
+static unsigned long hash_number(double number)
+{
+    const unsigned char type = cJSON_Number;
+    unsigned long hash = hash_bytes(hash_fnv_offset, &type, 1, false);
+
+    /* -0 and 0 compare equal */
+    if (number == 0)
+    {
+        number = 0.0;
+    }
+
+    return hash_bytes(hash, (const unsigned char*)&number, sizeof(number), false);
+}
+
+CJSON_PUBLIC(void) cJSON_InvalidateHash(const cJSON * const item)
+{
+#ifdef CJSON_HASH_CACHE
+    unsigned long generation = atomic_load_explicit(&current_hash_generation, memory_order_relaxed);
+    if ((item != NULL) && (item->hash_generation == generation))
+    {
+        /* if another thread got there first the generation has already moved past this one */
+        const unsigned long next = (generation + 1 == 0) ? 1 : generation + 1;
+        atomic_compare_exchange_strong_explicit(&current_hash_generation, &generation, next, memory_order_relaxed, memory_order_relaxed);
+    }
+#else
+    (void)item;
+#endif
+}
+
+CJSON_PUBLIC(unsigned long) cJSON_Hash(cJSON * const item)
+{
+    unsigned char type = 0;
+    unsigned long hash = 0;
+    cJSON *child = NULL;
+#ifdef CJSON_HASH_CACHE
+    const unsigned long generation = atomic_load_explicit(&current_hash_generation, memory_order_relaxed);
+#endif
+
+    if (item == NULL)
+    {
+        return 0;
+    }
+
+#ifdef CJSON_HASH_CACHE
+    if (item->hash_generation == generation)
+    {
+        return item->hash;
+    }
+#endif
+
+    type = (unsigned char)(item->type & 0xFF);
+    hash = hash_bytes(hash_fnv_offset, &type, 1, false);
+
+    switch (type)
+    {
+        case cJSON_Number:
+            hash = hash_number(item->valuedouble);
+            break;
+
+        case cJSON_String:
+        case cJSON_Raw:
+            if (item->valuestring != NULL)
+            {
+                hash = hash_bytes(hash, (const unsigned char*)item->valuestring, strlen(item->valuestring) + 1, false);
+            }
+            break;
+
+        case cJSON_Array:
+            if (item->type & cJSON_Packed)
+            {
+                /* the same as for the equivalent array of number items */
+                int i = 0;
+                for (i = 0; i < item->valueint; i++)
+                {
+                    hash = hash_mix(hash + hash_number(get_packed_number(item, (size_t)i)));
+                }
+                break;
+            }
+            cJSON_ArrayForEach(child, item)
+            {
+                hash = hash_mix(hash + cJSON_Hash(child));
+            }
+            break;
+
+        case cJSON_Object:
+        {
+            /* adding the members makes the result independent of their order, keys are folded to match both compare modes */
+            unsigned long members = 0;
+            cJSON_ArrayForEach(child, item)
+            {
+                unsigned long member = cJSON_Hash(child);
+                if (child->string != NULL)
+                {
+                    member = hash_bytes(member, (const unsigned char*)child->string, strlen(child->string) + 1, true);
+                }
+                members += hash_mix(member);
+            }
+            hash = hash_mix(hash ^ members);
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    hash &= 0xFFFFFFFFUL;
+#ifdef CJSON_HASH_CACHE
+    item->hash = hash;
+    item->hash_generation = generation;
+#endif
+
+    return hash;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_CompareHashed(cJSON * const a, cJSON * const b, const cJSON_bool case_sensitive)
+{
+    if ((a == NULL) || (b == NULL))
+    {
+        return false;
+    }
+
+    if ((a != b) && (cJSON_Hash(a) != cJSON_Hash(b)))
+    {
+        return false;
+    }
+
+    return cJSON_Compare(a, b, case_sensitive);
+}
+
+/* Parser contexts */
+CJSON_PUBLIC(void) cJSON_InitContext(cJSON_Context * const context, const cJSON_Allocator * const allocator)
+{
+    if (context == NULL)
+    {
+        return;
+    }
+
+    memset(context, 0, sizeof(*context));
+    if ((allocator != NULL) && (allocator->malloc_fn != NULL) && (allocator->free_fn != NULL))
+    {
+        context->allocator = *allocator;
+    }
+    else
+    {
+        /* plain malloc/free, independent of cJSON_InitHooks */
+        context->allocator.malloc_fn = internal_malloc;
+        context->allocator.free_fn = internal_free;
+        context->allocator.realloc_fn = internal_realloc;
+        context->allocator.userdata = NULL;
+    }
+    context->max_depth = CJSON_NESTING_LIMIT;
+    context->max_length = 0;
+}
+
+/* align arena allocations for the members of cJSON */
+#define arena_alignment sizeof(double)
+
+static void * CJSON_CDECL arena_allocate(void *userdata, size_t size)
+{
+    cJSON_Arena *arena = (cJSON_Arena*)userdata;
+    size_t misalignment = (size_t)(arena->buffer + arena->used) % arena_alignment;
+    size_t offset = arena->used + ((misalignment != 0) ? (arena_alignment - misalignment) : 0);
+
+    if ((offset > arena->size) || (size > (arena->size - offset)))
+    {
+        return NULL;
+    }
+
+    arena->last = offset;
+    arena->used = offset + size;
+    if (arena->used > arena->peak)
+    {
+        arena->peak = arena->used;
+    }
+
+    return arena->buffer + offset;
+}
+
+static void CJSON_CDECL arena_deallocate(void *userdata, void *pointer)
+{
+    cJSON_Arena *arena = (cJSON_Arena*)userdata;
+
+    /* only the most recent allocation can be given back, everything else waits for cJSON_ArenaReset */
+    if ((pointer != NULL) && ((unsigned char*)pointer == (arena->buffer + arena->last)))
+    {
+        arena->used = arena->last;
+    }
+}
+
+static void * CJSON_CDECL arena_reallocate(void *userdata, void *pointer, size_t size)
+{
+    cJSON_Arena *arena = (cJSON_Arena*)userdata;
+    unsigned char *old_block = (unsigned char*)pointer;
+    unsigned char *new_block = NULL;
+    size_t available = 0;
+
+    if (old_block == NULL)
+    {
+        return arena_allocate(userdata, size);
+    }
+
+    /* the most recent allocation can grow or shrink in place */
+    if (old_block == (arena->buffer + arena->last))
+    {
+        if (size > (arena->size - arena->last))
+        {
+            return NULL;
+        }
+        arena->used = arena->last + size;
+        if (arena->used > arena->peak)
+        {
+            arena->peak = arena->used;
+        }
+        return old_block;
+    }
+
+    /* the old size isn't known, but nothing past the end of the arena can belong to it */
+    available = arena->used - (size_t)(old_block - arena->buffer);
+    new_block = (unsigned char*)arena_allocate(userdata, size);
+    if (new_block != NULL)
+    {
+        memcpy(new_block, old_block, cjson_min(size, available));
+    }
+
+    return new_block;
+}
+
+CJSON_PUBLIC(void) cJSON_InitArena(cJSON_Arena * const arena, void *buffer, size_t size)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    arena->buffer = (unsigned char*)buffer;
+    arena->size = (buffer != NULL) ? size : 0;
+    arena->used = 0;
+    arena->last = 0;
+    arena->peak = 0;
+}
+
+CJSON_PUBLIC(void) cJSON_ArenaReset(cJSON_Arena * const arena)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    arena->used = 0;
+    arena->last = 0;
+}
+
+CJSON_PUBLIC(void) cJSON_InitContextWithArena(cJSON_Context * const context, cJSON_Arena * const arena)
+{
+    cJSON_Allocator allocator;
+
+    if (arena == NULL)
+    {
+        cJSON_InitContext(context, NULL);
+        return;
+    }
+
+    allocator.malloc_fn = arena_allocate;
+    allocator.free_fn = arena_deallocate;
+    allocator.realloc_fn = arena_reallocate;
+    allocator.userdata = arena;
+    cJSON_InitContext(context, &allocator);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithOptsCtx(cJSON_Context * const context, const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+{
+    internal_hooks hooks;
+    error parse_error = { NULL, 0 };
+    cJSON *item = NULL;
+
+    if (context == NULL)
+    {
+        return NULL;
+    }
+
+    /* reject oversized input before allocating anything */
+    if ((context->max_length > 0) && (buffer_length > context->max_length))
+    {
+        context->error_json = value;
+        context->error_position = context->max_length;
+        if (return_parse_end != NULL)
+        {
+            *return_parse_end = value + context->max_length;
+        }
+        return NULL;
+    }
+
+    hooks = context_hooks(context);
+    item = parse_with_hooks(value, buffer_length, return_parse_end, require_null_terminated, &hooks, (context->max_depth > 0) ? context->max_depth : CJSON_NESTING_LIMIT, &parse_error);
+
+    context->error_json = (const char*)parse_error.json;
+    context->error_position = parse_error.position;
+
+    return item;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseCtx(cJSON_Context * const context, const char *value, size_t buffer_length)
+{
+    return cJSON_ParseWithOptsCtx(context, value, buffer_length, NULL, false);
+}
+
+CJSON_PUBLIC(const char *) cJSON_GetErrorPtrCtx(const cJSON_Context * const context)
+{
+    if ((context == NULL) || (context->error_json == NULL))
+    {
+        return NULL;
+    }
+
+    return context->error_json + context->error_position;
+}
+
+CJSON_PUBLIC(char *) cJSON_PrintCtx(cJSON_Context * const context, const cJSON *item, cJSON_bool format)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return NULL;
+    }
+
+    hooks = context_hooks(context);
+    return (char*)print(item, format, &hooks);
+}
+
+CJSON_PUBLIC(void) cJSON_DeleteCtx(cJSON_Context * const context, cJSON *item)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return;
+    }
+
+    hooks = context_hooks(context);
+    delete_item(item, &hooks);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreateNumberCtx(cJSON_Context * const context, double num)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return NULL;
+    }
+
+    hooks = context_hooks(context);
+    return create_number(num, &hooks);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreateStringCtx(cJSON_Context * const context, const char *string)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return NULL;
+    }
+
+    hooks = context_hooks(context);
+    return create_string(string, &hooks);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreateArrayCtx(cJSON_Context * const context)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return NULL;
+    }
+
+    hooks = context_hooks(context);
+    return create_container(cJSON_Array, &hooks);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreatePackedArrayCtx(cJSON_Context * const context, const void *data, int count, int element_type)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return NULL;
+    }
+
+    hooks = context_hooks(context);
+    return create_packed_array(data, count, element_type, false, &hooks);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreatePackedArrayReferenceCtx(cJSON_Context * const context, const void *data, int count, int element_type)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return NULL;
+    }
+
+    hooks = context_hooks(context);
+    return create_packed_array(data, count, element_type, true, &hooks);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_PackArrayCtx(cJSON_Context * const context, cJSON * const array, int element_type)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return false;
+    }
+
+    hooks = context_hooks(context);
+    return pack_array(array, element_type, &hooks);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreateObjectCtx(cJSON_Context * const context)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return NULL;
+    }
+
+    hooks = context_hooks(context);
+    return create_container(cJSON_Object, &hooks);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToObjectCtx(cJSON_Context * const context, cJSON *object, const char *string, cJSON *item)
+{
+    internal_hooks hooks;
+
+    if (context == NULL)
+    {
+        return false;
+    }
+
+    hooks = context_hooks(context);
+    return add_item_to_object(object, string, item, &hooks, false);
+}
+
+/* add a new item to an object, deleting it again if that fails */
+static cJSON *add_new_item_to_object(cJSON_Context * const context, cJSON * const object, const char * const name, cJSON *item)
+{
+    if (cJSON_AddItemToObjectCtx(context, object, name, item))
+    {
+        return item;
+    }
+
+    cJSON_DeleteCtx(context, item);
+    return NULL;
+}
+
+CJSON_PUBLIC(cJSON*) cJSON_AddNumberToObjectCtx(cJSON_Context * const context, cJSON * const object, const char * const name, const double number)
+{
+    return add_new_item_to_object(context, object, name, cJSON_CreateNumberCtx(context, number));
+}
+
+CJSON_PUBLIC(cJSON*) cJSON_AddStringToObjectCtx(cJSON_Context * const context, cJSON * const object, const char * const name, const char * const string)
+{
+    return add_new_item_to_object(context, object, name, cJSON_CreateStringCtx(context, string));
+}
+
+CJSON_PUBLIC(cJSON*) cJSON_AddObjectToObjectCtx(cJSON_Context * const context, cJSON * const object, const char * const name)
+{
+    return add_new_item_to_object(context, object, name, cJSON_CreateObjectCtx(context));
+}
+
+CJSON_PUBLIC(cJSON*) cJSON_AddArrayToObjectCtx(cJSON_Context * const context, cJSON * const object, const char * const name)
+{
+    return add_new_item_to_object(context, object, name, cJSON_CreateArrayCtx(context));
+}
+
+CJSON_PUBLIC(void *) cJSON_mallocCtx(cJSON_Context * const context, size_t size)
+{
+    if (context == NULL)
+    {
+        return NULL;
+    }
+
+    return context->allocator.malloc_fn(context->allocator.userdata, size);
+}
+
+CJSON_PUBLIC(void) cJSON_freeCtx(cJSON_Context * const context, void *object)
+{
+    if ((context == NULL) || (object == NULL))
+    {
+        return;
+    }
+
+    context->allocator.free_fn(context->allocator.userdata, object);
+}
+
 CJSON_PUBLIC(void *) cJSON_malloc(size_t size)
 {
-    return global_hooks.allocate(size);
+    return global_hooks.allocate(global_hooks.userdata, size);
 }
 
 CJSON_PUBLIC(void) cJSON_free(void *object)
 {
-    global_hooks.deallocate(object);
+    global_hooks.deallocate(global_hooks.userdata, object);
 }
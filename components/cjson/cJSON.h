@@ -98,6 +98,14 @@ then using the CJSON_API_VISIBILITY flag to "export" the same symbols the way CJ
 
 #define cJSON_IsReference 256
 #define cJSON_StringIsConst 512
+/* Array whose numbers are stored contiguously rather than as child items, see cJSON_CreatePackedArray */
+#define cJSON_Packed 1024
+
+/* Element types of packed arrays */
+#define cJSON_PackedInt16 0  /* short */
+#define cJSON_PackedInt32 1  /* int */
+#define cJSON_PackedFloat 2
+#define cJSON_PackedDouble 3
 
 /* The cJSON structure: */
 typedef struct cJSON
@@ -120,6 +128,16 @@ typedef struct cJSON
 
     /* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
     char *string;
+
+#ifdef CJSON_HASH_CACHE
+    /* Structural hash cached by cJSON_Hash, valid while hash_generation is current. */
+    unsigned long hash;
+    unsigned long hash_generation;
+#endif
+#ifdef CJSON_ARRAY_INDEX
+    /* Children of a large array/object by position, built by the parser or cJSON_IndexArray with the hooks of the tree. */
+    struct cJSON_Index *index;
+#endif
 } cJSON;
 
 typedef struct cJSON_Hooks
@@ -131,6 +149,63 @@ typedef struct cJSON_Hooks
 
 typedef int cJSON_bool;
 
+/* Allocator for a parser context. userdata is passed back on every call, so allocators can keep per-context state (e.g. an arena). realloc_fn may be NULL. */
+typedef struct cJSON_Allocator
+{
+    void *(CJSON_CDECL *malloc_fn)(void *userdata, size_t sz);
+    void (CJSON_CDECL *free_fn)(void *userdata, void *ptr);
+    void *(CJSON_CDECL *realloc_fn)(void *userdata, void *ptr, size_t sz);
+    void *userdata;
+} cJSON_Allocator;
+
+/* State for parsing and printing without touching any global state: the allocator, limits and the position of the last parse error.
+ * Each thread should use its own context; contexts never share mutable data with each other or with the non-Ctx functions. */
+typedef struct cJSON_Context
+{
+    cJSON_Allocator allocator;
+    /* Maximum nesting depth of arrays/objects (0 means CJSON_NESTING_LIMIT) */
+    size_t max_depth;
+    /* Maximum length of the input in bytes (0 means unlimited) */
+    size_t max_length;
+    /* Input and offset of the last parse error, error_json is NULL when the last parse succeeded */
+    const char *error_json;
+    size_t error_position;
+} cJSON_Context;
+
+/* Number of top level keys recorded by cJSON_Validate */
+#ifndef CJSON_VALIDATE_MAX_KEYS
+#define CJSON_VALIDATE_MAX_KEYS 8
+#endif
+
+/* Result of cJSON_Validate */
+typedef struct cJSON_Validation
+{
+    /* Type of the top level value (cJSON_Invalid if validation failed) */
+    int type;
+    /* Number of keys in a top level object, only the first CJSON_VALIDATE_MAX_KEYS are recorded in keys */
+    size_t key_count;
+    /* Top level keys as they appear in the input: not null terminated and escape sequences are not decoded */
+    struct
+    {
+        const char *start;
+        size_t length;
+    } keys[CJSON_VALIDATE_MAX_KEYS];
+    /* Deepest nesting of arrays/objects */
+    size_t max_depth;
+    /* Offset just behind the value, or of the error if validation failed */
+    size_t end;
+} cJSON_Validation;
+
+/* Bump allocator over a caller supplied buffer. Memory is returned all at once with cJSON_ArenaReset. */
+typedef struct cJSON_Arena
+{
+    unsigned char *buffer;
+    size_t size;
+    size_t used;
+    size_t last; /* offset of the most recent allocation, which can be resized or freed in place */
+    size_t peak; /* highest value of used since the arena was initialised */
+} cJSON_Arena;
+
 /* Limits how deeply nested arrays/objects can be before cJSON rejects to parse them.
  * This is to prevent stack overflows. */
 #ifndef CJSON_NESTING_LIMIT
@@ -161,13 +236,27 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
 /* Render a cJSON entity to text using a buffer already allocated in memory with given length. Returns 1 on success and 0 on failure. */
 /* NOTE: cJSON is not always 100% accurate in estimating how much memory it will use, so to be safe allocate 5 bytes more than you actually need */
 CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format);
+/* Callback for cJSON_PrintStreamed. data points into the caller's chunk buffer and may be modified in place (e.g. encrypted),
+ * it is overwritten after the callback returns. Return 0 to abort the print. */
+typedef cJSON_bool (CJSON_CDECL *cJSON_WriteFn)(void *userdata, char *data, size_t length);
+/* Render a cJSON entity to text in pieces of at most chunk_size - 1 bytes, handing each piece to write_fn as the chunk fills up.
+ * Memory use is constant in the size of the document. The text is not null terminated. Returns 1 on success and 0 if write_fn
+ * failed or a single token (a number, or a string or key with its escapes) does not fit in the chunk. */
+CJSON_PUBLIC(cJSON_bool) cJSON_PrintStreamed(const cJSON *item, char *chunk, size_t chunk_size, const cJSON_bool format, cJSON_WriteFn write_fn, void *userdata);
 /* Delete a cJSON entity and all subentities. */
 CJSON_PUBLIC(void) cJSON_Delete(cJSON *item);
 
 /* Returns the number of items in an array (or object). */
 CJSON_PUBLIC(int) cJSON_GetArraySize(const cJSON *array);
 /* Retrieve item number "index" from array "array". Returns NULL if unsuccessful. */
+/* With CJSON_ARRAY_INDEX both are O(1) on an indexed array. The parser indexes arrays of at least CJSON_ARRAY_INDEX_MIN
+ * items, cJSON_IndexArray any array or object. Neither getter allocates or modifies the array. */
 CJSON_PUBLIC(cJSON *) cJSON_GetArrayItem(const cJSON *array, int index);
+/* Index the children of array, with the global hooks or those of the context the tree was built with, so that appends
+ * keep it and cJSON_ArenaReset frees it. Returns false without CJSON_ARRAY_INDEX or if the index can't be allocated. */
+CJSON_PUBLIC(cJSON_bool) cJSON_IndexArray(cJSON * const array);
+/* Drop the index of an array whose children were changed other than through the cJSON functions. */
+CJSON_PUBLIC(void) cJSON_InvalidateIndex(cJSON * const array);
 /* Get item "string" from object. Case insensitive. */
 CJSON_PUBLIC(cJSON *) cJSON_GetObjectItem(const cJSON * const object, const char * const string);
 CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemCaseSensitive(const cJSON * const object, const char * const string);
@@ -218,6 +307,21 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateFloatArray(const float *numbers, int count);
 CJSON_PUBLIC(cJSON *) cJSON_CreateDoubleArray(const double *numbers, int count);
 CJSON_PUBLIC(cJSON *) cJSON_CreateStringArray(const char *const *strings, int count);
 
+/* Packed arrays hold count numbers of one element type in a single buffer instead of one item per element. They print,
+ * compare and hash exactly like the equivalent array of numbers, cJSON_GetArraySize works on them, but they have no child
+ * items: use cJSON_GetPackedNumber for O(1) access, items cannot be added or detached. */
+/* Create a packed array with a copy of data. */
+CJSON_PUBLIC(cJSON *) cJSON_CreatePackedArray(const void *data, int count, int element_type);
+/* Create a packed array that references data without copying it, data must outlive the item. After changing data
+ * call cJSON_InvalidateHash on the item. */
+CJSON_PUBLIC(cJSON *) cJSON_CreatePackedArrayReference(const void *data, int count, int element_type);
+/* Turn an array of numbers (e.g. a parsed one) into a packed array in place. Fails, leaving the array unchanged, if an
+ * element is not a number or cannot be represented exactly as element_type. */
+CJSON_PUBLIC(cJSON_bool) cJSON_PackArray(cJSON * const array, int element_type);
+CJSON_PUBLIC(cJSON_bool) cJSON_IsPackedArray(const cJSON * const item);
+/* Returns element index of a packed array, or NaN if it is out of range or array is not a packed array. */
+CJSON_PUBLIC(double) cJSON_GetPackedNumber(const cJSON * const array, int index);
+
 /* Append item to the specified array/object. */
 CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToArray(cJSON *array, cJSON *item);
 CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item);
@@ -253,6 +357,15 @@ CJSON_PUBLIC(cJSON *) cJSON_Duplicate(const cJSON *item, cJSON_bool recurse);
 /* Recursively compare two cJSON items for equality. If either a or b is NULL or invalid, they will be considered unequal.
  * case_sensitive determines if object keys are treated case sensitive (1) or case insensitive (0) */
 CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * const b, const cJSON_bool case_sensitive);
+/* Structural hash of an item (32 bits): equal items hash equally in either case sensitivity, and the order of object members
+ * does not matter. Numbers are hashed exactly, so numbers cJSON_Compare treats as equal within rounding can hash differently.
+ * With CJSON_HASH_CACHE defined (which needs <stdatomic.h>) every item caches its hash, so rehashing an unchanged tree is O(1).
+ * The cache is invalidated by every cJSON function that changes a tree; after writing to an item's members directly call
+ * cJSON_InvalidateHash on it. */
+CJSON_PUBLIC(unsigned long) cJSON_Hash(cJSON * const item);
+CJSON_PUBLIC(void) cJSON_InvalidateHash(const cJSON * const item);
+/* cJSON_Compare that first rejects items whose hashes differ */
+CJSON_PUBLIC(cJSON_bool) cJSON_CompareHashed(cJSON * const a, cJSON * const b, const cJSON_bool case_sensitive);
 
 /* Minify a strings, remove blank characters(such as ' ', '\t', '\r', '\n') from strings.
  * The input pointer json cannot point to a read-only address area, such as a string constant, 
@@ -272,7 +385,7 @@ CJSON_PUBLIC(cJSON*) cJSON_AddObjectToObject(cJSON * const object, const char *
 CJSON_PUBLIC(cJSON*) cJSON_AddArrayToObject(cJSON * const object, const char * const name);
 
 /* When assigning an integer value, it needs to be propagated to valuedouble too. */
-#define cJSON_SetIntValue(object, number) ((object) ? (object)->valueint = (object)->valuedouble = (number) : (number))
+#define cJSON_SetIntValue(object, number) ((object) ? (cJSON_InvalidateHash(object), (object)->valueint = (object)->valuedouble = (number)) : (number))
 /* helper for the cJSON_SetNumberValue macro */
 CJSON_PUBLIC(double) cJSON_SetNumberHelper(cJSON *object, double number);
 #define cJSON_SetNumberValue(object, number) ((object != NULL) ? cJSON_SetNumberHelper(object, (double)number) : (number))
@@ -282,7 +395,7 @@ CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
 /* If the object is not a boolean type this does nothing and returns cJSON_Invalid else it returns the new type*/
 #define cJSON_SetBoolValue(object, boolValue) ( \
     (object != NULL && ((object)->type & (cJSON_False|cJSON_True))) ? \
-    (object)->type=((object)->type &(~(cJSON_False|cJSON_True)))|((boolValue)?cJSON_True:cJSON_False) : \
+    (cJSON_InvalidateHash(object), (object)->type=((object)->type &(~(cJSON_False|cJSON_True)))|((boolValue)?cJSON_True:cJSON_False)) : \
     cJSON_Invalid\
 )
 
@@ -293,6 +406,42 @@ CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
 CJSON_PUBLIC(void *) cJSON_malloc(size_t size);
 CJSON_PUBLIC(void) cJSON_free(void *object);
 
+/* Context API: the same operations as above, but allocating with the context's allocator and recording errors in the context.
+ * Items parsed or created with a context must be deleted (and printed strings freed) with the same context. */
+/* Initialise a context with an allocator (NULL for malloc/free) and the default limits. */
+CJSON_PUBLIC(void) cJSON_InitContext(cJSON_Context * const context, const cJSON_Allocator * const allocator);
+/* Initialise an arena over buffer, and a context that allocates from it. */
+CJSON_PUBLIC(void) cJSON_InitArena(cJSON_Arena * const arena, void *buffer, size_t size);
+CJSON_PUBLIC(void) cJSON_InitContextWithArena(cJSON_Context * const context, cJSON_Arena * const arena);
+/* Release everything allocated from an arena. Any items still referring to it become invalid. */
+CJSON_PUBLIC(void) cJSON_ArenaReset(cJSON_Arena * const arena);
+CJSON_PUBLIC(cJSON *) cJSON_ParseCtx(cJSON_Context * const context, const char *value, size_t buffer_length);
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithOptsCtx(cJSON_Context * const context, const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated);
+CJSON_PUBLIC(const char *) cJSON_GetErrorPtrCtx(const cJSON_Context * const context);
+/* Check that value is well formed JSON (RFC 8259, optionally preceded by a UTF-8 BOM and followed only by whitespace or a null terminator) in a single pass,
+ * without building a tree or allocating. The Ctx variant also applies the context's limits and records the error position in it. result may be NULL. */
+CJSON_PUBLIC(cJSON_bool) cJSON_Validate(const char *value, size_t buffer_length, cJSON_Validation * const result);
+CJSON_PUBLIC(cJSON_bool) cJSON_ValidateCtx(cJSON_Context * const context, const char *value, size_t buffer_length, cJSON_Validation * const result);
+/* Check whether a validated top level object has the given key (case sensitive, compared against the undecoded key) */
+CJSON_PUBLIC(cJSON_bool) cJSON_ValidationHasKey(const cJSON_Validation * const result, const char * const key);
+CJSON_PUBLIC(char *) cJSON_PrintCtx(cJSON_Context * const context, const cJSON *item, cJSON_bool format);
+CJSON_PUBLIC(void) cJSON_DeleteCtx(cJSON_Context * const context, cJSON *item);
+CJSON_PUBLIC(cJSON *) cJSON_CreateNumberCtx(cJSON_Context * const context, double num);
+CJSON_PUBLIC(cJSON *) cJSON_CreateStringCtx(cJSON_Context * const context, const char *string);
+CJSON_PUBLIC(cJSON *) cJSON_CreateArrayCtx(cJSON_Context * const context);
+CJSON_PUBLIC(cJSON *) cJSON_CreateObjectCtx(cJSON_Context * const context);
+CJSON_PUBLIC(cJSON *) cJSON_CreatePackedArrayCtx(cJSON_Context * const context, const void *data, int count, int element_type);
+CJSON_PUBLIC(cJSON *) cJSON_CreatePackedArrayReferenceCtx(cJSON_Context * const context, const void *data, int count, int element_type);
+CJSON_PUBLIC(cJSON_bool) cJSON_PackArrayCtx(cJSON_Context * const context, cJSON * const array, int element_type);
+CJSON_PUBLIC(cJSON_bool) cJSON_IndexArrayCtx(cJSON_Context * const context, cJSON * const array);
+CJSON_PUBLIC(cJSON_bool) cJSON_AddItemToObjectCtx(cJSON_Context * const context, cJSON *object, const char *string, cJSON *item);
+CJSON_PUBLIC(cJSON*) cJSON_AddNumberToObjectCtx(cJSON_Context * const context, cJSON * const object, const char * const name, const double number);
+CJSON_PUBLIC(cJSON*) cJSON_AddStringToObjectCtx(cJSON_Context * const context, cJSON * const object, const char * const name, const char * const string);
+CJSON_PUBLIC(cJSON*) cJSON_AddObjectToObjectCtx(cJSON_Context * const context, cJSON * const object, const char * const name);
+CJSON_PUBLIC(cJSON*) cJSON_AddArrayToObjectCtx(cJSON_Context * const context, cJSON * const object, const char * const name);
+CJSON_PUBLIC(void *) cJSON_mallocCtx(cJSON_Context * const context, size_t size);
+CJSON_PUBLIC(void) cJSON_freeCtx(cJSON_Context * const context, void *object);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,995 @@
+/*
+  Copyright (c) 2009-2017 Dave Gamble and cJSON contributors
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "cJSON_Utils.h"
+
+/* define our own boolean type */
+#ifdef true
+#undef true
+#endif
+#define true ((cJSON_bool)1)
+
+#ifdef false
+#undef false
+#endif
+#define false ((cJSON_bool)0)
+
+/* find the end of the reference token starting at token */
+static const char *token_end(const char *token, const char * const end)
+{
+    while ((token < end) && (*token != '/'))
+    {
+        token++;
+    }
+
+    return token;
+}
+
+/* compare an (unescaped) object key against an encoded reference token */
+static cJSON_bool compare_token(const char *name, const char *token, const char * const end)
+{
+    if (name == NULL)
+    {
+        return false;
+    }
+
+    for (; token < end; name++, token++)
+    {
+        if (*token == '~')
+        {
+            /* ~0 is ~ and ~1 is /, anything else is invalid */
+            if ((token + 1 >= end) || ((token[1] != '0') && (token[1] != '1')) || (*name != ((token[1] == '0') ? '~' : '/')))
+            {
+                return false;
+            }
+            token++;
+        }
+        else if (*name != *token)
+        {
+            return false;
+        }
+    }
+
+    return *name == '\0';
+}
+
+/* decode an array index token, which has no sign and no leading zeros */
+static cJSON_bool decode_array_index(const char *token, const char * const end, size_t * const index)
+{
+    size_t parsed = 0;
+
+    if ((token >= end) || ((token[0] == '0') && (end - token > 1)))
+    {
+        return false;
+    }
+
+    for (; token < end; token++)
+    {
+        if ((*token < '0') || (*token > '9'))
+        {
+            return false;
+        }
+        parsed = (parsed * 10) + (size_t)(*token - '0');
+    }
+
+    *index = parsed;
+    return true;
+}
+
+/* resolve the pointer between pointer and end, "" refers to object itself */
+static cJSON *get_item_from_pointer(cJSON * const object, const char *pointer, const char * const end)
+{
+    cJSON *current = object;
+
+    while ((current != NULL) && (pointer < end))
+    {
+        const char *token = NULL;
+        const char *after = NULL;
+
+        if (*pointer != '/')
+        {
+            return NULL;
+        }
+        token = pointer + 1;
+        after = token_end(token, end);
+
+        if (cJSON_IsArray(current))
+        {
+            size_t index = 0;
+            if (!decode_array_index(token, after, &index) || (index > INT_MAX))
+            {
+                return NULL;
+            }
+            current = cJSON_GetArrayItem(current, (int)index);
+        }
+        else if (cJSON_IsObject(current))
+        {
+            for (current = current->child; (current != NULL) && !compare_token(current->string, token, after); )
+            {
+                current = current->next;
+            }
+        }
+        else
+        {
+            return NULL;
+        }
+
+        pointer = after;
+    }
+
+    return current;
+}
+
+CJSON_PUBLIC(cJSON *) cJSONUtils_GetPointer(cJSON * const object, const char *pointer)
+{
+    if ((object == NULL) || (pointer == NULL))
+    {
+        return NULL;
+    }
+
+    return get_item_from_pointer(object, pointer, pointer + strlen(pointer));
+}
+
+/* Compiled paths: every reference token is decoded once, and array indices are parsed once. */
+#define path_not_index ((size_t)-1)
+#define path_end_of_array ((size_t)-2)
+
+typedef struct
+{
+    const char *key; /* decoded, null terminated */
+    size_t index;    /* the token as an array index, path_end_of_array for "-" or path_not_index */
+} path_segment;
+
+struct cJSONUtils_Path
+{
+    size_t count;
+    path_segment segments[1];
+};
+
+CJSON_PUBLIC(cJSONUtils_Path *) cJSONUtils_CompilePath(const char *pointer)
+{
+    cJSONUtils_Path *path = NULL;
+    const char *character = NULL;
+    const char *end = NULL;
+    char *keys = NULL;
+    size_t count = 0;
+    size_t i = 0;
+
+    if ((pointer == NULL) || ((*pointer != '\0') && (*pointer != '/')))
+    {
+        return NULL;
+    }
+
+    end = pointer + strlen(pointer);
+    for (character = pointer; character < end; character++)
+    {
+        if (*character == '/')
+        {
+            count++;
+        }
+        else if ((*character == '~') && (character[1] != '0') && (character[1] != '1'))
+        {
+            /* ~0 and ~1 are the only escapes */
+            return NULL;
+        }
+    }
+
+    /* segments followed by the decoded keys, which are never longer than the pointer */
+    path = (cJSONUtils_Path*)cJSON_malloc(sizeof(cJSONUtils_Path) + (count * sizeof(path_segment)) + (size_t)(end - pointer) + 1);
+    if (path == NULL)
+    {
+        return NULL;
+    }
+    path->count = count;
+    keys = (char*)&path->segments[count];
+
+    for (character = pointer; i < count; i++)
+    {
+        const char *token = character + 1;
+        const char *after = token_end(token, end);
+        path_segment *segment = &path->segments[i];
+
+        segment->key = keys;
+        for (; token < after; token++)
+        {
+            if (*token == '~')
+            {
+                token++;
+                *keys++ = (*token == '0') ? '~' : '/';
+            }
+            else
+            {
+                *keys++ = *token;
+            }
+        }
+        *keys++ = '\0';
+
+        if ((after - character == 2) && (character[1] == '-'))
+        {
+            segment->index = path_end_of_array;
+        }
+        else if (!decode_array_index(character + 1, after, &segment->index) || (segment->index > INT_MAX))
+        {
+            segment->index = path_not_index;
+        }
+        character = after;
+    }
+
+    return path;
+}
+
+CJSON_PUBLIC(void) cJSONUtils_FreePath(cJSONUtils_Path *path)
+{
+    cJSON_free(path);
+}
+
+/* get the child a segment refers to */
+static cJSON *get_path_segment(cJSON * const parent, const path_segment * const segment)
+{
+    cJSON *child = NULL;
+
+    if (cJSON_IsArray(parent))
+    {
+        return (segment->index <= INT_MAX) ? cJSON_GetArrayItem(parent, (int)segment->index) : NULL;
+    }
+
+    if (cJSON_IsObject(parent))
+    {
+        /* the first character rules out most keys without a call */
+        for (child = parent->child; child != NULL; child = child->next)
+        {
+            if ((child->string != NULL) && (child->string[0] == segment->key[0]) && (strcmp(child->string, segment->key) == 0))
+            {
+                return child;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* resolve the first count segments of path */
+static cJSON *get_path_prefix(cJSON * const object, const cJSONUtils_Path * const path, size_t count)
+{
+    cJSON *current = object;
+    size_t i = 0;
+
+    for (i = 0; (current != NULL) && (i < count); i++)
+    {
+        current = get_path_segment(current, &path->segments[i]);
+    }
+
+    return current;
+}
+
+CJSON_PUBLIC(cJSON *) cJSONUtils_GetPath(cJSON * const object, const cJSONUtils_Path * const path)
+{
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    return get_path_prefix(object, path, path->count);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSONUtils_SetPath(cJSON * const object, const cJSONUtils_Path * const path, cJSON * const value)
+{
+    cJSON *parent = NULL;
+    const path_segment *last = NULL;
+
+    if ((path == NULL) || (path->count == 0) || (value == NULL))
+    {
+        return false;
+    }
+
+    parent = get_path_prefix(object, path, path->count - 1);
+    last = &path->segments[path->count - 1];
+
+    if (cJSON_IsArray(parent))
+    {
+        const size_t size = (size_t)cJSON_GetArraySize(parent);
+        if ((last->index == path_end_of_array) || (last->index == size))
+        {
+            return cJSON_AddItemToArray(parent, value);
+        }
+        if (last->index < size)
+        {
+            return cJSON_ReplaceItemInArray(parent, (int)last->index, value);
+        }
+        return false;
+    }
+
+    if (cJSON_IsObject(parent))
+    {
+        if (get_path_segment(parent, last) != NULL)
+        {
+            return cJSON_ReplaceItemInObjectCaseSensitive(parent, last->key, value);
+        }
+        return cJSON_AddItemToObject(parent, last->key, value);
+    }
+
+    return false;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSONUtils_RemovePath(cJSON * const object, const cJSONUtils_Path * const path)
+{
+    cJSON *parent = NULL;
+    cJSON *item = NULL;
+
+    if ((path == NULL) || (path->count == 0))
+    {
+        return false;
+    }
+
+    parent = get_path_prefix(object, path, path->count - 1);
+    item = get_path_segment(parent, &path->segments[path->count - 1]);
+    if (item == NULL)
+    {
+        return false;
+    }
+
+    cJSON_Delete(cJSON_DetachItemViaPointer(parent, item));
+    return true;
+}
+
+/* decode a reference token into a newly allocated key */
+static char *decode_token(const char *token, const char * const end)
+{
+    char *key = (char*)cJSON_malloc((size_t)(end - token) + 1);
+    char *decoded = key;
+
+    if (key == NULL)
+    {
+        return NULL;
+    }
+
+    for (; token < end; token++)
+    {
+        if ((*token == '~') && (token + 1 < end) && ((token[1] == '0') || (token[1] == '1')))
+        {
+            *decoded++ = (token[1] == '0') ? '~' : '/';
+            token++;
+        }
+        else
+        {
+            *decoded++ = *token;
+        }
+    }
+    *decoded = '\0';
+
+    return key;
+}
+
+/* return a new pointer with an object key appended, escaping ~ and / */
+static char *append_key(const char * const path, const char *key)
+{
+    size_t path_length = strlen(path);
+    size_t length = path_length + 2;
+    const char *character = NULL;
+    char *pointer = NULL;
+    char *output = NULL;
+
+    for (character = key; *character != '\0'; character++)
+    {
+        length += ((*character == '~') || (*character == '/')) ? 2 : 1;
+    }
+
+    pointer = (char*)cJSON_malloc(length);
+    if (pointer == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(pointer, path, path_length);
+    output = pointer + path_length;
+    *output++ = '/';
+    for (character = key; *character != '\0'; character++)
+    {
+        if ((*character == '~') || (*character == '/'))
+        {
+            *output++ = '~';
+            *output++ = (*character == '~') ? '0' : '1';
+        }
+        else
+        {
+            *output++ = *character;
+        }
+    }
+    *output = '\0';
+
+    return pointer;
+}
+
+/* return a new pointer with an array index appended */
+static char *append_index(const char * const path, size_t index)
+{
+    char number[24];
+    sprintf(number, "%lu", (unsigned long)index);
+    return append_key(path, number);
+}
+
+CJSON_PUBLIC(void) cJSONUtils_AddPatchToArray(cJSON * const array, const char * const operation, const char * const path, const cJSON * const value)
+{
+    cJSON *patch = NULL;
+
+    if ((array == NULL) || (operation == NULL) || (path == NULL))
+    {
+        return;
+    }
+
+    patch = cJSON_CreateObject();
+    if (patch == NULL)
+    {
+        return;
+    }
+    cJSON_AddItemToObject(patch, "op", cJSON_CreateString(operation));
+    cJSON_AddItemToObject(patch, "path", cJSON_CreateString(path));
+    if (value != NULL)
+    {
+        cJSON_AddItemToObject(patch, "value", cJSON_Duplicate(value, true));
+    }
+    cJSON_AddItemToArray(array, patch);
+}
+
+static cJSON_bool create_patches(cJSON * const patches, const char * const path, cJSON * const from, cJSON * const to)
+{
+    cJSON_bool status = true;
+
+    /* equal subtrees produce no operations, and differing hashes make this O(1) with CJSON_HASH_CACHE */
+    if (cJSON_CompareHashed(from, to, true))
+    {
+        return true;
+    }
+
+    /* packed arrays have no element items to address, so they are replaced as a whole */
+    if (((from->type & 0xFF) != (to->type & 0xFF)) || cJSON_IsPackedArray(from) || cJSON_IsPackedArray(to))
+    {
+        cJSONUtils_AddPatchToArray(patches, "replace", path, to);
+        return true;
+    }
+
+    switch (from->type & 0xFF)
+    {
+        case cJSON_Array:
+        {
+            size_t index = 0;
+            cJSON *from_child = from->child;
+            cJSON *to_child = to->child;
+            char *child_path = NULL;
+
+            for (; status && (from_child != NULL) && (to_child != NULL); index++)
+            {
+                child_path = append_index(path, index);
+                status = (child_path != NULL) && create_patches(patches, child_path, from_child, to_child);
+                cJSON_free(child_path);
+
+                from_child = from_child->next;
+                to_child = to_child->next;
+            }
+
+            /* remove surplus elements one after the other at the same index, the next one moves up each time */
+            if (status && (from_child != NULL))
+            {
+                child_path = append_index(path, index);
+                status = (child_path != NULL);
+                for (; status && (from_child != NULL); from_child = from_child->next)
+                {
+                    cJSONUtils_AddPatchToArray(patches, "remove", child_path, NULL);
+                }
+                cJSON_free(child_path);
+            }
+
+            if (status && (to_child != NULL))
+            {
+                child_path = append_key(path, "-");
+                status = (child_path != NULL);
+                for (; status && (to_child != NULL); to_child = to_child->next)
+                {
+                    cJSONUtils_AddPatchToArray(patches, "add", child_path, to_child);
+                }
+                cJSON_free(child_path);
+            }
+
+            return status;
+        }
+
+        case cJSON_Object:
+        {
+            cJSON *from_child = NULL;
+            cJSON *to_child = NULL;
+            char *child_path = NULL;
+
+            cJSON_ArrayForEach(from_child, from)
+            {
+                if (!status)
+                {
+                    break;
+                }
+                child_path = append_key(path, from_child->string);
+                status = (child_path != NULL);
+                if (status)
+                {
+                    to_child = cJSON_GetObjectItemCaseSensitive(to, from_child->string);
+                    if (to_child == NULL)
+                    {
+                        cJSONUtils_AddPatchToArray(patches, "remove", child_path, NULL);
+                    }
+                    else
+                    {
+                        status = create_patches(patches, child_path, from_child, to_child);
+                    }
+                }
+                cJSON_free(child_path);
+            }
+
+            cJSON_ArrayForEach(to_child, to)
+            {
+                if (!status)
+                {
+                    break;
+                }
+                if (cJSON_GetObjectItemCaseSensitive(from, to_child->string) != NULL)
+                {
+                    continue;
+                }
+                child_path = append_key(path, to_child->string);
+                status = (child_path != NULL);
+                if (status)
+                {
+                    cJSONUtils_AddPatchToArray(patches, "add", child_path, to_child);
+                }
+                cJSON_free(child_path);
+            }
+
+            return status;
+        }
+
+        default:
+            /* scalars of the same type that differ */
+            cJSONUtils_AddPatchToArray(patches, "replace", path, to);
+            return true;
+    }
+}
+
+CJSON_PUBLIC(cJSON *) cJSONUtils_GeneratePatches(cJSON * const from, cJSON * const to)
+{
+    cJSON *patches = NULL;
+
+    if ((from == NULL) || (to == NULL))
+    {
+        return NULL;
+    }
+
+    patches = cJSON_CreateArray();
+    if (patches == NULL)
+    {
+        return NULL;
+    }
+
+    if (!create_patches(patches, "", from, to))
+    {
+        cJSON_Delete(patches);
+        return NULL;
+    }
+
+    return patches;
+}
+
+/* replace the contents of root with those of replacement, keeping root's key, and free the replacement */
+static void overwrite_item(cJSON * const root, cJSON * const replacement)
+{
+    cJSON_InvalidateHash(root);
+    cJSON_InvalidateIndex(root);
+    cJSON_InvalidateIndex(replacement);
+
+    if (!(root->type & cJSON_IsReference))
+    {
+        if (root->child != NULL)
+        {
+            cJSON_Delete(root->child);
+        }
+        if (root->valuestring != NULL)
+        {
+            cJSON_free(root->valuestring);
+        }
+    }
+
+    root->type = (replacement->type & ~cJSON_StringIsConst) | (root->type & cJSON_StringIsConst);
+    root->child = replacement->child;
+    root->valuestring = replacement->valuestring;
+    root->valueint = replacement->valueint;
+    root->valuedouble = replacement->valuedouble;
+
+    if (!(replacement->type & cJSON_StringIsConst) && (replacement->string != NULL))
+    {
+        cJSON_free(replacement->string);
+    }
+    cJSON_free(replacement);
+}
+
+/* detach the item at path from its parent */
+static cJSON *detach_path(cJSON * const object, const char * const path)
+{
+    const char *end = path + strlen(path);
+    const char *last = strrchr(path, '/');
+    cJSON *parent = NULL;
+    cJSON *item = NULL;
+
+    if (last == NULL)
+    {
+        return NULL;
+    }
+
+    parent = get_item_from_pointer(object, path, last);
+    item = get_item_from_pointer(parent, last, end);
+    if ((parent == NULL) || (item == NULL))
+    {
+        return NULL;
+    }
+
+    return cJSON_DetachItemViaPointer(parent, item);
+}
+
+/* insert value at path, an existing object member (or array element if replace is set) is replaced; value is consumed in every case */
+static int insert_at_path(cJSON * const object, const char * const path, cJSON * const value, const cJSON_bool replace)
+{
+    const char *end = path + strlen(path);
+    const char *last = strrchr(path, '/');
+    cJSON *parent = NULL;
+
+    if (last == NULL)
+    {
+        cJSON_Delete(value);
+        return CJSON_PATCH_NOT_FOUND;
+    }
+
+    parent = get_item_from_pointer(object, path, last);
+    if (cJSON_IsArray(parent))
+    {
+        size_t index = 0;
+        if ((end - last == 2) && (last[1] == '-'))
+        {
+            cJSON_AddItemToArray(parent, value);
+            return CJSON_PATCH_OK;
+        }
+        if (!decode_array_index(last + 1, end, &index) || (index > (size_t)cJSON_GetArraySize(parent)) || (index > (size_t)INT_MAX))
+        {
+            cJSON_Delete(value);
+            return CJSON_PATCH_NOT_FOUND;
+        }
+        if (replace)
+        {
+            cJSON_ReplaceItemInArray(parent, (int)index, value);
+            return CJSON_PATCH_OK;
+        }
+        /* inserting at the size appends */
+        cJSON_InsertItemInArray(parent, (int)index, value);
+        return CJSON_PATCH_OK;
+    }
+
+    if (cJSON_IsObject(parent))
+    {
+        char *key = decode_token(last + 1, end);
+        if (key == NULL)
+        {
+            cJSON_Delete(value);
+            return CJSON_PATCH_NO_MEMORY;
+        }
+        if (cJSON_GetObjectItemCaseSensitive(parent, key) != NULL)
+        {
+            cJSON_ReplaceItemInObjectCaseSensitive(parent, key, value);
+        }
+        else
+        {
+            cJSON_AddItemToObject(parent, key, value);
+        }
+        cJSON_free(key);
+        return CJSON_PATCH_OK;
+    }
+
+    cJSON_Delete(value);
+    return CJSON_PATCH_NOT_FOUND;
+}
+
+enum patch_operation { patch_add, patch_remove, patch_replace, patch_move, patch_copy, patch_test, patch_invalid };
+
+static enum patch_operation decode_operation(const char * const operation)
+{
+    if (strcmp(operation, "add") == 0)
+    {
+        return patch_add;
+    }
+    if (strcmp(operation, "remove") == 0)
+    {
+        return patch_remove;
+    }
+    if (strcmp(operation, "replace") == 0)
+    {
+        return patch_replace;
+    }
+    if (strcmp(operation, "move") == 0)
+    {
+        return patch_move;
+    }
+    if (strcmp(operation, "copy") == 0)
+    {
+        return patch_copy;
+    }
+    if (strcmp(operation, "test") == 0)
+    {
+        return patch_test;
+    }
+
+    return patch_invalid;
+}
+
+static int apply_patch(cJSON * const object, const cJSON * const patch)
+{
+    const char *path = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(patch, "path"));
+    const char *operation_name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(patch, "op"));
+    const cJSON *patch_value = cJSON_GetObjectItemCaseSensitive(patch, "value");
+    const char *from = NULL;
+    enum patch_operation operation = patch_invalid;
+    cJSON *value = NULL;
+
+    if ((path == NULL) || (operation_name == NULL))
+    {
+        return CJSON_PATCH_MALFORMED;
+    }
+
+    operation = decode_operation(operation_name);
+    if (operation == patch_invalid)
+    {
+        return CJSON_PATCH_UNKNOWN_OP;
+    }
+    if ((operation == patch_move) || (operation == patch_copy))
+    {
+        from = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(patch, "from"));
+        if (from == NULL)
+        {
+            return CJSON_PATCH_MALFORMED;
+        }
+    }
+    else if ((operation != patch_remove) && (patch_value == NULL))
+    {
+        return CJSON_PATCH_MALFORMED;
+    }
+
+    if (operation == patch_test)
+    {
+        return cJSON_Compare(cJSONUtils_GetPointer(object, path), patch_value, true) ? CJSON_PATCH_OK : CJSON_PATCH_TEST_FAILED;
+    }
+
+    if (operation == patch_remove)
+    {
+        /* the root cannot be removed in place, so an empty path is never found */
+        cJSON *removed = (path[0] == '\0') ? NULL : detach_path(object, path);
+        if (removed == NULL)
+        {
+            return CJSON_PATCH_NOT_FOUND;
+        }
+        cJSON_Delete(removed);
+        return CJSON_PATCH_OK;
+    }
+
+    /* replace needs an existing target, which is then replaced where it is */
+    if ((operation == patch_replace) && (cJSONUtils_GetPointer(object, path) == NULL))
+    {
+        return CJSON_PATCH_NOT_FOUND;
+    }
+
+    if (operation == patch_move)
+    {
+        size_t from_length = strlen(from);
+        /* a location cannot be moved into one of its own children */
+        if ((strncmp(path, from, from_length) == 0) && (path[from_length] == '/'))
+        {
+            return CJSON_PATCH_NOT_FOUND;
+        }
+        if (strcmp(path, from) == 0)
+        {
+            return (cJSONUtils_GetPointer(object, from) != NULL) ? CJSON_PATCH_OK : CJSON_PATCH_NOT_FOUND;
+        }
+        value = (from[0] == '\0') ? NULL : detach_path(object, from);
+    }
+    else if (operation == patch_copy)
+    {
+        value = cJSON_Duplicate(cJSONUtils_GetPointer(object, from), true);
+    }
+    else
+    {
+        value = cJSON_Duplicate(patch_value, true);
+    }
+    if (value == NULL)
+    {
+        return ((operation == patch_move) || (operation == patch_copy)) ? CJSON_PATCH_NOT_FOUND : CJSON_PATCH_NO_MEMORY;
+    }
+
+    if (path[0] == '\0')
+    {
+        overwrite_item(object, value);
+        return CJSON_PATCH_OK;
+    }
+
+    return insert_at_path(object, path, value, operation == patch_replace);
+}
+
+CJSON_PUBLIC(int) cJSONUtils_ApplyPatches(cJSON * const object, const cJSON * const patches)
+{
+    const cJSON *patch = NULL;
+    int status = CJSON_PATCH_OK;
+
+    if ((object == NULL) || !cJSON_IsArray(patches))
+    {
+        return CJSON_PATCH_MALFORMED;
+    }
+
+    cJSON_ArrayForEach(patch, patches)
+    {
+        status = apply_patch(object, patch);
+        if (status != CJSON_PATCH_OK)
+        {
+            return status;
+        }
+    }
+
+    return CJSON_PATCH_OK;
+}
+
+/* duplicate patch as a value, dropping the null members of objects which a merge patch treats as removals */
+static cJSON *merge_value(const cJSON * const patch)
+{
+    cJSON *merged = NULL;
+
+    if (!cJSON_IsObject(patch))
+    {
+        return cJSON_Duplicate(patch, true);
+    }
+
+    merged = cJSON_CreateObject();
+    if (merged == NULL)
+    {
+        return NULL;
+    }
+
+    return cJSONUtils_MergePatch(merged, patch);
+}
+
+CJSON_PUBLIC(cJSON *) cJSONUtils_MergePatch(cJSON *target, const cJSON * const patch)
+{
+    const cJSON *patch_child = NULL;
+
+    if (patch == NULL)
+    {
+        return target;
+    }
+
+    if (!cJSON_IsObject(patch))
+    {
+        cJSON_Delete(target);
+        return cJSON_Duplicate(patch, true);
+    }
+
+    if (!cJSON_IsObject(target))
+    {
+        cJSON_Delete(target);
+        target = cJSON_CreateObject();
+        if (target == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    cJSON_ArrayForEach(patch_child, patch)
+    {
+        cJSON *target_child = cJSON_GetObjectItemCaseSensitive(target, patch_child->string);
+
+        if (cJSON_IsNull(patch_child))
+        {
+            if (target_child != NULL)
+            {
+                cJSON_Delete(cJSON_DetachItemViaPointer(target, target_child));
+            }
+        }
+        else if (cJSON_IsObject(patch_child) && cJSON_IsObject(target_child))
+        {
+            /* merge into the existing member, keeping it in place */
+            cJSONUtils_MergePatch(target_child, patch_child);
+        }
+        else
+        {
+            cJSON *replacement = merge_value(patch_child);
+            if (replacement == NULL)
+            {
+                cJSON_Delete(target);
+                return NULL;
+            }
+            if (target_child != NULL)
+            {
+                cJSON_ReplaceItemInObjectCaseSensitive(target, patch_child->string, replacement);
+            }
+            else
+            {
+                cJSON_AddItemToObject(target, patch_child->string, replacement);
+            }
+        }
+    }
+
+    return target;
+}
+
+CJSON_PUBLIC(cJSON *) cJSONUtils_GenerateMergePatch(cJSON * const from, cJSON * const to)
+{
+    cJSON *patch = NULL;
+    cJSON *from_child = NULL;
+    cJSON *to_child = NULL;
+
+    if (to == NULL)
+    {
+        /* nothing to get to */
+        return NULL;
+    }
+
+    if (!cJSON_IsObject(to) || !cJSON_IsObject(from))
+    {
+        return cJSON_CompareHashed(from, to, true) ? NULL : cJSON_Duplicate(to, true);
+    }
+
+    if (cJSON_CompareHashed(from, to, true))
+    {
+        return NULL;
+    }
+
+    patch = cJSON_CreateObject();
+    if (patch == NULL)
+    {
+        return NULL;
+    }
+
+    cJSON_ArrayForEach(from_child, from)
+    {
+        if (cJSON_GetObjectItemCaseSensitive(to, from_child->string) == NULL)
+        {
+            cJSON_AddItemToObject(patch, from_child->string, cJSON_CreateNull());
+        }
+    }
+
+    cJSON_ArrayForEach(to_child, to)
+    {
+        from_child = cJSON_GetObjectItemCaseSensitive(from, to_child->string);
+        if (from_child == NULL)
+        {
+            cJSON_AddItemToObject(patch, to_child->string, cJSON_Duplicate(to_child, true));
+        }
+        else if (!cJSON_CompareHashed(from_child, to_child, true))
+        {
+            cJSON_AddItemToObject(patch, to_child->string, cJSONUtils_GenerateMergePatch(from_child, to_child));
+        }
+    }
+
+    return patch;
+}
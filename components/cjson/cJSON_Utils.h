@@ -0,0 +1,80 @@
+/*
+  Copyright (c) 2009-2017 Dave Gamble and cJSON contributors
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef cJSON_Utils__h
+#define cJSON_Utils__h
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "cJSON.h"
+
+/* Status codes returned by cJSONUtils_ApplyPatches */
+#define CJSON_PATCH_OK 0
+#define CJSON_PATCH_MALFORMED 1      /* patch is not an array of operation objects, or an operation lacks a member */
+#define CJSON_PATCH_UNKNOWN_OP 2     /* op is not one of add, remove, replace, move, copy, test */
+#define CJSON_PATCH_NOT_FOUND 3      /* path or from does not refer to an existing location */
+#define CJSON_PATCH_TEST_FAILED 4    /* a test operation did not match */
+#define CJSON_PATCH_NO_MEMORY 5
+
+/* Implement RFC6901 (https://tools.ietf.org/html/rfc6901) JSON Pointer spec. Keys are case sensitive. */
+CJSON_PUBLIC(cJSON *) cJSONUtils_GetPointer(cJSON * const object, const char *pointer);
+
+/* A JSON Pointer compiled for repeated use: the reference tokens are decoded and array indices parsed once, so lookups
+ * only compare keys. */
+typedef struct cJSONUtils_Path cJSONUtils_Path;
+/* Compile pointer, returns NULL if it is malformed or on allocation failure. Free with cJSONUtils_FreePath. */
+CJSON_PUBLIC(cJSONUtils_Path *) cJSONUtils_CompilePath(const char *pointer);
+CJSON_PUBLIC(void) cJSONUtils_FreePath(cJSONUtils_Path *path);
+/* Return the item path refers to in object, or NULL. */
+CJSON_PUBLIC(cJSON *) cJSONUtils_GetPath(cJSON * const object, const cJSONUtils_Path * const path);
+/* Put value where path refers to: an existing item is replaced, a missing object member is added, and an array index one past
+ * the end (or "-") appends. The parent must exist. On success value belongs to object, on failure it is left to the caller. */
+CJSON_PUBLIC(cJSON_bool) cJSONUtils_SetPath(cJSON * const object, const cJSONUtils_Path * const path, cJSON * const value);
+/* Remove and delete the item path refers to. */
+CJSON_PUBLIC(cJSON_bool) cJSONUtils_RemovePath(cJSON * const object, const cJSONUtils_Path * const path);
+
+/* Implement RFC6902 (https://tools.ietf.org/html/rfc6902) JSON Patch spec. */
+/* Return an array of the operations that turn from into to. Unchanged subtrees are skipped using cJSON_Hash,
+ * array elements are compared by index, and surplus elements are removed from the end. Neither tree is modified. */
+CJSON_PUBLIC(cJSON *) cJSONUtils_GeneratePatches(cJSON * const from, cJSON * const to);
+/* Utility to append a single operation to a patch array, value is duplicated and may be NULL. */
+CJSON_PUBLIC(void) cJSONUtils_AddPatchToArray(cJSON * const array, const char * const operation, const char * const path, const cJSON * const value);
+/* Apply the operations of a patch array to object in place, returning CJSON_PATCH_OK or the status of the first operation
+ * that failed. Operations are applied one by one, so after a failure object holds the result of the ones before it. */
+CJSON_PUBLIC(int) cJSONUtils_ApplyPatches(cJSON * const object, const cJSON * const patches);
+
+/* Implement RFC7396 (https://tools.ietf.org/html/rfc7396) JSON Merge Patch spec. */
+/* Merge patch into target in place and return the result, which is a new item (and target has been deleted) only if
+ * either of them is not an object. Returns NULL on allocation failure. */
+CJSON_PUBLIC(cJSON *) cJSONUtils_MergePatch(cJSON *target, const cJSON * const patch);
+/* Return the merge patch that turns from into to, or NULL if they are equal. Merge patches cannot set a member to null,
+ * so null members of to come out as removals. */
+CJSON_PUBLIC(cJSON *) cJSONUtils_GenerateMergePatch(cJSON * const from, cJSON * const to);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
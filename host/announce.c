@@ -0,0 +1,311 @@
+/**
+ * @file Collector and load generator for the multicast reading frames of main/announce.h
+ *
+ * listen joins the group and reports the frames per second and the lost, duplicate and reordered frames, with -v
+ * every frame. send plays any number of devices announcing at a total rate and leaves out a share of the sequence
+ * numbers, so that the losses listen reports can be checked against those send made.
+ *
+ * Usage: kasa_announce listen [-g group] [-p port] [-i interface] [-d duration_s] [-v]
+ *        kasa_announce send [-g group] [-p port] [-i interface] [-n devices] [-r frames_per_s] [-d duration_s]
+ *                           [-l skip_percent] [-e]
+ */
+
+/* system includes */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/* local includes */
+#include "announce_receiver.h"
+
+#define ANNOUNCE_DEFAULT_GROUP "239.255.0.99"
+/* frames handed to one sendmmsg() */
+#define SEND_BATCH 64
+/* most devices listed at the end of listen */
+#define LISTEN_REPORT_DEVICES 16
+
+struct options
+{
+    const char * group;
+    uint16_t port;
+    const char * interface;
+    double duration_s;
+    bool verbose;
+    uint32_t devices;
+    double rate;
+    double skip_percent;
+    bool encrypt;
+};
+
+static int64_t now_us(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000LL + time.tv_nsec / 1000;
+}
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s listen [-g group] [-p port] [-i interface] [-d duration_s] [-v]\n"
+            "       %s send [-g group] [-p port] [-i interface] [-n devices] [-r frames_per_s] [-d duration_s]\n"
+            "            [-l skip_percent] [-e]\n"
+            "  -g  multicast group (default " ANNOUNCE_DEFAULT_GROUP ")\n"
+            "  -p  UDP port (default %d)\n"
+            "  -i  address of the interface to join or send on (default picked by the routing table)\n"
+            "  -d  run for this many seconds (default until interrupted for listen, 10 for send)\n"
+            "  -v  print every frame\n"
+            "  -n  devices to play (default 100)\n"
+            "  -r  frames per second over all devices (default 10000)\n"
+            "  -l  share of sequence numbers left out, in %% (default 0)\n"
+            "  -e  encrypt the frames\n", program, program, CONFIG_ANNOUNCE_PORT);
+}
+
+static void print_frame(const announce_device_t * device, const announce_frame_t * frame, void * argument)
+{
+    const uint8_t * id = frame->device_id;
+    char address[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &device->address, address, sizeof(address));
+    printf("%02X%02X%02X%02X%02X%02X %s seq %u t %u.%03u %.2f*C %.2f%% status %u%s%s\n", id[0], id[1], id[2], id[3],
+            id[4], id[5], address, frame->sequence, frame->timestamp_ms / 1000, frame->timestamp_ms % 1000,
+            frame->temperature / 100.0, frame->humidity / 100.0, frame->status,
+            frame->flags & ANNOUNCE_FLAG_CHANGED ? " changed" : "", frame->flags & ANNOUNCE_FLAG_ENCRYPTED ? " encrypted" : "");
+}
+
+static void print_device(const announce_device_t * device, void * argument)
+{
+    int * remaining = argument;
+    if (*remaining == 0) {
+        return;
+    }
+    (*remaining)--;
+    const uint8_t * id = device->device_id;
+    printf("  %02X%02X%02X%02X%02X%02X: %llu frames, %llu lost, %llu duplicates, %llu reordered, %llu restarts, "
+            "last seq %u %.2f*C %.2f%%\n", id[0], id[1], id[2], id[3], id[4], id[5],
+            (unsigned long long)device->frames, (unsigned long long)device->lost,
+            (unsigned long long)device->duplicates, (unsigned long long)device->reordered,
+            (unsigned long long)device->restarts, device->latest.sequence, device->latest.temperature / 100.0,
+            device->latest.humidity / 100.0);
+}
+
+static void print_stats(const announce_receiver_stats_t * stats)
+{
+    printf("%u devices, %llu frames, %llu lost, %llu duplicates, %llu reordered, %llu restarts, %llu invalid\n",
+            stats->devices, (unsigned long long)stats->frames, (unsigned long long)stats->lost,
+            (unsigned long long)stats->duplicates, (unsigned long long)stats->reordered,
+            (unsigned long long)stats->restarts, (unsigned long long)stats->invalid);
+}
+
+static int listen_frames(const struct options * options)
+{
+    announce_receiver_t * receiver = announce_receiver_open(options->group, options->port, options->interface,
+        options->verbose ? print_frame : NULL, NULL);
+    if (receiver == NULL) {
+        fprintf(stderr, "Unable to join %s:%u: %s\n", options->group, options->port, strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "Listening on %s:%u\n", options->group, options->port);
+
+    const int64_t begin_us = now_us();
+    const int64_t end_us = options->duration_s > 0 ? begin_us + (int64_t)(options->duration_s * 1e6) : INT64_MAX;
+    int64_t report_us = begin_us + 1000000;
+    uint64_t reported_frames = 0;
+    announce_receiver_stats_t stats;
+    while (now_us() < end_us) {
+        if (announce_receiver_poll(receiver, 100) < 0) {
+            fprintf(stderr, "Unable to receive: %s\n", strerror(errno));
+            break;
+        }
+        if (now_us() >= report_us) {
+            announce_receiver_get_stats(receiver, &stats);
+            printf("%llu frames/s: ", (unsigned long long)(stats.frames - reported_frames));
+            print_stats(&stats);
+            fflush(stdout);
+            reported_frames = stats.frames;
+            report_us += 1000000;
+        }
+    }
+
+    announce_receiver_get_stats(receiver, &stats);
+    printf("total in %.1f s: ", (now_us() - begin_us) / 1e6);
+    print_stats(&stats);
+    int remaining = LISTEN_REPORT_DEVICES;
+    announce_receiver_foreach(receiver, print_device, &remaining);
+    announce_receiver_close(receiver);
+    return 0;
+}
+
+static int send_frames(const struct options * options)
+{
+    struct sockaddr_in destination = { .sin_family = AF_INET, .sin_port = htons(options->port) };
+    if (inet_pton(AF_INET, options->group, &destination.sin_addr) != 1) {
+        fprintf(stderr, "%s is not an IPv4 address\n", options->group);
+        return 2;
+    }
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    const int ttl = 1;
+    if (sock < 0 || setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+        perror("socket");
+        return 1;
+    }
+    if (options->interface != NULL) {
+        struct in_addr interface;
+        if (inet_pton(AF_INET, options->interface, &interface) != 1
+                || setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) < 0) {
+            fprintf(stderr, "Unable to send on %s\n", options->interface);
+            return 1;
+        }
+    }
+
+    uint32_t * sequences = calloc(options->devices, sizeof(uint32_t));
+    if (sequences == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    uint8_t frames[SEND_BATCH][ANNOUNCE_FRAME_SIZE];
+    struct iovec iovecs[SEND_BATCH];
+    struct mmsghdr messages[SEND_BATCH];
+    memset(messages, 0, sizeof(messages));
+    for (int i = 0; i < SEND_BATCH; i++) {
+        iovecs[i].iov_base = frames[i];
+        iovecs[i].iov_len = ANNOUNCE_FRAME_SIZE;
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = &destination;
+        messages[i].msg_hdr.msg_namelen = sizeof(destination);
+    }
+
+    /* locally administered addresses, devices take their turns so that each sends at the same rate */
+    announce_frame_t frame = {
+        .device_id = { 0x02, 0x00, 0x00 },
+        .flags = options->encrypt ? ANNOUNCE_FLAG_ENCRYPTED : 0,
+        .status = ANNOUNCE_STATUS_OK,
+    };
+    const uint32_t skip_threshold = (uint32_t)(options->skip_percent / 100.0 * RAND_MAX);
+    const int64_t begin_us = now_us();
+    const int64_t end_us = begin_us + (int64_t)(options->duration_s * 1e6);
+    uint64_t sent = 0;
+    uint64_t skipped = 0;
+    uint64_t failed = 0;
+    uint32_t device = 0;
+    srand(1);
+    while (true) {
+        const int64_t now = now_us();
+        if (now >= end_us) {
+            break;
+        }
+        /* frames due by now, in batches */
+        const uint64_t due = (uint64_t)((now - begin_us) / 1e6 * options->rate) + 1;
+        if (sent + skipped >= due) {
+            usleep(200);
+            continue;
+        }
+        int batch = 0;
+        while (batch < SEND_BATCH && sent + skipped + batch < due) {
+            frame.device_id[3] = device >> 16;
+            frame.device_id[4] = device >> 8;
+            frame.device_id[5] = device;
+            frame.sequence = sequences[device]++;
+            frame.timestamp_ms = (uint32_t)((now - begin_us) / 1000);
+            frame.temperature = (int16_t)lround(2100 + 200 * sin(frame.sequence / 100.0 + device));
+            frame.humidity = (uint16_t)lround(4500 + 500 * cos(frame.sequence / 150.0 + device));
+            device = (device + 1) % options->devices;
+            if ((uint32_t)rand() < skip_threshold) {
+                skipped++;
+                continue;
+            }
+            announce_frame_encode(&frame, frames[batch++]);
+        }
+        if (batch == 0) {
+            continue;
+        }
+        const int result = sendmmsg(sock, messages, batch, 0);
+        if (result < 0) {
+            if (errno != ENOBUFS && errno != EAGAIN) {
+                perror("sendmmsg");
+                break;
+            }
+            failed += batch;
+            sent += batch;
+        } else {
+            failed += batch - result;
+            sent += batch;
+        }
+    }
+
+    const double elapsed_s = (now_us() - begin_us) / 1e6;
+    printf("%llu frames from %u devices in %.2f s: %.0f frames/s, %llu sequence numbers skipped, %llu not sent\n",
+            (unsigned long long)(sent - failed), options->devices, elapsed_s, (sent - failed) / elapsed_s,
+            (unsigned long long)skipped, (unsigned long long)failed);
+    free(sequences);
+    close(sock);
+    return 0;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2 || (strcmp(argv[1], "listen") != 0 && strcmp(argv[1], "send") != 0)) {
+        usage(argv[0]);
+        return 2;
+    }
+    const bool sending = strcmp(argv[1], "send") == 0;
+    struct options options = {
+        .group = ANNOUNCE_DEFAULT_GROUP,
+        .port = CONFIG_ANNOUNCE_PORT,
+        .duration_s = sending ? 10 : 0,
+        .devices = 100,
+        .rate = 10000,
+    };
+
+    int option;
+    optind = 2;
+    while ((option = getopt(argc, argv, "g:p:i:d:vn:r:l:eh")) != -1) {
+        switch (option) {
+            case 'g':
+                options.group = optarg;
+                break;
+            case 'p':
+                options.port = atoi(optarg);
+                break;
+            case 'i':
+                options.interface = optarg;
+                break;
+            case 'd':
+                options.duration_s = atof(optarg);
+                break;
+            case 'v':
+                options.verbose = true;
+                break;
+            case 'n':
+                options.devices = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                options.rate = atof(optarg);
+                break;
+            case 'l':
+                options.skip_percent = atof(optarg);
+                break;
+            case 'e':
+                options.encrypt = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (options.devices == 0 || options.devices > 0xFFFFFF || options.rate <= 0 || options.skip_percent < 0
+            || options.skip_percent >= 100 || (sending && options.duration_s <= 0)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    return sending ? send_frames(&options) : listen_frames(&options);
+}
@@ -0,0 +1,291 @@
+/**
+ * @file Receiver of the multicast reading frames of main/announce.h for Linux collectors
+ */
+
+/* system includes */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/* local includes */
+#include "announce_receiver.h"
+
+/* datagrams taken by one recvmmsg() */
+#define RECEIVER_BATCH 64
+/* larger than a frame so that longer datagrams are recognised as invalid rather than truncated into frames */
+#define RECEIVER_DATAGRAM_SIZE 64
+/* room for bursts while the collector is busy with the previous batch */
+#define RECEIVER_BUFFER_SIZE (4 * 1024 * 1024)
+#define RECEIVER_INITIAL_DEVICES 64
+
+struct announce_receiver
+{
+    int socket;
+    struct ip_mreq membership;
+    announce_handler_t handler;
+    void * argument;
+    /* open addressing on the device identifier, never more than three quarters full */
+    announce_device_t * devices;
+    bool * used;
+    uint32_t capacity;
+    announce_receiver_stats_t stats;
+    uint8_t buffers[RECEIVER_BATCH][RECEIVER_DATAGRAM_SIZE];
+    struct sockaddr_in sources[RECEIVER_BATCH];
+    struct iovec iovecs[RECEIVER_BATCH];
+    struct mmsghdr messages[RECEIVER_BATCH];
+};
+
+static uint32_t hash_device(const uint8_t * device_id)
+{
+    /* FNV-1a, the vendor part of MAC addresses is shared so all the bytes matter */
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash = (hash ^ device_id[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t find_slot(const announce_device_t * devices, const bool * used, const uint32_t capacity,
+        const uint8_t * device_id)
+{
+    uint32_t slot = hash_device(device_id) & (capacity - 1);
+    while (used[slot] && memcmp(devices[slot].device_id, device_id, 6) != 0) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return slot;
+}
+
+static bool grow(announce_receiver_t * receiver)
+{
+    const uint32_t capacity = receiver->capacity ? receiver->capacity * 2 : RECEIVER_INITIAL_DEVICES;
+    announce_device_t * devices = calloc(capacity, sizeof(announce_device_t));
+    bool * used = calloc(capacity, sizeof(bool));
+    if (devices == NULL || used == NULL) {
+        free(devices);
+        free(used);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < receiver->capacity; i++) {
+        if (receiver->used[i]) {
+            const uint32_t slot = find_slot(devices, used, capacity, receiver->devices[i].device_id);
+            devices[slot] = receiver->devices[i];
+            used[slot] = true;
+        }
+    }
+    free(receiver->devices);
+    free(receiver->used);
+    receiver->devices = devices;
+    receiver->used = used;
+    receiver->capacity = capacity;
+    return true;
+}
+
+static announce_device_t * lookup(announce_receiver_t * receiver, const uint8_t * device_id)
+{
+    uint32_t slot = find_slot(receiver->devices, receiver->used, receiver->capacity, device_id);
+    if (receiver->used[slot]) {
+        return &receiver->devices[slot];
+    }
+
+    if ((receiver->stats.devices + 1) * 4 > receiver->capacity * 3) {
+        if (!grow(receiver)) {
+            return NULL;
+        }
+        slot = find_slot(receiver->devices, receiver->used, receiver->capacity, device_id);
+    }
+    receiver->used[slot] = true;
+    receiver->stats.devices++;
+    announce_device_t * device = &receiver->devices[slot];
+    memset(device, 0, sizeof(*device));
+    memcpy(device->device_id, device_id, sizeof(device->device_id));
+    return device;
+}
+
+/* the window and counters follow the sequence numbers, only the latest frame is kept */
+static void track(announce_receiver_t * receiver, announce_device_t * device, const announce_frame_t * frame)
+{
+    announce_receiver_stats_t * stats = &receiver->stats;
+    device->frames++;
+    stats->frames++;
+    if (device->frames == 1) {
+        device->latest = *frame;
+        device->window = 1;
+        return;
+    }
+
+    /* sequence numbers wrap, the difference is taken modulo 2^32 */
+    const int32_t ahead = (int32_t)(frame->sequence - device->latest.sequence);
+    if (ahead > 0) {
+        device->lost += ahead - 1;
+        stats->lost += ahead - 1;
+        device->window = ahead < ANNOUNCE_RECEIVER_WINDOW ? (device->window << ahead) | 1 : 1;
+        device->latest = *frame;
+    } else if (-(int64_t)ahead < ANNOUNCE_RECEIVER_WINDOW) {
+        const uint64_t bit = 1ULL << -ahead;
+        if (device->window & bit) {
+            device->duplicates++;
+            stats->duplicates++;
+        } else {
+            /* counted lost when the sequence numbers skipped over it */
+            device->window |= bit;
+            device->reordered++;
+            stats->reordered++;
+            device->lost--;
+            stats->lost--;
+        }
+    } else {
+        /* too far back to be late, the device rebooted and numbers its frames from 0 again */
+        device->restarts++;
+        stats->restarts++;
+        device->latest = *frame;
+        device->window = 1;
+    }
+}
+
+announce_receiver_t * announce_receiver_open(const char * group, const uint16_t port, const char * interface,
+        announce_handler_t handler, void * argument)
+{
+    announce_receiver_t * receiver = calloc(1, sizeof(announce_receiver_t));
+    if (receiver == NULL) {
+        return NULL;
+    }
+    receiver->socket = -1;
+    receiver->handler = handler;
+    receiver->argument = argument;
+    if (inet_pton(AF_INET, group, &receiver->membership.imr_multiaddr) != 1
+            || !IN_MULTICAST(ntohl(receiver->membership.imr_multiaddr.s_addr))
+            || (interface != NULL && inet_pton(AF_INET, interface, &receiver->membership.imr_interface) != 1)) {
+        errno = EINVAL;
+        goto fail;
+    }
+    if (!grow(receiver)) {
+        goto fail;
+    }
+
+    receiver->socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (receiver->socket < 0) {
+        goto fail;
+    }
+    /* several collectors can listen on one host, binding to the group keeps out datagrams to other groups */
+    const int enable = 1;
+    const int buffer_size = RECEIVER_BUFFER_SIZE;
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr = receiver->membership.imr_multiaddr,
+    };
+    if (setsockopt(receiver->socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0
+            || bind(receiver->socket, (struct sockaddr *)&address, sizeof(address)) < 0
+            || setsockopt(receiver->socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &receiver->membership,
+                sizeof(receiver->membership)) < 0) {
+        goto fail;
+    }
+    /* the kernel caps the buffer at net.core.rmem_max, a smaller one only makes bursts more likely to be lost */
+    setsockopt(receiver->socket, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+    for (int i = 0; i < RECEIVER_BATCH; i++) {
+        receiver->iovecs[i].iov_base = receiver->buffers[i];
+        receiver->iovecs[i].iov_len = RECEIVER_DATAGRAM_SIZE;
+        receiver->messages[i].msg_hdr.msg_iov = &receiver->iovecs[i];
+        receiver->messages[i].msg_hdr.msg_iovlen = 1;
+        receiver->messages[i].msg_hdr.msg_name = &receiver->sources[i];
+    }
+    return receiver;
+
+fail:;
+    const int error = errno;
+    announce_receiver_close(receiver);
+    errno = error;
+    return NULL;
+}
+
+int announce_receiver_poll(announce_receiver_t * receiver, const int timeout_ms)
+{
+    if (timeout_ms != 0) {
+        struct pollfd waiting = { .fd = receiver->socket, .events = POLLIN };
+        const int ready = poll(&waiting, 1, timeout_ms);
+        if (ready <= 0) {
+            return ready;
+        }
+    }
+
+    int handled = 0;
+    while (true) {
+        for (int i = 0; i < RECEIVER_BATCH; i++) {
+            receiver->messages[i].msg_hdr.msg_namelen = sizeof(receiver->sources[i]);
+        }
+        const int received = recvmmsg(receiver->socket, receiver->messages, RECEIVER_BATCH, MSG_DONTWAIT, NULL);
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return handled;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return handled > 0 ? handled : -1;
+        }
+
+        receiver->stats.datagrams += received;
+        for (int i = 0; i < received; i++) {
+            announce_frame_t frame;
+            if (!announce_frame_decode(receiver->buffers[i], receiver->messages[i].msg_len, &frame)) {
+                receiver->stats.invalid++;
+                continue;
+            }
+            announce_device_t * device = lookup(receiver, frame.device_id);
+            if (device == NULL) {
+                return -1;
+            }
+            device->address = receiver->sources[i].sin_addr;
+            track(receiver, device, &frame);
+            if (receiver->handler != NULL) {
+                receiver->handler(device, &frame, receiver->argument);
+            }
+            handled++;
+        }
+        if (received < RECEIVER_BATCH) {
+            return handled;
+        }
+    }
+}
+
+int announce_receiver_fd(const announce_receiver_t * receiver)
+{
+    return receiver->socket;
+}
+
+void announce_receiver_get_stats(const announce_receiver_t * receiver, announce_receiver_stats_t * stats)
+{
+    *stats = receiver->stats;
+}
+
+void announce_receiver_foreach(const announce_receiver_t * receiver,
+        void (*visit)(const announce_device_t * device, void * argument), void * argument)
+{
+    for (uint32_t i = 0; i < receiver->capacity; i++) {
+        if (receiver->used[i]) {
+            visit(&receiver->devices[i], argument);
+        }
+    }
+}
+
+void announce_receiver_close(announce_receiver_t * receiver)
+{
+    if (receiver == NULL) {
+        return;
+    }
+    if (receiver->socket >= 0) {
+        setsockopt(receiver->socket, IPPROTO_IP, IP_DROP_MEMBERSHIP, &receiver->membership,
+            sizeof(receiver->membership));
+        close(receiver->socket);
+    }
+    free(receiver->devices);
+    free(receiver->used);
+    free(receiver);
+}
@@ -0,0 +1,114 @@
+/**
+ * @file Receiver of the multicast reading frames of main/announce.h for Linux collectors
+ *
+ * Frames are read in batches with recvmmsg() and tracked per device in a hash table, so one receiver keeps up with
+ * thousands of frames per second from as many devices. Sequence numbers are checked against a window of the last 64
+ * numbers of each device: a number skipped over counts as lost until it arrives late, when it counts as reordered
+ * instead, a number seen again counts as a duplicate and a jump back beyond the window as the device restarting.
+ */
+
+#ifndef INTELLILIGHT_ANNOUNCE_RECEIVER_H
+#define INTELLILIGHT_ANNOUNCE_RECEIVER_H
+
+/* system includes */
+#include <stdint.h>
+#include <netinet/in.h>
+
+/* local includes */
+#include "announce.h"
+
+
+/* sequence numbers a late frame can lag the latest one by and still be told apart from a restart */
+#define ANNOUNCE_RECEIVER_WINDOW 64
+
+/**
+ * @brief What a receiver knows of one device
+ */
+typedef struct
+{
+    uint8_t device_id[6];
+    struct in_addr address;     /* source of the latest frame */
+    announce_frame_t latest;    /* frame with the highest sequence number since the last restart */
+    uint64_t window;            /* bit n is set if latest.sequence - n has been received */
+    uint64_t frames;
+    uint64_t lost;              /* sequence numbers skipped over and not received late */
+    uint64_t duplicates;
+    uint64_t reordered;         /* frames received after a higher sequence number */
+    uint64_t restarts;
+} announce_device_t;
+
+/**
+ * @brief Totals of a receiver over all devices
+ */
+typedef struct
+{
+    uint64_t datagrams;
+    uint64_t invalid;           /* datagrams that are not frames or fail their checksum */
+    uint64_t frames;
+    uint64_t lost;
+    uint64_t duplicates;
+    uint64_t reordered;
+    uint64_t restarts;
+    uint32_t devices;
+} announce_receiver_stats_t;
+
+typedef struct announce_receiver announce_receiver_t;
+
+/**
+ * @brief Called for each valid frame once the device state is updated
+ * @param device Device the frame is from, valid until the next frame is handled
+ * @param frame Frame
+ * @param argument Argument given to announce_receiver_open
+ */
+typedef void (*announce_handler_t)(const announce_device_t * device, const announce_frame_t * frame, void * argument);
+
+/**
+ * @brief Join a multicast group and receive the frames sent to it
+ * @param group IPv4 multicast group
+ * @param port UDP port
+ * @param interface Address of the interface to join on, NULL or "0.0.0.0" to let the routing table pick it
+ * @param handler Called for each frame, can be NULL
+ * @param argument Passed to the handler
+ * @return Receiver or NULL with errno set
+ */
+extern announce_receiver_t * announce_receiver_open(const char * group, const uint16_t port, const char * interface,
+        announce_handler_t handler, void * argument);
+
+/**
+ * @brief Receive and handle the frames waiting, waiting for the first one up to a timeout
+ * @param receiver Receiver
+ * @param timeout_ms Longest wait for a frame, 0 to not wait, -1 to wait for ever
+ * @return Frames handled, or -1 with errno set if receiving failed
+ */
+extern int announce_receiver_poll(announce_receiver_t * receiver, const int timeout_ms);
+
+/**
+ * @brief Get the socket to wait on in an event loop of the caller, announce_receiver_poll with 0 reads it
+ * @param receiver Receiver
+ * @return Non-blocking socket
+ */
+extern int announce_receiver_fd(const announce_receiver_t * receiver);
+
+/**
+ * @brief Get the totals over all devices
+ * @param receiver Receiver
+ * @param stats Output totals
+ */
+extern void announce_receiver_get_stats(const announce_receiver_t * receiver, announce_receiver_stats_t * stats);
+
+/**
+ * @brief Call a function for each device a frame was received from, in no particular order
+ * @param receiver Receiver
+ * @param visit Function
+ * @param argument Passed to the function
+ */
+extern void announce_receiver_foreach(const announce_receiver_t * receiver,
+        void (*visit)(const announce_device_t * device, void * argument), void * argument);
+
+/**
+ * @brief Leave the group and free the receiver
+ * @param receiver Receiver, can be NULL
+ */
+extern void announce_receiver_close(announce_receiver_t * receiver);
+
+#endif
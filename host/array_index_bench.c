@@ -0,0 +1,114 @@
+/**
+ * @file Loops over a large cJSON array by position, for (i < cJSON_GetArraySize) cJSON_GetArrayItem(i), on an array
+ * that walks its child list, one indexed with cJSON_IndexArray and one indexed by the parser in a cJSON arena, and
+ * reports the best time of each loop
+ *
+ * The host build has CJSON_ARRAY_INDEX, so the walked array is the one that was never indexed. The loops sum the
+ * items and fail on a wrong sum. The index of the parsed array is in the arena, which is only reset at the end.
+ *
+ * Usage: array_index_bench [-n elements] [-r repeats]
+ */
+
+/* system includes */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "cJSON.h"
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-n elements] [-r repeats]\n"
+            "  -n  elements of the array (default 10000)\n"
+            "  -r  loops over each array, the best one is reported (default 3)\n", program);
+}
+
+/**
+ * @brief Loop over array by position repeats times
+ * @return False if a loop got the wrong sum
+ */
+static bool measure(const char * name, const cJSON * array, int elements, int repeats)
+{
+    const double expected = (double) elements * (elements - 1) / 2;
+    int64_t best_us = INT64_MAX;
+    for (int repeat = 0; repeat < repeats; repeat++) {
+        const int64_t begin_us = esp_timer_get_time();
+        double sum = 0;
+        for (int i = 0; i < cJSON_GetArraySize(array); i++) {
+            sum += cJSON_GetArrayItem(array, i)->valuedouble;
+        }
+        const int64_t elapsed_us = esp_timer_get_time() - begin_us;
+        if (sum != expected) {
+            printf("%-10s FAILED: sum %.0f instead of %.0f\n", name, sum, expected);
+            return false;
+        }
+        if (elapsed_us < best_us) {
+            best_us = elapsed_us;
+        }
+    }
+    printf("%-10s %d elements: %.3f ms per loop\n", name, elements, best_us / 1e3);
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    int elements = 10000;
+    int repeats = 3;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:r:h")) != -1) {
+        switch (option) {
+            case 'n':
+                elements = atoi(optarg);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (elements < 1 || repeats < 1 || optind < argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    cJSON * walked = cJSON_CreateArray();
+    for (int i = 0; i < elements; i++) {
+        cJSON_AddItemToArray(walked, cJSON_CreateNumber(i));
+    }
+    cJSON * indexed = cJSON_Duplicate(walked, true);
+    char * text = cJSON_PrintUnformatted(walked);
+    if (indexed == NULL || text == NULL || !cJSON_IndexArray(indexed)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    /* as much arena as the parsed tree and its index take, with room to spare */
+    const size_t arena_size = (size_t) elements * (sizeof(cJSON) + 2 * sizeof(cJSON *)) + 4096;
+    void * arena_buffer = malloc(arena_size);
+    cJSON_Arena arena;
+    cJSON_Context context;
+    cJSON_InitArena(&arena, arena_buffer, arena_size);
+    cJSON_InitContextWithArena(&context, &arena);
+    cJSON * parsed = cJSON_ParseCtx(&context, text, strlen(text) + 1);
+    if (parsed == NULL) {
+        fprintf(stderr, "failed to parse %d elements in an arena of %zu bytes\n", elements, arena_size);
+        return 1;
+    }
+
+    bool passed = measure("walked", walked, elements, repeats);
+    passed = measure("indexed", indexed, elements, repeats) && passed;
+    passed = measure("arena", parsed, elements, repeats) && passed;
+    cJSON_ArenaReset(&arena);
+
+    free(arena_buffer);
+    cJSON_free(text);
+    cJSON_Delete(indexed);
+    cJSON_Delete(walked);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,513 @@
+/**
+ * @file Device farm: many emulated Kasa sensors served by one thread of one Linux process, for load testing
+ * controllers
+ *
+ * Every device has the identity, state and discovery reply cache of a tplink_kasa_device_t and a simulated sensor,
+ * and listens on UDP and TCP either at its own port of one address or at port 9999 of its own loopback address (all
+ * of 127.0.0.0/8 is local, so no aliases need to be configured). A further UDP socket on the discovery port of every
+ * address answers broadcasts on behalf of all devices, each reply sent from the socket of the device. One epoll loop
+ * serves every socket, requests are processed one at a time with a single cJSON arena like on the device.
+ *
+ * Usage: kasa_farm [-n devices] [-p first_port | -a first_address] [-d discovery_port] [-s stats_interval_s]
+ */
+
+/* system includes */
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "cJSON.h"
+#include "history.h"
+#include "memstats.h"
+#include "tplink_kasa.h"
+
+#define KASA_PORT 9999
+/* large enough for every reply, which are not streamed */
+#define FARM_BUFFER_SIZE 16384
+#define FARM_MAX_CONNECTIONS 1024
+/* datagrams taken from one socket per wake, so a busy device cannot starve the others */
+#define FARM_UDP_BATCH 16
+#define FARM_MAX_EVENTS 256
+/* an accepted connection that has not been answered in this time is closed to free its slot */
+#define FARM_CONNECTION_TIMEOUT_MS 5000
+
+/* identities are the ones of the firmware with the device number in the low digits */
+#define FARM_DEVICE_ID_PREFIX "80121C1874CF2DEA94DF3127F8DDF7D7"
+#define FARM_MAC_PREFIX "C0C9E3"
+
+enum source
+{
+    SOURCE_UDP,
+    SOURCE_TCP,
+    SOURCE_CONNECTION,
+    SOURCE_DISCOVERY,
+};
+
+struct farm_device
+{
+    tplink_kasa_device_t kasa;  /* first, so the sensor callback can find the farm device */
+    int udp;
+    int tcp;
+};
+
+struct connection
+{
+    int socket;                 /* -1 while the slot is free */
+    uint32_t device;
+    uint32_t received;
+    uint32_t reply_len;         /* non-zero once the reply is being sent */
+    uint32_t sent;
+    int64_t accepted_us;
+    char * buffer;              /* allocated on first use and kept */
+};
+
+struct counters
+{
+    uint64_t requests;
+    uint64_t replies;
+    uint64_t discoveries;
+    uint64_t dropped;
+};
+
+static const char *log_tag = "farm";
+
+static struct farm_device *devices = NULL;
+static uint32_t device_count = 100;
+static struct connection connections[FARM_MAX_CONNECTIONS];
+static uint32_t free_connections[FARM_MAX_CONNECTIONS];
+static uint32_t free_connection_count = 0;
+static int epoll_socket = -1;
+static struct counters counters;
+
+/* one request at a time, so one buffer and one arena serve all devices */
+static char datagram[FARM_BUFFER_SIZE];
+static char discovery_request[FARM_BUFFER_SIZE];
+static uint8_t arena_buffer[CONFIG_KASA_CJSON_ARENA_SIZE];
+static cJSON_Arena json_arena;
+static cJSON_Context json_context;
+
+static volatile sig_atomic_t stop = 0;
+
+static void request_stop(int signal_number)
+{
+    (void) signal_number;
+    stop = 1;
+}
+
+/* every device samples once a minute at its own offset, following an hourly cycle around its own mean */
+static bool farm_sensor(const tplink_kasa_device_t * kasa, sampler_reading_t * reading)
+{
+    const uint32_t index = (const struct farm_device *) kasa - devices;
+    const int64_t now = esp_timer_get_time();
+    const int64_t now_s = now / 1000000;
+    const int64_t age_s = (now_s + index) % 60;
+    const double phase = 2.0 * M_PI * (now_s - age_s) / 3600.0 + index;
+
+    reading->temperature = 18.0f + (index % 60) / 10.0f + 2.0f * (float) sin(phase);
+    reading->humidity = 35.0f + (index % 30) + 5.0f * (float) cos(phase);
+    reading->timestamp_us = now - age_s * 1000000;
+    reading->count = (uint32_t) (now_s / 60) + 1;
+    return true;
+}
+
+static uint64_t event_data(enum source source, uint32_t index)
+{
+    return ((uint64_t) source << 32) | index;
+}
+
+static int open_socket(int type, const struct sockaddr_in * address)
+{
+    const int sock = socket(AF_INET, type | SOCK_NONBLOCK, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    const int opt = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (type == SOCK_DGRAM) {
+        setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &opt, sizeof(opt));
+    }
+    if (bind(sock, (const struct sockaddr *) address, sizeof(*address)) != 0
+            || (type == SOCK_STREAM && listen(sock, 128) != 0)) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static bool watch(int sock, uint32_t events, enum source source, uint32_t index)
+{
+    struct epoll_event event = { .events = events, .data.u64 = event_data(source, index) };
+    return epoll_ctl(epoll_socket, EPOLL_CTL_ADD, sock, &event) == 0;
+}
+
+/* process a request on behalf of device in place, returning the length of the reply left in buffer */
+static int process(struct farm_device * device, char * buffer, int length, bool include_header)
+{
+    counters.requests++;
+
+    memstats_request_t request;
+    memstats_request_begin(&request);
+    const int reply_len = tplink_kasa_process_device_buffer(&device->kasa, &json_context, buffer, length,
+            FARM_BUFFER_SIZE, include_header, NULL);
+    memstats_request_end(&request);
+    cJSON_ArenaReset(&json_arena);
+
+    if (reply_len > 0) {
+        counters.replies++;
+    } else {
+        counters.dropped++;
+    }
+    return reply_len;
+}
+
+static void serve_udp(struct farm_device * device)
+{
+    for (int i = 0; i < FARM_UDP_BATCH; i++) {
+        struct sockaddr_storage source;
+        socklen_t source_len = sizeof(source);
+        const int received = recvfrom(device->udp, datagram, sizeof(datagram) - 1, 0,
+                (struct sockaddr *) &source, &source_len);
+        if (received <= 0) {
+            return;
+        }
+        const int reply_len = process(device, datagram, received, false);
+        if (reply_len > 0) {
+            sendto(device->udp, datagram, reply_len, 0, (struct sockaddr *) &source, source_len);
+        }
+    }
+}
+
+/* real devices answer any broadcast command, so the request is processed by every device in turn */
+static void serve_discovery(int sock)
+{
+    for (int i = 0; i < FARM_UDP_BATCH; i++) {
+        struct sockaddr_storage source;
+        socklen_t source_len = sizeof(source);
+        const int received = recvfrom(sock, discovery_request, sizeof(discovery_request) - 1, 0,
+                (struct sockaddr *) &source, &source_len);
+        if (received <= 0) {
+            return;
+        }
+        counters.discoveries++;
+        for (uint32_t d = 0; d < device_count; d++) {
+            memcpy(datagram, discovery_request, received);
+            const int reply_len = process(&devices[d], datagram, received, false);
+            if (reply_len > 0) {
+                sendto(devices[d].udp, datagram, reply_len, 0, (struct sockaddr *) &source, source_len);
+            }
+        }
+    }
+}
+
+static void close_connection(uint32_t index)
+{
+    close(connections[index].socket);
+    connections[index].socket = -1;
+    free_connections[free_connection_count++] = index;
+}
+
+static void accept_connections(uint32_t device)
+{
+    while (true) {
+        const int sock = accept4(devices[device].tcp, NULL, NULL, SOCK_NONBLOCK);
+        if (sock < 0) {
+            return;
+        }
+        if (free_connection_count == 0) {
+            ESP_LOGW(log_tag, "All %d connections in use, refusing one", FARM_MAX_CONNECTIONS);
+            close(sock);
+            continue;
+        }
+
+        const uint32_t index = free_connections[--free_connection_count];
+        struct connection * connection = &connections[index];
+        if (connection->buffer == NULL && (connection->buffer = malloc(FARM_BUFFER_SIZE)) == NULL) {
+            free_connections[free_connection_count++] = index;
+            close(sock);
+            continue;
+        }
+        connection->socket = sock;
+        connection->device = device;
+        connection->received = 0;
+        connection->reply_len = 0;
+        connection->sent = 0;
+        connection->accepted_us = esp_timer_get_time();
+        if ( !watch(sock, EPOLLIN, SOURCE_CONNECTION, index) ) {
+            close_connection(index);
+        }
+    }
+}
+
+/* the device closes a connection once it has replied, the farm does the same */
+static void send_reply(uint32_t index)
+{
+    struct connection * connection = &connections[index];
+    while (connection->sent < connection->reply_len) {
+        const int written = send(connection->socket, connection->buffer + connection->sent,
+                connection->reply_len - connection->sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct epoll_event event = { .events = EPOLLOUT, .data.u64 = event_data(SOURCE_CONNECTION, index) };
+                epoll_ctl(epoll_socket, EPOLL_CTL_MOD, connection->socket, &event);
+                return;
+            }
+            break;
+        }
+        connection->sent += written;
+    }
+    close_connection(index);
+}
+
+static void receive_request(uint32_t index)
+{
+    struct connection * connection = &connections[index];
+    const int received = recv(connection->socket, connection->buffer + connection->received,
+            FARM_BUFFER_SIZE - 1 - connection->received, 0);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (received <= 0) {
+        close_connection(index);
+        return;
+    }
+    connection->received += received;
+    if (connection->received < 4) {
+        return;
+    }
+
+    const uint8_t * header = (const uint8_t *) connection->buffer;
+    const uint32_t length = 4 + ((uint32_t) header[0] << 24 | (uint32_t) header[1] << 16 | (uint32_t) header[2] << 8 | header[3]);
+    if (length > FARM_BUFFER_SIZE - 1) {
+        ESP_LOGW(log_tag, "Dropping %u byte request, larger than the buffer", (unsigned) length);
+        close_connection(index);
+        return;
+    }
+    if (connection->received < length) {
+        return;
+    }
+
+    connection->reply_len = process(&devices[connection->device], connection->buffer, length, true);
+    connection->sent = 0;
+    send_reply(index);
+}
+
+static void close_stale_connections(void)
+{
+    const int64_t now = esp_timer_get_time();
+    for (uint32_t i = 0; i < FARM_MAX_CONNECTIONS; i++) {
+        if (connections[i].socket >= 0 && now - connections[i].accepted_us > FARM_CONNECTION_TIMEOUT_MS * 1000LL) {
+            close_connection(i);
+        }
+    }
+}
+
+static bool setup_devices(uint32_t first_port, const struct in_addr * first_address)
+{
+    devices = calloc(device_count, sizeof(struct farm_device));
+    if (devices == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < device_count; i++) {
+        struct farm_device * device = &devices[i];
+        char device_id[sizeof(device->kasa.device_id)];
+        char mic_mac[sizeof(device->kasa.mic_mac)];
+        char alias[sizeof(device->kasa.alias)];
+        snprintf(device_id, sizeof(device_id), FARM_DEVICE_ID_PREFIX "%08X", (unsigned) i);
+        snprintf(mic_mac, sizeof(mic_mac), FARM_MAC_PREFIX "%06X", (unsigned) i & 0xFFFFFF);
+        snprintf(alias, sizeof(alias), "Farm Sensor %u", (unsigned) i);
+        if ( !tplink_kasa_device_init(&device->kasa, device_id, mic_mac, alias, farm_sensor) ) {
+            ESP_LOGE(log_tag, "Out of memory for device %u", (unsigned) i);
+            return false;
+        }
+
+        struct sockaddr_in address = { .sin_family = AF_INET };
+        if (first_address != NULL) {
+            address.sin_addr.s_addr = htonl(ntohl(first_address->s_addr) + i);
+            address.sin_port = htons(KASA_PORT);
+        } else {
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = htons(first_port + i);
+        }
+        device->udp = open_socket(SOCK_DGRAM, &address);
+        device->tcp = open_socket(SOCK_STREAM, &address);
+        if (device->udp < 0 || device->tcp < 0) {
+            char address_str[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &address.sin_addr, address_str, sizeof(address_str));
+            ESP_LOGE(log_tag, "Unable to listen on %s:%u: errno %d", address_str, ntohs(address.sin_port), errno);
+            return false;
+        }
+        if ( !watch(device->udp, EPOLLIN, SOURCE_UDP, i) || !watch(device->tcp, EPOLLIN, SOURCE_TCP, i) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* two sockets per device and the connections, above the usual limit of 1024 descriptors */
+static void raise_descriptor_limit(void)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        const rlim_t needed = 2 * (rlim_t) device_count + FARM_MAX_CONNECTIONS + 64;
+        if (limit.rlim_cur < needed) {
+            limit.rlim_cur = needed < limit.rlim_max ? needed : limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+}
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-n devices] [-p first_port | -a first_address] [-d discovery_port] [-s stats_interval_s]\n"
+            "  -n  number of devices (default 100)\n"
+            "  -p  device i listens on 127.0.0.1, port first_port + i (default 10000)\n"
+            "  -a  device i listens on first_address + i, port %d\n"
+            "  -d  port answering broadcasts for all devices (default %d, 0 for none)\n"
+            "  -s  seconds between statistics lines (default 10, 0 for none)\n",
+            program, KASA_PORT, KASA_PORT);
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t first_port = 10000;
+    struct in_addr first_address;
+    bool use_addresses = false;
+    int discovery_port = KASA_PORT;
+    int stats_interval_s = 10;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:p:a:d:s:h")) != -1) {
+        switch (option) {
+            case 'n':
+                device_count = strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                first_port = strtoul(optarg, NULL, 0);
+                break;
+            case 'a':
+                use_addresses = inet_aton(optarg, &first_address) != 0;
+                if ( !use_addresses ) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'd':
+                discovery_port = atoi(optarg);
+                break;
+            case 's':
+                stats_interval_s = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (device_count == 0 || (!use_addresses && first_port + device_count > 65536)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    /* logging every request would cost more than serving it */
+    esp_log_level_set("*", ESP_LOG_WARN);
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    raise_descriptor_limit();
+
+    memstats_init();
+    history_init();
+    tplink_kasa_init();
+    cJSON_InitArena(&json_arena, arena_buffer, sizeof(arena_buffer));
+    cJSON_InitContextWithArena(&json_context, &json_arena);
+
+    for (uint32_t i = 0; i < FARM_MAX_CONNECTIONS; i++) {
+        connections[i].socket = -1;
+        free_connections[free_connection_count++] = FARM_MAX_CONNECTIONS - 1 - i;
+    }
+
+    epoll_socket = epoll_create1(0);
+    if (epoll_socket < 0 || !setup_devices(first_port, use_addresses ? &first_address : NULL)) {
+        return 1;
+    }
+
+    int discovery_socket = -1;
+    if (discovery_port > 0) {
+        const struct sockaddr_in address = {
+            .sin_family = AF_INET,
+            .sin_port = htons(discovery_port),
+            .sin_addr.s_addr = htonl(INADDR_ANY),
+        };
+        discovery_socket = open_socket(SOCK_DGRAM, &address);
+        if (discovery_socket < 0 || !watch(discovery_socket, EPOLLIN, SOURCE_DISCOVERY, 0)) {
+            ESP_LOGE(log_tag, "Unable to listen for discovery on port %d: errno %d", discovery_port, errno);
+            return 1;
+        }
+    }
+
+    printf("%u devices on %s from %s port %u, discovery on port %d\n", (unsigned) device_count,
+            use_addresses ? "addresses" : "ports", use_addresses ? inet_ntoa(first_address) : "127.0.0.1",
+            use_addresses ? KASA_PORT : (unsigned) first_port, discovery_port);
+    fflush(stdout);
+
+    struct epoll_event events[FARM_MAX_EVENTS];
+    struct counters reported = counters;
+    int64_t reported_us = esp_timer_get_time();
+    int64_t swept_us = reported_us;
+    while ( !stop ) {
+        const int count = epoll_wait(epoll_socket, events, FARM_MAX_EVENTS, 1000);
+        for (int i = 0; i < count; i++) {
+            const uint32_t index = (uint32_t) events[i].data.u64;
+            switch ((enum source) (events[i].data.u64 >> 32)) {
+                case SOURCE_UDP:
+                    serve_udp(&devices[index]);
+                    break;
+                case SOURCE_TCP:
+                    accept_connections(index);
+                    break;
+                case SOURCE_CONNECTION:
+                    if (connections[index].reply_len > 0) {
+                        send_reply(index);
+                    } else {
+                        receive_request(index);
+                    }
+                    break;
+                case SOURCE_DISCOVERY:
+                    serve_discovery(discovery_socket);
+                    break;
+            }
+        }
+
+        const int64_t now = esp_timer_get_time();
+        if (now - swept_us >= 1000000) {
+            close_stale_connections();
+            swept_us = now;
+        }
+        if (stats_interval_s > 0 && now - reported_us >= stats_interval_s * 1000000LL) {
+            const double seconds = (now - reported_us) / 1e6;
+            printf("%.0f requests/s, %.0f replies/s, %.1f discoveries/s, %llu dropped, %u connections open\n",
+                    (counters.requests - reported.requests) / seconds, (counters.replies - reported.replies) / seconds,
+                    (counters.discoveries - reported.discoveries) / seconds,
+                    (unsigned long long) (counters.dropped - reported.dropped),
+                    (unsigned) (FARM_MAX_CONNECTIONS - free_connection_count));
+            fflush(stdout);
+            reported = counters;
+            reported_us = now;
+        }
+    }
+
+    printf("%llu requests, %llu replies, %llu discoveries, %llu dropped\n", (unsigned long long) counters.requests,
+            (unsigned long long) counters.replies, (unsigned long long) counters.discoveries,
+            (unsigned long long) counters.dropped);
+    return 0;
+}
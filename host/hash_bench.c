@@ -0,0 +1,150 @@
+/**
+ * @file Cost of cJSON_Hash and cJSON_CompareHashed against cJSON_Compare on large objects: objects of n members that
+ * are objects {v, s} themselves, compared with an equal object that has its members in reverse order and with one that
+ * differs in the last value
+ *
+ * The hash is timed cold, after cJSON_InvalidateHash has moved the generation on, and cached. The results must agree
+ * with cJSON_Compare.
+ *
+ * Usage: hash_bench [-n members] [-w work]
+ */
+
+/* system includes */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "cJSON.h"
+
+static const int default_members[] = { 10, 100, 1000 };
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-n members] [-w work]\n"
+            "  -n  members of the objects (default 10, 100 and 1000 in turn)\n"
+            "  -w  members visited per measurement, the iterations are work / members (default 100000)\n", program);
+}
+
+/**
+ * @brief Create an object of members {"v": value, "s": "value"} named by their position, in reverse order if asked
+ */
+static cJSON * create_object(int members, bool reverse, int changed)
+{
+    cJSON * object = cJSON_CreateObject();
+    for (int i = 0; i < members; i++) {
+        const int position = reverse ? members - 1 - i : i;
+        char name[16];
+        snprintf(name, sizeof(name), "m%d", position);
+        cJSON * member = cJSON_AddObjectToObject(object, name);
+        cJSON_AddNumberToObject(member, "v", position == changed ? -1 : position);
+        cJSON_AddStringToObject(member, "s", name);
+    }
+    return object;
+}
+
+typedef enum {
+    MEASURE_COMPARE,
+    MEASURE_HASH_COLD,
+    MEASURE_HASH_CACHED,
+    MEASURE_COMPARE_HASHED,
+} measure_t;
+
+/**
+ * @brief Time one way of comparing a with b
+ * @return Nanoseconds per comparison or hash of a
+ */
+static double measure_ns(measure_t measure, cJSON * a, cJSON * b, int iterations)
+{
+    const int64_t begin_us = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        switch (measure) {
+            case MEASURE_COMPARE:
+                cJSON_Compare(a, b, true);
+                break;
+            case MEASURE_HASH_COLD:
+                cJSON_InvalidateHash(a);
+                cJSON_Hash(a);
+                break;
+            case MEASURE_HASH_CACHED:
+                cJSON_Hash(a);
+                break;
+            case MEASURE_COMPARE_HASHED:
+                cJSON_CompareHashed(a, b, true);
+                break;
+        }
+    }
+    return (esp_timer_get_time() - begin_us) * 1e3 / iterations;
+}
+
+/**
+ * @brief Measure objects of members
+ * @return False if the hashes disagree with cJSON_Compare
+ */
+static bool bench(int members, int work)
+{
+    cJSON * object = create_object(members, false, -1);
+    cJSON * equal = create_object(members, true, -1);
+    cJSON * unequal = create_object(members, true, members - 1);
+    const int iterations = work / members > 0 ? work / members : 1;
+
+    const bool passed = cJSON_Compare(object, equal, true) && cJSON_CompareHashed(object, equal, true)
+            && cJSON_Hash(object) == cJSON_Hash(equal) && !cJSON_Compare(object, unequal, true)
+            && !cJSON_CompareHashed(object, unequal, true);
+    if (!passed) {
+        printf("%7d FAILED: cJSON_Hash or cJSON_CompareHashed disagree with cJSON_Compare\n", members);
+    } else {
+        /* the cold hash goes last as it invalidates the hashes the comparisons use, cached ones take constant time */
+        const double compare_equal = measure_ns(MEASURE_COMPARE, object, equal, iterations);
+        const double compare_unequal = measure_ns(MEASURE_COMPARE, object, unequal, iterations);
+        const double hashed_equal = measure_ns(MEASURE_COMPARE_HASHED, object, equal, iterations);
+        const double hashed_unequal = measure_ns(MEASURE_COMPARE_HASHED, object, unequal, work);
+        const double hash_cached = measure_ns(MEASURE_HASH_CACHED, object, NULL, work);
+        const double hash_cold = measure_ns(MEASURE_HASH_COLD, object, NULL, iterations);
+        printf("%7d %14.1f %14.1f %14.1f %14.1f %14.1f %14.1f\n", members, compare_equal, compare_unequal,
+                hashed_equal, hashed_unequal, hash_cold, hash_cached);
+    }
+
+    cJSON_Delete(unequal);
+    cJSON_Delete(equal);
+    cJSON_Delete(object);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int members = 0;
+    int work = 100000;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:w:h")) != -1) {
+        switch (option) {
+            case 'n':
+                members = atoi(optarg);
+                break;
+            case 'w':
+                work = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (members < 0 || work < 1 || optind < argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    printf("%7s %14s %14s %14s %14s %14s %14s\n", "members", "Compare eq ns", "Compare ne ns", "Hashed eq ns",
+            "Hashed ne ns", "Hash cold ns", "Hash cached ns");
+    bool passed = true;
+    if (members > 0) {
+        passed = bench(members, work);
+    } else {
+        for (size_t i = 0; i < sizeof(default_members) / sizeof(default_members[0]); i++) {
+            passed = bench(default_members[i], work) && passed;
+        }
+    }
+    return passed ? 0 : 1;
+}
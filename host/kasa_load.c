@@ -0,0 +1,336 @@
+/**
+ * @file Load client for Kasa servers: keeps a number of requests in flight over TCP, one connection per request like
+ * the Kasa apps, or over UDP, and reports the throughput, the latency distribution and the failures
+ *
+ * Usage: kasa_load [-u] [-c concurrency] [-n requests | -d duration_s] [-r request] [host [port]]
+ */
+
+/* system includes */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#define LOAD_BUFFER_SIZE 16384
+#define LOAD_MAX_CONCURRENCY 4096
+#define LOAD_MAX_EVENTS 256
+/* a request without a reply in this time counts as failed */
+#define LOAD_TIMEOUT_MS 1000
+#define KASA_CIPHER_KEY 171
+
+struct client
+{
+    int socket;
+    int64_t started_us;
+    uint32_t sent;
+    uint32_t received;
+    char buffer[LOAD_BUFFER_SIZE];
+};
+
+static struct sockaddr_in server_address;
+static bool use_udp = false;
+static uint8_t request[LOAD_BUFFER_SIZE];
+static uint32_t request_len;
+
+static uint32_t * latencies;
+static size_t latency_count;
+static size_t latency_capacity;
+static uint64_t started;
+static uint64_t failures;
+
+static int64_t now_us(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000LL + time.tv_nsec / 1000;
+}
+
+/* the autokey cipher of the Kasa protocol */
+static void encrypt(const char * text, uint8_t * out, uint32_t length)
+{
+    uint8_t key = KASA_CIPHER_KEY;
+    for (uint32_t i = 0; i < length; i++) {
+        key ^= (uint8_t) text[i];
+        out[i] = key;
+    }
+}
+
+/* a reply is valid if it decrypts to a JSON object */
+static bool reply_valid(const char * reply, uint32_t length)
+{
+    const uint8_t * data = (const uint8_t *) reply;
+    return length >= 2 && (data[0] ^ KASA_CIPHER_KEY) == '{' && (data[length - 1] ^ data[length - 2]) == '}';
+}
+
+static void record(int64_t latency_us)
+{
+    if (latency_count == latency_capacity) {
+        latency_capacity = latency_capacity ? latency_capacity * 2 : 65536;
+        latencies = realloc(latencies, latency_capacity * sizeof(uint32_t));
+        if (latencies == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    latencies[latency_count++] = latency_us;
+}
+
+static void finish(int epoll_socket, struct client * client, bool valid)
+{
+    if (valid) {
+        record(now_us() - client->started_us);
+    } else {
+        failures++;
+    }
+    if ( !use_udp ) {
+        epoll_ctl(epoll_socket, EPOLL_CTL_DEL, client->socket, NULL);
+        close(client->socket);
+        client->socket = -1;
+    }
+}
+
+static bool start(int epoll_socket, struct client * client)
+{
+    started++;
+    client->started_us = now_us();
+    client->sent = 0;
+    client->received = 0;
+
+    if (use_udp) {
+        if (send(client->socket, request + 4, request_len - 4, 0) < 0) {
+            return false;
+        }
+        return true;
+    }
+
+    client->socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (client->socket < 0) {
+        return false;
+    }
+    if (connect(client->socket, (struct sockaddr *) &server_address, sizeof(server_address)) != 0
+            && errno != EINPROGRESS) {
+        close(client->socket);
+        client->socket = -1;
+        return false;
+    }
+    struct epoll_event event = { .events = EPOLLOUT, .data.ptr = client };
+    epoll_ctl(epoll_socket, EPOLL_CTL_ADD, client->socket, &event);
+    return true;
+}
+
+static void handle_tcp(int epoll_socket, struct client * client)
+{
+    if (client->sent < request_len) {
+        const int written = send(client->socket, request + client->sent, request_len - client->sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno != EAGAIN) {
+                finish(epoll_socket, client, false);
+            }
+            return;
+        }
+        client->sent += written;
+        if (client->sent == request_len) {
+            struct epoll_event event = { .events = EPOLLIN, .data.ptr = client };
+            epoll_ctl(epoll_socket, EPOLL_CTL_MOD, client->socket, &event);
+        }
+        return;
+    }
+
+    const int received = recv(client->socket, client->buffer + client->received,
+            LOAD_BUFFER_SIZE - client->received, 0);
+    if (received < 0 && errno == EAGAIN) {
+        return;
+    }
+    if (received <= 0) {
+        finish(epoll_socket, client, false);
+        return;
+    }
+    client->received += received;
+    if (client->received >= 4) {
+        const uint8_t * header = (const uint8_t *) client->buffer;
+        const uint32_t length = (uint32_t) header[0] << 24 | (uint32_t) header[1] << 16 | (uint32_t) header[2] << 8 | header[3];
+        if (client->received >= 4 + length) {
+            finish(epoll_socket, client, reply_valid(client->buffer + 4, length));
+        } else if (client->received == LOAD_BUFFER_SIZE) {
+            finish(epoll_socket, client, false);
+        }
+    }
+}
+
+static void handle_udp(int epoll_socket, struct client * client)
+{
+    const int received = recv(client->socket, client->buffer, LOAD_BUFFER_SIZE, 0);
+    if (received < 0) {
+        return;
+    }
+    finish(epoll_socket, client, reply_valid(client->buffer, received));
+    client->started_us = 0;
+}
+
+static int compare_latency(const void * a, const void * b)
+{
+    const uint32_t x = *(const uint32_t *) a;
+    const uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-u] [-c concurrency] [-n requests | -d duration_s] [-r request] [host [port]]\n"
+            "  -u  send over UDP instead of one TCP connection per request\n"
+            "  -c  requests in flight (default 64)\n"
+            "  -n  number of requests (default 100000)\n"
+            "  -d  run for this many seconds instead of a number of requests\n"
+            "  -r  request JSON (default get_sysinfo)\n"
+            "  host and port default to 127.0.0.1 9999\n", program);
+}
+
+int main(int argc, char * argv[])
+{
+    int concurrency = 64;
+    uint64_t total = 100000;
+    int duration_s = 0;
+    const char * request_json = "{\"system\":{\"get_sysinfo\":null}}";
+    const char * host = "127.0.0.1";
+    int port = 9999;
+
+    int option;
+    while ((option = getopt(argc, argv, "uc:n:d:r:h")) != -1) {
+        switch (option) {
+            case 'u':
+                use_udp = true;
+                break;
+            case 'c':
+                concurrency = atoi(optarg);
+                break;
+            case 'n':
+                total = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                duration_s = atoi(optarg);
+                break;
+            case 'r':
+                request_json = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind < argc) {
+        host = argv[optind++];
+    }
+    if (optind < argc) {
+        port = atoi(argv[optind++]);
+    }
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(port);
+    if (concurrency < 1 || concurrency > LOAD_MAX_CONCURRENCY || strlen(request_json) > LOAD_BUFFER_SIZE - 4
+            || inet_pton(AF_INET, host, &server_address.sin_addr) != 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    const uint32_t json_len = strlen(request_json);
+    request[0] = json_len >> 24;
+    request[1] = json_len >> 16;
+    request[2] = json_len >> 8;
+    request[3] = json_len;
+    encrypt(request_json, request + 4, json_len);
+    request_len = 4 + json_len;
+
+    /* every client holds a socket */
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    const int epoll_socket = epoll_create1(0);
+    struct client * clients = calloc(concurrency, sizeof(struct client));
+    if (epoll_socket < 0 || clients == NULL) {
+        perror("setup");
+        return 1;
+    }
+    for (int i = 0; i < concurrency; i++) {
+        clients[i].socket = -1;
+        if (use_udp) {
+            clients[i].socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+            struct epoll_event event = { .events = EPOLLIN, .data.ptr = &clients[i] };
+            if (clients[i].socket < 0
+                    || connect(clients[i].socket, (struct sockaddr *) &server_address, sizeof(server_address)) != 0
+                    || epoll_ctl(epoll_socket, EPOLL_CTL_ADD, clients[i].socket, &event) != 0) {
+                perror("udp socket");
+                return 1;
+            }
+        }
+    }
+
+    const int64_t begin_us = now_us();
+    const int64_t end_us = duration_s > 0 ? begin_us + duration_s * 1000000LL : INT64_MAX;
+    int64_t checked_us = begin_us;
+    struct epoll_event events[LOAD_MAX_EVENTS];
+    while (true) {
+        const int64_t now = now_us();
+        /* idle clients start their next request, or the run ends once they are all idle */
+        int busy = 0;
+        for (int i = 0; i < concurrency; i++) {
+            struct client * client = &clients[i];
+            const bool idle = use_udp ? client->started_us == 0 : client->socket < 0;
+            if (idle && (duration_s > 0 ? now < end_us : started < total)) {
+                if ( !start(epoll_socket, client) ) {
+                    failures++;
+                    client->started_us = 0;
+                    continue;
+                }
+            }
+            busy += use_udp ? client->started_us != 0 : client->socket >= 0;
+        }
+        if (busy == 0) {
+            break;
+        }
+
+        if (now - checked_us >= LOAD_TIMEOUT_MS * 1000LL / 4) {
+            for (int i = 0; i < concurrency; i++) {
+                struct client * client = &clients[i];
+                const bool active = use_udp ? client->started_us != 0 : client->socket >= 0;
+                if (active && now - client->started_us > LOAD_TIMEOUT_MS * 1000LL) {
+                    finish(epoll_socket, client, false);
+                    client->started_us = 0;
+                }
+            }
+            checked_us = now;
+        }
+
+        const int count = epoll_wait(epoll_socket, events, LOAD_MAX_EVENTS, 100);
+        for (int i = 0; i < count; i++) {
+            struct client * client = events[i].data.ptr;
+            if (use_udp) {
+                handle_udp(epoll_socket, client);
+            } else if (client->socket >= 0) {
+                handle_tcp(epoll_socket, client);
+            }
+        }
+    }
+    const double elapsed_s = (now_us() - begin_us) / 1e6;
+
+    qsort(latencies, latency_count, sizeof(uint32_t), compare_latency);
+    printf("%s, %d in flight: %zu replies, %llu failed in %.2f s, %.0f requests/s\n", use_udp ? "udp" : "tcp",
+            concurrency, latency_count, (unsigned long long) failures, elapsed_s, latency_count / elapsed_s);
+    if (latency_count > 0) {
+        printf("latency us: p50 %u p90 %u p99 %u p99.9 %u max %u\n", latencies[latency_count / 2],
+                latencies[latency_count * 90 / 100], latencies[latency_count * 99 / 100],
+                latencies[latency_count * 999 / 1000], latencies[latency_count - 1]);
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file Test that every Kasa command without request fields, every diag method among them, is answered over UDP: the
+ * request is processed the way the processing task does it, with a cJSON arena of CONFIG_KASA_CJSON_ARENA_SIZE and a
+ * buffer of PIPELINE_BUFFER_SIZE, and the reply must come back in the buffer as the JSON of that command
+ *
+ * The commands are read from the schema, so a method added there is covered without touching the test. A reply that
+ * outgrows the arena or the buffer is not sent at all, which is what this catches. An alias too long for its buffer
+ * must be refused with err_code -3 rather than dropped.
+ *
+ * Usage: kasa_udp_test kasa_commands.schema
+ */
+
+/* system includes */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* local includes */
+#include "cJSON.h"
+#include "history.h"
+#include "memstats.h"
+#include "pipeline.h"
+#include "sampler.h"
+#include "taskstats.h"
+#include "tplink_kasa.h"
+
+#define TEST_MAX_NAME 64
+
+/* the tasks of the firmware, then as many more as taskstats takes with names as long as FreeRTOS allows */
+static const char * const task_names[TASKSTATS_MAX_TASKS] = {
+    "network", "processing", "telemetry", "spare-task-0001", "spare-task-0002", "spare-task-0003", "spare-task-0004",
+    "spare-task-0005",
+};
+
+static uint8_t arena_buffer[CONFIG_KASA_CJSON_ARENA_SIZE];
+static char buffer[PIPELINE_BUFFER_SIZE];
+
+/**
+ * @brief Check one command over UDP
+ * @return False if it got no reply or not the reply of the command
+ */
+static bool check_command(cJSON_Context * json_context, cJSON_Arena * json_arena, const char * module,
+        const char * method)
+{
+    json_arena->peak = 0;
+    const int length = snprintf(buffer, sizeof(buffer), "{\"%s\":{\"%s\":{}}}", module, method);
+    tplink_kasa_encrypt_buffer((uint8_t *) buffer, length);
+    const int reply_len = tplink_kasa_process_buffer(json_context, buffer, length, sizeof(buffer), false, NULL);
+    const size_t arena_peak = json_arena->peak;
+    cJSON_ArenaReset(json_arena);
+    if (reply_len <= 0) {
+        printf("FAILED %s.%s: no reply (arena peak %zu of %d bytes)\n", module, method, arena_peak,
+                CONFIG_KASA_CJSON_ARENA_SIZE);
+        return false;
+    }
+
+    /* packed arrays come back as a node per number, more than the arena has to hold on the device */
+    tplink_kasa_decrypt_buffer((uint8_t *) buffer, reply_len);
+    cJSON_Context heap_context;
+    cJSON_InitContext(&heap_context, NULL);
+    cJSON * reply = cJSON_ParseCtx(&heap_context, buffer, reply_len);
+    const cJSON * result = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(reply, module), method);
+    const cJSON * err_code = cJSON_GetObjectItemCaseSensitive(result, "err_code");
+    const bool valid = cJSON_IsNumber(err_code);
+    printf("%s %s.%s: %d bytes, err_code %d, arena peak %zu of %d bytes\n", valid ? "ok" : "FAILED", module, method,
+            reply_len, valid ? err_code->valueint : 0, arena_peak, CONFIG_KASA_CJSON_ARENA_SIZE);
+    cJSON_DeleteCtx(&heap_context, reply);
+    return valid;
+}
+
+/**
+ * @brief Check that system.set_dev_alias with an alias longer than the device stores is refused with a reply
+ * @return False if it got no reply or not the refusal
+ */
+static bool check_oversize_alias(cJSON_Context * json_context, cJSON_Arena * json_arena)
+{
+    const int length = snprintf(buffer, sizeof(buffer), "{\"system\":{\"set_dev_alias\":{\"alias\":\"%0*d\"}}}",
+            TPLINK_KASA_ALIAS_SIZE, 0);
+    tplink_kasa_encrypt_buffer((uint8_t *) buffer, length);
+    const int reply_len = tplink_kasa_process_buffer(json_context, buffer, length, sizeof(buffer), false, NULL);
+    cJSON_ArenaReset(json_arena);
+    if (reply_len <= 0) {
+        printf("FAILED system.set_dev_alias: no reply to an alias of %d characters\n", TPLINK_KASA_ALIAS_SIZE);
+        return false;
+    }
+
+    tplink_kasa_decrypt_buffer((uint8_t *) buffer, reply_len);
+    cJSON_Context heap_context;
+    cJSON_InitContext(&heap_context, NULL);
+    cJSON * reply = cJSON_ParseCtx(&heap_context, buffer, reply_len);
+    const cJSON * result = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(reply, "system"),
+            "set_dev_alias");
+    const cJSON * err_code = cJSON_GetObjectItemCaseSensitive(result, "err_code");
+    const bool refused = cJSON_IsNumber(err_code) && err_code->valueint == -3;
+    printf("%s system.set_dev_alias: alias of %d characters answered with err_code %d\n", refused ? "ok" : "FAILED",
+            TPLINK_KASA_ALIAS_SIZE, cJSON_IsNumber(err_code) ? err_code->valueint : 0);
+    cJSON_DeleteCtx(&heap_context, reply);
+    return refused;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s kasa_commands.schema\n", argv[0]);
+        return 2;
+    }
+    FILE * schema = fopen(argv[1], "r");
+    if (schema == NULL) {
+        perror(argv[1]);
+        return 2;
+    }
+
+    /* the device as the firmware sets it up, without the network, with a full day of history and a full task table */
+    memstats_init();
+    taskstats_init();
+    history_init();
+    sampler_start();
+    tplink_kasa_init();
+    for (int i = 0; i < TASKSTATS_MAX_TASKS; i++) {
+        taskstats_register(xTaskGetCurrentTaskHandle(), task_names[i], CONFIG_PROCESSING_TASK_STACK_SIZE);
+    }
+    for (int i = 0; i < HISTORY_SAMPLES; i++) {
+        history_record(21.0f + (i % 40) / 10.0f, 45.0f + (i % 20) / 10.0f);
+    }
+
+    cJSON_Arena json_arena;
+    cJSON_Context json_context;
+    cJSON_InitArena(&json_arena, arena_buffer, sizeof(arena_buffer));
+    cJSON_InitContextWithArena(&json_context, &json_arena);
+    json_context.max_depth = TPLINK_KASA_MAX_DEPTH;
+    json_context.max_length = PIPELINE_BUFFER_SIZE;
+
+    /* a command starts a line as module.method, the ones taking request fields follow it with a { */
+    int checked = 0;
+    int failed = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), schema) != NULL) {
+        char module[TEST_MAX_NAME];
+        char method[TEST_MAX_NAME];
+        char rest[2] = "";
+        if (!isalpha((unsigned char) line[0])
+                || sscanf(line, "%63[a-z_].%63[a-z_] %1s", module, method, rest) < 2 || rest[0] == '{') {
+            continue;
+        }
+        checked++;
+        failed += !check_command(&json_context, &json_arena, module, method);
+    }
+    fclose(schema);
+    failed += !check_oversize_alias(&json_context, &json_arena);
+
+    printf("%d commands over UDP: %s\n", checked, checked > 0 && failed == 0 ? "passed" : "FAILED");
+    return checked > 0 && failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/**
+ * @file Heap test of the request path: processes every Kasa command over and over under the per-request accounting of
+ * memstats and fails if a request leaks, if the live bytes of a subsystem grow once the first requests have been
+ * served or if a request peaks above CONFIG_MEMSTATS_REQUEST_PEAK_LIMIT
+ *
+ * The cJSON context allocates through memstats rather than from an arena like the processing task does, so that a
+ * tree that is not deleted shows up as a leak instead of being dropped with the arena. Replies over TCP are streamed
+ * to a sink, over UDP they are left in the buffer, each command is sent both ways.
+ *
+ * Usage: memstats_test [-n iterations]
+ */
+
+/* system includes */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* local includes */
+#include "cJSON.h"
+#include "history.h"
+#include "memstats.h"
+#include "pipeline.h"
+#include "sampler.h"
+#include "tplink_kasa.h"
+
+/* a warm-up pass builds whatever is built once, such as the sysinfo reply cache */
+#define TEST_WARM_UP_ITERATIONS 1
+
+static const char * const commands[] = {
+    "{\"system\":{\"get_sysinfo\":{}}}",
+    "{\"system\":{\"set_dev_alias\":{\"alias\":\"memstats test\"}}}",
+    "{\"emeter\":{\"get_daystat\":{\"year\":2026,\"month\":10}}}",
+    "{\"diag\":{\"get_heap_stats\":{}}}",
+    "{\"sensor\":{\"get_history\":{}}}",
+    "{\"sensor\":{\"get_reading\":{}}}",
+    "{\"diag\":{\"get_task_stats\":{}}}",
+    "{\"diag\":{\"get_server_stats\":{}}}",
+    "{\"diag\":{\"get_boot_trace\":{}}}",
+    "{\"diag\":{\"get_trace\":{}}}",
+    /* malformed and unknown requests are dropped, which must not leak either */
+    "{\"system\":{\"get_sysinfo\":",
+    "{\"nothing\":{\"known\":{}}}",
+};
+
+#define COMMAND_COUNT (sizeof(commands) / sizeof(commands[0]))
+
+static void * CJSON_CDECL context_malloc(void * userdata, size_t size)
+{
+    return memstats_malloc(MEMSTATS_TAG_CJSON, size);
+}
+
+static void CJSON_CDECL context_free(void * userdata, void * pointer)
+{
+    memstats_free(pointer);
+}
+
+static bool sink_write(void * userdata, const char * data, size_t length)
+{
+    *(size_t *) userdata += length;
+    return true;
+}
+
+/* encrypt a request the way a client sends it, with the length header over TCP */
+static int encode_request(const char * json, char * buffer, const bool include_header)
+{
+    const int length = strlen(json);
+    const int header_len = include_header ? 4 : 0;
+    if (include_header) {
+        buffer[0] = length >> 24;
+        buffer[1] = length >> 16;
+        buffer[2] = length >> 8;
+        buffer[3] = length;
+    }
+    memcpy(buffer + header_len, json, length);
+    tplink_kasa_encrypt_buffer((uint8_t *) buffer + header_len, length);
+    return header_len + length;
+}
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-n iterations]\n"
+            "  -n  passes over every command and transport (default 200)\n", program);
+}
+
+int main(int argc, char * argv[])
+{
+    int iterations = 200;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:h")) != -1) {
+        switch (option) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (iterations < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    /* the device as the firmware sets it up, without the network, with a full day of history */
+    memstats_init();
+    history_init();
+    sampler_start();
+    tplink_kasa_init();
+    for (int i = 0; i < HISTORY_SAMPLES; i++) {
+        history_record(21.0f + (i % 40) / 10.0f, 45.0f + (i % 20) / 10.0f);
+    }
+
+    const cJSON_Allocator allocator = { context_malloc, context_free, NULL, NULL };
+    cJSON_Context json_context;
+    cJSON_InitContext(&json_context, &allocator);
+    json_context.max_depth = TPLINK_KASA_MAX_DEPTH;
+    json_context.max_length = PIPELINE_BUFFER_SIZE;
+
+    static char buffer[PIPELINE_BUFFER_SIZE];
+    size_t streamed = 0;
+    const tplink_kasa_stream_t stream = { .write = sink_write, .userdata = &streamed };
+    memstats_counters_t settled[MEMSTATS_TAG_COUNT];
+    uint32_t peaks[COMMAND_COUNT][2] = { { 0 } };
+    uint32_t failures = 0;
+
+    for (int iteration = 0; iteration < TEST_WARM_UP_ITERATIONS + iterations; iteration++) {
+        if (iteration == TEST_WARM_UP_ITERATIONS) {
+            for (int tag = 0; tag < MEMSTATS_TAG_COUNT; tag++) {
+                memstats_get(tag, &settled[tag]);
+            }
+        }
+        for (size_t command = 0; command < COMMAND_COUNT; command++) {
+            for (int tcp = 0; tcp < 2; tcp++) {
+                const int length = encode_request(commands[command], buffer, tcp);
+                memstats_request_t request;
+                memstats_request_begin(&request);
+                tplink_kasa_process_buffer(&json_context, buffer, length, sizeof(buffer), tcp, tcp ? &stream : NULL);
+                const bool within_limits = memstats_request_end(&request);
+                if (request.counters.peak_bytes > peaks[command][tcp]) {
+                    peaks[command][tcp] = request.counters.peak_bytes;
+                }
+                if ( !within_limits ) {
+                    fprintf(stderr, "%s over %s: %u bytes left, peak %u bytes\n", commands[command], tcp ? "TCP" : "UDP",
+                            (unsigned) request.counters.live_bytes, (unsigned) request.counters.peak_bytes);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    static const char * const tag_names[MEMSTATS_TAG_COUNT] = { "cjson", "kasa" };
+    for (int tag = 0; tag < MEMSTATS_TAG_COUNT; tag++) {
+        memstats_counters_t counters;
+        memstats_get(tag, &counters);
+        printf("%-5s %u allocations, %u live bytes after warm-up, %u now\n", tag_names[tag],
+                (unsigned) counters.allocations, (unsigned) settled[tag].live_bytes, (unsigned) counters.live_bytes);
+        if (counters.live_bytes > settled[tag].live_bytes) {
+            fprintf(stderr, "%s grew by %u bytes over %d iterations\n", tag_names[tag],
+                    (unsigned) (counters.live_bytes - settled[tag].live_bytes), iterations);
+            failures++;
+        }
+    }
+    for (size_t command = 0; command < COMMAND_COUNT; command++) {
+        printf("peak UDP %5u TCP %5u  %s\n", (unsigned) peaks[command][0], (unsigned) peaks[command][1],
+                commands[command]);
+    }
+    printf("%u requests, %zu bytes streamed, limit %d bytes: %s\n",
+            (unsigned) ((TEST_WARM_UP_ITERATIONS + iterations) * COMMAND_COUNT * 2), streamed,
+            CONFIG_MEMSTATS_REQUEST_PEAK_LIMIT, failures == 0 ? "passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file Cost of looking up a member of a get_sysinfo reply through a compiled JSON Pointer, cJSONUtils_GetPath,
+ * against nested cJSON_GetObjectItem and cJSON_GetObjectItemCaseSensitive calls and cJSONUtils_GetPointer
+ *
+ * Every way must find the same item before it is timed.
+ *
+ * Usage: pointer_bench [-n lookups]
+ */
+
+/* system includes */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "cJSON.h"
+#include "cJSON_Utils.h"
+
+#define BENCH_MAX_TOKENS 4
+
+typedef struct {
+    const char * pointer;
+    const char * tokens[BENCH_MAX_TOKENS];
+} bench_lookup_t;
+
+typedef enum {
+    LOOKUP_NESTED,
+    LOOKUP_NESTED_CASE_SENSITIVE,
+    LOOKUP_POINTER,
+    LOOKUP_PATH,
+} lookup_t;
+
+static const char sysinfo[] =
+    "{\"system\":{\"get_sysinfo\":{\"sw_ver\":\"1.0.0 Build 000001 Rel.000001\",\"hw_ver\":\"1.0\","
+    "\"model\":\"KL130B(UN)\",\"deviceId\":\"8012C9D8A4E1F0B2C3D4E5F60718293A4B5C6D7E\","
+    "\"oemId\":\"E45F76AD3AF13E60B58D6F68739CD7E5\",\"hwId\":\"1E97141B9F0E939BD8F9679F0B6167C8\",\"rssi\":-71,"
+    "\"latitude_i\":0,\"longitude_i\":0,\"alias\":\"Living room\",\"status\":\"new\","
+    "\"description\":\"WiFi BLE Smart Bulb Bridge\",\"mic_type\":\"IOT.SMARTBULB\",\"mic_mac\":\"246F28A1B2C3\","
+    "\"dev_state\":\"normal\",\"is_factory\":false,\"disco_ver\":\"1.0\","
+    "\"ctrl_protocols\":{\"name\":\"Linkie\",\"version\":\"1.0\"},\"active_mode\":\"none\",\"is_dimmable\":1,"
+    "\"is_color\":1,\"is_variable_color_temp\":1,\"light_state\":{\"on_off\":1},\"err_code\":0}}}";
+
+/* the ones tplink_kasa reads from the device state, and the last member of get_sysinfo */
+static const bench_lookup_t lookups[] = {
+    { "/system/get_sysinfo/light_state/on_off", { "system", "get_sysinfo", "light_state", "on_off" } },
+    { "/system/get_sysinfo/alias", { "system", "get_sysinfo", "alias" } },
+    { "/system/get_sysinfo/err_code", { "system", "get_sysinfo", "err_code" } },
+};
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-n lookups]\n"
+            "  -n  lookups of each pointer each way (default 1000000)\n", program);
+}
+
+/**
+ * @brief Look up the item of bench_lookup in tree one way, path being its compiled pointer
+ */
+static cJSON * lookup(lookup_t way, cJSON * tree, const bench_lookup_t * bench_lookup, const cJSONUtils_Path * path)
+{
+    cJSON * item = tree;
+    switch (way) {
+        case LOOKUP_NESTED:
+            for (int i = 0; i < BENCH_MAX_TOKENS && bench_lookup->tokens[i] != NULL; i++) {
+                item = cJSON_GetObjectItem(item, bench_lookup->tokens[i]);
+            }
+            return item;
+        case LOOKUP_NESTED_CASE_SENSITIVE:
+            for (int i = 0; i < BENCH_MAX_TOKENS && bench_lookup->tokens[i] != NULL; i++) {
+                item = cJSON_GetObjectItemCaseSensitive(item, bench_lookup->tokens[i]);
+            }
+            return item;
+        case LOOKUP_POINTER:
+            return cJSONUtils_GetPointer(tree, bench_lookup->pointer);
+        case LOOKUP_PATH:
+            return cJSONUtils_GetPath(tree, path);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Time lookups one way
+ * @return Nanoseconds per lookup
+ */
+static double lookup_ns(lookup_t way, cJSON * tree, const bench_lookup_t * bench_lookup, const cJSONUtils_Path * path,
+        int iterations)
+{
+    const int64_t begin_us = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        lookup(way, tree, bench_lookup, path);
+    }
+    return (esp_timer_get_time() - begin_us) * 1e3 / iterations;
+}
+
+int main(int argc, char * argv[])
+{
+    int iterations = 1000000;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:h")) != -1) {
+        switch (option) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (iterations < 1 || optind < argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    cJSON * tree = cJSON_Parse(sysinfo);
+    if (tree == NULL) {
+        fprintf(stderr, "failed to parse the get_sysinfo reply\n");
+        return 1;
+    }
+
+    bool passed = true;
+    printf("%-40s %10s %10s %10s %10s\n", "pointer", "nested ns", "case ns", "pointer ns", "path ns");
+    for (size_t i = 0; i < sizeof(lookups) / sizeof(lookups[0]); i++) {
+        const bench_lookup_t * bench_lookup = &lookups[i];
+        cJSONUtils_Path * path = cJSONUtils_CompilePath(bench_lookup->pointer);
+        const cJSON * expected = lookup(LOOKUP_NESTED_CASE_SENSITIVE, tree, bench_lookup, path);
+        if (path == NULL || expected == NULL || lookup(LOOKUP_NESTED, tree, bench_lookup, path) != expected
+                || lookup(LOOKUP_POINTER, tree, bench_lookup, path) != expected
+                || lookup(LOOKUP_PATH, tree, bench_lookup, path) != expected) {
+            printf("%-40s FAILED: the lookups disagree\n", bench_lookup->pointer);
+            passed = false;
+        } else {
+            printf("%-40s %10.1f %10.1f %10.1f %10.1f\n", bench_lookup->pointer,
+                    lookup_ns(LOOKUP_NESTED, tree, bench_lookup, path, iterations),
+                    lookup_ns(LOOKUP_NESTED_CASE_SENSITIVE, tree, bench_lookup, path, iterations),
+                    lookup_ns(LOOKUP_POINTER, tree, bench_lookup, path, iterations),
+                    lookup_ns(LOOKUP_PATH, tree, bench_lookup, path, iterations));
+        }
+        cJSONUtils_FreePath(path);
+    }
+
+    cJSON_Delete(tree);
+    return passed ? 0 : 1;
+}
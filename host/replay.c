@@ -0,0 +1,1054 @@
+/**
+ * @file Record and replay of Kasa traffic, for protocol regression tests and for benchmarking on a realistic workload
+ *
+ * Traffic is taken from pcap files (tcpdump -w, Ethernet, Linux cooked or raw IP links) or captured live from an
+ * interface, and kept as a sequence of messages: the requests controllers sent to port 9999 and the replies devices
+ * sent back, over UDP or reassembled from TCP. Replaying sends every request either straight into
+ * tplink_kasa_process_buffer, which measures nothing but the processing, or to a running server or device, at the
+ * recorded pace, faster, or back to back. Each reply is checked against the recorded one and the latency of every
+ * request is kept, for a summary per command and optionally a CSV file.
+ *
+ * Recordings are in a framed format, little endian: the magic "KASAREC1", then for every message
+ *
+ *     time_us:8  client_address:4 (network order)  client_port:2  transport:1 (0 UDP, 1 TCP)
+ *     direction:1 (0 request, 1 reply)  length:4  data:length (as sent, so TCP messages include their header)
+ *
+ * Usage: kasa_replay record [-i interface] [-p port] [-d duration_s] output.krec
+ *        kasa_replay convert [-p port] input.pcap output.krec
+ *        kasa_replay replay [-x speed] [-n repeat] [-v exact|keys|none] [-a address [-p port]] [-l latency.csv]
+ *                           input.krec|input.pcap
+ */
+
+/* system includes */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <esp_log.h>
+
+/* local includes */
+#include "cJSON.h"
+#include "history.h"
+#include "memstats.h"
+#include "sampler.h"
+#include "tplink_kasa.h"
+
+#define KASA_PORT 9999
+#define KASA_CIPHER_KEY 171
+#define RECORD_MAGIC "KASAREC1"
+#define RECORD_HEADER_SIZE 20
+
+/* largest message kept, requests and replies are not larger than the device's buffers */
+#define REPLAY_MAX_MESSAGE 65536
+/* TCP streams reassembled at the same time, the least recently active one is dropped for a new one */
+#define REPLAY_MAX_FLOWS 1024
+/* a reply belongs to the first request before it from the same client, if no more than this many messages apart */
+#define REPLAY_PAIR_WINDOW 1024
+#define REPLAY_BUFFER_SIZE 16384
+#define REPLAY_TIMEOUT_MS 2000
+#define REPLAY_MAX_COMMANDS 32
+
+enum transport
+{
+    TRANSPORT_UDP,
+    TRANSPORT_TCP,
+};
+
+enum direction
+{
+    DIRECTION_REQUEST,
+    DIRECTION_REPLY,
+};
+
+enum verify
+{
+    VERIFY_NONE,
+    VERIFY_KEYS,
+    VERIFY_EXACT,
+};
+
+typedef struct
+{
+    int64_t time_us;
+    uint32_t client_address;    /* network order */
+    uint16_t client_port;
+    uint8_t transport;
+    uint8_t direction;
+    uint32_t length;
+    uint8_t * data;
+} record_t;
+
+typedef struct
+{
+    record_t * records;
+    size_t count;
+    size_t capacity;
+} capture_t;
+
+/* one direction of one TCP connection being reassembled */
+struct flow
+{
+    bool used;
+    uint32_t client_address;
+    uint16_t client_port;
+    uint8_t direction;
+    bool synchronised;          /* next_seq is known */
+    uint32_t next_seq;
+    int64_t first_us;           /* when the message being reassembled started */
+    int64_t last_us;
+    uint32_t length;
+    uint8_t * buffer;
+};
+
+/* a request with the reply recorded for it, and the name of its command for the summary */
+struct exchange
+{
+    const record_t * request;
+    const record_t * reply;
+    int command;
+};
+
+struct command_stats
+{
+    char name[48];
+    uint32_t * latencies;       /* ns */
+    size_t count;
+    size_t capacity;
+};
+
+static struct flow flows[REPLAY_MAX_FLOWS];
+static uint16_t kasa_port = KASA_PORT;
+
+static struct command_stats commands[REPLAY_MAX_COMMANDS];
+static int command_count = 0;
+
+static volatile sig_atomic_t stop = 0;
+
+static void request_stop(int signal_number)
+{
+    (void) signal_number;
+    stop = 1;
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static int64_t now_us(void)
+{
+    return now_ns() / 1000;
+}
+
+static uint16_t read_be16(const uint8_t * data)
+{
+    return (uint16_t) (data[0] << 8 | data[1]);
+}
+
+static uint32_t read_be32(const uint8_t * data)
+{
+    return (uint32_t) data[0] << 24 | (uint32_t) data[1] << 16 | (uint32_t) data[2] << 8 | data[3];
+}
+
+static uint64_t read_le(const uint8_t * data, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = value << 8 | data[i];
+    }
+    return value;
+}
+
+static void write_le(uint8_t * data, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        data[i] = value >> (8 * i);
+    }
+}
+
+static void * allocate(size_t size)
+{
+    void * memory = malloc(size);
+    if (memory == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return memory;
+}
+
+static void capture_add(capture_t * capture, int64_t time_us, uint32_t client_address, uint16_t client_port,
+        uint8_t transport, uint8_t direction, const uint8_t * data, uint32_t length)
+{
+    if (capture->count == capture->capacity) {
+        capture->capacity = capture->capacity ? capture->capacity * 2 : 1024;
+        capture->records = realloc(capture->records, capture->capacity * sizeof(record_t));
+        if (capture->records == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    record_t * record = &capture->records[capture->count++];
+    record->time_us = time_us;
+    record->client_address = client_address;
+    record->client_port = client_port;
+    record->transport = transport;
+    record->direction = direction;
+    record->length = length;
+    record->data = allocate(length > 0 ? length : 1);
+    memcpy(record->data, data, length);
+}
+
+static struct flow * find_flow(uint32_t client_address, uint16_t client_port, uint8_t direction, int64_t time_us)
+{
+    struct flow * oldest = &flows[0];
+    struct flow * unused = NULL;
+    for (int i = 0; i < REPLAY_MAX_FLOWS; i++) {
+        struct flow * flow = &flows[i];
+        if ( !flow->used ) {
+            unused = unused ? unused : flow;
+            continue;
+        }
+        if (flow->client_address == client_address && flow->client_port == client_port && flow->direction == direction) {
+            return flow;
+        }
+        if (flow->last_us < oldest->last_us) {
+            oldest = flow;
+        }
+    }
+
+    struct flow * flow = unused ? unused : oldest;
+    uint8_t * buffer = flow->buffer ? flow->buffer : allocate(REPLAY_MAX_MESSAGE);
+    memset(flow, 0, sizeof(*flow));
+    flow->used = true;
+    flow->client_address = client_address;
+    flow->client_port = client_port;
+    flow->direction = direction;
+    flow->last_us = time_us;
+    flow->buffer = buffer;
+    return flow;
+}
+
+/* append a segment to its stream and take every complete framed message off the front of it */
+static void flow_segment(capture_t * capture, struct flow * flow, int64_t time_us, uint32_t seq, const uint8_t * payload,
+        uint32_t length)
+{
+    flow->last_us = time_us;
+    if ( !flow->synchronised ) {
+        flow->synchronised = true;
+        flow->next_seq = seq;
+    }
+
+    const int32_t offset = (int32_t) (seq - flow->next_seq);
+    if (offset > 0) {
+        /* data was not captured, the stream is picked up again at this segment */
+        flow->length = 0;
+        flow->next_seq = seq;
+    } else if (offset < 0) {
+        /* retransmitted, only what goes beyond the stream so far is new */
+        if ((uint32_t) -offset >= length) {
+            return;
+        }
+        payload += -offset;
+        length -= -offset;
+    }
+    if (flow->length + length > REPLAY_MAX_MESSAGE) {
+        flow->length = 0;
+        flow->next_seq += length;
+        return;
+    }
+
+    if (flow->length == 0) {
+        flow->first_us = time_us;
+    }
+    memcpy(flow->buffer + flow->length, payload, length);
+    flow->length += length;
+    flow->next_seq += length;
+
+    while (flow->length >= 4) {
+        const uint32_t message_len = 4 + read_be32(flow->buffer);
+        if (message_len > REPLAY_MAX_MESSAGE) {
+            flow->length = 0;
+            return;
+        }
+        if (flow->length < message_len) {
+            return;
+        }
+        capture_add(capture, flow->first_us, flow->client_address, flow->client_port, TRANSPORT_TCP, flow->direction,
+                flow->buffer, message_len);
+        flow->length -= message_len;
+        memmove(flow->buffer, flow->buffer + message_len, flow->length);
+        flow->first_us = time_us;
+    }
+}
+
+/* take the Kasa messages out of one IPv4 packet */
+static void capture_ip(capture_t * capture, int64_t time_us, const uint8_t * packet, size_t length)
+{
+    if (length < 20 || (packet[0] >> 4) != 4) {
+        return;
+    }
+    const size_t header_len = (packet[0] & 0x0F) * 4;
+    const size_t total_len = read_be16(packet + 2);
+    /* fragments are not reassembled, Kasa messages fit in one packet */
+    if (header_len < 20 || total_len < header_len || total_len > length || (read_be16(packet + 6) & 0x3FFF) != 0) {
+        return;
+    }
+    const uint8_t protocol = packet[9];
+    uint32_t source, destination;
+    memcpy(&source, packet + 12, 4);
+    memcpy(&destination, packet + 16, 4);
+    const uint8_t * segment = packet + header_len;
+    const size_t segment_len = total_len - header_len;
+
+    if (protocol == IPPROTO_UDP && segment_len >= 8) {
+        const uint16_t source_port = read_be16(segment);
+        const uint16_t destination_port = read_be16(segment + 2);
+        if (destination_port == kasa_port) {
+            capture_add(capture, time_us, source, source_port, TRANSPORT_UDP, DIRECTION_REQUEST, segment + 8,
+                    segment_len - 8);
+        } else if (source_port == kasa_port) {
+            capture_add(capture, time_us, destination, destination_port, TRANSPORT_UDP, DIRECTION_REPLY, segment + 8,
+                    segment_len - 8);
+        }
+    } else if (protocol == IPPROTO_TCP && segment_len >= 20) {
+        const uint16_t source_port = read_be16(segment);
+        const uint16_t destination_port = read_be16(segment + 2);
+        const uint32_t seq = read_be32(segment + 4);
+        const size_t data_offset = (segment[12] >> 4) * 4;
+        const uint8_t flags = segment[13];
+        if (data_offset < 20 || data_offset > segment_len) {
+            return;
+        }
+
+        uint8_t direction;
+        uint32_t client_address;
+        uint16_t client_port;
+        if (destination_port == kasa_port) {
+            direction = DIRECTION_REQUEST;
+            client_address = source;
+            client_port = source_port;
+        } else if (source_port == kasa_port) {
+            direction = DIRECTION_REPLY;
+            client_address = destination;
+            client_port = destination_port;
+        } else {
+            return;
+        }
+
+        struct flow * flow = find_flow(client_address, client_port, direction, time_us);
+        if (flags & 0x02) {
+            /* SYN: a new connection on this port pair, its data starts after the SYN */
+            flow->length = 0;
+            flow->synchronised = true;
+            flow->next_seq = seq + 1;
+        }
+        if (segment_len > data_offset) {
+            flow_segment(capture, flow, time_us, seq, segment + data_offset, segment_len - data_offset);
+        }
+        if (flags & 0x05) {
+            /* FIN or RST */
+            flow->used = false;
+        }
+    }
+}
+
+static bool read_pcap(FILE * file, capture_t * capture)
+{
+    uint8_t header[24];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        return false;
+    }
+    const uint32_t magic = read_le(header, 4);
+    bool swapped;
+    bool nanoseconds;
+    if (magic == 0xA1B2C3D4 || magic == 0xA1B23C4D) {
+        swapped = false;
+        nanoseconds = magic == 0xA1B23C4D;
+    } else if (magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1) {
+        swapped = true;
+        nanoseconds = magic == 0x4D3CB2A1;
+    } else {
+        fprintf(stderr, "Not a pcap file (pcapng is not supported, convert it with editcap -F pcap)\n");
+        return false;
+    }
+#define PCAP_U32(data) ((uint32_t) (swapped ? read_be32(data) : read_le(data, 4)))
+    const uint32_t link_type = PCAP_U32(header + 20) & 0xFFFF;
+
+    uint8_t * packet = allocate(262144);
+    uint8_t record[16];
+    while (fread(record, 1, sizeof(record), file) == sizeof(record)) {
+        const int64_t time_us = PCAP_U32(record) * 1000000LL + PCAP_U32(record + 4) / (nanoseconds ? 1000 : 1);
+        const uint32_t captured = PCAP_U32(record + 8);
+        if (captured > 262144 || fread(packet, 1, captured, file) != captured) {
+            break;
+        }
+
+        /* skip to the IPv4 header */
+        const uint8_t * ip = NULL;
+        size_t ip_len = 0;
+        if (link_type == 1 && captured >= 14) {
+            size_t offset = 12;
+            uint16_t ether_type = read_be16(packet + offset);
+            while ((ether_type == 0x8100 || ether_type == 0x88A8) && captured >= offset + 6) {
+                offset += 4;
+                ether_type = read_be16(packet + offset);
+            }
+            if (ether_type == 0x0800) {
+                ip = packet + offset + 2;
+                ip_len = captured - offset - 2;
+            }
+        } else if (link_type == 113 && captured >= 16 && read_be16(packet + 14) == 0x0800) {
+            ip = packet + 16;
+            ip_len = captured - 16;
+        } else if (link_type == 276 && captured >= 20 && read_be16(packet) == 0x0800) {
+            ip = packet + 20;
+            ip_len = captured - 20;
+        } else if (link_type == 101 || link_type == 12 || link_type == 228) {
+            ip = packet;
+            ip_len = captured;
+        } else if (link_type == 0 && captured >= 4) {
+            ip = packet + 4;
+            ip_len = captured - 4;
+        }
+        if (ip != NULL) {
+            capture_ip(capture, time_us, ip, ip_len);
+        }
+    }
+#undef PCAP_U32
+    free(packet);
+    return true;
+}
+
+static bool read_records(FILE * file, capture_t * capture)
+{
+    uint8_t header[RECORD_HEADER_SIZE];
+    uint8_t * data = allocate(REPLAY_MAX_MESSAGE);
+    bool complete = true;
+    while (true) {
+        const size_t header_read = fread(header, 1, sizeof(header), file);
+        if (header_read == 0) {
+            break;
+        }
+        const uint32_t length = read_le(header + 16, 4);
+        if (header_read != sizeof(header) || length > REPLAY_MAX_MESSAGE || fread(data, 1, length, file) != length) {
+            complete = false;
+            break;
+        }
+        uint32_t client_address;
+        memcpy(&client_address, header + 8, 4);
+        capture_add(capture, (int64_t) read_le(header, 8), client_address, read_le(header + 12, 2), header[14],
+                header[15], data, length);
+    }
+    free(data);
+    return complete;
+}
+
+static void capture_free(capture_t * capture)
+{
+    for (size_t i = 0; i < capture->count; i++) {
+        free(capture->records[i].data);
+    }
+    free(capture->records);
+    memset(capture, 0, sizeof(*capture));
+}
+
+static bool load_capture(const char * path, capture_t * capture)
+{
+    FILE * file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char magic[8];
+    bool loaded;
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, RECORD_MAGIC, sizeof(magic)) == 0) {
+        loaded = read_records(file, capture);
+        if ( !loaded ) {
+            fprintf(stderr, "%s is truncated, replaying the %zu complete messages\n", path, capture->count);
+            loaded = true;
+        }
+    } else {
+        rewind(file);
+        loaded = read_pcap(file, capture);
+    }
+    fclose(file);
+    return loaded;
+}
+
+static bool save_capture(const char * path, const capture_t * capture)
+{
+    FILE * file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    bool written = fwrite(RECORD_MAGIC, 1, 8, file) == 8;
+    for (size_t i = 0; written && i < capture->count; i++) {
+        const record_t * record = &capture->records[i];
+        uint8_t header[RECORD_HEADER_SIZE];
+        write_le(header, record->time_us, 8);
+        memcpy(header + 8, &record->client_address, 4);
+        write_le(header + 12, record->client_port, 2);
+        header[14] = record->transport;
+        header[15] = record->direction;
+        write_le(header + 16, record->length, 4);
+        written = fwrite(header, 1, sizeof(header), file) == sizeof(header)
+            && fwrite(record->data, 1, record->length, file) == record->length;
+    }
+    if (fclose(file) != 0 || !written) {
+        fprintf(stderr, "Unable to write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+/* decrypt a message as sent, returning NULL if it is not a complete one */
+static char * decrypt_message(const uint8_t * data, uint32_t length, bool include_header)
+{
+    if (include_header) {
+        if (length < 4 || read_be32(data) != length - 4) {
+            return NULL;
+        }
+        data += 4;
+        length -= 4;
+    }
+    char * text = allocate(length + 1);
+    uint8_t key = KASA_CIPHER_KEY;
+    for (uint32_t i = 0; i < length; i++) {
+        text[i] = data[i] ^ key;
+        key = data[i];
+    }
+    text[length] = '\0';
+    return text;
+}
+
+/* module.method of the first command in a request */
+static int command_of(const record_t * request)
+{
+    char name[sizeof(commands[0].name)] = "invalid";
+    char * text = decrypt_message(request->data, request->length, request->transport == TRANSPORT_TCP);
+    cJSON * json = text ? cJSON_Parse(text) : NULL;
+    if (json != NULL && json->child != NULL) {
+        snprintf(name, sizeof(name), "%s.%s", json->child->string,
+                json->child->child && json->child->child->string ? json->child->child->string : "");
+    }
+    cJSON_Delete(json);
+    free(text);
+
+    for (int i = 0; i < command_count; i++) {
+        if (strcmp(commands[i].name, name) == 0) {
+            return i;
+        }
+    }
+    if (command_count == REPLAY_MAX_COMMANDS) {
+        return REPLAY_MAX_COMMANDS - 1;
+    }
+    snprintf(commands[command_count].name, sizeof(commands[0].name), "%s",
+            command_count == REPLAY_MAX_COMMANDS - 1 ? "other" : name);
+    return command_count++;
+}
+
+static size_t pair_exchanges(const capture_t * capture, struct exchange * exchanges)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < capture->count; i++) {
+        const record_t * request = &capture->records[i];
+        if (request->direction != DIRECTION_REQUEST) {
+            continue;
+        }
+        struct exchange * exchange = &exchanges[count++];
+        exchange->request = request;
+        exchange->reply = NULL;
+        exchange->command = command_of(request);
+        for (size_t j = i + 1; j < capture->count && j <= i + REPLAY_PAIR_WINDOW; j++) {
+            const record_t * other = &capture->records[j];
+            if (other->client_address != request->client_address || other->client_port != request->client_port
+                    || other->transport != request->transport) {
+                continue;
+            }
+            if (other->direction == DIRECTION_REQUEST) {
+                break;
+            }
+            exchange->reply = other;
+            break;
+        }
+    }
+    return count;
+}
+
+/* same shape: the same keys with values of the same types, arrays compared by their first element */
+static bool same_keys(const cJSON * a, const cJSON * b)
+{
+    if ((a->type & 0xFF) != (b->type & 0xFF) && !(cJSON_IsBool(a) && cJSON_IsBool(b))) {
+        return false;
+    }
+    if (cJSON_IsArray(a)) {
+        return a->child == NULL || b->child == NULL || same_keys(a->child, b->child);
+    }
+    if ( !cJSON_IsObject(a) ) {
+        return true;
+    }
+    if (cJSON_GetArraySize(a) != cJSON_GetArraySize(b)) {
+        return false;
+    }
+    for (const cJSON * child = a->child; child != NULL; child = child->next) {
+        const cJSON * other = cJSON_GetObjectItemCaseSensitive(b, child->string);
+        if (other == NULL || !same_keys(child, other)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool verify_reply(const struct exchange * exchange, const uint8_t * reply, uint32_t reply_len, enum verify verify,
+        bool * mismatch_printed)
+{
+    if (verify == VERIFY_NONE || exchange->reply == NULL) {
+        return true;
+    }
+    const bool include_header = exchange->request->transport == TRANSPORT_TCP;
+    char * expected_text = decrypt_message(exchange->reply->data, exchange->reply->length, include_header);
+    char * actual_text = decrypt_message(reply, reply_len, include_header);
+    cJSON * expected = expected_text ? cJSON_Parse(expected_text) : NULL;
+    cJSON * actual = actual_text ? cJSON_Parse(actual_text) : NULL;
+
+    bool matched;
+    if (expected == NULL) {
+        /* nothing to compare with */
+        matched = true;
+    } else if (actual == NULL) {
+        matched = false;
+    } else if (verify == VERIFY_EXACT) {
+        matched = cJSON_Compare(expected, actual, true);
+    } else {
+        matched = same_keys(expected, actual);
+    }
+
+    if ( !matched && !*mismatch_printed ) {
+        /* the first one is shown, the rest are counted */
+        fprintf(stderr, "%s reply differs:\n  recorded %.400s\n  replayed %.400s\n", commands[exchange->command].name,
+                expected_text ? expected_text : "(incomplete)", actual_text ? actual_text : "(incomplete)");
+        *mismatch_printed = true;
+    }
+    cJSON_Delete(expected);
+    cJSON_Delete(actual);
+    free(expected_text);
+    free(actual_text);
+    return matched;
+}
+
+static void record_latency(struct command_stats * stats, uint32_t latency_ns)
+{
+    if (stats->count == stats->capacity) {
+        stats->capacity = stats->capacity ? stats->capacity * 2 : 1024;
+        stats->latencies = realloc(stats->latencies, stats->capacity * sizeof(uint32_t));
+        if (stats->latencies == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    stats->latencies[stats->count++] = latency_ns;
+}
+
+static int compare_latency(const void * a, const void * b)
+{
+    const uint32_t x = *(const uint32_t *) a;
+    const uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void print_latencies(const char * name, uint32_t * latencies, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    qsort(latencies, count, sizeof(uint32_t), compare_latency);
+    printf("%-28s %8zu %8.1f %8.1f %8.1f %8.1f\n", name, count, latencies[count / 2] / 1e3,
+            latencies[count * 90 / 100] / 1e3, latencies[count * 99 / 100] / 1e3, latencies[count - 1] / 1e3);
+}
+
+/* the request is answered in process, by the same function that serves the device's sockets */
+static uint32_t process_in_process(cJSON_Context * json_context, cJSON_Arena * json_arena, const record_t * request,
+        uint8_t * buffer)
+{
+    if (request->length >= REPLAY_BUFFER_SIZE) {
+        return 0;
+    }
+    memcpy(buffer, request->data, request->length);
+    const int reply_len = tplink_kasa_process_buffer(json_context, (char *) buffer, request->length, REPLAY_BUFFER_SIZE,
+            request->transport == TRANSPORT_TCP, NULL);
+    cJSON_ArenaReset(json_arena);
+    return reply_len > 0 ? reply_len : 0;
+}
+
+static uint32_t process_udp(int udp_socket, const record_t * request, uint8_t * buffer)
+{
+    /* replies that arrived after their request timed out are not taken for this one */
+    while (recv(udp_socket, buffer, REPLAY_BUFFER_SIZE, MSG_DONTWAIT) >= 0) {
+    }
+    if (send(udp_socket, request->data, request->length, 0) < 0) {
+        return 0;
+    }
+    const int received = recv(udp_socket, buffer, REPLAY_BUFFER_SIZE, 0);
+    return received > 0 ? received : 0;
+}
+
+static uint32_t process_tcp(const struct sockaddr_in * address, const record_t * request, uint8_t * buffer)
+{
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return 0;
+    }
+    const struct timeval timeout = { .tv_sec = REPLAY_TIMEOUT_MS / 1000, .tv_usec = (REPLAY_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    uint32_t received = 0;
+    if (connect(sock, (const struct sockaddr *) address, sizeof(*address)) == 0
+            && send(sock, request->data, request->length, MSG_NOSIGNAL) == (ssize_t) request->length) {
+        while (received < REPLAY_BUFFER_SIZE) {
+            const ssize_t chunk = recv(sock, buffer + received, REPLAY_BUFFER_SIZE - received, 0);
+            if (chunk <= 0) {
+                break;
+            }
+            received += chunk;
+            if (received >= 4 && received >= 4 + read_be32(buffer)) {
+                break;
+            }
+        }
+    }
+    close(sock);
+    return received;
+}
+
+static void sleep_until(int64_t time_us)
+{
+    const int64_t remaining_us = time_us - now_us();
+    if (remaining_us > 0) {
+        const struct timespec delay = { .tv_sec = remaining_us / 1000000, .tv_nsec = (remaining_us % 1000000) * 1000 };
+        nanosleep(&delay, NULL);
+    }
+}
+
+static int replay(int argc, char * argv[])
+{
+    double speed = 1.0;
+    int repeat = 1;
+    enum verify verify = VERIFY_KEYS;
+    const char * address_text = NULL;
+    const char * latency_path = NULL;
+
+    int option;
+    while ((option = getopt(argc, argv, "x:n:v:a:p:l:")) != -1) {
+        switch (option) {
+            case 'x':
+                speed = atof(optarg);
+                break;
+            case 'n':
+                repeat = atoi(optarg);
+                break;
+            case 'v':
+                verify = strcmp(optarg, "exact") == 0 ? VERIFY_EXACT : strcmp(optarg, "none") == 0 ? VERIFY_NONE : VERIFY_KEYS;
+                break;
+            case 'a':
+                address_text = optarg;
+                break;
+            case 'p':
+                kasa_port = atoi(optarg);
+                break;
+            case 'l':
+                latency_path = optarg;
+                break;
+            default:
+                return 2;
+        }
+    }
+    if (optind != argc - 1 || repeat < 1 || speed < 0) {
+        return 2;
+    }
+
+    capture_t capture = { 0 };
+    if ( !load_capture(argv[optind], &capture) ) {
+        return 1;
+    }
+    struct exchange * exchanges = allocate((capture.count + 1) * sizeof(struct exchange));
+    const size_t exchange_count = pair_exchanges(&capture, exchanges);
+    if (exchange_count == 0) {
+        fprintf(stderr, "No requests to port %u in %s\n", kasa_port, argv[optind]);
+        return 1;
+    }
+
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons(kasa_port) };
+    int udp_socket = -1;
+    uint8_t * arena_buffer = NULL;
+    cJSON_Arena json_arena;
+    cJSON_Context json_context;
+    if (address_text != NULL) {
+        if (inet_pton(AF_INET, address_text, &address.sin_addr) != 1) {
+            return 2;
+        }
+        udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        const struct timeval timeout = { .tv_sec = REPLAY_TIMEOUT_MS / 1000, .tv_usec = (REPLAY_TIMEOUT_MS % 1000) * 1000 };
+        setsockopt(udp_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (connect(udp_socket, (const struct sockaddr *) &address, sizeof(address)) != 0) {
+            fprintf(stderr, "Unable to reach %s: %s\n", address_text, strerror(errno));
+            return 1;
+        }
+    } else {
+        /* the device as the firmware sets it up, without the network */
+        memstats_init();
+        history_init();
+        sampler_start();
+        tplink_kasa_init();
+        arena_buffer = allocate(CONFIG_KASA_CJSON_ARENA_SIZE);
+        cJSON_InitArena(&json_arena, arena_buffer, CONFIG_KASA_CJSON_ARENA_SIZE);
+        cJSON_InitContextWithArena(&json_context, &json_arena);
+    }
+
+    FILE * latency_file = NULL;
+    if (latency_path != NULL) {
+        latency_file = fopen(latency_path, "w");
+        if (latency_file == NULL) {
+            fprintf(stderr, "Unable to create %s: %s\n", latency_path, strerror(errno));
+            return 1;
+        }
+        fprintf(latency_file, "index,offset_us,transport,command,latency_us,result\n");
+    }
+
+    uint8_t * buffer = allocate(REPLAY_BUFFER_SIZE);
+    const int64_t first_us = exchanges[0].request->time_us;
+    const int64_t span_us = exchanges[exchange_count - 1].request->time_us - first_us;
+    uint64_t matched = 0, mismatched = 0, unanswered = 0, unrecorded = 0;
+    bool mismatch_printed = false;
+    const int64_t start_us = now_us();
+
+    for (int pass = 0; pass < repeat && !stop; pass++) {
+        for (size_t i = 0; i < exchange_count && !stop; i++) {
+            const struct exchange * exchange = &exchanges[i];
+            const int64_t offset_us = exchange->request->time_us - first_us;
+            if (speed > 0) {
+                sleep_until(start_us + (int64_t) ((pass * (span_us + 1000000LL) + offset_us) / speed));
+            }
+
+            const int64_t sent_ns = now_ns();
+            uint32_t reply_len;
+            if (address_text == NULL) {
+                reply_len = process_in_process(&json_context, &json_arena, exchange->request, buffer);
+            } else if (exchange->request->transport == TRANSPORT_UDP) {
+                reply_len = process_udp(udp_socket, exchange->request, buffer);
+            } else {
+                reply_len = process_tcp(&address, exchange->request, buffer);
+            }
+            const uint32_t latency_ns = now_ns() - sent_ns;
+
+            const char * result;
+            if (reply_len == 0) {
+                /* no reply is right when none was recorded */
+                result = exchange->reply == NULL ? "ok" : "no reply";
+                unanswered += exchange->reply != NULL;
+                matched += exchange->reply == NULL;
+            } else {
+                record_latency(&commands[exchange->command], latency_ns);
+                if (exchange->reply == NULL) {
+                    unrecorded++;
+                    result = "unrecorded";
+                } else if (verify_reply(exchange, buffer, reply_len, verify, &mismatch_printed)) {
+                    matched++;
+                    result = "ok";
+                } else {
+                    mismatched++;
+                    result = "mismatch";
+                }
+            }
+            if (latency_file != NULL) {
+                fprintf(latency_file, "%zu,%lld,%s,%s,%.3f,%s\n", pass * exchange_count + i, (long long) offset_us,
+                        exchange->request->transport == TRANSPORT_TCP ? "tcp" : "udp",
+                        commands[exchange->command].name, latency_ns / 1e3, result);
+            }
+        }
+    }
+    const double elapsed_s = (now_us() - start_us) / 1e6;
+
+    char pace[32];
+    snprintf(pace, sizeof(pace), speed > 0 ? "%gx recorded pace" : "back to back", speed);
+    printf("%zu requests x %d in %.2f s (%s, %s): %llu ok, %llu mismatched, %llu without reply, "
+            "%llu answered without a recorded reply\n", exchange_count, repeat, elapsed_s,
+            address_text ? address_text : "in process", pace,
+            (unsigned long long) matched, (unsigned long long) mismatched, (unsigned long long) unanswered,
+            (unsigned long long) unrecorded);
+    printf("%-28s %8s %8s %8s %8s %8s\n", "latency us", "count", "p50", "p90", "p99", "max");
+    size_t total = 0;
+    for (int i = 0; i < command_count; i++) {
+        total += commands[i].count;
+    }
+    uint32_t * all = allocate((total + 1) * sizeof(uint32_t));
+    size_t filled = 0;
+    for (int i = 0; i < command_count; i++) {
+        memcpy(all + filled, commands[i].latencies, commands[i].count * sizeof(uint32_t));
+        filled += commands[i].count;
+        print_latencies(commands[i].name, commands[i].latencies, commands[i].count);
+    }
+    print_latencies("all", all, total);
+
+    if (latency_file != NULL) {
+        fclose(latency_file);
+    }
+    if (udp_socket >= 0) {
+        close(udp_socket);
+    }
+    for (int i = 0; i < command_count; i++) {
+        free(commands[i].latencies);
+    }
+    free(all);
+    free(buffer);
+    free(exchanges);
+    free(arena_buffer);
+    capture_free(&capture);
+    return mismatched > 0 || unanswered > 0 ? 1 : 0;
+}
+
+static int convert(int argc, char * argv[])
+{
+    int option;
+    while ((option = getopt(argc, argv, "p:")) != -1) {
+        if (option != 'p') {
+            return 2;
+        }
+        kasa_port = atoi(optarg);
+    }
+    if (optind != argc - 2) {
+        return 2;
+    }
+    capture_t capture = { 0 };
+    const bool converted = load_capture(argv[optind], &capture) && save_capture(argv[optind + 1], &capture);
+    if (converted) {
+        printf("%zu messages\n", capture.count);
+    }
+    capture_free(&capture);
+    return converted ? 0 : 1;
+}
+
+/* capture from a packet socket, which needs CAP_NET_RAW */
+static int record(int argc, char * argv[])
+{
+    const char * interface = NULL;
+    int duration_s = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "i:p:d:")) != -1) {
+        switch (option) {
+            case 'i':
+                interface = optarg;
+                break;
+            case 'p':
+                kasa_port = atoi(optarg);
+                break;
+            case 'd':
+                duration_s = atoi(optarg);
+                break;
+            default:
+                return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        return 2;
+    }
+
+    const int sock = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (sock < 0) {
+        fprintf(stderr, "Unable to open a packet socket: %s\n", strerror(errno));
+        return 1;
+    }
+    if (interface != NULL) {
+        struct sockaddr_ll link = { .sll_family = AF_PACKET, .sll_protocol = htons(ETH_P_IP) };
+        link.sll_ifindex = if_nametoindex(interface);
+        if (link.sll_ifindex == 0 || bind(sock, (struct sockaddr *) &link, sizeof(link)) != 0) {
+            fprintf(stderr, "Unable to capture on %s: %s\n", interface, strerror(errno));
+            return 1;
+        }
+    }
+
+    struct sigaction action = { .sa_handler = request_stop };
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    fprintf(stderr, "Recording port %u%s%s, interrupt to stop\n", kasa_port, interface ? " on " : "",
+            interface ? interface : "");
+
+    capture_t capture = { 0 };
+    uint8_t * packet = allocate(65536);
+    const int64_t end_us = duration_s > 0 ? now_us() + duration_s * 1000000LL : INT64_MAX;
+    while ( !stop && now_us() < end_us ) {
+        struct pollfd poll_socket = { .fd = sock, .events = POLLIN };
+        if (poll(&poll_socket, 1, 200) <= 0) {
+            continue;
+        }
+        struct sockaddr_ll source;
+        socklen_t source_len = sizeof(source);
+        const ssize_t length = recvfrom(sock, packet, 65536, 0, (struct sockaddr *) &source, &source_len);
+        /* sent packets are seen again when received on loopback */
+        if (length > 0 && source.sll_pkttype != PACKET_OUTGOING) {
+            struct timespec time;
+            clock_gettime(CLOCK_REALTIME, &time);
+            capture_ip(&capture, time.tv_sec * 1000000LL + time.tv_nsec / 1000, packet, length);
+        }
+    }
+    close(sock);
+    free(packet);
+
+    const bool saved = save_capture(argv[optind], &capture);
+    if (saved) {
+        printf("%zu messages\n", capture.count);
+    }
+    capture_free(&capture);
+    return saved ? 0 : 1;
+}
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s record [-i interface] [-p port] [-d duration_s] output.krec\n"
+            "       %s convert [-p port] input.pcap output.krec\n"
+            "       %s replay [-x speed] [-n repeat] [-v exact|keys|none] [-a address [-p port]] [-l latency.csv]\n"
+            "                 input.krec|input.pcap\n"
+            "  -p  Kasa port of the devices (default 9999)\n"
+            "  -x  replay speed, 1 for the recorded pace (default), 10 for ten times as fast, 0 back to back\n"
+            "  -n  replay the recording this many times\n"
+            "  -v  compare replies with the recorded ones exactly, by their keys (default) or not at all\n"
+            "  -a  replay to this address instead of processing in process\n"
+            "  -l  write the latency of every request to a CSV file\n", program, program, program);
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    /* per-request logging would be measured along with the processing */
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    int result = 2;
+    if (strcmp(argv[1], "record") == 0) {
+        result = record(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "convert") == 0) {
+        result = convert(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "replay") == 0) {
+        result = replay(argc - 1, argv + 1);
+    }
+    if (result == 2) {
+        usage(argv[0]);
+    }
+    return result;
+}
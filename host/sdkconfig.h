@@ -0,0 +1,66 @@
+/**
+ * @file Configuration of the host simulation build, the defaults of main/Kconfig.projbuild plus the ESP-IDF options the
+ * sources read. Options can be overridden with -D on the compiler command line.
+ */
+
+#ifndef INTELLILIGHT_SIM_SDKCONFIG_H
+#define INTELLILIGHT_SIM_SDKCONFIG_H
+
+#define CONFIG_WIFI_SSID "mywifissid"
+#define CONFIG_WIFI_PASSWORD "mypassword"
+#define CONFIG_KASA_CJSON_ARENA_SIZE 8192
+#define CONFIG_KASA_REQUEST_SLOTS 4
+#define CONFIG_KASA_SEND_TIMEOUT_MS 2000
+#define CONFIG_KASA_RATE_LIMIT_PER_S 4
+#define CONFIG_KASA_RATE_LIMIT_BURST 8
+#define CONFIG_COAP_PORT 5683
+#define CONFIG_COAP_OBSERVERS 8
+#define CONFIG_COAP_DEADBAND_TEMPERATURE_CENTI 10
+#define CONFIG_COAP_DEADBAND_HUMIDITY_CENTI 50
+/* unprivileged on the host */
+#ifndef CONFIG_HTTP_PORT
+#define CONFIG_HTTP_PORT 8080
+#endif
+#define CONFIG_HTTP_CONNECTIONS 4
+/* enough for the load test of websocket_bench */
+#ifndef CONFIG_WEBSOCKET_SUBSCRIBERS
+#define CONFIG_WEBSOCKET_SUBSCRIBERS 64
+#endif
+#define CONFIG_WEBSOCKET_QUEUE_FRAMES 8
+#define CONFIG_WEBSOCKET_DERIVED 1
+#define CONFIG_NETWORK_TASK_STACK_SIZE 4096
+#define CONFIG_PROCESSING_TASK_STACK_SIZE 4096
+#define CONFIG_SAMPLER_TASK_STACK_SIZE 3072
+#define CONFIG_TASKSTATS_INTERVAL_S 10
+#ifndef CONFIG_TELEMETRY_BROKER
+#define CONFIG_TELEMETRY_BROKER ""
+#endif
+#define CONFIG_TELEMETRY_BROKER_PORT 1883
+#define CONFIG_TELEMETRY_CLIENT_ID "intellilight-C0C9E3AD7C1D"
+#define CONFIG_TELEMETRY_TOPIC "intellilight/C0C9E3AD7C1D/telemetry"
+#define CONFIG_TELEMETRY_BATCH_SAMPLES 5
+#define CONFIG_TELEMETRY_IN_FLIGHT 4
+#define CONFIG_TELEMETRY_QUEUE_SAMPLES 256
+#define CONFIG_TELEMETRY_SPILL_BLOCKS 16
+#define CONFIG_TELEMETRY_TASK_STACK_SIZE 4096
+#ifndef CONFIG_ANNOUNCE_GROUP
+#define CONFIG_ANNOUNCE_GROUP ""
+#endif
+#define CONFIG_ANNOUNCE_PORT 9998
+#define CONFIG_ANNOUNCE_INTERVAL_S 10
+#define CONFIG_ANNOUNCE_CHANGE_CENTI 10
+#define CONFIG_MEMSTATS_REQUEST_PEAK_LIMIT 8192
+#define CONFIG_CJSON_HASH_CACHE 1
+#define CONFIG_CJSON_ARRAY_INDEX 1
+
+#ifdef CONFIG_TRACE_ENABLE
+#ifndef CONFIG_TRACE_BUFFER_EVENTS
+#define CONFIG_TRACE_BUFFER_EVENTS 512
+#endif
+#endif
+
+/* ESP-IDF options */
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#define CONFIG_FREERTOS_HZ 1000
+
+#endif
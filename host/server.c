@@ -0,0 +1,241 @@
+/**
+ * @file Native Kasa server for Linux, for the simulator and for gateways bridging to the sensor
+ *
+ * The firmware's request processing, device state and sampled sensor are served by worker threads pinned one per
+ * core. Each worker has its own TCP and UDP socket bound to the port with SO_REUSEPORT, so the kernel spreads
+ * connections and datagrams over the workers, and runs its own event loop on them: an epoll loop or an io_uring with
+ * multishot accept and receive into provided buffers. Workers share nothing but the device, whose reply to discovery
+ * and sensor reading are published for lock-free reads, so the request path takes no lock and throughput scales with
+ * the number of cores. Like the device, a TCP connection carries one request and is closed after the reply.
+ *
+ * Usage: kasa_server [-b epoll|uring] [-t threads] [-p port] [-s stats_interval_s]
+ */
+
+/* system includes */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "history.h"
+#include "memstats.h"
+#include "sampler.h"
+#include "server.h"
+#include "tplink_kasa.h"
+
+#define SERVER_MAX_WORKERS 64
+
+static const char *log_tag = "server";
+
+atomic_bool server_stopping = false;
+
+static server_worker_t workers[SERVER_MAX_WORKERS];
+static int worker_count = 1;
+static bool (*backend_run)(server_worker_t * worker) = server_epoll_run;
+
+int server_process(server_worker_t * worker, char * buffer, int length, int buffer_size, bool include_header)
+{
+    atomic_fetch_add_explicit(&worker->counters.requests, 1, memory_order_relaxed);
+
+    /* no memstats request window: requests allocate from the worker's arena, and its totals are behind a lock */
+    const int reply_len = tplink_kasa_process_buffer(&worker->json_context, buffer, length, buffer_size,
+            include_header, NULL);
+    cJSON_ArenaReset(&worker->json_arena);
+
+    atomic_fetch_add_explicit(reply_len > 0 ? &worker->counters.replies : &worker->counters.dropped, 1,
+            memory_order_relaxed);
+    return reply_len;
+}
+
+int server_tcp_request_length(const char * buffer, uint32_t received)
+{
+    if (received < 4) {
+        return 0;
+    }
+    const uint8_t * header = (const uint8_t *) buffer;
+    const uint32_t length = 4 + ((uint32_t) header[0] << 24 | (uint32_t) header[1] << 16 | (uint32_t) header[2] << 8 | header[3]);
+    if (length > SERVER_BUFFER_SIZE - 1) {
+        return -1;
+    }
+    return received >= length ? (int) length : 0;
+}
+
+static int open_socket(int type, int port)
+{
+    const int sock = socket(AF_INET, type | SOCK_NONBLOCK, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    const int opt = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    const struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(sock, (const struct sockaddr *) &address, sizeof(address)) != 0
+            || (type == SOCK_STREAM && listen(sock, 1024) != 0)) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void * worker_thread(void * arg)
+{
+    server_worker_t * worker = arg;
+
+    /* one worker per core of the ones the server may run on (see taskset), so each event loop stays on the caches of
+     * its core and a load generator can be given the others */
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        int remaining = worker->index % CPU_COUNT(&allowed);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed) && remaining-- == 0) {
+                cpu_set_t cpus;
+                CPU_ZERO(&cpus);
+                CPU_SET(cpu, &cpus);
+                pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+                break;
+            }
+        }
+    }
+
+    if ( !backend_run(worker) ) {
+        ESP_LOGE(log_tag, "Worker %d could not start its backend", worker->index);
+        atomic_store(&server_stopping, true);
+    }
+    return NULL;
+}
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-b epoll|uring] [-t threads] [-p port] [-s stats_interval_s]\n"
+            "  -b  event loop of the workers (default epoll)\n"
+            "  -t  number of worker threads (default 1)\n"
+            "  -p  TCP and UDP port (default 9999)\n"
+            "  -s  seconds between statistics lines (default 10, 0 for none)\n", program);
+}
+
+int main(int argc, char * argv[])
+{
+    int port = 9999;
+    int stats_interval_s = 10;
+
+    int option;
+    while ((option = getopt(argc, argv, "b:t:p:s:h")) != -1) {
+        switch (option) {
+            case 'b':
+                if (strcmp(optarg, "epoll") == 0) {
+                    backend_run = server_epoll_run;
+                } else if (strcmp(optarg, "uring") == 0) {
+                    backend_run = server_uring_run;
+                } else {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 't':
+                worker_count = atoi(optarg);
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 's':
+                stats_interval_s = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (worker_count < 1 || worker_count > SERVER_MAX_WORKERS) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    /* logging every request would cost more than serving it */
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    /* the main thread takes the signals, workers inherit the mask */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    memstats_init();
+    history_init();
+    sampler_start();
+    tplink_kasa_init();
+
+    pthread_t threads[SERVER_MAX_WORKERS];
+    for (int i = 0; i < worker_count; i++) {
+        server_worker_t * worker = &workers[i];
+        worker->index = i;
+        worker->tcp_listener = open_socket(SOCK_STREAM, port);
+        worker->udp_socket = open_socket(SOCK_DGRAM, port);
+        if (worker->tcp_listener < 0 || worker->udp_socket < 0) {
+            ESP_LOGE(log_tag, "Unable to listen on port %d: errno %d", port, errno);
+            return 1;
+        }
+        worker->arena_buffer = malloc(CONFIG_KASA_CJSON_ARENA_SIZE);
+        if (worker->arena_buffer == NULL) {
+            return 1;
+        }
+        cJSON_InitArena(&worker->json_arena, worker->arena_buffer, CONFIG_KASA_CJSON_ARENA_SIZE);
+        cJSON_InitContextWithArena(&worker->json_context, &worker->json_arena);
+        pthread_create(&threads[i], NULL, worker_thread, worker);
+    }
+    printf("%d %s workers on port %d\n", worker_count, backend_run == server_uring_run ? "io_uring" : "epoll", port);
+    fflush(stdout);
+
+    uint64_t reported_requests = 0;
+    int64_t reported_us = esp_timer_get_time();
+    const struct timespec tick = { .tv_sec = 1, .tv_nsec = 0 };
+    while ( !atomic_load(&server_stopping) ) {
+        if (sigtimedwait(&signals, NULL, &tick) > 0) {
+            break;
+        }
+        const int64_t now = esp_timer_get_time();
+        if (stats_interval_s > 0 && now - reported_us >= stats_interval_s * 1000000LL) {
+            uint64_t requests = 0;
+            for (int i = 0; i < worker_count; i++) {
+                requests += atomic_load_explicit(&workers[i].counters.requests, memory_order_relaxed);
+            }
+            printf("%.0f requests/s\n", (requests - reported_requests) / ((now - reported_us) / 1e6));
+            fflush(stdout);
+            reported_requests = requests;
+            reported_us = now;
+        }
+    }
+
+    atomic_store(&server_stopping, true);
+    uint64_t requests = 0, replies = 0, accepted = 0, dropped = 0;
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(threads[i], NULL);
+        close(workers[i].tcp_listener);
+        close(workers[i].udp_socket);
+        requests += workers[i].counters.requests;
+        replies += workers[i].counters.replies;
+        accepted += workers[i].counters.accepted;
+        dropped += workers[i].counters.dropped;
+    }
+    printf("%llu requests, %llu replies, %llu connections, %llu dropped\n", (unsigned long long) requests,
+            (unsigned long long) replies, (unsigned long long) accepted, (unsigned long long) dropped);
+    /* how evenly the kernel spread the load over the workers' sockets */
+    for (int i = 0; i < worker_count; i++) {
+        printf("worker %d: %llu requests\n", i, (unsigned long long) workers[i].counters.requests);
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file Native Kasa server for Linux: worker threads, each with its own sockets, event loop backend, buffers and
+ * cJSON arena, serving the firmware's request processing on TCP and UDP port 9999
+ */
+
+#ifndef INTELLILIGHT_SERVER_H
+#define INTELLILIGHT_SERVER_H
+
+/* system includes */
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* local includes */
+#include "cJSON.h"
+
+/* largest request or reply, replies are not streamed so this also bounds get_history */
+#define SERVER_BUFFER_SIZE 16384
+/* size of the buffers received into, Kasa requests are a few hundred bytes */
+#define SERVER_RECEIVE_SIZE 2048
+/* connections one worker serves at the same time */
+#define SERVER_MAX_CONNECTIONS 4096
+
+/**
+ * @brief Counters of one worker, written by it and read by the statistics thread
+ */
+typedef struct
+{
+    atomic_uint_least64_t requests;
+    atomic_uint_least64_t replies;
+    atomic_uint_least64_t accepted;
+    atomic_uint_least64_t dropped;
+} server_counters_t;
+
+/**
+ * @brief One worker thread and what it owns
+ */
+typedef struct
+{
+    int index;
+    int tcp_listener;           /* the worker's own sockets, bound to the port with SO_REUSEPORT */
+    int udp_socket;
+    cJSON_Arena json_arena;
+    cJSON_Context json_context;
+    uint8_t * arena_buffer;
+    server_counters_t counters;
+} server_worker_t;
+
+/* set once the server is to stop, backends check it at least once a second */
+extern atomic_bool server_stopping;
+
+/**
+ * @brief Process one request with the worker's cJSON arena
+ * @param worker Calling worker
+ * @param buffer Request, replaced by the encrypted reply
+ * @param length Length of the request, less than buffer_size
+ * @param buffer_size Size of buffer
+ * @param include_header True for TCP framing
+ * @return Length of the reply in buffer, 0 if there is none
+ */
+extern int server_process(server_worker_t * worker, char * buffer, int length, int buffer_size, bool include_header);
+
+/**
+ * @brief Length of a complete framed TCP request at the start of buffer
+ * @param buffer Received bytes
+ * @param received Number of bytes received
+ * @return Length including the header, 0 if more is needed, -1 if the request cannot fit SERVER_BUFFER_SIZE
+ */
+extern int server_tcp_request_length(const char * buffer, uint32_t received);
+
+/**
+ * @brief Serve with epoll until the server stops
+ * @param worker Calling worker
+ * @return False if the backend could not be set up
+ */
+extern bool server_epoll_run(server_worker_t * worker);
+
+/**
+ * @brief Serve with io_uring until the server stops
+ * @param worker Calling worker
+ * @return False if the backend could not be set up
+ */
+extern bool server_uring_run(server_worker_t * worker);
+
+#endif
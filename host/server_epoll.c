@@ -0,0 +1,217 @@
+/**
+ * @file epoll backend of the native Kasa server: readiness for the worker's sockets and connections, non-blocking
+ * accept, receive and send
+ */
+
+/* system includes */
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "server.h"
+
+#define EPOLL_MAX_EVENTS 256
+/* datagrams taken per wake, so connections are not starved */
+#define EPOLL_UDP_BATCH 16
+/* a connection that has not been answered in this time is closed to free its slot */
+#define EPOLL_CONNECTION_TIMEOUT_MS 5000
+
+/* tags of the listening sockets, connections are tagged with their slot */
+#define TAG_TCP_LISTENER UINT64_MAX
+#define TAG_UDP (UINT64_MAX - 1)
+
+static const char *log_tag = "server_epoll";
+
+struct connection
+{
+    int socket;                 /* -1 while the slot is free */
+    uint32_t received;
+    uint32_t reply_len;         /* non-zero once the reply is being sent */
+    uint32_t sent;
+    int64_t accepted_us;
+    char * buffer;              /* allocated on first use and kept */
+};
+
+struct epoll_state
+{
+    server_worker_t * worker;
+    int epoll_socket;
+    struct connection connections[SERVER_MAX_CONNECTIONS];
+    uint32_t free_slots[SERVER_MAX_CONNECTIONS];
+    uint32_t free_count;
+    char datagram[SERVER_BUFFER_SIZE];
+};
+
+static void close_connection(struct epoll_state * state, uint32_t slot)
+{
+    close(state->connections[slot].socket);
+    state->connections[slot].socket = -1;
+    state->free_slots[state->free_count++] = slot;
+}
+
+static void serve_udp(struct epoll_state * state)
+{
+    for (int i = 0; i < EPOLL_UDP_BATCH; i++) {
+        struct sockaddr_storage source;
+        socklen_t source_len = sizeof(source);
+        const int received = recvfrom(state->worker->udp_socket, state->datagram, sizeof(state->datagram) - 1, 0,
+                (struct sockaddr *) &source, &source_len);
+        if (received <= 0) {
+            return;
+        }
+        const int reply_len = server_process(state->worker, state->datagram, received, sizeof(state->datagram), false);
+        if (reply_len > 0) {
+            sendto(state->worker->udp_socket, state->datagram, reply_len, 0, (struct sockaddr *) &source, source_len);
+        }
+    }
+}
+
+static void accept_connections(struct epoll_state * state)
+{
+    while (true) {
+        const int sock = accept4(state->worker->tcp_listener, NULL, NULL, SOCK_NONBLOCK);
+        if (sock < 0) {
+            return;
+        }
+        if (state->free_count == 0) {
+            close(sock);
+            continue;
+        }
+
+        const uint32_t slot = state->free_slots[--state->free_count];
+        struct connection * connection = &state->connections[slot];
+        if (connection->buffer == NULL && (connection->buffer = malloc(SERVER_BUFFER_SIZE)) == NULL) {
+            state->free_slots[state->free_count++] = slot;
+            close(sock);
+            continue;
+        }
+        connection->socket = sock;
+        connection->received = 0;
+        connection->reply_len = 0;
+        connection->sent = 0;
+        connection->accepted_us = esp_timer_get_time();
+        atomic_fetch_add_explicit(&state->worker->counters.accepted, 1, memory_order_relaxed);
+
+        struct epoll_event event = { .events = EPOLLIN, .data.u64 = slot };
+        if (epoll_ctl(state->epoll_socket, EPOLL_CTL_ADD, sock, &event) != 0) {
+            close_connection(state, slot);
+        }
+    }
+}
+
+/* like the device, the connection is closed once the reply has been sent */
+static void send_reply(struct epoll_state * state, uint32_t slot)
+{
+    struct connection * connection = &state->connections[slot];
+    while (connection->sent < connection->reply_len) {
+        const int written = send(connection->socket, connection->buffer + connection->sent,
+                connection->reply_len - connection->sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct epoll_event event = { .events = EPOLLOUT, .data.u64 = slot };
+                epoll_ctl(state->epoll_socket, EPOLL_CTL_MOD, connection->socket, &event);
+                return;
+            }
+            break;
+        }
+        connection->sent += written;
+    }
+    close_connection(state, slot);
+}
+
+static void receive_request(struct epoll_state * state, uint32_t slot)
+{
+    struct connection * connection = &state->connections[slot];
+    const int received = recv(connection->socket, connection->buffer + connection->received,
+            SERVER_BUFFER_SIZE - 1 - connection->received, 0);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (received <= 0) {
+        close_connection(state, slot);
+        return;
+    }
+    connection->received += received;
+
+    const int length = server_tcp_request_length(connection->buffer, connection->received);
+    if (length < 0) {
+        close_connection(state, slot);
+    } else if (length > 0) {
+        connection->reply_len = server_process(state->worker, connection->buffer, length, SERVER_BUFFER_SIZE, true);
+        connection->sent = 0;
+        send_reply(state, slot);
+    }
+}
+
+static void close_stale_connections(struct epoll_state * state)
+{
+    const int64_t now = esp_timer_get_time();
+    for (uint32_t i = 0; i < SERVER_MAX_CONNECTIONS; i++) {
+        if (state->connections[i].socket >= 0 && now - state->connections[i].accepted_us > EPOLL_CONNECTION_TIMEOUT_MS * 1000LL) {
+            close_connection(state, i);
+        }
+    }
+}
+
+bool server_epoll_run(server_worker_t * worker)
+{
+    struct epoll_state * state = calloc(1, sizeof(struct epoll_state));
+    if (state == NULL) {
+        return false;
+    }
+    state->worker = worker;
+    for (uint32_t i = 0; i < SERVER_MAX_CONNECTIONS; i++) {
+        state->connections[i].socket = -1;
+        state->free_slots[state->free_count++] = SERVER_MAX_CONNECTIONS - 1 - i;
+    }
+
+    state->epoll_socket = epoll_create1(0);
+    struct epoll_event tcp_event = { .events = EPOLLIN, .data.u64 = TAG_TCP_LISTENER };
+    struct epoll_event udp_event = { .events = EPOLLIN, .data.u64 = TAG_UDP };
+    if (state->epoll_socket < 0
+            || epoll_ctl(state->epoll_socket, EPOLL_CTL_ADD, worker->tcp_listener, &tcp_event) != 0
+            || epoll_ctl(state->epoll_socket, EPOLL_CTL_ADD, worker->udp_socket, &udp_event) != 0) {
+        ESP_LOGE(log_tag, "Unable to set up epoll: errno %d", errno);
+        free(state);
+        return false;
+    }
+
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int64_t swept_us = esp_timer_get_time();
+    while ( !atomic_load_explicit(&server_stopping, memory_order_relaxed) ) {
+        const int count = epoll_wait(state->epoll_socket, events, EPOLL_MAX_EVENTS, 1000);
+        for (int i = 0; i < count; i++) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag == TAG_TCP_LISTENER) {
+                accept_connections(state);
+            } else if (tag == TAG_UDP) {
+                serve_udp(state);
+            } else if (state->connections[tag].reply_len > 0) {
+                send_reply(state, tag);
+            } else {
+                receive_request(state, tag);
+            }
+        }
+
+        const int64_t now = esp_timer_get_time();
+        if (now - swept_us >= 1000000) {
+            close_stale_connections(state);
+            swept_us = now;
+        }
+    }
+
+    for (uint32_t i = 0; i < SERVER_MAX_CONNECTIONS; i++) {
+        if (state->connections[i].socket >= 0) {
+            close(state->connections[i].socket);
+        }
+        free(state->connections[i].buffer);
+    }
+    close(state->epoll_socket);
+    free(state);
+    return true;
+}
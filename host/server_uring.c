@@ -0,0 +1,608 @@
+/**
+ * @file io_uring backend of the native Kasa server
+ *
+ * Each worker owns a ring. Its sockets are read with a multishot accept and a multishot recvmsg, and every connection
+ * with a multishot recv, all of them taking buffers from the worker's ring of provided buffers so no buffer is tied up
+ * by an idle connection. A complete request is answered with a send linked to the close of the connection.
+ * The system calls are made directly rather than through liburing, which the host build does not depend on.
+ */
+
+/* system includes */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "server.h"
+
+#define URING_SQ_ENTRIES 1024
+#define URING_CQ_ENTRIES 4096
+/* provided receive buffers, a power of two */
+#define URING_BUFFER_COUNT 512
+#define URING_BUFFER_GROUP 0
+/* UDP replies in flight, further replies are sent synchronously */
+#define URING_UDP_SENDS 64
+/* a connection that has not sent its request in this time is closed to free its slot */
+#define URING_CONNECTION_TIMEOUT_MS 5000
+
+/* user_data: the operation, the connection slot and the slot's generation, so late completions are recognised */
+enum
+{
+    OP_ACCEPT,
+    OP_RECV,
+    OP_SEND,
+    OP_CLOSE,
+    OP_CANCEL,
+    OP_UDP_RECV,
+    OP_UDP_SEND,
+    OP_TIMEOUT,
+};
+#define USER_DATA(op, slot, generation) ((uint64_t) (op) << 56 | (uint64_t) (slot) << 32 | (uint32_t) (generation))
+#define USER_DATA_OP(user_data) ((unsigned) ((user_data) >> 56))
+#define USER_DATA_SLOT(user_data) ((uint32_t) ((user_data) >> 32) & 0xFFFFFF)
+#define USER_DATA_GENERATION(user_data) ((uint32_t) (user_data))
+
+static const char *log_tag = "server_uring";
+
+struct connection
+{
+    int socket;                 /* -1 while the slot is free */
+    uint32_t generation;
+    uint32_t received;
+    bool receiving;             /* the multishot recv is armed */
+    bool closing;               /* the reply and close have been submitted */
+    int64_t accepted_us;
+    char * buffer;              /* allocated on first use and kept */
+};
+
+struct udp_send
+{
+    struct msghdr message;
+    struct iovec iov;
+    struct sockaddr_in address;
+    char buffer[SERVER_BUFFER_SIZE];
+};
+
+struct uring_state
+{
+    server_worker_t * worker;
+
+    int ring;
+    void * sq_ring;
+    size_t sq_ring_size;
+    void * cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe * sqes;
+    size_t sqes_size;
+    _Atomic unsigned * sq_head;
+    _Atomic unsigned * sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_tail_local;
+    unsigned sq_submitted;
+    _Atomic unsigned * cq_head;
+    _Atomic unsigned * cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe * cqes;
+
+    struct io_uring_buf_ring * buffer_ring;
+    size_t buffer_ring_size;
+    uint16_t buffer_tail;
+    uint8_t * buffers;
+
+    struct msghdr udp_receive_message;
+    struct udp_send * udp_sends;
+    uint32_t udp_free[URING_UDP_SENDS];
+    uint32_t udp_free_count;
+
+    struct __kernel_timespec tick;
+
+    struct connection connections[SERVER_MAX_CONNECTIONS];
+    uint32_t free_slots[SERVER_MAX_CONNECTIONS];
+    uint32_t free_count;
+    char datagram[SERVER_BUFFER_SIZE];
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params * params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int ring, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, ring, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int ring, unsigned opcode, void * arg, unsigned count)
+{
+    return syscall(__NR_io_uring_register, ring, opcode, arg, count);
+}
+
+static bool map_ring(struct uring_state * state, const struct io_uring_params * params)
+{
+    state->sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    state->cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        if (state->cq_ring_size > state->sq_ring_size) {
+            state->sq_ring_size = state->cq_ring_size;
+        }
+        state->cq_ring_size = 0;
+    }
+
+    state->sq_ring = mmap(NULL, state->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state->ring,
+            IORING_OFF_SQ_RING);
+    if (state->sq_ring == MAP_FAILED) {
+        return false;
+    }
+    if (state->cq_ring_size == 0) {
+        state->cq_ring = state->sq_ring;
+    } else {
+        state->cq_ring = mmap(NULL, state->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                state->ring, IORING_OFF_CQ_RING);
+        if (state->cq_ring == MAP_FAILED) {
+            return false;
+        }
+    }
+    state->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    state->sqes = mmap(NULL, state->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state->ring,
+            IORING_OFF_SQES);
+    if (state->sqes == MAP_FAILED) {
+        return false;
+    }
+
+    uint8_t * sq = state->sq_ring;
+    uint8_t * cq = state->cq_ring;
+    state->sq_head = (_Atomic unsigned *) (sq + params->sq_off.head);
+    state->sq_tail = (_Atomic unsigned *) (sq + params->sq_off.tail);
+    state->sq_mask = *(unsigned *) (sq + params->sq_off.ring_mask);
+    state->sq_entries = params->sq_entries;
+    state->sq_tail_local = atomic_load_explicit(state->sq_tail, memory_order_relaxed);
+    state->sq_submitted = state->sq_tail_local;
+    state->cq_head = (_Atomic unsigned *) (cq + params->cq_off.head);
+    state->cq_tail = (_Atomic unsigned *) (cq + params->cq_off.tail);
+    state->cq_mask = *(unsigned *) (cq + params->cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe *) (cq + params->cq_off.cqes);
+
+    /* submission entries are always taken in order */
+    unsigned * array = (unsigned *) (sq + params->sq_off.array);
+    for (unsigned i = 0; i < params->sq_entries; i++) {
+        array[i] = i;
+    }
+    return true;
+}
+
+static bool open_ring(struct uring_state * state)
+{
+    /* only this worker submits, which lets completions be run when it waits rather than by interrupting it */
+    struct io_uring_params params = {
+        .flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        .cq_entries = URING_CQ_ENTRIES,
+    };
+    state->ring = uring_setup(URING_SQ_ENTRIES, &params);
+    if (state->ring < 0) {
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = URING_CQ_ENTRIES;
+        state->ring = uring_setup(URING_SQ_ENTRIES, &params);
+    }
+    if (state->ring < 0) {
+        ESP_LOGE(log_tag, "io_uring_setup failed: errno %d", errno);
+        return false;
+    }
+    if ( !map_ring(state, &params) ) {
+        ESP_LOGE(log_tag, "Unable to map the rings: errno %d", errno);
+        return false;
+    }
+    return true;
+}
+
+static void provide_buffer(struct uring_state * state, uint16_t id)
+{
+    struct io_uring_buf * buffer = &state->buffer_ring->bufs[state->buffer_tail & (URING_BUFFER_COUNT - 1)];
+    buffer->addr = (uintptr_t) (state->buffers + (size_t) id * SERVER_RECEIVE_SIZE);
+    buffer->len = SERVER_RECEIVE_SIZE;
+    buffer->bid = id;
+    state->buffer_tail++;
+}
+
+static void publish_buffers(struct uring_state * state)
+{
+    atomic_store_explicit((_Atomic uint16_t *) &state->buffer_ring->tail, state->buffer_tail, memory_order_release);
+}
+
+static bool register_buffers(struct uring_state * state)
+{
+    state->buffer_ring_size = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+    state->buffer_ring = mmap(NULL, state->buffer_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+            -1, 0);
+    state->buffers = malloc((size_t) URING_BUFFER_COUNT * SERVER_RECEIVE_SIZE);
+    if (state->buffer_ring == MAP_FAILED || state->buffers == NULL) {
+        return false;
+    }
+
+    struct io_uring_buf_reg registration = {
+        .ring_addr = (uintptr_t) state->buffer_ring,
+        .ring_entries = URING_BUFFER_COUNT,
+        .bgid = URING_BUFFER_GROUP,
+    };
+    if (uring_register(state->ring, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+        ESP_LOGE(log_tag, "Unable to register the buffer ring: errno %d", errno);
+        return false;
+    }
+    for (uint16_t i = 0; i < URING_BUFFER_COUNT; i++) {
+        provide_buffer(state, i);
+    }
+    publish_buffers(state);
+    return true;
+}
+
+static void submit(struct uring_state * state, unsigned min_complete)
+{
+    const unsigned to_submit = state->sq_tail_local - state->sq_submitted;
+    atomic_store_explicit(state->sq_tail, state->sq_tail_local, memory_order_release);
+    const int submitted = uring_enter(state->ring, to_submit, min_complete, IORING_ENTER_GETEVENTS);
+    if (submitted > 0) {
+        state->sq_submitted += submitted;
+    }
+}
+
+static struct io_uring_sqe * get_sqe(struct uring_state * state)
+{
+    while (state->sq_tail_local - atomic_load_explicit(state->sq_head, memory_order_acquire) >= state->sq_entries) {
+        submit(state, 0);
+    }
+    struct io_uring_sqe * sqe = &state->sqes[state->sq_tail_local & state->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    state->sq_tail_local++;
+    return sqe;
+}
+
+static void arm_accept(struct uring_state * state)
+{
+    struct io_uring_sqe * sqe = get_sqe(state);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = state->worker->tcp_listener;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = USER_DATA(OP_ACCEPT, 0, 0);
+}
+
+static void arm_udp_receive(struct uring_state * state)
+{
+    struct io_uring_sqe * sqe = get_sqe(state);
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = state->worker->udp_socket;
+    sqe->addr = (uintptr_t) &state->udp_receive_message;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = USER_DATA(OP_UDP_RECV, 0, 0);
+}
+
+static void arm_timeout(struct uring_state * state)
+{
+    struct io_uring_sqe * sqe = get_sqe(state);
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uintptr_t) &state->tick;
+    sqe->len = 1;
+    sqe->user_data = USER_DATA(OP_TIMEOUT, 0, 0);
+}
+
+static void arm_receive(struct uring_state * state, uint32_t slot)
+{
+    struct connection * connection = &state->connections[slot];
+    struct io_uring_sqe * sqe = get_sqe(state);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection->socket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = USER_DATA(OP_RECV, slot, connection->generation);
+    connection->receiving = true;
+}
+
+/* the multishot recv ends when the connection is closed, and the slot is freed with the close */
+static void close_connection(struct uring_state * state, uint32_t slot, uint32_t reply_len)
+{
+    struct connection * connection = &state->connections[slot];
+    connection->closing = true;
+
+    if (connection->receiving) {
+        struct io_uring_sqe * sqe = get_sqe(state);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = USER_DATA(OP_RECV, slot, connection->generation);
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = USER_DATA(OP_CANCEL, slot, connection->generation);
+    }
+    if (reply_len > 0) {
+        struct io_uring_sqe * sqe = get_sqe(state);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = connection->socket;
+        sqe->addr = (uintptr_t) connection->buffer;
+        sqe->len = reply_len;
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        sqe->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = USER_DATA(OP_SEND, slot, connection->generation);
+    }
+    struct io_uring_sqe * sqe = get_sqe(state);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = connection->socket;
+    sqe->user_data = USER_DATA(OP_CLOSE, slot, connection->generation);
+}
+
+static void free_connection(struct uring_state * state, uint32_t slot)
+{
+    struct connection * connection = &state->connections[slot];
+    connection->socket = -1;
+    connection->generation++;
+    state->free_slots[state->free_count++] = slot;
+}
+
+static void handle_accept(struct uring_state * state, const struct io_uring_cqe * cqe)
+{
+    if ( !(cqe->flags & IORING_CQE_F_MORE) ) {
+        arm_accept(state);
+    }
+    if (cqe->res < 0) {
+        return;
+    }
+    const int sock = cqe->res;
+    if (state->free_count == 0) {
+        close(sock);
+        return;
+    }
+
+    const uint32_t slot = state->free_slots[--state->free_count];
+    struct connection * connection = &state->connections[slot];
+    if (connection->buffer == NULL && (connection->buffer = malloc(SERVER_BUFFER_SIZE)) == NULL) {
+        state->free_slots[state->free_count++] = slot;
+        close(sock);
+        return;
+    }
+    connection->socket = sock;
+    connection->received = 0;
+    connection->closing = false;
+    connection->accepted_us = esp_timer_get_time();
+    atomic_fetch_add_explicit(&state->worker->counters.accepted, 1, memory_order_relaxed);
+    arm_receive(state, slot);
+}
+
+static void handle_receive(struct uring_state * state, const struct io_uring_cqe * cqe)
+{
+    const uint32_t slot = USER_DATA_SLOT(cqe->user_data);
+    struct connection * connection = &state->connections[slot];
+    const char * data = NULL;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        const uint16_t id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        data = (const char *) state->buffers + (size_t) id * SERVER_RECEIVE_SIZE;
+        /* the data is copied out below before anything else can be received into the buffer */
+        provide_buffer(state, id);
+    }
+    if (USER_DATA_GENERATION(cqe->user_data) != connection->generation) {
+        return;
+    }
+    if ( !(cqe->flags & IORING_CQE_F_MORE) ) {
+        connection->receiving = false;
+    }
+    if (connection->closing) {
+        return;
+    }
+
+    if (cqe->res == -ENOBUFS) {
+        /* every provided buffer was in use, they are back by the time this is submitted */
+        arm_receive(state, slot);
+        return;
+    }
+    if (cqe->res <= 0 || data == NULL || connection->received + cqe->res > SERVER_BUFFER_SIZE - 1) {
+        close_connection(state, slot, 0);
+        return;
+    }
+    memcpy(connection->buffer + connection->received, data, cqe->res);
+    connection->received += cqe->res;
+
+    const int length = server_tcp_request_length(connection->buffer, connection->received);
+    if (length < 0) {
+        close_connection(state, slot, 0);
+    } else if (length > 0) {
+        const int reply_len = server_process(state->worker, connection->buffer, length, SERVER_BUFFER_SIZE, true);
+        close_connection(state, slot, reply_len > 0 ? reply_len : 0);
+    } else if ( !connection->receiving ) {
+        arm_receive(state, slot);
+    }
+}
+
+static void handle_close(struct uring_state * state, const struct io_uring_cqe * cqe)
+{
+    const uint32_t slot = USER_DATA_SLOT(cqe->user_data);
+    if (USER_DATA_GENERATION(cqe->user_data) != state->connections[slot].generation) {
+        return;
+    }
+    /* a failed send breaks the link and cancels the close */
+    if (cqe->res == -ECANCELED) {
+        close(state->connections[slot].socket);
+    }
+    free_connection(state, slot);
+}
+
+static void send_datagram(struct uring_state * state, uint32_t index)
+{
+    struct io_uring_sqe * sqe = get_sqe(state);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = state->worker->udp_socket;
+    sqe->addr = (uintptr_t) &state->udp_sends[index].message;
+    sqe->user_data = USER_DATA(OP_UDP_SEND, index, 0);
+}
+
+static void handle_udp_receive(struct uring_state * state, const struct io_uring_cqe * cqe)
+{
+    if ( !(cqe->flags & IORING_CQE_F_MORE) ) {
+        arm_udp_receive(state);
+    }
+    if (cqe->res < 0 || !(cqe->flags & IORING_CQE_F_BUFFER)) {
+        return;
+    }
+
+    const uint16_t id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    uint8_t * received = state->buffers + (size_t) id * SERVER_RECEIVE_SIZE;
+    const struct io_uring_recvmsg_out * out = (const struct io_uring_recvmsg_out *) received;
+    const uint32_t payload_offset = sizeof(*out) + state->udp_receive_message.msg_namelen;
+    uint32_t length = out->payloadlen;
+    if ((out->flags & MSG_TRUNC) || payload_offset + length > (uint32_t) cqe->res
+            || out->namelen > sizeof(struct sockaddr_in)) {
+        provide_buffer(state, id);
+        return;
+    }
+
+    /* the reply is built in a send slot, or in the datagram buffer and sent at once if all slots are in flight */
+    struct udp_send * send = NULL;
+    char * buffer = state->datagram;
+    if (state->udp_free_count > 0) {
+        send = &state->udp_sends[state->udp_free[--state->udp_free_count]];
+        buffer = send->buffer;
+    }
+    struct sockaddr_in address;
+    memcpy(&address, received + sizeof(*out), sizeof(address));
+    memcpy(buffer, received + payload_offset, length);
+    provide_buffer(state, id);
+
+    const int reply_len = server_process(state->worker, buffer, length, SERVER_BUFFER_SIZE, false);
+    if (send == NULL) {
+        if (reply_len > 0) {
+            sendto(state->worker->udp_socket, buffer, reply_len, 0, (struct sockaddr *) &address, sizeof(address));
+        }
+        return;
+    }
+    const uint32_t index = send - state->udp_sends;
+    if (reply_len <= 0) {
+        state->udp_free[state->udp_free_count++] = index;
+        return;
+    }
+    send->address = address;
+    send->iov.iov_base = send->buffer;
+    send->iov.iov_len = reply_len;
+    send->message.msg_name = &send->address;
+    send->message.msg_namelen = sizeof(send->address);
+    send->message.msg_iov = &send->iov;
+    send->message.msg_iovlen = 1;
+    send_datagram(state, index);
+}
+
+static void close_stale_connections(struct uring_state * state)
+{
+    const int64_t now = esp_timer_get_time();
+    for (uint32_t i = 0; i < SERVER_MAX_CONNECTIONS; i++) {
+        struct connection * connection = &state->connections[i];
+        if (connection->socket >= 0 && !connection->closing
+                && now - connection->accepted_us > URING_CONNECTION_TIMEOUT_MS * 1000LL) {
+            close_connection(state, i, 0);
+        }
+    }
+}
+
+static void handle_completions(struct uring_state * state)
+{
+    unsigned head = atomic_load_explicit(state->cq_head, memory_order_relaxed);
+    const unsigned tail = atomic_load_explicit(state->cq_tail, memory_order_acquire);
+    for (; head != tail; head++) {
+        const struct io_uring_cqe * cqe = &state->cqes[head & state->cq_mask];
+        switch (USER_DATA_OP(cqe->user_data)) {
+            case OP_ACCEPT:
+                handle_accept(state, cqe);
+                break;
+            case OP_RECV:
+                handle_receive(state, cqe);
+                break;
+            case OP_CLOSE:
+                handle_close(state, cqe);
+                break;
+            case OP_UDP_RECV:
+                handle_udp_receive(state, cqe);
+                break;
+            case OP_UDP_SEND:
+                /* like a datagram socket, a reply that cannot be sent is lost */
+                state->udp_free[state->udp_free_count++] = USER_DATA_SLOT(cqe->user_data);
+                break;
+            case OP_TIMEOUT:
+                close_stale_connections(state);
+                if ( !atomic_load_explicit(&server_stopping, memory_order_relaxed) ) {
+                    arm_timeout(state);
+                }
+                break;
+            default:
+                /* failed sends are followed by their cancelled close, and cancels are of no interest */
+                break;
+        }
+    }
+    atomic_store_explicit(state->cq_head, head, memory_order_release);
+    publish_buffers(state);
+}
+
+static void release(struct uring_state * state)
+{
+    for (uint32_t i = 0; i < SERVER_MAX_CONNECTIONS; i++) {
+        if (state->connections[i].socket >= 0) {
+            close(state->connections[i].socket);
+        }
+        free(state->connections[i].buffer);
+    }
+    if (state->ring >= 0) {
+        close(state->ring);
+    }
+    if (state->sqes != NULL && state->sqes != MAP_FAILED) {
+        munmap(state->sqes, state->sqes_size);
+    }
+    if (state->cq_ring != NULL && state->cq_ring != MAP_FAILED && state->cq_ring != state->sq_ring) {
+        munmap(state->cq_ring, state->cq_ring_size);
+    }
+    if (state->sq_ring != NULL && state->sq_ring != MAP_FAILED) {
+        munmap(state->sq_ring, state->sq_ring_size);
+    }
+    if (state->buffer_ring != NULL && state->buffer_ring != MAP_FAILED) {
+        munmap(state->buffer_ring, state->buffer_ring_size);
+    }
+    free(state->buffers);
+    free(state->udp_sends);
+    free(state);
+}
+
+bool server_uring_run(server_worker_t * worker)
+{
+    struct uring_state * state = calloc(1, sizeof(struct uring_state));
+    if (state == NULL) {
+        return false;
+    }
+    state->worker = worker;
+    state->ring = -1;
+    for (uint32_t i = 0; i < SERVER_MAX_CONNECTIONS; i++) {
+        state->connections[i].socket = -1;
+        state->free_slots[state->free_count++] = SERVER_MAX_CONNECTIONS - 1 - i;
+    }
+    state->udp_sends = calloc(URING_UDP_SENDS, sizeof(struct udp_send));
+    for (uint32_t i = 0; i < URING_UDP_SENDS; i++) {
+        state->udp_free[state->udp_free_count++] = i;
+    }
+    state->udp_receive_message.msg_namelen = sizeof(struct sockaddr_in);
+    state->tick.tv_sec = 1;
+
+    if (state->udp_sends == NULL || !open_ring(state) || !register_buffers(state)) {
+        release(state);
+        return false;
+    }
+
+    arm_accept(state);
+    arm_udp_receive(state);
+    arm_timeout(state);
+    while ( !atomic_load_explicit(&server_stopping, memory_order_relaxed) ) {
+        submit(state, 1);
+        handle_completions(state);
+    }
+
+    release(state);
+    return true;
+}
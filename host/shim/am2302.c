@@ -0,0 +1,39 @@
+/**
+ * @file AM2302 sensor simulation for the host build
+ */
+
+/* system includes */
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+/* local includes */
+#include "am2302.h"
+#include "esp_timer.h"
+#include "sim.h"
+
+#define DAY_S (24.0 * 3600.0)
+
+am2302_data_t am2302_read_data(gpio_num_t pin)
+{
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static unsigned int seed = 2302;
+    (void) pin;
+
+    pthread_mutex_lock(&lock);
+    const int noise = rand_r(&seed) % 5 - 2;
+    const int failure = rand_r(&seed) % 100;
+    pthread_mutex_unlock(&lock);
+
+    am2302_data_t data = {ESP_OK, 0, 0};
+    if (failure < sim_env_int("SIM_SENSOR_FAILURE_PERCENT", 0)) {
+        data.error = ESP_FAIL;
+        return data;
+    }
+
+    /* warmest in the afternoon, humidity moves the other way */
+    const double day_phase = 2.0 * M_PI * (esp_timer_get_time() / 1e6) / DAY_S;
+    data.temperature = (int) lround(215.0 + 30.0 * sin(day_phase)) + noise;
+    data.humidity = (int) lround(450.0 - 60.0 * sin(day_phase)) + noise;
+    return data;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file AM2302 temperature and humidity sensor driver for the host simulation build, readings follow a slow daily
+ * cycle with some noise
+ */
+
+#ifndef INTELLILIGHT_SIM_AM2302_H
+#define INTELLILIGHT_SIM_AM2302_H
+
+/* local includes */
+#include "esp_err.h"
+
+typedef enum
+{
+    GPIO_NUM_4 = 4,
+} gpio_num_t;
+
+typedef struct
+{
+    esp_err_t error;
+    int temperature;    /* tenths of a degree Celsius */
+    int humidity;       /* tenths of a percent */
+} am2302_data_t;
+
+/**
+ * @brief Read the sensor
+ * @param pin Data pin
+ * @return Reading, error is ESP_FAIL for the share of reads set by SIM_SENSOR_FAILURE_PERCENT
+ */
+extern am2302_data_t am2302_read_data(gpio_num_t pin);
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * @file ESP-IDF default event loop for the host simulation build
+ */
+
+/* system includes */
+#include <stdlib.h>
+#include <string.h>
+
+/* local includes */
+#include "esp_event.h"
+#include "freertos/task.h"
+
+#define MAX_HANDLERS 16
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+struct handler
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t function;
+    void * arg;
+};
+
+struct event
+{
+    struct event * next;
+    esp_event_base_t base;
+    int32_t id;
+    size_t size;
+    char data[];
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t posted = PTHREAD_COND_INITIALIZER;
+static bool loop_created = false;
+static struct handler handlers[MAX_HANDLERS];
+static int handler_count = 0;
+static struct event *queue_head = NULL;
+static struct event *queue_tail = NULL;
+
+static void dispatch(const struct event * event)
+{
+    pthread_mutex_lock(&lock);
+    const int count = handler_count;
+    pthread_mutex_unlock(&lock);
+
+    for (int i = 0; i < count; i++) {
+        const struct handler *handler = &handlers[i];
+        if ((handler->base == ESP_EVENT_ANY_BASE || handler->base == event->base)
+                && (handler->id == ESP_EVENT_ANY_ID || handler->id == event->id)) {
+            handler->function(handler->arg, event->base, event->id, event->size > 0 ? (void *) event->data : NULL);
+        }
+    }
+}
+
+static void event_task(void * arg)
+{
+    (void) arg;
+
+    while (true) {
+        pthread_mutex_lock(&lock);
+        while (queue_head == NULL) {
+            pthread_cond_wait(&posted, &lock);
+        }
+        struct event *event = queue_head;
+        queue_head = event->next;
+        if (queue_head == NULL) {
+            queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&lock);
+
+        dispatch(event);
+        free(event);
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    pthread_mutex_lock(&lock);
+    const bool created = loop_created;
+    loop_created = true;
+    pthread_mutex_unlock(&lock);
+
+    if (created) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return xTaskCreatePinnedToCore(event_task, "sys_evt", 2304, NULL, 20, NULL, 0) == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+        esp_event_handler_t event_handler, void * event_handler_arg, esp_event_handler_instance_t * instance)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+
+    /* handlers are only ever appended, so the event task reads the entries below the count it saw without the lock */
+    pthread_mutex_lock(&lock);
+    if (handler_count < MAX_HANDLERS) {
+        struct handler *handler = &handlers[handler_count];
+        handler->base = event_base;
+        handler->id = event_id;
+        handler->function = event_handler;
+        handler->arg = event_handler_arg;
+        if (instance != NULL) {
+            *instance = handler;
+        }
+        handler_count++;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void * event_data,
+        size_t event_data_size, TickType_t ticks_to_wait)
+{
+    (void) ticks_to_wait;
+
+    struct event *event = malloc(sizeof(struct event) + event_data_size);
+    if (event == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    event->next = NULL;
+    event->base = event_base;
+    event->id = event_id;
+    event->size = event_data != NULL ? event_data_size : 0;
+    if (event->size > 0) {
+        memcpy(event->data, event_data, event->size);
+    }
+
+    pthread_mutex_lock(&lock);
+    if (!loop_created) {
+        pthread_mutex_unlock(&lock);
+        free(event);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (queue_tail != NULL) {
+        queue_tail->next = event;
+    } else {
+        queue_head = event;
+    }
+    queue_tail = event;
+    pthread_cond_signal(&posted);
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file ESP-IDF default event loop for the host simulation build, handlers run on an event task in posting order
+ */
+
+#ifndef INTELLILIGHT_SIM_ESP_EVENT_H
+#define INTELLILIGHT_SIM_ESP_EVENT_H
+
+/* system includes */
+#include <stddef.h>
+#include <stdint.h>
+
+/* local includes */
+#include "esp_err.h"
+#include "esp_netif.h"
+#include "freertos/FreeRTOS.h"
+
+typedef const char * esp_event_base_t;
+typedef void (*esp_event_handler_t)(void * event_handler_arg, esp_event_base_t event_base, int32_t event_id,
+        void * event_data);
+typedef void * esp_event_handler_instance_t;
+
+#define ESP_EVENT_ANY_BASE NULL
+#define ESP_EVENT_ANY_ID -1
+
+extern esp_event_base_t const WIFI_EVENT;
+extern esp_event_base_t const IP_EVENT;
+
+typedef enum
+{
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+typedef struct
+{
+    esp_netif_t * esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+/**
+ * @brief Create the default event loop and its task
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if it exists
+ */
+extern esp_err_t esp_event_loop_create_default(void);
+
+/**
+ * @brief Register a handler with the default event loop
+ * @param event_base Base to handle, ESP_EVENT_ANY_BASE for all
+ * @param event_id Event to handle, ESP_EVENT_ANY_ID for all of the base
+ * @param event_handler Handler
+ * @param event_handler_arg Argument passed to the handler
+ * @param instance Receives the registration, may be NULL
+ * @return ESP_OK or ESP_ERR_NO_MEM
+ */
+extern esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+        esp_event_handler_t event_handler, void * event_handler_arg, esp_event_handler_instance_t * instance);
+
+/**
+ * @brief Post an event to the default event loop, the data is copied
+ * @param event_base Base
+ * @param event_id Event
+ * @param event_data Data passed to the handlers, may be NULL
+ * @param event_data_size Size of the data
+ * @param ticks_to_wait Ignored, the queue is unbounded
+ * @return ESP_OK, ESP_ERR_INVALID_STATE without a loop or ESP_ERR_NO_MEM
+ */
+extern esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void * event_data,
+        size_t event_data_size, TickType_t ticks_to_wait);
+
+#endif
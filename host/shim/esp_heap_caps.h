@@ -0,0 +1,41 @@
+/**
+ * @file ESP-IDF heap capabilities for the host simulation build. The simulated device has a heap of SIM_HEAP_SIZE
+ * bytes of which what the process has allocated is in use, capabilities are ignored.
+ */
+
+#ifndef INTELLILIGHT_SIM_ESP_HEAP_CAPS_H
+#define INTELLILIGHT_SIM_ESP_HEAP_CAPS_H
+
+/* system includes */
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+/* heap left to the application on an ESP32 running WiFi */
+#define SIM_HEAP_SIZE (200 * 1024)
+
+/**
+ * @brief Free bytes of the simulated heap
+ * @param caps Ignored
+ * @return Bytes free
+ */
+extern size_t heap_caps_get_free_size(uint32_t caps);
+
+/**
+ * @brief Lowest free bytes of the simulated heap seen by any heap function
+ * @param caps Ignored
+ * @return Bytes free at the low water mark
+ */
+extern size_t heap_caps_get_minimum_free_size(uint32_t caps);
+
+/**
+ * @brief Largest block that could be allocated, the simulated heap does not fragment
+ * @param caps Ignored
+ * @return Bytes free
+ */
+extern size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif
@@ -0,0 +1,25 @@
+/**
+ * @file ESP-IDF inter-processor calls for the host simulation build, the function runs on the calling thread
+ */
+
+#ifndef INTELLILIGHT_SIM_ESP_IPC_H
+#define INTELLILIGHT_SIM_ESP_IPC_H
+
+/* system includes */
+#include <stdint.h>
+
+/* local includes */
+#include "esp_err.h"
+
+typedef void (*esp_ipc_func_t)(void * arg);
+
+/**
+ * @brief Run func on core cpu_id and wait for it to return
+ * @param cpu_id Core, 0 or 1
+ * @param func Function
+ * @param arg Argument of func
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for a core that does not exist
+ */
+extern esp_err_t esp_ipc_call_blocking(uint32_t cpu_id, esp_ipc_func_t func, void * arg);
+
+#endif
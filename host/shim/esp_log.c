@@ -0,0 +1,74 @@
+/**
+ * @file ESP-IDF logging and environment helpers for the host simulation build
+ */
+
+/* system includes */
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* local includes */
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sim.h"
+
+static const char level_letters[] = "NEWIDV";
+
+static esp_log_level_t threshold = ESP_LOG_INFO;
+static pthread_once_t threshold_once = PTHREAD_ONCE_INIT;
+
+static void read_threshold(void)
+{
+    const char *name = getenv("SIM_LOG_LEVEL");
+    for (int i = ESP_LOG_ERROR; name != NULL && i <= ESP_LOG_VERBOSE; i++) {
+        if (name[0] == level_letters[i]) {
+            threshold = i;
+        }
+    }
+}
+
+void sim_log_write(esp_log_level_t level, const char * tag, const char * format, ...)
+{
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+    pthread_once(&threshold_once, read_threshold);
+    if (level > threshold) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&lock);
+    printf("%c (%u) %s: ", level_letters[level], esp_log_timestamp(), tag);
+    vprintf(format, args);
+    putchar('\n');
+    fflush(stdout);
+    pthread_mutex_unlock(&lock);
+    va_end(args);
+}
+
+void esp_log_level_set(const char * tag, esp_log_level_t level)
+{
+    (void) tag;
+    pthread_once(&threshold_once, read_threshold);
+    if (getenv("SIM_LOG_LEVEL") == NULL) {
+        threshold = level;
+    }
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t) (esp_timer_get_time() / 1000);
+}
+
+int32_t sim_env_int(const char * name, int32_t default_value)
+{
+    const char *value = getenv(name);
+    char *end;
+    if (value == NULL || *value == '\0') {
+        return default_value;
+    }
+    const long number = strtol(value, &end, 0);
+    return *end == '\0' ? (int32_t) number : default_value;
+}
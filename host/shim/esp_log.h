@@ -0,0 +1,50 @@
+/**
+ * @file ESP-IDF logging for the host simulation build, lines go to stdout in the format of the device console
+ */
+
+#ifndef INTELLILIGHT_SIM_ESP_LOG_H
+#define INTELLILIGHT_SIM_ESP_LOG_H
+
+/* system includes */
+#include <stdint.h>
+
+typedef enum
+{
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+/**
+ * @brief Write one log line if level is enabled, the threshold is taken from the SIM_LOG_LEVEL environment variable
+ * (E, W, I, D or V, default I)
+ * @param level Level of the message
+ * @param tag Tag of the module logging
+ * @param format printf format of the message
+ */
+extern void sim_log_write(esp_log_level_t level, const char * tag, const char * format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * @brief Set the log threshold, which only the SIM_LOG_LEVEL environment variable overrides
+ * @param tag "*" for all tags, the simulation has no per tag levels
+ * @param level Most verbose level written
+ */
+extern void esp_log_level_set(const char * tag, esp_log_level_t level);
+
+/**
+ * @brief Milliseconds since the simulated boot
+ * @return Timestamp as printed in log lines
+ */
+extern uint32_t esp_log_timestamp(void);
+
+#define ESP_LOGE(tag, format, ...) sim_log_write(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) sim_log_write(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) sim_log_write(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) sim_log_write(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) sim_log_write(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#endif
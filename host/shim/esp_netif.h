@@ -0,0 +1,51 @@
+/**
+ * @file ESP-IDF network interfaces for the host simulation build, the simulated station gets the loopback address
+ */
+
+#ifndef INTELLILIGHT_SIM_ESP_NETIF_H
+#define INTELLILIGHT_SIM_ESP_NETIF_H
+
+/* system includes */
+#include <stdint.h>
+
+/* local includes */
+#include "esp_err.h"
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct
+{
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct
+{
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+#define IPSTR "%d.%d.%d.%d"
+#define esp_ip4_addr_get_byte(ipaddr, idx) (((const uint8_t *) (&(ipaddr)->addr))[idx])
+#define IP2STR(ipaddr) esp_ip4_addr_get_byte(ipaddr, 0), esp_ip4_addr_get_byte(ipaddr, 1), \
+    esp_ip4_addr_get_byte(ipaddr, 2), esp_ip4_addr_get_byte(ipaddr, 3)
+
+/**
+ * @brief Initialise the TCP/IP stack
+ * @return ESP_OK
+ */
+extern esp_err_t esp_netif_init(void);
+
+/**
+ * @brief Create the station interface
+ * @return Interface
+ */
+extern esp_netif_t * esp_netif_create_default_wifi_sta(void);
+
+/**
+ * @brief Create the access point interface
+ * @return Interface
+ */
+extern esp_netif_t * esp_netif_create_default_wifi_ap(void);
+
+#endif
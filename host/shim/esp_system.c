@@ -0,0 +1,73 @@
+/**
+ * @file ESP-IDF heap figures and inter-processor calls for the host simulation build
+ */
+
+/* system includes */
+#include <malloc.h>
+#include <stdatomic.h>
+#include <sys/random.h>
+
+/* local includes */
+#include "esp_heap_caps.h"
+#include "esp_ipc.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+
+static atomic_size_t minimum_free = SIM_HEAP_SIZE;
+
+/* what the process has allocated is in use on the simulated heap */
+static size_t free_size(void)
+{
+    const struct mallinfo2 info = mallinfo2();
+    const size_t free = info.uordblks < SIM_HEAP_SIZE ? SIM_HEAP_SIZE - info.uordblks : 0;
+
+    size_t minimum = atomic_load(&minimum_free);
+    while (free < minimum && !atomic_compare_exchange_weak(&minimum_free, &minimum, free)) {
+    }
+    return free;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void) caps;
+    return free_size();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    (void) caps;
+    free_size();
+    return atomic_load(&minimum_free);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    (void) caps;
+    return free_size();
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return free_size();
+}
+
+uint32_t esp_get_free_internal_heap_size(void)
+{
+    return free_size();
+}
+
+uint32_t esp_random(void)
+{
+    uint32_t value = 0;
+    getrandom(&value, sizeof(value), 0);
+    return value;
+}
+
+esp_err_t esp_ipc_call_blocking(uint32_t cpu_id, esp_ipc_func_t func, void * arg)
+{
+    if (cpu_id >= portNUM_PROCESSORS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    func(arg);
+    return ESP_OK;
+}
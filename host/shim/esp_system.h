@@ -0,0 +1,29 @@
+/**
+ * @file ESP-IDF system functions for the host simulation build
+ */
+
+#ifndef INTELLILIGHT_SIM_ESP_SYSTEM_H
+#define INTELLILIGHT_SIM_ESP_SYSTEM_H
+
+/* system includes */
+#include <stdint.h>
+
+/**
+ * @brief Free heap of the simulated device
+ * @return Bytes free
+ */
+extern uint32_t esp_get_free_heap_size(void);
+
+/**
+ * @brief Free internal heap of the simulated device, all of it is internal
+ * @return Bytes free
+ */
+extern uint32_t esp_get_free_internal_heap_size(void);
+
+/**
+ * @brief Random number, from the host's generator in place of the hardware one
+ * @return 32 random bits
+ */
+extern uint32_t esp_random(void);
+
+#endif
@@ -0,0 +1,145 @@
+/**
+ * @file ESP-IDF high resolution timer and cycle counter on CLOCK_MONOTONIC for the host simulation build
+ */
+
+/* system includes */
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* local includes */
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "xtensa/hal.h"
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void * arg;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool armed;
+    uint64_t period_us;     /* 0 for a one-shot timer */
+    int64_t alarm_us;
+};
+
+/* the process start is the simulated boot */
+static struct timespec boot_time;
+
+__attribute__((constructor))
+static void capture_boot_time(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &boot_time);
+}
+
+static int64_t elapsed_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) (now.tv_sec - boot_time.tv_sec) * 1000000000LL + (now.tv_nsec - boot_time.tv_nsec);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return elapsed_ns() / 1000;
+}
+
+uint32_t xthal_get_ccount(void)
+{
+    return (uint32_t) ((uint64_t) elapsed_ns() * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / 1000);
+}
+
+static struct timespec monotonic_at(int64_t time_us)
+{
+    struct timespec at = boot_time;
+    at.tv_sec += time_us / 1000000;
+    at.tv_nsec += (time_us % 1000000) * 1000;
+    if (at.tv_nsec >= 1000000000L) {
+        at.tv_sec++;
+        at.tv_nsec -= 1000000000L;
+    }
+    return at;
+}
+
+/* each timer has a task of its own, on the device all callbacks share the esp_timer task */
+static void timer_task(void * arg)
+{
+    struct esp_timer *timer = arg;
+
+    pthread_mutex_lock(&timer->lock);
+    while (true) {
+        if (!timer->armed) {
+            pthread_cond_wait(&timer->changed, &timer->lock);
+            continue;
+        }
+        const struct timespec alarm = monotonic_at(timer->alarm_us);
+        if (pthread_cond_clockwait(&timer->changed, &timer->lock, CLOCK_MONOTONIC, &alarm) != ETIMEDOUT) {
+            continue;
+        }
+        if (!timer->armed || esp_timer_get_time() < timer->alarm_us) {
+            continue;
+        }
+        if (timer->period_us != 0) {
+            timer->alarm_us += timer->period_us;
+        } else {
+            timer->armed = false;
+        }
+        pthread_mutex_unlock(&timer->lock);
+        timer->callback(timer->arg);
+        pthread_mutex_lock(&timer->lock);
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t * create_args, esp_timer_handle_t * out_handle)
+{
+    struct esp_timer *timer = calloc(1, sizeof(struct esp_timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    pthread_mutex_init(&timer->lock, NULL);
+    pthread_cond_init(&timer->changed, NULL);
+
+    if (xTaskCreatePinnedToCore(timer_task, "esp_timer", 3584, timer, 22, NULL, 0) != pdPASS) {
+        free(timer);
+        return ESP_ERR_NO_MEM;
+    }
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    pthread_mutex_lock(&timer->lock);
+    const bool armed = timer->armed;
+    if (!armed) {
+        timer->armed = true;
+        timer->period_us = period_us;
+        timer->alarm_us = esp_timer_get_time() + timeout_us;
+        pthread_cond_signal(&timer->changed);
+    }
+    pthread_mutex_unlock(&timer->lock);
+    return armed ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return start(timer, period, period);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout)
+{
+    return start(timer, timeout, 0);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&timer->lock);
+    const bool armed = timer->armed;
+    timer->armed = false;
+    pthread_cond_signal(&timer->changed);
+    pthread_mutex_unlock(&timer->lock);
+    return armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
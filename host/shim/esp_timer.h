@@ -0,0 +1,69 @@
+/**
+ * @file ESP-IDF high resolution timer for the host simulation build, backed by CLOCK_MONOTONIC
+ */
+
+#ifndef INTELLILIGHT_SIM_ESP_TIMER_H
+#define INTELLILIGHT_SIM_ESP_TIMER_H
+
+/* system includes */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* local includes */
+#include "esp_err.h"
+
+typedef struct esp_timer * esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void * arg);
+
+typedef enum
+{
+    ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+
+typedef struct
+{
+    esp_timer_cb_t callback;
+    void * arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char * name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+/**
+ * @brief Microseconds since the simulated boot, which is the start of the process
+ * @return Time in microseconds
+ */
+extern int64_t esp_timer_get_time(void);
+
+/**
+ * @brief Create a timer, its callback runs on a thread of its own
+ * @param create_args Callback, argument and name
+ * @param out_handle Receives the timer
+ * @return ESP_OK or ESP_ERR_NO_MEM
+ */
+extern esp_err_t esp_timer_create(const esp_timer_create_args_t * create_args, esp_timer_handle_t * out_handle);
+
+/**
+ * @brief Run the callback of timer every period microseconds
+ * @param timer Timer that is not running
+ * @param period Period in microseconds
+ * @return ESP_OK or ESP_ERR_INVALID_STATE if it is running already
+ */
+extern esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+
+/**
+ * @brief Run the callback of timer once after timeout microseconds
+ * @param timer Timer that is not running
+ * @param timeout Delay in microseconds
+ * @return ESP_OK or ESP_ERR_INVALID_STATE if it is running already
+ */
+extern esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout);
+
+/**
+ * @brief Stop timer, a callback that is running completes
+ * @param timer Timer
+ * @return ESP_OK or ESP_ERR_INVALID_STATE if it is not running
+ */
+extern esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+#endif
@@ -0,0 +1,262 @@
+/**
+ * @file ESP-IDF WiFi driver and network interfaces for the host simulation build
+ *
+ * There is one simulated access point. Connecting scans for it (SIM_WIFI_SCAN_MS) unless the station configuration
+ * names a BSSID and channel, which is quicker (SIM_WIFI_ASSOCIATE_MS) but fails if they are not those of the access
+ * point. The address, 127.0.0.1, follows after SIM_WIFI_DHCP_MS. In access point mode a station joins shortly after
+ * the start.
+ */
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* local includes */
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+static const char *log_tag = "sim_wifi";
+
+struct esp_netif_obj
+{
+    int reserved;
+};
+
+static esp_netif_t netif_sta;
+static esp_netif_t netif_ap;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static wifi_mode_t mode = WIFI_MODE_NULL;
+static wifi_config_t configs[2];
+static bool started = false;
+static bool connecting = false;
+static bool connected = false;
+/* advanced on every disconnect so that an attempt in flight does not deliver a stale address */
+static uint32_t association = 0;
+
+/* the simulated access point */
+static uint8_t ap_bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static uint8_t ap_channel = 6;
+
+static void load_access_point(void)
+{
+    const char *bssid = getenv("SIM_WIFI_BSSID");
+    unsigned int bytes[6];
+    if (bssid != NULL && sscanf(bssid, "%x:%x:%x:%x:%x:%x",
+            &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) == 6) {
+        for (int i = 0; i < 6; i++) {
+            ap_bssid[i] = bytes[i];
+        }
+    }
+    ap_channel = sim_env_int("SIM_WIFI_CHANNEL", ap_channel);
+}
+
+static void post_disconnected(uint8_t reason)
+{
+    wifi_event_sta_disconnected_t event = {0};
+    pthread_mutex_lock(&lock);
+    const wifi_sta_config_t *sta = &configs[WIFI_IF_STA].sta;
+    event.ssid_len = strnlen((const char *) sta->ssid, sizeof(sta->ssid));
+    memcpy(event.ssid, sta->ssid, event.ssid_len);
+    memcpy(event.bssid, sta->bssid_set ? sta->bssid : ap_bssid, sizeof(event.bssid));
+    pthread_mutex_unlock(&lock);
+    event.reason = reason;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event), portMAX_DELAY);
+}
+
+static void connect_task(void * arg)
+{
+    (void) arg;
+
+    pthread_mutex_lock(&lock);
+    const uint32_t attempt = association;
+    const wifi_sta_config_t sta = configs[WIFI_IF_STA].sta;
+    pthread_mutex_unlock(&lock);
+
+    const bool direct = sta.bssid_set && sta.channel != 0;
+    vTaskDelay(pdMS_TO_TICKS(direct ? sim_env_int("SIM_WIFI_ASSOCIATE_MS", 200) : sim_env_int("SIM_WIFI_SCAN_MS", 1500)));
+
+    if ((sta.bssid_set && memcmp(sta.bssid, ap_bssid, sizeof(ap_bssid)) != 0)
+            || (sta.channel != 0 && sta.channel != ap_channel)) {
+        ESP_LOGI(log_tag, "no access point "MACSTR" on channel %d", MAC2STR(sta.bssid), sta.channel);
+        pthread_mutex_lock(&lock);
+        connecting = false;
+        pthread_mutex_unlock(&lock);
+        post_disconnected(WIFI_REASON_NO_AP_FOUND);
+        vTaskDelete(NULL);
+    }
+
+    pthread_mutex_lock(&lock);
+    connecting = false;
+    const bool current = attempt == association;
+    connected = current;
+    pthread_mutex_unlock(&lock);
+    if (!current) {
+        vTaskDelete(NULL);
+    }
+
+    wifi_event_sta_connected_t event = {0};
+    event.ssid_len = strnlen((const char *) sta.ssid, sizeof(sta.ssid));
+    memcpy(event.ssid, sta.ssid, event.ssid_len);
+    memcpy(event.bssid, ap_bssid, sizeof(event.bssid));
+    event.channel = ap_channel;
+    event.authmode = sta.threshold.authmode;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &event, sizeof(event), portMAX_DELAY);
+
+    vTaskDelay(pdMS_TO_TICKS(sim_env_int("SIM_WIFI_DHCP_MS", 300)));
+    pthread_mutex_lock(&lock);
+    const bool still_connected = connected && attempt == association;
+    pthread_mutex_unlock(&lock);
+    if (still_connected) {
+        ip_event_got_ip_t got_ip = {0};
+        got_ip.esp_netif = &netif_sta;
+        got_ip.ip_info.ip.addr = htonl(INADDR_LOOPBACK);
+        got_ip.ip_info.netmask.addr = htonl(0xFF000000);
+        got_ip.ip_info.gw.addr = htonl(INADDR_LOOPBACK);
+        got_ip.ip_changed = true;
+        esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), portMAX_DELAY);
+    }
+    vTaskDelete(NULL);
+}
+
+static void station_join_task(void * arg)
+{
+    (void) arg;
+
+    vTaskDelay(pdMS_TO_TICKS(sim_env_int("SIM_WIFI_ASSOCIATE_MS", 200)));
+    wifi_event_ap_staconnected_t event = {
+        .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02},
+        .aid = 1,
+    };
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_AP_STACONNECTED, &event, sizeof(event), portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t * esp_netif_create_default_wifi_sta(void)
+{
+    return &netif_sta;
+}
+
+esp_netif_t * esp_netif_create_default_wifi_ap(void)
+{
+    return &netif_ap;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t * config)
+{
+    (void) config;
+    load_access_point();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t new_mode)
+{
+    if (new_mode != WIFI_MODE_STA && new_mode != WIFI_MODE_AP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&lock);
+    mode = new_mode;
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t * conf)
+{
+    pthread_mutex_lock(&lock);
+    configs[interface] = *conf;
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t * conf)
+{
+    pthread_mutex_lock(&lock);
+    *conf = configs[interface];
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mac(wifi_interface_t interface, const uint8_t mac[6])
+{
+    (void) interface;
+    (void) mac;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    pthread_mutex_lock(&lock);
+    const wifi_mode_t started_mode = mode;
+    started = mode != WIFI_MODE_NULL;
+    pthread_mutex_unlock(&lock);
+
+    if (started_mode == WIFI_MODE_STA) {
+        return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+    } else if (started_mode == WIFI_MODE_AP) {
+        const esp_err_t err = esp_event_post(WIFI_EVENT, WIFI_EVENT_AP_START, NULL, 0, portMAX_DELAY);
+        if (err == ESP_OK && xTaskCreatePinnedToCore(station_join_task, "sim_wifi", 2048, NULL, 5, NULL, 0) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+        return err;
+    }
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    pthread_mutex_lock(&lock);
+    if (!started || mode != WIFI_MODE_STA) {
+        pthread_mutex_unlock(&lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    const bool busy = connecting || connected;
+    if (!busy) {
+        connecting = true;
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (busy) {
+        return ESP_OK;
+    }
+    if (xTaskCreatePinnedToCore(connect_task, "sim_wifi", 2048, NULL, 5, NULL, 0) != pdPASS) {
+        pthread_mutex_lock(&lock);
+        connecting = false;
+        pthread_mutex_unlock(&lock);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static void disconnect(uint8_t reason)
+{
+    pthread_mutex_lock(&lock);
+    const bool was_connected = connected;
+    connected = false;
+    association++;
+    pthread_mutex_unlock(&lock);
+
+    if (was_connected) {
+        post_disconnected(reason);
+    }
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    disconnect(WIFI_REASON_ASSOC_LEAVE);
+    return ESP_OK;
+}
+
+void sim_wifi_drop(void)
+{
+    ESP_LOGW(log_tag, "access point lost");
+    disconnect(WIFI_REASON_BEACON_TIMEOUT);
+}
@@ -0,0 +1,206 @@
+/**
+ * @file ESP-IDF WiFi driver for the host simulation build. The simulated station associates with an access point
+ * after a delay and gets the loopback address, see sim.h for the environment variables that shape it.
+ */
+
+#ifndef INTELLILIGHT_SIM_ESP_WIFI_H
+#define INTELLILIGHT_SIM_ESP_WIFI_H
+
+/* system includes */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* local includes */
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_system.h"
+
+typedef enum
+{
+    WIFI_EVENT_WIFI_READY = 0,
+    WIFI_EVENT_SCAN_DONE,
+    WIFI_EVENT_STA_START,
+    WIFI_EVENT_STA_STOP,
+    WIFI_EVENT_STA_CONNECTED,
+    WIFI_EVENT_STA_DISCONNECTED,
+    WIFI_EVENT_STA_AUTHMODE_CHANGE,
+    WIFI_EVENT_STA_WPS_ER_SUCCESS,
+    WIFI_EVENT_STA_WPS_ER_FAILED,
+    WIFI_EVENT_STA_WPS_ER_TIMEOUT,
+    WIFI_EVENT_STA_WPS_ER_PIN,
+    WIFI_EVENT_STA_WPS_ER_PBC_OVERLAP,
+    WIFI_EVENT_AP_START,
+    WIFI_EVENT_AP_STOP,
+    WIFI_EVENT_AP_STACONNECTED,
+    WIFI_EVENT_AP_STADISCONNECTED,
+} wifi_event_t;
+
+typedef enum
+{
+    WIFI_MODE_NULL = 0,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA,
+} wifi_mode_t;
+
+typedef enum
+{
+    WIFI_IF_STA = 0,
+    WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef enum
+{
+    WIFI_AUTH_OPEN = 0,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+} wifi_auth_mode_t;
+
+typedef enum
+{
+    WIFI_FAST_SCAN = 0,
+    WIFI_ALL_CHANNEL_SCAN,
+} wifi_scan_method_t;
+
+typedef enum
+{
+    WIFI_CONNECT_AP_BY_SIGNAL = 0,
+    WIFI_CONNECT_AP_BY_SECURITY,
+} wifi_sort_method_t;
+
+typedef enum
+{
+    WIFI_REASON_ASSOC_LEAVE = 8,
+    WIFI_REASON_BEACON_TIMEOUT = 200,
+    WIFI_REASON_NO_AP_FOUND = 201,
+} wifi_err_reason_t;
+
+typedef struct
+{
+    int8_t rssi;
+    wifi_auth_mode_t authmode;
+} wifi_scan_threshold_t;
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t password[64];
+    wifi_scan_method_t scan_method;
+    bool bssid_set;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint16_t listen_interval;
+    wifi_sort_method_t sort_method;
+    wifi_scan_threshold_t threshold;
+} wifi_sta_config_t;
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t password[64];
+    uint8_t ssid_len;
+    uint8_t channel;
+    wifi_auth_mode_t authmode;
+    uint8_t ssid_hidden;
+    uint8_t max_connection;
+    uint16_t beacon_interval;
+} wifi_ap_config_t;
+
+typedef union
+{
+    wifi_ap_config_t ap;
+    wifi_sta_config_t sta;
+} wifi_config_t;
+
+typedef struct
+{
+    int reserved;
+} wifi_init_config_t;
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t channel;
+    wifi_auth_mode_t authmode;
+} wifi_event_sta_connected_t;
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t reason;
+} wifi_event_sta_disconnected_t;
+
+typedef struct
+{
+    uint8_t mac[6];
+    uint8_t aid;
+} wifi_event_ap_staconnected_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT() { 0 }
+
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+
+/**
+ * @brief Initialise the driver
+ * @param config Ignored
+ * @return ESP_OK
+ */
+extern esp_err_t esp_wifi_init(const wifi_init_config_t * config);
+
+/**
+ * @brief Select station or access point mode
+ * @param mode WIFI_MODE_STA or WIFI_MODE_AP
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for other modes
+ */
+extern esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+
+/**
+ * @brief Set the configuration of an interface
+ * @param interface Interface
+ * @param conf Configuration, copied
+ * @return ESP_OK
+ */
+extern esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t * conf);
+
+/**
+ * @brief Get the configuration of an interface
+ * @param interface Interface
+ * @param conf Receives the configuration
+ * @return ESP_OK
+ */
+extern esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t * conf);
+
+/**
+ * @brief Set the MAC address of an interface
+ * @param interface Interface
+ * @param mac Address
+ * @return ESP_OK
+ */
+extern esp_err_t esp_wifi_set_mac(wifi_interface_t interface, const uint8_t mac[6]);
+
+/**
+ * @brief Start the driver, posts WIFI_EVENT_STA_START or WIFI_EVENT_AP_START
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE without a mode or event loop
+ */
+extern esp_err_t esp_wifi_start(void);
+
+/**
+ * @brief Associate with the configured access point, posts WIFI_EVENT_STA_CONNECTED and IP_EVENT_STA_GOT_IP or
+ * WIFI_EVENT_STA_DISCONNECTED when the simulated attempt completes
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if not started in station mode
+ */
+extern esp_err_t esp_wifi_connect(void);
+
+/**
+ * @brief Leave the access point, posts WIFI_EVENT_STA_DISCONNECTED
+ * @return ESP_OK
+ */
+extern esp_err_t esp_wifi_disconnect(void);
+
+#endif
@@ -0,0 +1,228 @@
+/**
+ * @file FreeRTOS tasks, delays, notifications and mutexes on POSIX threads for the host simulation build
+ */
+
+/* system includes */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* local includes */
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+struct sim_task
+{
+    pthread_t thread;
+    TaskFunction_t function;
+    void * parameters;
+    char name[16];
+    uint32_t stack_depth;
+    BaseType_t core;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notifications;
+};
+
+/* app_main runs on the main thread, which is the main task on core 0 like on the device */
+static struct sim_task main_task = {
+    .name = "main",
+    .stack_depth = 3584,
+    .core = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .notified = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread struct sim_task *current_task = NULL;
+
+/* absolute CLOCK_MONOTONIC time ticks from now */
+static struct timespec deadline_after(TickType_t ticks)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    const uint64_t ns = (uint64_t) ticks * portTICK_PERIOD_MS * 1000000ULL;
+    deadline.tv_sec += ns / 1000000000ULL;
+    deadline.tv_nsec += ns % 1000000000ULL;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+static void * task_entry(void * arg)
+{
+    struct sim_task *task = arg;
+    current_task = task;
+    pthread_setname_np(pthread_self(), task->name);
+    task->function(task->parameters);
+
+    /* a FreeRTOS task must not return */
+    fprintf(stderr, "task %s returned from its function\n", task->name);
+    abort();
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return xTaskGetCurrentTaskHandle()->core;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char * name, uint32_t stack_depth,
+        void * parameters, UBaseType_t priority, StackType_t * stack_buffer, StaticTask_t * task_buffer,
+        BaseType_t core_id)
+{
+    (void) priority;
+    (void) stack_buffer;
+    (void) task_buffer;
+
+    struct sim_task *task = calloc(1, sizeof(struct sim_task));
+    if (task == NULL) {
+        return NULL;
+    }
+    task->function = function;
+    task->parameters = parameters;
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->stack_depth = stack_depth;
+    task->core = core_id == tskNO_AFFINITY ? 0 : core_id;
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->notified, NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    const int err = pthread_create(&task->thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        free(task);
+        return NULL;
+    }
+    return task;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char * name, uint32_t stack_depth,
+        void * parameters, UBaseType_t priority, TaskHandle_t * created_task, BaseType_t core_id)
+{
+    TaskHandle_t task = xTaskCreateStaticPinnedToCore(function, name, stack_depth, parameters, priority, NULL, NULL,
+            core_id);
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+    return task != NULL ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char * name, uint32_t stack_depth,
+        void * parameters, UBaseType_t priority, TaskHandle_t * created_task)
+{
+    return xTaskCreatePinnedToCore(function, name, stack_depth, parameters, priority, created_task, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task != NULL && task != current_task) {
+        fprintf(stderr, "vTaskDelete of another task is not simulated\n");
+        abort();
+    }
+    /* like FreeRTOS frees the control block, handles to a deleted task must not be used any more */
+    if (current_task != NULL) {
+        pthread_mutex_destroy(&current_task->lock);
+        pthread_cond_destroy(&current_task->notified);
+        free(current_task);
+        current_task = NULL;
+    }
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    const struct timespec deadline = deadline_after(ticks);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+void vTaskDelayUntil(TickType_t * previous_wake_time, TickType_t increment)
+{
+    *previous_wake_time += increment;
+    const TickType_t now = xTaskGetTickCount();
+    if ((int32_t) (*previous_wake_time - now) > 0) {
+        vTaskDelay(*previous_wake_time - now);
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t) (esp_timer_get_time() / (1000 * portTICK_PERIOD_MS));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current_task != NULL ? current_task : &main_task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    if (task == NULL) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    return task->stack_depth;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notifications++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    struct sim_task *task = xTaskGetCurrentTaskHandle();
+    const struct timespec deadline = deadline_after(ticks_to_wait);
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notifications == 0) {
+        if (ticks_to_wait == portMAX_DELAY) {
+            pthread_cond_wait(&task->notified, &task->lock);
+        } else if (pthread_cond_clockwait(&task->notified, &task->lock, CLOCK_MONOTONIC, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    const uint32_t count = task->notifications;
+    if (count > 0) {
+        task->notifications = clear_on_exit ? 0 : count - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t * buffer)
+{
+    pthread_mutex_init(&buffer->mutex, NULL);
+    return buffer;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    StaticSemaphore_t *buffer = malloc(sizeof(StaticSemaphore_t));
+    return buffer != NULL ? xSemaphoreCreateMutexStatic(buffer) : NULL;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    if (ticks_to_wait == portMAX_DELAY) {
+        return pthread_mutex_lock(&semaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+    }
+    const struct timespec deadline = deadline_after(ticks_to_wait);
+    return pthread_mutex_clocklock(&semaphore->mutex, CLOCK_MONOTONIC, &deadline) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    pthread_mutex_unlock(&semaphore->mutex);
+    return pdTRUE;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file FreeRTOS base types for the host simulation build. Tasks are POSIX threads, ticks are milliseconds and a
+ * critical section is a mutex, so code that relies on a critical section disabling interrupts is not modelled.
+ */
+
+#ifndef INTELLILIGHT_SIM_FREERTOS_H
+#define INTELLILIGHT_SIM_FREERTOS_H
+
+/* system includes */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* local includes */
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+typedef struct sim_task * TaskHandle_t;
+
+/* control block storage of a static task, the simulation allocates its own */
+typedef struct
+{
+    int reserved;
+} StaticTask_t;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_MUTEX_INITIALIZER }
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(&(mux)->mutex)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(&(mux)->mutex)
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms) ((TickType_t) (((TickType_t) (ms) * configTICK_RATE_HZ) / 1000))
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define portNUM_PROCESSORS 2
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+/**
+ * @brief Core the calling task was pinned to, 0 for tasks without affinity and threads the simulation did not create
+ * @return Core number
+ */
+extern BaseType_t xPortGetCoreID(void);
+
+#endif
@@ -0,0 +1,11 @@
+/**
+ * @file FreeRTOS event groups for the host simulation build, included by the sources but not used
+ */
+
+#ifndef INTELLILIGHT_SIM_EVENT_GROUPS_H
+#define INTELLILIGHT_SIM_EVENT_GROUPS_H
+
+/* local includes */
+#include "freertos/FreeRTOS.h"
+
+#endif
@@ -0,0 +1,46 @@
+/**
+ * @file FreeRTOS mutex semaphores for the host simulation build
+ */
+
+#ifndef INTELLILIGHT_SIM_SEMPHR_H
+#define INTELLILIGHT_SIM_SEMPHR_H
+
+/* local includes */
+#include "freertos/FreeRTOS.h"
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+} StaticSemaphore_t;
+
+typedef StaticSemaphore_t * SemaphoreHandle_t;
+
+/**
+ * @brief Create a mutex in caller provided storage
+ * @param buffer Storage of the mutex
+ * @return Handle of the mutex
+ */
+extern SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t * buffer);
+
+/**
+ * @brief Create a mutex on the heap
+ * @return Handle of the mutex, NULL if out of memory
+ */
+extern SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+/**
+ * @brief Lock a mutex
+ * @param semaphore Mutex
+ * @param ticks_to_wait Ticks to wait, portMAX_DELAY for ever
+ * @return pdTRUE if taken, pdFALSE on timeout
+ */
+extern BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait);
+
+/**
+ * @brief Unlock a mutex
+ * @param semaphore Mutex held by the calling task
+ * @return pdTRUE
+ */
+extern BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif
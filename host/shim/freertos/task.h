@@ -0,0 +1,89 @@
+/**
+ * @file FreeRTOS tasks for the host simulation build. The stack buffer of a static task is not used: threads get a
+ * stack of the platform default size, so stack high water marks report the whole configured size as free.
+ */
+
+#ifndef INTELLILIGHT_SIM_TASK_H
+#define INTELLILIGHT_SIM_TASK_H
+
+/* local includes */
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+
+/**
+ * @brief Create a task pinned to a core
+ * @return pdPASS, or pdFAIL if the thread could not be created
+ */
+extern BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char * name, uint32_t stack_depth,
+        void * parameters, UBaseType_t priority, TaskHandle_t * created_task, BaseType_t core_id);
+
+/**
+ * @brief Create a task without affinity
+ * @return pdPASS, or pdFAIL if the thread could not be created
+ */
+extern BaseType_t xTaskCreate(TaskFunction_t function, const char * name, uint32_t stack_depth,
+        void * parameters, UBaseType_t priority, TaskHandle_t * created_task);
+
+/**
+ * @brief Create a task pinned to a core from caller provided storage
+ * @return Handle of the task, NULL if the thread could not be created
+ */
+extern TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char * name, uint32_t stack_depth,
+        void * parameters, UBaseType_t priority, StackType_t * stack_buffer, StaticTask_t * task_buffer,
+        BaseType_t core_id);
+
+/**
+ * @brief Delete a task, only the calling task (NULL) can be deleted in the simulation
+ * @param task NULL
+ */
+extern void vTaskDelete(TaskHandle_t task);
+
+/**
+ * @brief Block the calling task
+ * @param ticks Ticks to sleep
+ */
+extern void vTaskDelay(TickType_t ticks);
+
+/**
+ * @brief Block the calling task until a fixed period after the previous wake time, which is advanced
+ * @param previous_wake_time Tick count of the previous wake, updated
+ * @param increment Period in ticks
+ */
+extern void vTaskDelayUntil(TickType_t * previous_wake_time, TickType_t increment);
+
+/**
+ * @brief Ticks since the simulated boot
+ * @return Tick count
+ */
+extern TickType_t xTaskGetTickCount(void);
+
+/**
+ * @brief Handle of the calling task, the main thread has one too
+ * @return Task handle
+ */
+extern TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+/**
+ * @brief Minimum free stack, which the simulation cannot measure and reports as the configured stack size
+ * @param task Task, NULL for the calling task
+ * @return Stack size in bytes
+ */
+extern UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+/**
+ * @brief Give a notification to task
+ * @param task Task to notify
+ * @return pdPASS
+ */
+extern BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+/**
+ * @brief Wait for notifications of the calling task
+ * @param clear_on_exit pdTRUE to clear the count, pdFALSE to decrement it
+ * @param ticks_to_wait Ticks to wait, portMAX_DELAY for ever
+ * @return Notification count before it was cleared or decremented, 0 on timeout
+ */
+extern uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+
+#endif
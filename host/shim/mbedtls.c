@@ -0,0 +1,104 @@
+/**
+ * @file mbedtls SHA-1 and base64 for the host simulation build, the two functions the WebSocket handshake needs
+ */
+
+/* system includes */
+#include <stdint.h>
+#include <string.h>
+
+/* local includes */
+#include "mbedtls/base64.h"
+#include "mbedtls/sha1.h"
+
+static uint32_t rotate(const uint32_t value, const int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1_block(uint32_t state[5], const unsigned char block[64])
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8
+            | block[4 * i + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        const uint32_t t = rotate(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotate(b, 30);
+        b = a;
+        a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+int mbedtls_sha1_ret(const unsigned char * input, size_t ilen, unsigned char output[20])
+{
+    uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    const uint64_t bits = (uint64_t)ilen * 8;
+    for (; ilen >= 64; input += 64, ilen -= 64) {
+        sha1_block(state, input);
+    }
+
+    /* the rest, the 0x80 marker and the length in bits, in one or two blocks */
+    unsigned char tail[128] = { 0 };
+    memcpy(tail, input, ilen);
+    tail[ilen] = 0x80;
+    const size_t tail_length = ilen < 56 ? 64 : 128;
+    for (int i = 0; i < 8; i++) {
+        tail[tail_length - 1 - i] = bits >> (8 * i);
+    }
+    for (size_t offset = 0; offset < tail_length; offset += 64) {
+        sha1_block(state, tail + offset);
+    }
+    for (int i = 0; i < 20; i++) {
+        output[i] = state[i / 4] >> (24 - 8 * (i % 4));
+    }
+    return 0;
+}
+
+int mbedtls_base64_encode(unsigned char * dst, size_t dlen, size_t * olen, const unsigned char * src, size_t slen)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const size_t needed = (slen + 2) / 3 * 4;
+    if (dlen < needed + 1) {
+        *olen = needed + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    unsigned char * out = dst;
+    for (size_t i = 0; i < slen; i += 3) {
+        const uint32_t group = (uint32_t)src[i] << 16 | (i + 1 < slen ? src[i + 1] << 8 : 0)
+            | (i + 2 < slen ? src[i + 2] : 0);
+        *out++ = alphabet[group >> 18 & 0x3f];
+        *out++ = alphabet[group >> 12 & 0x3f];
+        *out++ = i + 1 < slen ? alphabet[group >> 6 & 0x3f] : '=';
+        *out++ = i + 2 < slen ? alphabet[group & 0x3f] : '=';
+    }
+    *out = 0;
+    *olen = needed;
+    return 0;
+}
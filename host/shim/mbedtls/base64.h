@@ -0,0 +1,25 @@
+/**
+ * @file mbedtls base64 encoding for the host simulation build
+ */
+
+#ifndef INTELLILIGHT_SIM_MBEDTLS_BASE64_H
+#define INTELLILIGHT_SIM_MBEDTLS_BASE64_H
+
+/* system includes */
+#include <stddef.h>
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+
+/**
+ * @brief Encode a buffer in base64, with a terminating zero
+ * @param dst Output
+ * @param dlen Size of the output
+ * @param olen Output, length of the encoding without the terminator, or the size needed if dst is too small
+ * @param src Data
+ * @param slen Length of the data
+ * @return 0, or MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL
+ */
+extern int mbedtls_base64_encode(unsigned char * dst, size_t dlen, size_t * olen, const unsigned char * src,
+        size_t slen);
+
+#endif
@@ -0,0 +1,20 @@
+/**
+ * @file mbedtls SHA-1 for the host simulation build
+ */
+
+#ifndef INTELLILIGHT_SIM_MBEDTLS_SHA1_H
+#define INTELLILIGHT_SIM_MBEDTLS_SHA1_H
+
+/* system includes */
+#include <stddef.h>
+
+/**
+ * @brief SHA-1 digest of a buffer
+ * @param input Data
+ * @param ilen Length of the data
+ * @param output Output, 20 bytes
+ * @return 0
+ */
+extern int mbedtls_sha1_ret(const unsigned char * input, size_t ilen, unsigned char output[20]);
+
+#endif
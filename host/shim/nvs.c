@@ -0,0 +1,285 @@
+/**
+ * @file ESP-IDF non-volatile storage for the host simulation build
+ *
+ * Every entry is a line "<namespace> <key> <hex bytes>" of the storage file, which is rewritten on commit. Only
+ * blobs are simulated.
+ */
+
+/* system includes */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* local includes */
+#include "esp_log.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define MAX_ENTRIES 64
+#define MAX_HANDLES 8
+#define MAX_BLOB_SIZE 1984
+
+static const char *log_tag = "sim_nvs";
+
+struct entry
+{
+    char name_space[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    size_t length;
+    uint8_t *value;
+};
+
+struct open_handle
+{
+    bool used;
+    nvs_open_mode_t mode;
+    char name_space[NVS_KEY_NAME_MAX_SIZE];
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static bool initialised = false;
+static struct entry entries[MAX_ENTRIES];
+static struct open_handle handles[MAX_HANDLES];
+
+static const char * storage_file(void)
+{
+    const char *file = getenv("SIM_NVS_FILE");
+    return file != NULL ? file : "sim_nvs.txt";
+}
+
+static void clear_entries(void)
+{
+    for (int i = 0; i < MAX_ENTRIES; i++) {
+        free(entries[i].value);
+        memset(&entries[i], 0, sizeof(entries[i]));
+    }
+}
+
+static struct entry * find_entry(const char * name_space, const char * key)
+{
+    for (int i = 0; i < MAX_ENTRIES; i++) {
+        if (entries[i].value != NULL && strcmp(entries[i].name_space, name_space) == 0
+                && (key == NULL || strcmp(entries[i].key, key) == 0)) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static bool store_entry(const char * name_space, const char * key, const void * value, size_t length)
+{
+    struct entry *entry = find_entry(name_space, key);
+    for (int i = 0; entry == NULL && i < MAX_ENTRIES; i++) {
+        if (entries[i].value == NULL) {
+            entry = &entries[i];
+        }
+    }
+    /* a zero length blob still needs a non-NULL value to mark the entry used */
+    uint8_t *copy = malloc(length > 0 ? length : 1);
+    if (entry == NULL || copy == NULL) {
+        free(copy);
+        return false;
+    }
+    memcpy(copy, value, length);
+    free(entry->value);
+    snprintf(entry->name_space, sizeof(entry->name_space), "%s", name_space);
+    snprintf(entry->key, sizeof(entry->key), "%s", key);
+    entry->value = copy;
+    entry->length = length;
+    return true;
+}
+
+static bool load(FILE * file)
+{
+    char name_space[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    static char hex[2 * MAX_BLOB_SIZE + 1];
+    static uint8_t value[MAX_BLOB_SIZE];
+
+    int fields;
+    while ((fields = fscanf(file, "%15s %15s %3968s", name_space, key, hex)) == 3) {
+        const size_t length = strlen(hex) / 2;
+        for (size_t i = 0; i < length; i++) {
+            unsigned int byte;
+            if (sscanf(&hex[2 * i], "%2x", &byte) != 1) {
+                return false;
+            }
+            value[i] = byte;
+        }
+        if (!store_entry(name_space, key, value, length)) {
+            return false;
+        }
+    }
+    return fields == EOF;
+}
+
+static esp_err_t save(void)
+{
+    FILE *file = fopen(storage_file(), "w");
+    if (file == NULL) {
+        ESP_LOGE(log_tag, "cannot write %s", storage_file());
+        return ESP_FAIL;
+    }
+    for (int i = 0; i < MAX_ENTRIES; i++) {
+        if (entries[i].value == NULL) {
+            continue;
+        }
+        fprintf(file, "%s %s ", entries[i].name_space, entries[i].key);
+        for (size_t j = 0; j < entries[i].length; j++) {
+            fprintf(file, "%02x", entries[i].value[j]);
+        }
+        fputc('\n', file);
+    }
+    return fclose(file) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static struct open_handle * handle_of(nvs_handle_t handle)
+{
+    return handle >= 1 && handle <= MAX_HANDLES && handles[handle - 1].used ? &handles[handle - 1] : NULL;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&lock);
+    clear_entries();
+    FILE *file = fopen(storage_file(), "r");
+    if (file != NULL) {
+        if (!load(file)) {
+            ESP_LOGW(log_tag, "%s is damaged", storage_file());
+            clear_entries();
+            err = ESP_ERR_NVS_NEW_VERSION_FOUND;
+        }
+        fclose(file);
+    }
+    initialised = err == ESP_OK;
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    pthread_mutex_lock(&lock);
+    clear_entries();
+    remove(storage_file());
+    initialised = false;
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char * name, nvs_open_mode_t open_mode, nvs_handle_t * out_handle)
+{
+    esp_err_t err = ESP_ERR_NVS_NOT_INITIALIZED;
+
+    pthread_mutex_lock(&lock);
+    if (!initialised) {
+        /* err is set */
+    } else if (strlen(name) >= NVS_KEY_NAME_MAX_SIZE) {
+        err = ESP_ERR_NVS_KEY_TOO_LONG;
+    } else if (open_mode == NVS_READONLY && find_entry(name, NULL) == NULL) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        err = ESP_ERR_NO_MEM;
+        for (int i = 0; i < MAX_HANDLES; i++) {
+            if (!handles[i].used) {
+                handles[i].used = true;
+                handles[i].mode = open_mode;
+                snprintf(handles[i].name_space, sizeof(handles[i].name_space), "%s", name);
+                *out_handle = i + 1;
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * out_value, size_t * length)
+{
+    esp_err_t err = ESP_ERR_NVS_INVALID_HANDLE;
+
+    pthread_mutex_lock(&lock);
+    const struct open_handle *open = handle_of(handle);
+    const struct entry *entry = open != NULL ? find_entry(open->name_space, key) : NULL;
+    if (open == NULL) {
+        /* err is set */
+    } else if (entry == NULL) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (out_value == NULL) {
+        *length = entry->length;
+        err = ESP_OK;
+    } else if (*length < entry->length) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out_value, entry->value, entry->length);
+        *length = entry->length;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char * key, const void * value, size_t length)
+{
+    esp_err_t err = ESP_ERR_NVS_INVALID_HANDLE;
+
+    pthread_mutex_lock(&lock);
+    const struct open_handle *open = handle_of(handle);
+    if (open == NULL) {
+        /* err is set */
+    } else if (open->mode == NVS_READONLY) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        err = ESP_ERR_NVS_KEY_TOO_LONG;
+    } else if (length > MAX_BLOB_SIZE) {
+        err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    } else {
+        err = store_entry(open->name_space, key, value, length) ? ESP_OK : ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char * key)
+{
+    esp_err_t err = ESP_ERR_NVS_INVALID_HANDLE;
+
+    pthread_mutex_lock(&lock);
+    const struct open_handle *open = handle_of(handle);
+    struct entry *entry = open != NULL ? find_entry(open->name_space, key) : NULL;
+    if (open == NULL) {
+        /* err is set */
+    } else if (open->mode == NVS_READONLY) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else if (entry == NULL) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        free(entry->value);
+        memset(entry, 0, sizeof(*entry));
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&lock);
+    const esp_err_t err = handle_of(handle) != NULL ? save() : ESP_ERR_NVS_INVALID_HANDLE;
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&lock);
+    struct open_handle *open = handle_of(handle);
+    if (open != NULL) {
+        open->used = false;
+    }
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,77 @@
+/**
+ * @file ESP-IDF non-volatile storage for the host simulation build, blobs in memory written through to a file
+ */
+
+#ifndef INTELLILIGHT_SIM_NVS_H
+#define INTELLILIGHT_SIM_NVS_H
+
+/* system includes */
+#include <stddef.h>
+#include <stdint.h>
+
+/* local includes */
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum
+{
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+/* longest namespace or key without the terminator */
+#define NVS_KEY_NAME_MAX_SIZE 16
+
+/**
+ * @brief Open a namespace
+ * @param name Namespace, at most 15 characters
+ * @param open_mode NVS_READONLY or NVS_READWRITE
+ * @param out_handle Receives the handle
+ * @return ESP_OK, ESP_ERR_NVS_NOT_INITIALIZED, ESP_ERR_NVS_KEY_TOO_LONG or ESP_ERR_NVS_NOT_FOUND when opening a
+ * namespace that does not exist read only
+ */
+extern esp_err_t nvs_open(const char * name, nvs_open_mode_t open_mode, nvs_handle_t * out_handle);
+
+/**
+ * @brief Read a blob
+ * @param handle Namespace
+ * @param key Key
+ * @param out_value Receives the blob, NULL to only query its length
+ * @param length Size of out_value, receives the length of the blob
+ * @return ESP_OK, ESP_ERR_NVS_NOT_FOUND or ESP_ERR_NVS_INVALID_LENGTH if out_value is too small
+ */
+extern esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * out_value, size_t * length);
+
+/**
+ * @brief Write a blob
+ * @param handle Namespace opened read-write
+ * @param key Key, at most 15 characters
+ * @param value Blob
+ * @param length Length of the blob
+ * @return ESP_OK, ESP_ERR_NVS_READ_ONLY, ESP_ERR_NVS_KEY_TOO_LONG or ESP_ERR_NO_MEM
+ */
+extern esp_err_t nvs_set_blob(nvs_handle_t handle, const char * key, const void * value, size_t length);
+
+/**
+ * @brief Erase a key
+ * @param handle Namespace opened read-write
+ * @param key Key
+ * @return ESP_OK, ESP_ERR_NVS_READ_ONLY or ESP_ERR_NVS_NOT_FOUND
+ */
+extern esp_err_t nvs_erase_key(nvs_handle_t handle, const char * key);
+
+/**
+ * @brief Write the storage file
+ * @param handle Namespace
+ * @return ESP_OK or ESP_FAIL if the file could not be written
+ */
+extern esp_err_t nvs_commit(nvs_handle_t handle);
+
+/**
+ * @brief Close a namespace
+ * @param handle Namespace
+ */
+extern void nvs_close(nvs_handle_t handle);
+
+#endif
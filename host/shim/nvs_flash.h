@@ -0,0 +1,24 @@
+/**
+ * @file ESP-IDF NVS partition for the host simulation build, the partition is the file named by SIM_NVS_FILE
+ * (default sim_nvs.txt in the working directory)
+ */
+
+#ifndef INTELLILIGHT_SIM_NVS_FLASH_H
+#define INTELLILIGHT_SIM_NVS_FLASH_H
+
+/* local includes */
+#include "nvs.h"
+
+/**
+ * @brief Load the storage file, a missing file is an empty partition
+ * @return ESP_OK, or ESP_ERR_NVS_NEW_VERSION_FOUND if the file cannot be parsed
+ */
+extern esp_err_t nvs_flash_init(void);
+
+/**
+ * @brief Erase all namespaces and the storage file
+ * @return ESP_OK
+ */
+extern esp_err_t nvs_flash_erase(void);
+
+#endif
@@ -0,0 +1,34 @@
+/**
+ * @file Controls of the host simulation that have no ESP-IDF counterpart
+ *
+ * Environment variables read by the simulation:
+ * SIM_LOG_LEVEL              log threshold E, W, I, D or V (default I)
+ * SIM_NVS_FILE               file backing NVS (default sim_nvs.txt)
+ * SIM_WIFI_BSSID             BSSID of the simulated access point, aa:bb:cc:dd:ee:ff (default 02:00:00:00:00:01)
+ * SIM_WIFI_CHANNEL           channel of the simulated access point (default 6)
+ * SIM_WIFI_SCAN_MS           association time with a full scan (default 1500)
+ * SIM_WIFI_ASSOCIATE_MS      association time with a known BSSID and channel (default 200)
+ * SIM_WIFI_DHCP_MS           time from association to the IP address (default 300)
+ * SIM_SENSOR_FAILURE_PERCENT share of failed sensor reads (default 0)
+ */
+
+#ifndef INTELLILIGHT_SIM_H
+#define INTELLILIGHT_SIM_H
+
+/* system includes */
+#include <stdint.h>
+
+/**
+ * @brief Drop the simulated association as if the access point went away, the driver reconnects when asked to
+ */
+extern void sim_wifi_drop(void);
+
+/**
+ * @brief Integer from the environment
+ * @param name Variable name
+ * @param default_value Value if the variable is not set or not a number
+ * @return Value
+ */
+extern int32_t sim_env_int(const char * name, int32_t default_value);
+
+#endif
@@ -0,0 +1,25 @@
+/**
+ * @file Included ahead of every source of the host simulation build, fills in what ESP-IDF and lwIP headers pull in
+ * implicitly and what glibc spells differently
+ */
+
+#ifndef INTELLILIGHT_SIM_COMPAT_H
+#define INTELLILIGHT_SIM_COMPAT_H
+
+/* system includes */
+#include <assert.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/* local includes */
+#include "sdkconfig.h"
+
+/* lwIP has a reentrant inet_ntoa, glibc has inet_ntop */
+static inline char * inet_ntoa_r(struct in_addr addr, char * buffer, int length)
+{
+    return (char *) inet_ntop(AF_INET, &addr, buffer, length);
+}
+
+#endif
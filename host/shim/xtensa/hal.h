@@ -0,0 +1,18 @@
+/**
+ * @file Xtensa cycle counter for the host simulation build, derived from CLOCK_MONOTONIC at the configured CPU clock
+ * and shared by both simulated cores
+ */
+
+#ifndef INTELLILIGHT_SIM_XTENSA_HAL_H
+#define INTELLILIGHT_SIM_XTENSA_HAL_H
+
+/* system includes */
+#include <stdint.h>
+
+/**
+ * @brief Current value of the 32-bit CCOUNT register
+ * @return Cycle count
+ */
+extern uint32_t xthal_get_ccount(void);
+
+#endif
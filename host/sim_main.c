@@ -0,0 +1,51 @@
+/**
+ * @file Entry point of the host simulation: boots the firmware like the ESP-IDF startup code does and turns signals
+ * into events of the simulated device
+ *
+ * SIGUSR1 drops the WiFi association, SIGINT and SIGTERM power the device off.
+ */
+
+/* system includes */
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* local includes */
+#include "sim.h"
+
+/**
+ * @brief Application main entry point of the firmware
+ */
+extern void app_main(void);
+
+int main(void)
+{
+    /* signals are taken by the loop below, the tasks created from here on inherit the mask */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    /* like with lwIP, writing to a connection the peer has closed fails with EPIPE rather than killing the device */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* like a serial console, log lines are seen as they are written */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    app_main();
+
+    while (true) {
+        int signal_number;
+        if (sigwait(&signals, &signal_number) != 0) {
+            continue;
+        }
+        if (signal_number == SIGUSR1) {
+            sim_wifi_drop();
+        } else {
+            break;
+        }
+    }
+    return 0;
+}
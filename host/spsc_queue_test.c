@@ -0,0 +1,142 @@
+/**
+ * @file Stress test of the single-producer/single-consumer queue between the network and the processing task: a
+ * producer and a consumer thread pass numbered messages through a small queue, and the consumer checks that every
+ * message arrives once, in order and with the payload it was sent with
+ *
+ * The queue indices start just before they wrap around. Build with SIM_TSAN to run it under ThreadSanitizer.
+ *
+ * Usage: spsc_queue_test [-n messages] [-c capacity]
+ */
+
+/* system includes */
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "spsc_queue.h"
+
+/* head and tail wrap around after this many messages */
+#define TEST_INDEX_START (UINT32_MAX - 1000)
+
+typedef struct {
+    uint32_t sequence;
+    uint32_t payload[3];
+} test_message_t;
+
+typedef struct {
+    spsc_queue_t queue;
+    uint32_t messages;
+    uint32_t received;      /* messages the consumer has checked, written by the consumer only */
+    uint32_t errors;
+} test_state_t;
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-n messages] [-c capacity]\n"
+            "  -n  messages to pass through the queue (default 5000000)\n"
+            "  -c  capacity of the queue, a power of two (default 64)\n", program);
+}
+
+/**
+ * @brief Fill in the payload of message number sequence
+ */
+static void fill_message(test_message_t * message, uint32_t sequence)
+{
+    message->sequence = sequence;
+    message->payload[0] = sequence * 2654435761u;
+    message->payload[1] = ~sequence;
+    message->payload[2] = message->payload[0] ^ message->payload[1];
+}
+
+static void * producer(void * arg)
+{
+    test_state_t * state = arg;
+    test_message_t message;
+    for (uint32_t sequence = 0; sequence < state->messages; sequence++) {
+        fill_message(&message, sequence);
+        while (!spsc_queue_push(&state->queue, &message)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void * consumer(void * arg)
+{
+    test_state_t * state = arg;
+    test_message_t message;
+    test_message_t expected;
+    while (state->received < state->messages) {
+        if (!spsc_queue_pop(&state->queue, &message)) {
+            sched_yield();
+            continue;
+        }
+        fill_message(&expected, state->received);
+        if (message.sequence != expected.sequence || message.payload[0] != expected.payload[0]
+                || message.payload[1] != expected.payload[1] || message.payload[2] != expected.payload[2]) {
+            if (state->errors++ < 10) {
+                printf("FAILED: message %" PRIu32 " arrived as number %" PRIu32 " with payload %08" PRIx32 " %08"
+                        PRIx32 " %08" PRIx32 "\n", state->received, message.sequence, message.payload[0],
+                        message.payload[1], message.payload[2]);
+            }
+        }
+        state->received++;
+    }
+    return NULL;
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t messages = 5000000;
+    uint32_t capacity = 64;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:c:h")) != -1) {
+        switch (option) {
+            case 'n':
+                messages = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                capacity = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (messages == 0 || capacity < 2 || (capacity & (capacity - 1)) != 0 || optind < argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    static test_state_t state;
+    test_message_t * buffer = malloc(capacity * sizeof(test_message_t));
+    spsc_queue_init(&state.queue, buffer, sizeof(test_message_t), capacity);
+    atomic_store(&state.queue.head, TEST_INDEX_START);
+    atomic_store(&state.queue.tail, TEST_INDEX_START);
+    state.messages = messages;
+
+    const int64_t begin_us = esp_timer_get_time();
+    pthread_t threads[2];
+    pthread_create(&threads[0], NULL, consumer, &state);
+    pthread_create(&threads[1], NULL, producer, &state);
+    pthread_join(threads[1], NULL);
+    pthread_join(threads[0], NULL);
+    const int64_t elapsed_us = esp_timer_get_time() - begin_us;
+
+    /* both threads are joined, the producer statistics and the depth are exact */
+    const uint32_t depth = spsc_queue_depth(&state.queue);
+    const bool passed = state.errors == 0 && state.received == messages && state.queue.pushed == messages
+            && depth == 0;
+    printf("%" PRIu32 " messages through a queue of %" PRIu32 " in %.2f s (%.0f ns per message), %" PRIu32
+            " pushes refused, max depth %" PRIu32 ", %" PRIu32 " errors: %s\n", messages, capacity, elapsed_us / 1e6,
+            elapsed_us * 1e3 / messages, state.queue.full, state.queue.max_depth, state.errors,
+            passed ? "passed" : "FAILED");
+    free(buffer);
+    return passed ? 0 : 1;
+}
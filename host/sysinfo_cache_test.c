@@ -0,0 +1,161 @@
+/**
+ * @file Stress test of the cached reply to discovery: reader threads ask for the system information the way the
+ * workers of kasa_server do while a writer thread keeps changing the alias, and every reply must be a complete
+ * get_sysinfo with one of the aliases the writer sets
+ *
+ * The readers copy the cache without taking the device lock, so a torn copy shows up as a reply that does not parse or
+ * has the wrong alias. Build with SIM_TSAN to run it under ThreadSanitizer.
+ *
+ * Usage: sysinfo_cache_test [-n replies] [-r readers]
+ */
+
+/* system includes */
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* local includes */
+#include "cJSON.h"
+#include "memstats.h"
+#include "pipeline.h"
+#include "tplink_kasa.h"
+
+#define TEST_MAX_READERS 8
+
+/* of different lengths, so a copy that mixes two of them cannot pass */
+static const char * const aliases[] = { "Back Light", "A much longer alias for a test" };
+
+typedef struct {
+    pthread_t thread;
+    uint8_t arena_buffer[CONFIG_KASA_CJSON_ARENA_SIZE];
+    cJSON_Arena json_arena;
+    cJSON_Context json_context;
+    char buffer[PIPELINE_BUFFER_SIZE];
+    uint32_t replies;
+    uint32_t errors;
+} test_thread_t;
+
+static test_thread_t threads[TEST_MAX_READERS + 1];
+static atomic_bool done;
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-n replies] [-r readers]\n"
+            "  -n  replies to discovery each reader checks (default 20000)\n"
+            "  -r  reader threads, at most %d (default 3)\n", program, TEST_MAX_READERS);
+}
+
+/**
+ * @brief Send request to the device in the buffer of thread
+ * @return Length of the decrypted reply in the buffer, 0 if there is none
+ */
+static int test_request(test_thread_t * thread, const char * request)
+{
+    const int length = snprintf(thread->buffer, sizeof(thread->buffer), "%s", request);
+    tplink_kasa_encrypt_buffer((uint8_t *) thread->buffer, length);
+    const int reply_len = tplink_kasa_process_buffer(&thread->json_context, thread->buffer, length,
+            sizeof(thread->buffer), false, NULL);
+    cJSON_ArenaReset(&thread->json_arena);
+    if (reply_len > 0) {
+        tplink_kasa_decrypt_buffer((uint8_t *) thread->buffer, reply_len);
+    }
+    return reply_len > 0 ? reply_len : 0;
+}
+
+static void * writer(void * arg)
+{
+    test_thread_t * thread = arg;
+    char request[128];
+    while (!atomic_load_explicit(&done, memory_order_relaxed)) {
+        snprintf(request, sizeof(request), "{\"system\":{\"set_dev_alias\":{\"alias\":\"%s\"}}}",
+                aliases[thread->replies % 2]);
+        if (test_request(thread, request) == 0) {
+            thread->errors++;
+        }
+        thread->replies++;
+    }
+    return NULL;
+}
+
+static void * reader(void * arg)
+{
+    test_thread_t * thread = arg;
+    cJSON_Context heap_context;
+    cJSON_InitContext(&heap_context, NULL);
+    const uint32_t replies = thread->replies;
+    for (thread->replies = 0; thread->replies < replies; thread->replies++) {
+        const int reply_len = test_request(thread, "{\"system\":{\"get_sysinfo\":{}}}");
+        cJSON * reply = cJSON_ParseCtx(&heap_context, thread->buffer, reply_len);
+        const char * alias = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(
+                cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(reply, "system"), "get_sysinfo"),
+                "alias"));
+        if (alias == NULL || (strcmp(alias, aliases[0]) != 0 && strcmp(alias, aliases[1]) != 0)) {
+            if (thread->errors++ < 10) {
+                printf("FAILED: reply %u of %d bytes is %.*s\n", (unsigned) thread->replies, reply_len, reply_len,
+                        thread->buffer);
+            }
+        }
+        cJSON_DeleteCtx(&heap_context, reply);
+    }
+    return NULL;
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t replies = 20000;
+    int readers = 3;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:r:h")) != -1) {
+        switch (option) {
+            case 'n':
+                replies = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                readers = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (replies == 0 || readers < 1 || readers > TEST_MAX_READERS || optind < argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    memstats_init();
+    tplink_kasa_init();
+    for (int i = 0; i <= readers; i++) {
+        test_thread_t * thread = &threads[i];
+        cJSON_InitArena(&thread->json_arena, thread->arena_buffer, sizeof(thread->arena_buffer));
+        cJSON_InitContextWithArena(&thread->json_context, &thread->json_arena);
+        thread->json_context.max_depth = TPLINK_KASA_MAX_DEPTH;
+        thread->json_context.max_length = PIPELINE_BUFFER_SIZE;
+        thread->replies = replies;
+    }
+
+    /* the writer is the last thread, it counts the aliases it set */
+    test_thread_t * writer_thread = &threads[readers];
+    writer_thread->replies = 0;
+    pthread_create(&writer_thread->thread, NULL, writer, writer_thread);
+    for (int i = 0; i < readers; i++) {
+        pthread_create(&threads[i].thread, NULL, reader, &threads[i]);
+    }
+    uint32_t errors = 0;
+    for (int i = 0; i < readers; i++) {
+        pthread_join(threads[i].thread, NULL);
+        errors += threads[i].errors;
+    }
+    atomic_store(&done, true);
+    pthread_join(writer_thread->thread, NULL);
+    errors += writer_thread->errors;
+
+    const bool passed = errors == 0 && writer_thread->replies > 1;
+    printf("%d readers checked %u replies each while the alias changed %u times, %u errors: %s\n", readers,
+            (unsigned) replies, (unsigned) writer_thread->replies, (unsigned) errors, passed ? "passed" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file Throughput test of the telemetry publisher against an MQTT broker such as mosquitto: hands it synthetic
+ * readings as fast as it takes them and reports messages and readings per second and the bytes per reading
+ *
+ * The broker does not need to be up when the test starts, readings are then queued and spilled to the NVS file like
+ * on the device and the backlog is drained once the broker can be reached.
+ *
+ * Usage: telemetry_bench [-n readings] [-b batch] [-w in_flight] [-t timeout_s] [-T topic] [broker [port]]
+ */
+
+/* system includes */
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <esp_timer.h>
+#include "nvs_flash.h"
+
+/* local includes */
+#include "telemetry.h"
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-n readings] [-b batch] [-w in_flight] [-t timeout_s] [-T topic] [broker [port]]\n"
+            "  -n  readings to publish (default 100000)\n"
+            "  -b  readings per message (default %d)\n"
+            "  -w  messages awaiting PUBACK (default %d)\n"
+            "  -t  give up after this many seconds (default 60)\n"
+            "  -T  topic (default intellilight/bench/telemetry)\n"
+            "  broker and port default to 127.0.0.1 1883\n", program, CONFIG_TELEMETRY_BATCH_SAMPLES,
+            CONFIG_TELEMETRY_IN_FLIGHT);
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t readings = 100000;
+    int timeout_s = 60;
+    telemetry_config_t config = {
+        .broker = "127.0.0.1",
+        .port = 1883,
+        .client_id = "telemetry-bench",
+        .topic = "intellilight/bench/telemetry",
+        .batch_samples = CONFIG_TELEMETRY_BATCH_SAMPLES,
+        .in_flight = CONFIG_TELEMETRY_IN_FLIGHT,
+    };
+
+    int option;
+    while ((option = getopt(argc, argv, "n:b:w:t:T:h")) != -1) {
+        switch (option) {
+            case 'n':
+                readings = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                config.batch_samples = atoi(optarg);
+                break;
+            case 'w':
+                config.in_flight = atoi(optarg);
+                break;
+            case 't':
+                timeout_s = atoi(optarg);
+                break;
+            case 'T':
+                config.topic = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind < argc) {
+        config.broker = argv[optind++];
+    }
+    if (optind < argc) {
+        config.port = atoi(argv[optind++]);
+    }
+    if (readings == 0 || config.batch_samples < 1 || config.batch_samples > TELEMETRY_MESSAGE_SAMPLES
+            || config.in_flight < 1 || config.in_flight > TELEMETRY_MAX_IN_FLIGHT) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    /* a broker that goes away makes the publishing fail with EPIPE, as on the device */
+    signal(SIGPIPE, SIG_IGN);
+    nvs_flash_init();
+    telemetry_init();
+    telemetry_start(&config);
+
+    /* readings a minute apart like the sampler's, with a slow drift */
+    const int64_t begin_us = esp_timer_get_time();
+    const int64_t end_us = begin_us + timeout_s * 1000000LL;
+    telemetry_stats_t stats;
+    telemetry_get_stats(&stats);
+    const uint32_t backlog = stats.spilled_queued;
+    sampler_reading_t reading = { 0 };
+    while (reading.count < readings && esp_timer_get_time() < end_us) {
+        /* the RAM queue is kept from overflowing, this measures the publisher rather than the spilling */
+        telemetry_get_stats(&stats);
+        if (stats.connections > 0
+                && stats.queued + (reading.count - stats.recorded) >= CONFIG_TELEMETRY_QUEUE_SAMPLES - TELEMETRY_MESSAGE_SAMPLES) {
+            usleep(100);
+            continue;
+        }
+        reading.count++;
+        reading.timestamp_us = reading.count * 60000000LL;
+        reading.temperature = 21.0f + 2.0f * sinf(reading.count / 100.0f);
+        reading.humidity = 45.0f + 5.0f * cosf(reading.count / 150.0f);
+        while (!telemetry_record(&reading)) {
+            usleep(100);
+        }
+    }
+
+    /* every reading is acknowledged, dropped, or still spilled when the broker never came up */
+    telemetry_flush();
+    do {
+        usleep(1000);
+        telemetry_get_stats(&stats);
+    } while (stats.acked + stats.dropped < reading.count + backlog && esp_timer_get_time() < end_us);
+    const double elapsed_s = (esp_timer_get_time() - begin_us) / 1e6;
+
+    printf("%u readings in %u messages in %.2f s: %.0f messages/s, %.0f readings/s\n", (unsigned)stats.acked,
+            (unsigned)stats.acked_messages, elapsed_s, stats.acked_messages / elapsed_s, stats.acked / elapsed_s);
+    if (stats.acked > 0) {
+        printf("bytes per reading: %.1f payload, %.1f on the wire\n", (double)stats.payload_bytes / stats.acked,
+                (double)stats.wire_bytes / stats.acked);
+    }
+    printf("%u connections, %u messages published, %u readings spilled, %u dropped, %u not acknowledged\n",
+            (unsigned)stats.connections, (unsigned)stats.messages, (unsigned)stats.spilled, (unsigned)stats.dropped,
+            (unsigned)(reading.count + backlog - stats.acked - stats.dropped));
+    return stats.acked + stats.dropped == reading.count + backlog && stats.dropped == 0 ? 0 : 1;
+}
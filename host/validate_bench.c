@@ -0,0 +1,134 @@
+/**
+ * @file Cost of cJSON_ValidateCtx against a full cJSON_ParseCtx, on the heap and in a cJSON arena the way the
+ * processing task parses, for a get_sysinfo reply and for the junk a Kasa port sees, a TLS ClientHello and an HTTP
+ * request
+ *
+ * Every input is validated and parsed once up front and must give the same verdict both ways.
+ *
+ * Usage: validate_bench [-n iterations]
+ */
+
+/* system includes */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "cJSON.h"
+
+#define BENCH_ARENA_SIZE 8192
+
+typedef struct {
+    const char * name;
+    const char * text;
+    size_t length;
+} bench_input_t;
+
+static const char sysinfo[] =
+    "{\"system\":{\"get_sysinfo\":{\"sw_ver\":\"1.0.0 Build 000001 Rel.000001\",\"hw_ver\":\"1.0\","
+    "\"model\":\"KL130B(UN)\",\"deviceId\":\"8012C9D8A4E1F0B2C3D4E5F60718293A4B5C6D7E\","
+    "\"oemId\":\"E45F76AD3AF13E60B58D6F68739CD7E5\",\"hwId\":\"1E97141B9F0E939BD8F9679F0B6167C8\",\"rssi\":-71,"
+    "\"latitude_i\":0,\"longitude_i\":0,\"alias\":\"Living room\",\"status\":\"new\","
+    "\"description\":\"WiFi BLE Smart Bulb Bridge\",\"mic_type\":\"IOT.SMARTBULB\",\"mic_mac\":\"246F28A1B2C3\","
+    "\"dev_state\":\"normal\",\"is_factory\":false,\"disco_ver\":\"1.0\","
+    "\"ctrl_protocols\":{\"name\":\"Linkie\",\"version\":\"1.0\"},\"active_mode\":\"none\",\"is_dimmable\":1,"
+    "\"is_color\":1,\"is_variable_color_temp\":1,\"light_state\":{\"on_off\":1},\"err_code\":0}}}";
+
+static const char tls_hello[] = "\x16\x03\x01\x02\x00\x01\x00\x01\xfc\x03\x03\x9a\x4f\x1e\x72";
+
+static const char http_request[] = "GET / HTTP/1.1\r\nHost: 192.168.0.1:9999\r\nUser-Agent: scanner\r\n\r\n";
+
+static uint8_t arena_buffer[BENCH_ARENA_SIZE];
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-n iterations]\n"
+            "  -n  validations and parses of each input (default 1000000)\n", program);
+}
+
+/**
+ * @brief Time cJSON_ValidateCtx of input
+ * @return Nanoseconds per validation
+ */
+static double validate_ns(cJSON_Context * context, const bench_input_t * input, int iterations)
+{
+    cJSON_Validation validation;
+    const int64_t begin_us = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        cJSON_ValidateCtx(context, input->text, input->length, &validation);
+    }
+    return (esp_timer_get_time() - begin_us) * 1e3 / iterations;
+}
+
+/**
+ * @brief Time cJSON_ParseCtx of input and freeing the tree, by resetting arena if not NULL
+ * @return Nanoseconds per parse
+ */
+static double parse_ns(cJSON_Context * context, cJSON_Arena * arena, const bench_input_t * input, int iterations)
+{
+    const int64_t begin_us = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        cJSON * tree = cJSON_ParseCtx(context, input->text, input->length);
+        if (arena != NULL) {
+            cJSON_ArenaReset(arena);
+        } else {
+            cJSON_DeleteCtx(context, tree);
+        }
+    }
+    return (esp_timer_get_time() - begin_us) * 1e3 / iterations;
+}
+
+int main(int argc, char * argv[])
+{
+    int iterations = 1000000;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:h")) != -1) {
+        switch (option) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (iterations < 1 || optind < argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    const bench_input_t inputs[] = {
+        { "sysinfo", sysinfo, sizeof(sysinfo) - 1 },
+        { "tls", tls_hello, sizeof(tls_hello) - 1 },
+        { "http", http_request, sizeof(http_request) - 1 },
+    };
+
+    cJSON_Context heap_context;
+    cJSON_Arena arena;
+    cJSON_Context arena_context;
+    cJSON_InitContext(&heap_context, NULL);
+    cJSON_InitArena(&arena, arena_buffer, sizeof(arena_buffer));
+    cJSON_InitContextWithArena(&arena_context, &arena);
+
+    bool passed = true;
+    printf("%-8s %6s %12s %12s %12s\n", "input", "bytes", "validate ns", "heap ns", "arena ns");
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        const bench_input_t * input = &inputs[i];
+        const bool valid = cJSON_ValidateCtx(&heap_context, input->text, input->length, NULL);
+        cJSON * tree = cJSON_ParseCtx(&heap_context, input->text, input->length);
+        if (valid != (tree != NULL)) {
+            printf("%-8s FAILED: validates %s but %s\n", input->name, valid ? "true" : "false",
+                    tree != NULL ? "parses" : "does not parse");
+            passed = false;
+        }
+        cJSON_DeleteCtx(&heap_context, tree);
+
+        printf("%-8s %6zu %12.1f %12.1f %12.1f\n", input->name, input->length,
+                validate_ns(&heap_context, input, iterations), parse_ns(&heap_context, NULL, input, iterations),
+                parse_ns(&arena_context, &arena, input, iterations));
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,399 @@
+/**
+ * @file Load test of the WebSocket stream: runs the network and processing tasks of the firmware in process, connects
+ * many subscribers to /ws, publishes synthetic readings at a fixed rate and reports the frames each subscriber was
+ * sent, the latency from publishing to arrival and the spread of the fan-out
+ *
+ * Slow subscribers connect with a small receive buffer and stop reading, the others must not notice them. Once the
+ * readings are published the slow subscribers catch up, having skipped the oldest frames but ending on the latest.
+ * Each subscriber connects from its own loopback address, as distinct clients for the rate limit. The send buffer of
+ * the server side of each connection is cut to the default of lwIP, Linux would otherwise take megabytes of frames
+ * for a subscriber that does not read and there would be nothing to push back.
+ *
+ * Usage: websocket_bench [-c subscribers] [-s slow] [-n readings] [-r readings_per_s]
+ */
+
+/* system includes */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "history.h"
+#include "memstats.h"
+#include "pipeline.h"
+#include "taskstats.h"
+#include "websocket.h"
+#include "wifi.h"
+
+#define BENCH_BUFFER_SIZE 4096
+#define BENCH_MAX_EVENTS 64
+/* a small receive buffer makes a slow subscriber push back on the server after a few frames */
+#define BENCH_SLOW_RECEIVE_BUFFER 2048
+/* CONFIG_LWIP_TCP_SND_BUF_DEFAULT */
+#define BENCH_SERVER_SEND_BUFFER 5744
+#define BENCH_HANDSHAKE_TIMEOUT_S 5
+/* frames still arriving after the last reading is published are waited for this long */
+#define BENCH_DRAIN_MS 1000
+
+struct subscriber
+{
+    int socket;
+    bool slow;
+    uint32_t last;          /* reading count of the last frame received */
+    uint32_t frames;
+    uint32_t missing;       /* readings skipped between frames */
+    uint32_t pings;
+    size_t length;
+    uint8_t buffer[BENCH_BUFFER_SIZE];
+};
+
+static struct subscriber * subscribers;
+static int64_t * published_us;      /* per reading count */
+static int64_t * first_us;          /* first arrival of each reading at a fast subscriber */
+static int64_t * last_us;           /* last arrival */
+static uint32_t * latencies;
+static size_t latency_count;
+
+
+static int compare_latency(const void * a, const void * b)
+{
+    const uint32_t x = *(const uint32_t *) a;
+    const uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void print_distribution(const char * name, uint32_t * values, const size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    qsort(values, count, sizeof(uint32_t), compare_latency);
+    printf("%s us: p50 %u p90 %u p99 %u max %u\n", name, values[count / 2], values[count * 90 / 100],
+            values[count * 99 / 100], values[count - 1]);
+}
+
+/**
+ * @brief Connect a subscriber from 127.0.0.(2 + index) and upgrade it
+ * @return Non-blocking socket, or -1
+ */
+static int subscribe(const int index, const bool slow)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (slow) {
+        const int size = BENCH_SLOW_RECEIVE_BUFFER;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    const struct timeval timeout = { .tv_sec = BENCH_HANDSHAKE_TIMEOUT_S };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    struct sockaddr_in address = { .sin_family = AF_INET };
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + index);
+    if (bind(sock, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        perror("bind");
+        close(sock);
+        return -1;
+    }
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(CONFIG_HTTP_PORT);
+    if (connect(sock, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        close(sock);
+        return -1;
+    }
+
+    char text[256];
+    const int length = snprintf(text, sizeof(text), "GET /ws HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\n"
+            "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+    send(sock, text, length, 0);
+
+    /* read up to the end of the response header only, frames may follow it */
+    int received = 0;
+    while (received < 4 || memcmp(&text[received - 4], "\r\n\r\n", 4) != 0) {
+        if (received == sizeof(text) - 1 || recv(sock, &text[received], 1, 0) != 1) {
+            close(sock);
+            return -1;
+        }
+        received++;
+    }
+    text[received] = 0;
+    if (strncmp(text, "HTTP/1.1 101", 12) != 0
+            || strstr(text, "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == NULL) {
+        fprintf(stderr, "Subscriber %d refused: %.40s\n", index, text);
+        close(sock);
+        return -1;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    return sock;
+}
+
+/**
+ * @brief Cut the send buffer of the server side of a subscriber connection, found among the descriptors of the process
+ * @return False if it was not found
+ */
+static bool limit_server_send_buffer(const int sock)
+{
+    struct sockaddr_in local;
+    socklen_t length = sizeof(local);
+    getsockname(sock, (struct sockaddr *) &local, &length);
+    const int fd_count = sysconf(_SC_OPEN_MAX);
+    for (int fd = 0; fd < fd_count; fd++) {
+        struct sockaddr_in peer;
+        length = sizeof(peer);
+        if (fd != sock && getpeername(fd, (struct sockaddr *) &peer, &length) == 0 && peer.sin_family == AF_INET
+                && peer.sin_addr.s_addr == local.sin_addr.s_addr && peer.sin_port == local.sin_port) {
+            const int size = BENCH_SERVER_SEND_BUFFER;
+            return setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == 0;
+        }
+    }
+    return false;
+}
+
+static void send_pong(struct subscriber * subscriber)
+{
+    /* client frames are masked, an all zero mask leaves the empty payload as it is */
+    const uint8_t pong[] = { 0x8A, 0x80, 0, 0, 0, 0 };
+    send(subscriber->socket, pong, sizeof(pong), 0);
+    subscriber->pings++;
+}
+
+static void handle_frame(struct subscriber * subscriber, const uint8_t opcode, const char * payload,
+        const size_t length, const int64_t now)
+{
+    if (opcode == 0x9) {
+        send_pong(subscriber);
+        return;
+    }
+    unsigned count;
+    if (opcode != 0x1 || length == 0 || sscanf(payload, "{\"n\":%u", &count) != 1) {
+        fprintf(stderr, "Unexpected frame, opcode %u\n", opcode);
+        return;
+    }
+    if (count > subscriber->last + 1) {
+        subscriber->missing += count - subscriber->last - 1;
+    }
+    subscriber->last = count;
+    subscriber->frames++;
+    if (!subscriber->slow) {
+        latencies[latency_count++] = now - published_us[count];
+        if (first_us[count] == 0) {
+            first_us[count] = now;
+        }
+        last_us[count] = now;
+    }
+}
+
+/**
+ * @brief Read what has arrived for a subscriber and handle its complete frames
+ * @return False if the connection was closed
+ */
+static bool receive(struct subscriber * subscriber)
+{
+    while (true) {
+        const ssize_t received = recv(subscriber->socket, subscriber->buffer + subscriber->length,
+                BENCH_BUFFER_SIZE - subscriber->length, 0);
+        if (received <= 0) {
+            return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        subscriber->length += received;
+
+        const int64_t now = esp_timer_get_time();
+        size_t offset = 0;
+        while (subscriber->length - offset >= 2) {
+            const uint8_t * frame = subscriber->buffer + offset;
+            const size_t length = frame[1] & 0x7f;
+            if (length > 125) {
+                fprintf(stderr, "Frame with an extended length\n");
+                return false;
+            }
+            if (subscriber->length - offset < 2 + length) {
+                break;
+            }
+            char payload[126];
+            memcpy(payload, frame + 2, length);
+            payload[length] = 0;
+            handle_frame(subscriber, frame[0] & 0x0f, payload, length, now);
+            offset += 2 + length;
+        }
+        subscriber->length -= offset;
+        memmove(subscriber->buffer, subscriber->buffer + offset, subscriber->length);
+    }
+}
+
+/* receive until the deadline, or until nothing has arrived for BENCH_DRAIN_MS */
+static void poll_subscribers(const int epoll_socket, const int64_t end_us, const bool until_quiet)
+{
+    struct epoll_event events[BENCH_MAX_EVENTS];
+    while (esp_timer_get_time() < end_us) {
+        const int ready = epoll_wait(epoll_socket, events, BENCH_MAX_EVENTS, until_quiet ? BENCH_DRAIN_MS : 1);
+        if (ready == 0 && until_quiet) {
+            return;
+        }
+        for (int i = 0; i < ready; i++) {
+            struct subscriber * subscriber = events[i].data.ptr;
+            if (!receive(subscriber)) {
+                epoll_ctl(epoll_socket, EPOLL_CTL_DEL, subscriber->socket, NULL);
+            }
+        }
+    }
+}
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-c subscribers] [-s slow] [-n readings] [-r readings_per_s]\n"
+            "  -c  subscribers, at most %d (default 60)\n"
+            "  -s  of which stop reading until the end (default 4)\n"
+            "  -n  readings to publish (default 5000)\n"
+            "  -r  readings per second (default 500)\n", program, CONFIG_WEBSOCKET_SUBSCRIBERS);
+}
+
+int main(int argc, char * argv[])
+{
+    int count = 60;
+    int slow = 4;
+    uint32_t readings = 5000;
+    int rate = 500;
+
+    int option;
+    while ((option = getopt(argc, argv, "c:s:n:r:h")) != -1) {
+        switch (option) {
+            case 'c':
+                count = atoi(optarg);
+                break;
+            case 's':
+                slow = atoi(optarg);
+                break;
+            case 'n':
+                readings = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (count < 1 || count > CONFIG_WEBSOCKET_SUBSCRIBERS || slow < 0 || slow >= count || readings == 0 || rate < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    /* the servers of the firmware without the sampler, whose readings the bench publishes itself */
+    signal(SIGPIPE, SIG_IGN);
+    memstats_init();
+    taskstats_init();
+    history_init();
+    websocket_init();
+    pipeline_init();
+    wifi_setup(false);
+    wifi_application_ready();
+
+    subscribers = calloc(count, sizeof(*subscribers));
+    published_us = calloc(readings + 1, sizeof(int64_t));
+    first_us = calloc(readings + 1, sizeof(int64_t));
+    last_us = calloc(readings + 1, sizeof(int64_t));
+    latencies = calloc((size_t) readings * (count - slow), sizeof(uint32_t));
+    if (subscribers == NULL || published_us == NULL || first_us == NULL || last_us == NULL || latencies == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    /* the server is up once the simulated WiFi has associated, subscribers connect one after the other */
+    const int epoll_socket = epoll_create1(0);
+    const int64_t connect_deadline_us = esp_timer_get_time() + BENCH_HANDSHAKE_TIMEOUT_S * 1000000LL;
+    for (int i = 0; i < count; i++) {
+        subscribers[i].slow = i < slow;
+        while ((subscribers[i].socket = subscribe(i, subscribers[i].slow)) < 0) {
+            if (esp_timer_get_time() > connect_deadline_us) {
+                fprintf(stderr, "Subscriber %d could not connect\n", i);
+                return 1;
+            }
+            usleep(10000);
+        }
+        if (!limit_server_send_buffer(subscribers[i].socket)) {
+            fprintf(stderr, "Subscriber %d has no server side\n", i);
+            return 1;
+        }
+        if (!subscribers[i].slow) {
+            struct epoll_event event = { .events = EPOLLIN, .data.ptr = &subscribers[i] };
+            epoll_ctl(epoll_socket, EPOLL_CTL_ADD, subscribers[i].socket, &event);
+        }
+    }
+
+    /* readings at the rate, received as they come */
+    const int64_t begin_us = esp_timer_get_time();
+    sampler_reading_t reading = { 0 };
+    while (reading.count < readings) {
+        const int64_t due_us = begin_us + (int64_t) reading.count * 1000000 / rate;
+        if (esp_timer_get_time() < due_us) {
+            poll_subscribers(epoll_socket, due_us, false);
+            continue;
+        }
+        reading.count++;
+        reading.temperature = 21.0f + (reading.count % 100) / 10.0f;
+        reading.humidity = 45.0f + (reading.count % 50) / 10.0f;
+        reading.timestamp_us = esp_timer_get_time();
+        published_us[reading.count] = reading.timestamp_us;
+        websocket_publish(&reading);
+    }
+    const double elapsed_s = (esp_timer_get_time() - begin_us) / 1e6;
+    poll_subscribers(epoll_socket, INT64_MAX, true);
+
+    /* the slow subscribers catch up at the end */
+    for (int i = 0; i < slow; i++) {
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = &subscribers[i] };
+        epoll_ctl(epoll_socket, EPOLL_CTL_ADD, subscribers[i].socket, &event);
+    }
+    poll_subscribers(epoll_socket, INT64_MAX, true);
+
+    uint64_t fast_frames = 0;
+    uint64_t fast_missing = 0;
+    uint32_t incomplete = 0;
+    uint32_t pings = 0;
+    for (int i = slow; i < count; i++) {
+        fast_frames += subscribers[i].frames;
+        fast_missing += subscribers[i].missing + readings - subscribers[i].last;
+        incomplete += subscribers[i].frames != readings;
+        pings += subscribers[i].pings;
+    }
+    printf("%d subscribers, %u readings in %.2f s (%.0f/s): %llu frames, %.0f frames/s\n", count, (unsigned) readings,
+            elapsed_s, readings / elapsed_s, (unsigned long long) fast_frames, fast_frames / elapsed_s);
+    printf("%d fast subscribers: %llu frames missing, %u incomplete, %u pings answered\n", count - slow,
+            (unsigned long long) fast_missing, (unsigned) incomplete, (unsigned) pings);
+
+    /* a reading the network task did not take in time is missing for everybody, anything else is a fault */
+    cJSON_Context json_context;
+    cJSON_InitContext(&json_context, NULL);
+    cJSON * server = websocket_to_json(&json_context);
+    const uint32_t overrun = cJSON_GetNumberValue(cJSON_GetObjectItemCaseSensitive(server, "overrun"));
+    char * text = cJSON_PrintCtx(&json_context, server, false);
+    printf("server: %s\n", text);
+    cJSON_freeCtx(&json_context, text);
+    cJSON_DeleteCtx(&json_context, server);
+
+    print_distribution("latency", latencies, latency_count);
+
+    /* the spread is the time between the first and the last fast subscriber receiving the same reading */
+    size_t spread_count = 0;
+    for (uint32_t n = 1; n <= readings; n++) {
+        if (first_us[n] != 0) {
+            latencies[spread_count++] = last_us[n] - first_us[n];
+        }
+    }
+    print_distribution("fan-out spread", latencies, spread_count);
+
+    bool slow_caught_up = true;
+    for (int i = 0; i < slow; i++) {
+        printf("slow subscriber %d: %u frames, %u skipped, last reading %u\n", i, (unsigned) subscribers[i].frames,
+                (unsigned) subscribers[i].missing, (unsigned) subscribers[i].last);
+        slow_caught_up &= subscribers[i].last == readings;
+    }
+    return fast_missing == (uint64_t) overrun * (count - slow) && slow_caught_up ? 0 : 1;
+}
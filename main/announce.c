@@ -0,0 +1,220 @@
+/**
+ * @file Multicast announcer: pushes the readings to LAN collectors as small fixed-layout binary frames over UDP
+ */
+
+/* system includes */
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "announce.h"
+#include "history.h"
+#include "tplink_kasa.h"
+#include "wifi.h"
+
+/* frames stay on the local network */
+#define ANNOUNCE_TTL 1
+/* a reading older than this many sampling intervals is reported stale */
+#define ANNOUNCE_STALE_INTERVALS 3
+/* the magic, version and flags, the rest of a frame is encrypted when enabled */
+#define ANNOUNCE_HEADER_SIZE 4
+
+#ifdef CONFIG_ANNOUNCE_ENCRYPT
+#define ANNOUNCE_FLAGS ANNOUNCE_FLAG_ENCRYPTED
+#else
+#define ANNOUNCE_FLAGS 0
+#endif
+
+static const char *log_tag = "announce";
+
+static int announce_socket = -1;
+static struct sockaddr_in destination;
+static esp_timer_handle_t announce_timer = NULL;
+/* frames are sent from the sampler task and the timer task, each takes the next sequence number */
+static atomic_uint_least32_t sequence = 0;
+/* last reading announced by the sampler task, in hundredths, only touched by that task */
+static int32_t announced_temperature;
+static int32_t announced_humidity;
+static bool announced = false;
+/* one error is logged until a frame is sent again, a device without an IP address would fill the log otherwise */
+static atomic_bool failing = false;
+
+
+static void put_u16(uint8_t * out, const uint16_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void put_u32(uint8_t * out, const uint32_t value)
+{
+    put_u16(out, value & 0xFFFF);
+    put_u16(out + 2, value >> 16);
+}
+
+static uint16_t get_u16(const uint8_t * in)
+{
+    return in[0] | (in[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t * in)
+{
+    return get_u16(in) | ((uint32_t)get_u16(in + 2) << 16);
+}
+
+static uint8_t checksum(const uint8_t * data)
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < ANNOUNCE_FRAME_SIZE - 1; i++) {
+        sum ^= data[i];
+    }
+    return sum;
+}
+
+void announce_frame_encode(const announce_frame_t * frame, uint8_t * out)
+{
+    out[0] = 'K';
+    out[1] = 'S';
+    out[2] = ANNOUNCE_VERSION;
+    out[3] = frame->flags;
+    memcpy(&out[4], frame->device_id, sizeof(frame->device_id));
+    put_u32(&out[10], frame->sequence);
+    put_u32(&out[14], frame->timestamp_ms);
+    put_u16(&out[18], (uint16_t)frame->temperature);
+    put_u16(&out[20], frame->humidity);
+    out[22] = frame->status;
+    out[23] = checksum(out);
+
+    if (frame->flags & ANNOUNCE_FLAG_ENCRYPTED) {
+        tplink_kasa_encrypt_buffer(&out[ANNOUNCE_HEADER_SIZE], ANNOUNCE_FRAME_SIZE - ANNOUNCE_HEADER_SIZE);
+    }
+}
+
+bool announce_frame_decode(const uint8_t * data, const size_t length, announce_frame_t * frame)
+{
+    if (length != ANNOUNCE_FRAME_SIZE || data[0] != 'K' || data[1] != 'S' || data[2] != ANNOUNCE_VERSION) {
+        return false;
+    }
+
+    uint8_t plain[ANNOUNCE_FRAME_SIZE];
+    memcpy(plain, data, sizeof(plain));
+    if (plain[3] & ANNOUNCE_FLAG_ENCRYPTED) {
+        tplink_kasa_decrypt_buffer(&plain[ANNOUNCE_HEADER_SIZE], ANNOUNCE_FRAME_SIZE - ANNOUNCE_HEADER_SIZE);
+    }
+    if (checksum(plain) != plain[23]) {
+        return false;
+    }
+
+    frame->flags = plain[3];
+    memcpy(frame->device_id, &plain[4], sizeof(frame->device_id));
+    frame->sequence = get_u32(&plain[10]);
+    frame->timestamp_ms = get_u32(&plain[14]);
+    frame->temperature = (int16_t)get_u16(&plain[18]);
+    frame->humidity = get_u16(&plain[20]);
+    frame->status = plain[22];
+    return true;
+}
+
+static int32_t hundredths(const float value, const int32_t minimum, const int32_t maximum)
+{
+    const int32_t scaled = lroundf(value * 100.0f);
+    return scaled < minimum ? minimum : scaled > maximum ? maximum : scaled;
+}
+
+static void send_frame(const sampler_reading_t * reading, const bool valid, const bool changed)
+{
+    announce_frame_t frame = {
+        .flags = (changed ? ANNOUNCE_FLAG_CHANGED : 0) | ANNOUNCE_FLAGS,
+        .sequence = atomic_fetch_add_explicit(&sequence, 1, memory_order_relaxed),
+        .status = ANNOUNCE_STATUS_NO_READING,
+    };
+    memcpy(frame.device_id, wifi_mac_address(), sizeof(frame.device_id));
+    if (valid) {
+        frame.timestamp_ms = (uint32_t)(reading->timestamp_us / 1000);
+        frame.temperature = hundredths(reading->temperature, INT16_MIN, INT16_MAX);
+        frame.humidity = hundredths(reading->humidity, 0, UINT16_MAX);
+        const int64_t age_us = esp_timer_get_time() - reading->timestamp_us;
+        frame.status = age_us > ANNOUNCE_STALE_INTERVALS * HISTORY_INTERVAL_S * 1000000LL
+            ? ANNOUNCE_STATUS_STALE : ANNOUNCE_STATUS_OK;
+    }
+
+    uint8_t data[ANNOUNCE_FRAME_SIZE];
+    announce_frame_encode(&frame, data);
+    if (sendto(announce_socket, data, sizeof(data), 0, (struct sockaddr *)&destination, sizeof(destination)) < 0) {
+        if (!atomic_exchange(&failing, true)) {
+            ESP_LOGW(log_tag, "Unable to send frame: errno %d", errno);
+        }
+    } else {
+        atomic_store_explicit(&failing, false, memory_order_relaxed);
+    }
+}
+
+static void periodic(void * arg)
+{
+    sampler_reading_t reading;
+    const bool valid = sampler_latest(&reading);
+    send_frame(&reading, valid, false);
+}
+
+void announce_start(const char * group, const uint16_t port)
+{
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(port);
+    if (inet_pton(AF_INET, group, &destination.sin_addr) != 1 || !IN_MULTICAST(ntohl(destination.sin_addr.s_addr))) {
+        ESP_LOGE(log_tag, "%s is not an IPv4 multicast group", group);
+        return;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(log_tag, "Unable to create socket: errno %d", errno);
+        return;
+    }
+    /* a frame that does not fit in the send buffer is dropped rather than holding up the sampler */
+    const uint8_t ttl = ANNOUNCE_TTL;
+    if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0
+            || fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) < 0) {
+        ESP_LOGE(log_tag, "Unable to set socket options: errno %d", errno);
+        close(sock);
+        return;
+    }
+    announce_socket = sock;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = periodic,
+        .name = "announce",
+    };
+    if (esp_timer_create(&timer_args, &announce_timer) != ESP_OK ||
+        esp_timer_start_periodic(announce_timer, CONFIG_ANNOUNCE_INTERVAL_S * 1000000ULL) != ESP_OK) {
+        ESP_LOGE(log_tag, "Unable to start periodic frames");
+    }
+    ESP_LOGI(log_tag, "Announcing readings to %s:%u", group, port);
+}
+
+void announce_reading(const sampler_reading_t * reading)
+{
+    if (announce_socket < 0) {
+        return;
+    }
+
+    const int32_t temperature = hundredths(reading->temperature, INT16_MIN, INT16_MAX);
+    const int32_t humidity = hundredths(reading->humidity, 0, UINT16_MAX);
+    if (announced && abs(temperature - announced_temperature) < CONFIG_ANNOUNCE_CHANGE_CENTI
+            && abs(humidity - announced_humidity) < CONFIG_ANNOUNCE_CHANGE_CENTI) {
+        return;
+    }
+    announced_temperature = temperature;
+    announced_humidity = humidity;
+    announced = true;
+    send_frame(reading, true, true);
+}
@@ -0,0 +1,97 @@
+/**
+ * @file Multicast announcer: pushes the readings to LAN collectors as small fixed-layout binary frames over UDP
+ *
+ * A frame is sent whenever a new reading differs from the last one announced by CONFIG_ANNOUNCE_CHANGE_CENTI or more,
+ * and every CONFIG_ANNOUNCE_INTERVAL_S with the latest reading so that collectors see the device alive. Frames are
+ * ANNOUNCE_FRAME_SIZE bytes, all fields little-endian:
+ *
+ *   offset  size  field
+ *        0     2  magic "KS"
+ *        2     1  version, ANNOUNCE_VERSION
+ *        3     1  flags, ANNOUNCE_FLAG_*
+ *        4     6  device identifier, the MAC address of the station interface
+ *       10     4  sequence number, counting every frame the device has sent since it booted
+ *       14     4  uptime in ms when the reading was taken
+ *       18     2  temperature in hundredths of *C, signed
+ *       20     2  relative humidity in hundredths of %
+ *       22     1  status, announce_status_t
+ *       23     1  checksum, the XOR of bytes 0 to 22
+ *
+ * With ANNOUNCE_FLAG_ENCRYPTED bytes 4 to 23 are encrypted with the autokey cipher of the Kasa protocol, the magic,
+ * version and flags stay readable.
+ */
+
+#ifndef INTELLILIGHT_ANNOUNCE_H
+#define INTELLILIGHT_ANNOUNCE_H
+
+/* system includes */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* local includes */
+#include "sampler.h"
+
+
+#define ANNOUNCE_FRAME_SIZE 24
+#define ANNOUNCE_VERSION 1
+
+/* the reading changed by the threshold since the last frame, rather than being repeated */
+#define ANNOUNCE_FLAG_CHANGED 0x01
+/* bytes 4 to 23 are encrypted */
+#define ANNOUNCE_FLAG_ENCRYPTED 0x02
+
+/**
+ * @brief State of the sensor a frame reports
+ */
+typedef enum
+{
+    ANNOUNCE_STATUS_OK = 0,
+    ANNOUNCE_STATUS_NO_READING,     /* the sensor has not been read yet, the values are 0 */
+    ANNOUNCE_STATUS_STALE,          /* the latest reading is older than three sampling intervals */
+} announce_status_t;
+
+/**
+ * @brief Content of a frame
+ */
+typedef struct
+{
+    uint8_t device_id[6];
+    uint8_t flags;
+    uint32_t sequence;
+    uint32_t timestamp_ms;
+    int16_t temperature;        /* hundredths of *C */
+    uint16_t humidity;          /* hundredths of % */
+    uint8_t status;
+} announce_frame_t;
+
+/**
+ * @brief Lay out a frame, encrypting it if its flags say so
+ * @param frame Content of the frame
+ * @param out Output buffer of ANNOUNCE_FRAME_SIZE bytes
+ */
+extern void announce_frame_encode(const announce_frame_t * frame, uint8_t * out);
+
+/**
+ * @brief Read a frame, decrypting it if its flags say so
+ * @param data Received datagram
+ * @param length Length of the datagram
+ * @param frame Output content of the frame
+ * @return False if the datagram is not a frame of this version or its checksum does not match
+ */
+extern bool announce_frame_decode(const uint8_t * data, const size_t length, announce_frame_t * frame);
+
+/**
+ * @brief Open the multicast socket and start the periodic frames, once the network stack is initialised
+ * @param group IPv4 multicast group to send to, must stay valid for ever
+ * @param port UDP port to send to
+ */
+extern void announce_start(const char * group, const uint16_t port);
+
+/**
+ * @brief Announce a new reading if it changed enough since the last one announced (sampler task only)
+ * @param reading Reading
+ */
+extern void announce_reading(const sampler_reading_t * reading);
+
+#endif
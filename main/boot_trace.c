@@ -0,0 +1,87 @@
+/**
+ * @file Timeline of the boot, from app_main to the first reply served
+ */
+
+/* system includes */
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+
+/* local includes */
+#include "boot_trace.h"
+
+static const char *log_tag = "boot";
+
+static const char * const phase_names[BOOT_PHASE_COUNT] = {
+    "app_main", "nvs", "netif", "wifi_init", "wifi_start", "reply_cache", "first_sample",
+    "wifi_connected", "got_ip", "servers", "first_request", "first_reply"
+};
+
+/* esp_timer time of each milestone, 0 until it is reached */
+static portMUX_TYPE boot_trace_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t phase_times[BOOT_PHASE_COUNT];
+
+
+static void copy_timeline(int64_t * times)
+{
+    portENTER_CRITICAL(&boot_trace_lock);
+    memcpy(times, phase_times, sizeof(phase_times));
+    portEXIT_CRITICAL(&boot_trace_lock);
+}
+
+static void log_timeline(void)
+{
+    int64_t times[BOOT_PHASE_COUNT];
+    int64_t previous = 0;
+    copy_timeline(times);
+    for (int phase = 0; phase < BOOT_PHASE_COUNT; phase++) {
+        const int64_t time = times[phase];
+        if (time == 0) {
+            continue;
+        }
+        ESP_LOGI(log_tag, "%-14s %6d ms (+%d ms)", phase_names[phase], (int)(time / 1000), (int)((time - previous) / 1000));
+        previous = time;
+    }
+}
+
+void boot_trace_mark(const boot_phase_t phase)
+{
+    /* esp_timer starts before app_main, so a milestone can never be at time 0 */
+    const int64_t now = esp_timer_get_time();
+    bool first = false;
+    portENTER_CRITICAL(&boot_trace_lock);
+    if (phase_times[phase] == 0) {
+        phase_times[phase] = now;
+        first = true;
+    }
+    portEXIT_CRITICAL(&boot_trace_lock);
+    if (!first) {
+        return;
+    }
+
+    /* the first reply completes the boot */
+    if (phase == BOOT_FIRST_REPLY) {
+        log_timeline();
+    }
+}
+
+cJSON * boot_trace_to_json(cJSON_Context * json_context)
+{
+    int64_t times[BOOT_PHASE_COUNT];
+    copy_timeline(times);
+
+    cJSON * timeline = cJSON_CreateObjectCtx(json_context);
+    if (timeline == NULL) {
+        return NULL;
+    }
+
+    for (int phase = 0; phase < BOOT_PHASE_COUNT; phase++) {
+        const int64_t time = times[phase];
+        if (time != 0) {
+            cJSON_AddNumberToObjectCtx(json_context, timeline, phase_names[phase], (double)time);
+        }
+    }
+
+    return timeline;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file Timeline of the boot, from app_main to the first reply served
+ */
+
+#ifndef INTELLILIGHT_BOOT_TRACE_H
+#define INTELLILIGHT_BOOT_TRACE_H
+
+/* local includes */
+#include "cJSON.h"
+
+
+/**
+ * @brief Milestones of the boot, in the order they are normally reached
+ */
+typedef enum
+{
+    BOOT_APP_MAIN = 0,      /* app_main entered */
+    BOOT_NVS,               /* NVS flash initialised */
+    BOOT_NETIF,             /* TCP/IP stack and default event loop initialised */
+    BOOT_WIFI_INIT,         /* WiFi driver initialised */
+    BOOT_WIFI_START,        /* WiFi started, association runs in the background from here */
+    BOOT_REPLY_CACHE,       /* system information reply built */
+    BOOT_FIRST_SAMPLE,      /* first sensor reading taken */
+    BOOT_WIFI_CONNECTED,    /* associated with the access point */
+    BOOT_GOT_IP,            /* IP address acquired */
+    BOOT_SERVERS,           /* servers listening */
+    BOOT_FIRST_REQUEST,     /* first request received */
+    BOOT_FIRST_REPLY,       /* first reply sent */
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+/**
+ * @brief Record that a milestone has been reached, only the first time counts (any task)
+ * @param phase Milestone
+ */
+extern void boot_trace_mark(const boot_phase_t phase);
+
+/**
+ * @brief Render the timeline as JSON, microseconds since boot for each milestone reached
+ * @param json_context cJSON context to allocate the result from
+ * @return New cJSON object that the caller must delete with the same context
+ */
+extern cJSON * boot_trace_to_json(cJSON_Context * json_context);
+
+#endif
@@ -0,0 +1,822 @@
+/**
+ * @file CoAP server (RFC 7252) with Observe (RFC 7641) and block-wise transfer (RFC 7959) of the readings
+ */
+
+/* system includes */
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "coap.h"
+#include "history.h"
+#include "ratelimit.h"
+#include "sampler.h"
+#include "wifi.h"
+
+#define COAP_VERSION 1
+#define COAP_HEADER_SIZE 4
+#define COAP_MAX_TOKEN 8
+#define COAP_PAYLOAD_MARKER 0xFF
+
+/* message types */
+#define COAP_TYPE_CON 0
+#define COAP_TYPE_NON 1
+#define COAP_TYPE_ACK 2
+#define COAP_TYPE_RST 3
+
+/* codes, class in the top 3 bits and detail in the bottom 5 */
+#define COAP_CODE(class, detail) (((class) << 5) | (detail))
+#define COAP_EMPTY 0
+#define COAP_GET 1
+#define COAP_VALID COAP_CODE(2, 3)
+#define COAP_CONTENT COAP_CODE(2, 5)
+#define COAP_BAD_OPTION COAP_CODE(4, 2)
+#define COAP_NOT_FOUND COAP_CODE(4, 4)
+#define COAP_METHOD_NOT_ALLOWED COAP_CODE(4, 5)
+#define COAP_NOT_ACCEPTABLE COAP_CODE(4, 6)
+#define COAP_SERVICE_UNAVAILABLE COAP_CODE(5, 3)
+
+/* options */
+#define COAP_OPTION_IF_MATCH 1
+#define COAP_OPTION_URI_HOST 3
+#define COAP_OPTION_ETAG 4
+#define COAP_OPTION_IF_NONE_MATCH 5
+#define COAP_OPTION_OBSERVE 6
+#define COAP_OPTION_URI_PORT 7
+#define COAP_OPTION_URI_PATH 11
+#define COAP_OPTION_CONTENT_FORMAT 12
+#define COAP_OPTION_MAX_AGE 14
+#define COAP_OPTION_URI_QUERY 15
+#define COAP_OPTION_ACCEPT 17
+#define COAP_OPTION_BLOCK2 23
+#define COAP_OPTION_SIZE2 28
+
+/* content formats */
+#define COAP_FORMAT_TEXT 0
+#define COAP_FORMAT_LINK 40
+#define COAP_FORMAT_CBOR 60
+
+/* largest block sent is 16 << 5 = 512 bytes, a client can ask for smaller ones */
+#define COAP_MAX_SZX 5
+#define COAP_BLOCK_SIZE(szx) (16u << (szx))
+/* options of a response are well within this */
+#define COAP_MAX_OPTIONS 32
+#define COAP_MAX_MESSAGE (COAP_HEADER_SIZE + COAP_MAX_TOKEN + COAP_MAX_OPTIONS + 1 + COAP_BLOCK_SIZE(COAP_MAX_SZX))
+/* requests carry no payload, a longer datagram is cut short and then fails to parse */
+#define COAP_MAX_REQUEST 256
+#define COAP_MAX_PATH 32
+
+/* confirmable transmission of RFC 7252 section 4.8, without the random factor */
+#define COAP_ACK_TIMEOUT_MS 2000
+#define COAP_MAX_RETRANSMIT 4
+
+/* observe values are 24 bits */
+#define COAP_OBSERVE_MASK 0xFFFFFF
+
+static const char *log_tag = "coap";
+
+enum resource
+{
+    RESOURCE_TEMPERATURE = 0,
+    RESOURCE_HUMIDITY,
+    RESOURCE_HISTORY,
+    RESOURCE_CORE,
+    RESOURCE_COUNT,
+};
+
+struct resource_info
+{
+    const char * path;
+    uint8_t format;
+    bool observable;
+    int32_t deadband;       /* hundredths */
+    uint32_t max_age_s;     /* 0 for the default of 60 s */
+};
+
+static const struct resource_info resources[RESOURCE_COUNT] = {
+    [RESOURCE_TEMPERATURE] = { "temperature", COAP_FORMAT_TEXT, true, CONFIG_COAP_DEADBAND_TEMPERATURE_CENTI,
+        COAP_REFRESH_S + HISTORY_INTERVAL_S },
+    [RESOURCE_HUMIDITY] = { "humidity", COAP_FORMAT_TEXT, true, CONFIG_COAP_DEADBAND_HUMIDITY_CENTI,
+        COAP_REFRESH_S + HISTORY_INTERVAL_S },
+    [RESOURCE_HISTORY] = { "history", COAP_FORMAT_CBOR, false, 0, HISTORY_INTERVAL_S },
+    [RESOURCE_CORE] = { ".well-known/core", COAP_FORMAT_LINK, false, 0, 0 },
+};
+
+static const char core_links[] =
+    "</temperature>;rt=\"temperature-c\";obs;ct=0,"
+    "</humidity>;rt=\"humidity-p\";obs;ct=0,"
+    "</history>;ct=60";
+
+struct request
+{
+    uint8_t type;
+    uint8_t code;
+    uint16_t message_id;
+    uint8_t token_length;
+    uint8_t token[COAP_MAX_TOKEN];
+    char path[COAP_MAX_PATH];
+    bool path_too_long;
+    bool bad_option;            /* a critical option this server does not know */
+    int32_t observe;            /* -1 if absent */
+    int32_t accept;             /* -1 if absent */
+    int64_t block2;             /* -1 if absent */
+    uint8_t etag_length;        /* 0 if absent */
+    uint8_t etag[8];
+};
+
+struct observer
+{
+    bool used;
+    enum resource resource;
+    struct sockaddr_storage address;
+    uint8_t token_length;
+    uint8_t token[COAP_MAX_TOKEN];
+    uint32_t sequence;          /* observe value of the last notification */
+    int32_t notified;           /* value of the last notification, hundredths */
+    uint16_t message_id;        /* of the last notification, an ACK or reset to it is matched with it */
+    int64_t notified_us;
+    int64_t acked_us;           /* when the client last showed it is still interested */
+    uint8_t transmissions;      /* of the confirmable notification awaiting its ACK, 0 if none */
+    uint32_t timeout_ms;
+    int64_t retransmit_us;
+};
+
+struct coap_stats
+{
+    uint32_t requests;
+    uint32_t rejected;          /* by the rate limit */
+    uint32_t invalid;           /* datagrams that are not CoAP messages */
+    uint32_t notifications;
+    uint32_t confirmable;       /* notifications sent confirmable */
+    uint32_t retransmissions;
+    uint32_t registered;
+    uint32_t cancelled;         /* by a GET with Observe 1 or a reset */
+    uint32_t timed_out;         /* observers dropped after their confirmable notification went unacknowledged */
+};
+
+/* only the network task touches the observers and the buffers */
+static struct observer observers[CONFIG_COAP_OBSERVERS];
+static uint16_t next_message_id = 0;
+static uint8_t request_buffer[COAP_MAX_REQUEST];
+static uint8_t message_buffer[COAP_MAX_MESSAGE];
+static uint8_t payload_buffer[COAP_BLOCK_SIZE(COAP_MAX_SZX)];
+/* a reading was published since the observers were last checked */
+static atomic_bool reading_pending = false;
+/* earliest retransmission or refresh, the observers need no attention before */
+static int64_t next_due_us = 0;
+/* counters are read by other tasks without a lock: slightly inconsistent but never wrong for long */
+static struct coap_stats stats;
+
+
+/* option numbers and lengths are 4 bits, with 13 and 14 announcing 1 and 2 extension bytes */
+static bool read_extended(const uint8_t ** position, const uint8_t * end, uint32_t * value)
+{
+    if (*value == 13) {
+        if (*position + 1 > end) {
+            return false;
+        }
+        *value = 13 + (*position)[0];
+        *position += 1;
+    } else if (*value == 14) {
+        if (*position + 2 > end) {
+            return false;
+        }
+        *value = 269 + (((*position)[0] << 8) | (*position)[1]);
+        *position += 2;
+    } else if (*value == 15) {
+        return false;
+    }
+    return true;
+}
+
+static uint32_t read_uint(const uint8_t * value, const uint32_t length)
+{
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        result = (result << 8) | value[i];
+    }
+    return result;
+}
+
+static bool parse_request(const uint8_t * data, const size_t length, struct request * request)
+{
+    memset(request, 0, sizeof(*request));
+    request->observe = -1;
+    request->accept = -1;
+    request->block2 = -1;
+    if (length < COAP_HEADER_SIZE || (data[0] >> 6) != COAP_VERSION) {
+        return false;
+    }
+    request->type = (data[0] >> 4) & 0x03;
+    request->token_length = data[0] & 0x0F;
+    request->code = data[1];
+    request->message_id = (data[2] << 8) | data[3];
+    if (request->token_length > COAP_MAX_TOKEN || COAP_HEADER_SIZE + request->token_length > length) {
+        return false;
+    }
+    memcpy(request->token, &data[COAP_HEADER_SIZE], request->token_length);
+
+    const uint8_t * position = &data[COAP_HEADER_SIZE + request->token_length];
+    const uint8_t * end = data + length;
+    uint32_t number = 0;
+    size_t path_length = 0;
+    while (position < end && *position != COAP_PAYLOAD_MARKER) {
+        uint32_t delta = *position >> 4;
+        uint32_t value_length = *position & 0x0F;
+        position++;
+        if (!read_extended(&position, end, &delta) || !read_extended(&position, end, &value_length)
+                || position + value_length > end) {
+            return false;
+        }
+        number += delta;
+        const uint8_t * value = position;
+        position += value_length;
+
+        switch (number) {
+            case COAP_OPTION_URI_PATH:
+                if (path_length + (path_length > 0) + value_length >= sizeof(request->path)) {
+                    request->path_too_long = true;
+                    break;
+                }
+                if (path_length > 0) {
+                    request->path[path_length++] = '/';
+                }
+                memcpy(&request->path[path_length], value, value_length);
+                path_length += value_length;
+                request->path[path_length] = 0;
+                break;
+            case COAP_OPTION_OBSERVE:
+                request->observe = value_length <= 3 ? read_uint(value, value_length) : 1;
+                break;
+            case COAP_OPTION_ACCEPT:
+                request->accept = value_length <= 2 ? read_uint(value, value_length) : 0xFFFF;
+                break;
+            case COAP_OPTION_BLOCK2:
+                request->block2 = value_length <= 3 ? read_uint(value, value_length) : -1;
+                request->bad_option |= value_length > 3;
+                break;
+            case COAP_OPTION_ETAG:
+                /* only the first ETag is compared, clients that know the representation send one */
+                if (request->etag_length == 0 && value_length >= 1 && value_length <= sizeof(request->etag)) {
+                    memcpy(request->etag, value, value_length);
+                    request->etag_length = value_length;
+                }
+                break;
+            case COAP_OPTION_IF_MATCH:
+            case COAP_OPTION_URI_HOST:
+            case COAP_OPTION_IF_NONE_MATCH:
+            case COAP_OPTION_URI_PORT:
+            case COAP_OPTION_URI_QUERY:
+                /* critical but meaningless for these resources, safe to ignore for a GET */
+                break;
+            default:
+                /* unknown elective options are ignored, unknown critical ones fail the request */
+                request->bad_option |= (number & 1) != 0;
+                break;
+        }
+    }
+    return true;
+}
+
+struct writer
+{
+    uint8_t * data;
+    size_t length;
+    uint32_t option;    /* number of the last option written, they are written in increasing order */
+};
+
+static void write_header(struct writer * writer, const uint8_t type, const uint8_t code, const uint16_t message_id,
+        const uint8_t * token, const uint8_t token_length)
+{
+    writer->data[0] = (COAP_VERSION << 6) | (type << 4) | token_length;
+    writer->data[1] = code;
+    writer->data[2] = message_id >> 8;
+    writer->data[3] = message_id & 0xFF;
+    if (token_length > 0) {
+        memcpy(&writer->data[COAP_HEADER_SIZE], token, token_length);
+    }
+    writer->length = COAP_HEADER_SIZE + token_length;
+    writer->option = 0;
+}
+
+static uint8_t nibble(const uint32_t value)
+{
+    return value < 13 ? value : value < 269 ? 13 : 14;
+}
+
+static void write_extended(struct writer * writer, const uint32_t value)
+{
+    if (value >= 269) {
+        writer->data[writer->length++] = (value - 269) >> 8;
+        writer->data[writer->length++] = (value - 269) & 0xFF;
+    } else if (value >= 13) {
+        writer->data[writer->length++] = value - 13;
+    }
+}
+
+static void write_option(struct writer * writer, const uint32_t number, const uint8_t * value, const size_t length)
+{
+    const uint32_t delta = number - writer->option;
+    writer->data[writer->length++] = (nibble(delta) << 4) | nibble(length);
+    write_extended(writer, delta);
+    write_extended(writer, length);
+    memcpy(&writer->data[writer->length], value, length);
+    writer->length += length;
+    writer->option = number;
+}
+
+/* unsigned options are big-endian without leading zero bytes, 0 is empty */
+static void write_uint_option(struct writer * writer, const uint32_t number, const uint32_t value)
+{
+    uint8_t bytes[4];
+    size_t length = 0;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        if (length > 0 || ((value >> shift) & 0xFF) != 0) {
+            bytes[length++] = value >> shift;
+        }
+    }
+    write_option(writer, number, bytes, length);
+}
+
+static void write_payload(struct writer * writer, const uint8_t * payload, const size_t length)
+{
+    if (length > 0) {
+        writer->data[writer->length++] = COAP_PAYLOAD_MARKER;
+        memcpy(&writer->data[writer->length], payload, length);
+        writer->length += length;
+    }
+}
+
+/**
+ * @brief Part of a representation to keep: it is rendered whole every time and only the bytes of the block asked for
+ * are copied, so that a block costs no memory beyond its own
+ */
+struct window
+{
+    uint8_t * out;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t total;     /* bytes rendered so far */
+};
+
+static void emit(struct window * window, const void * data, const uint32_t length)
+{
+    const uint32_t begin = MAX(window->total, window->offset);
+    const uint32_t end = MIN(window->total + length, window->offset + window->size);
+    if (begin < end) {
+        memcpy(window->out + (begin - window->offset), (const uint8_t *)data + (begin - window->total), end - begin);
+    }
+    window->total += length;
+}
+
+/* CBOR head of a major type with an argument below 65536 */
+static void emit_cbor_head(struct window * window, const uint8_t major, const uint32_t argument)
+{
+    uint8_t head[3];
+    uint32_t length = 1;
+    if (argument < 24) {
+        head[0] = (major << 5) | argument;
+    } else if (argument < 256) {
+        head[0] = (major << 5) | 24;
+        head[1] = argument;
+        length = 2;
+    } else {
+        head[0] = (major << 5) | 25;
+        head[1] = argument >> 8;
+        head[2] = argument & 0xFF;
+        length = 3;
+    }
+    emit(window, head, length);
+}
+
+static void emit_cbor_int(struct window * window, const int32_t value)
+{
+    if (value >= 0) {
+        emit_cbor_head(window, 0, value);
+    } else {
+        emit_cbor_head(window, 1, -1 - value);
+    }
+}
+
+static void emit_cbor_text(struct window * window, const char * text)
+{
+    const uint32_t length = strlen(text);
+    emit_cbor_head(window, 3, length);
+    emit(window, text, length);
+}
+
+static void emit_cbor_samples(struct window * window, const char * name, const int16_t * samples, const int count)
+{
+    emit_cbor_text(window, name);
+    emit_cbor_head(window, 4, count);
+    for (int i = 0; i < count; i++) {
+        emit_cbor_int(window, samples[i]);
+    }
+}
+
+static int32_t hundredths(const float value)
+{
+    return lroundf(value * 100.0f);
+}
+
+static uint32_t format_hundredths(char * text, const size_t size, const int32_t value)
+{
+    const uint32_t magnitude = value < 0 ? -value : value;
+    return snprintf(text, size, "%s%u.%02u", value < 0 ? "-" : "", (unsigned)(magnitude / 100),
+        (unsigned)(magnitude % 100));
+}
+
+/**
+ * @brief Current value of an observable resource
+ * @return False if no reading has been taken yet
+ */
+static bool current_value(const enum resource resource, int32_t * value)
+{
+    sampler_reading_t reading;
+    if (!sampler_latest(&reading)) {
+        return false;
+    }
+    *value = hundredths(resource == RESOURCE_TEMPERATURE ? reading.temperature : reading.humidity);
+    return true;
+}
+
+/**
+ * @brief Render a representation, keeping the bytes of the window
+ * @param etag Output entity tag of the representation
+ * @return False if there is nothing to render yet
+ */
+static bool render(const enum resource resource, struct window * window, uint32_t * etag)
+{
+    switch (resource) {
+        case RESOURCE_TEMPERATURE:
+        case RESOURCE_HUMIDITY: {
+            int32_t value;
+            if (!current_value(resource, &value)) {
+                return false;
+            }
+            char text[16];
+            emit(window, text, format_hundredths(text, sizeof(text), value));
+            /* the text follows from the value alone */
+            *etag = (uint32_t)value;
+            return true;
+        }
+        case RESOURCE_HISTORY: {
+            history_lock();
+            const int16_t * temperature;
+            const int16_t * humidity;
+            const int count = history_samples(&temperature, &humidity);
+            *etag = history_version();
+            emit_cbor_head(window, 5, 3);
+            emit_cbor_text(window, "interval");
+            emit_cbor_int(window, HISTORY_INTERVAL_S);
+            emit_cbor_samples(window, "temperature_x10", temperature, count);
+            emit_cbor_samples(window, "humidity_x10", humidity, count);
+            history_unlock();
+            return true;
+        }
+        case RESOURCE_CORE:
+            emit(window, core_links, sizeof(core_links) - 1);
+            *etag = 0;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void send_message(const int coap_socket, const struct writer * writer, const struct sockaddr_storage * address)
+{
+    if (sendto(coap_socket, writer->data, writer->length, 0, (const struct sockaddr *)address,
+            sizeof(struct sockaddr_in)) < 0) {
+        ESP_LOGW(log_tag, "Error occurred during send: errno %d", errno);
+    }
+}
+
+static bool same_address(const struct sockaddr_storage * a, const struct sockaddr_storage * b)
+{
+    const struct sockaddr_in * a4 = (const struct sockaddr_in *)a;
+    const struct sockaddr_in * b4 = (const struct sockaddr_in *)b;
+    return a4->sin_addr.s_addr == b4->sin_addr.s_addr && a4->sin_port == b4->sin_port;
+}
+
+static struct observer * find_observer(const struct sockaddr_storage * address, const uint8_t * token,
+        const uint8_t token_length)
+{
+    for (int i = 0; i < CONFIG_COAP_OBSERVERS; i++) {
+        struct observer * observer = &observers[i];
+        if (observer->used && observer->token_length == token_length && same_address(&observer->address, address)
+                && memcmp(observer->token, token, token_length) == 0) {
+            return observer;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Register an observer or refresh the registration of the same client and token
+ * @return Observer, NULL if every entry is taken
+ */
+static struct observer * register_observer(const struct request * request, const struct sockaddr_storage * address,
+        const enum resource resource, const int32_t value)
+{
+    struct observer * observer = find_observer(address, request->token, request->token_length);
+    for (int i = 0; observer == NULL && i < CONFIG_COAP_OBSERVERS; i++) {
+        if (!observers[i].used) {
+            observer = &observers[i];
+            memset(observer, 0, sizeof(*observer));
+            observer->used = true;
+            observer->address = *address;
+            observer->token_length = request->token_length;
+            memcpy(observer->token, request->token, request->token_length);
+            stats.registered++;
+        }
+    }
+    if (observer == NULL) {
+        return NULL;
+    }
+
+    const int64_t now = esp_timer_get_time();
+    observer->resource = resource;
+    observer->sequence = (observer->sequence + 1) & COAP_OBSERVE_MASK;
+    observer->notified = value;
+    observer->notified_us = now;
+    observer->acked_us = now;
+    observer->transmissions = 0;
+    next_due_us = MIN(next_due_us, now + COAP_REFRESH_S * 1000000LL);
+    return observer;
+}
+
+static void respond(const int coap_socket, const struct request * request, const struct sockaddr_storage * address)
+{
+    /* a confirmable request is answered in its ACK, a non-confirmable one with a message of its own */
+    struct writer writer = { .data = message_buffer };
+    const bool confirmable = request->type == COAP_TYPE_CON;
+    const uint8_t type = confirmable ? COAP_TYPE_ACK : COAP_TYPE_NON;
+    const uint16_t message_id = confirmable ? request->message_id : next_message_id++;
+
+    enum resource resource = RESOURCE_COUNT;
+    for (int i = 0; i < RESOURCE_COUNT && !request->path_too_long; i++) {
+        if (strcmp(request->path, resources[i].path) == 0) {
+            resource = i;
+        }
+    }
+    uint8_t code = COAP_CONTENT;
+    if (request->code != COAP_GET) {
+        code = COAP_METHOD_NOT_ALLOWED;
+    } else if (request->bad_option) {
+        code = COAP_BAD_OPTION;
+    } else if (resource == RESOURCE_COUNT) {
+        code = COAP_NOT_FOUND;
+    } else if (request->accept >= 0 && request->accept != resources[resource].format) {
+        code = COAP_NOT_ACCEPTABLE;
+    }
+    if (code != COAP_CONTENT) {
+        write_header(&writer, type, code, message_id, request->token, request->token_length);
+        send_message(coap_socket, &writer, address);
+        return;
+    }
+
+    /* without a Block2 option the server picks the largest block, a client can then ask for the rest */
+    const uint32_t szx = request->block2 >= 0 ? MIN(request->block2 & 0x07, COAP_MAX_SZX) : COAP_MAX_SZX;
+    const uint32_t number = request->block2 >= 0 ? (uint32_t)request->block2 >> 4 : 0;
+    struct window window = {
+        .out = payload_buffer,
+        .offset = number * COAP_BLOCK_SIZE(szx),
+        .size = COAP_BLOCK_SIZE(szx),
+    };
+    uint32_t etag = 0;
+    if (!render(resource, &window, &etag)) {
+        write_header(&writer, type, COAP_SERVICE_UNAVAILABLE, message_id, request->token, request->token_length);
+        send_message(coap_socket, &writer, address);
+        return;
+    }
+    if (window.offset > 0 && window.offset >= window.total) {
+        write_header(&writer, type, COAP_BAD_OPTION, message_id, request->token, request->token_length);
+        send_message(coap_socket, &writer, address);
+        return;
+    }
+
+    /* registering and cancelling only apply to the first block, later ones are plain GETs of the same resource */
+    struct observer * observer = NULL;
+    if (resources[resource].observable && number == 0) {
+        if (request->observe == 0) {
+            observer = register_observer(request, address, resource, (int32_t)etag);
+        } else if (request->observe == 1) {
+            struct observer * cancelled = find_observer(address, request->token, request->token_length);
+            if (cancelled != NULL) {
+                cancelled->used = false;
+                stats.cancelled++;
+            }
+        }
+    }
+
+    const uint8_t etag_bytes[4] = { etag >> 24, (etag >> 16) & 0xFF, (etag >> 8) & 0xFF, etag & 0xFF };
+    const bool valid = resource != RESOURCE_CORE && request->etag_length == sizeof(etag_bytes) && memcmp(request->etag, etag_bytes, 4) == 0;
+    const bool blockwise = request->block2 >= 0 || window.total > window.size;
+    const uint32_t block_length = MIN(window.size, window.total - window.offset);
+    write_header(&writer, type, valid ? COAP_VALID : COAP_CONTENT, message_id, request->token, request->token_length);
+    if (resource != RESOURCE_CORE) {
+        write_option(&writer, COAP_OPTION_ETAG, etag_bytes, sizeof(etag_bytes));
+    }
+    if (observer != NULL) {
+        write_uint_option(&writer, COAP_OPTION_OBSERVE, observer->sequence);
+    }
+    if (!valid) {
+        write_uint_option(&writer, COAP_OPTION_CONTENT_FORMAT, resources[resource].format);
+    }
+    if (resources[resource].max_age_s > 0) {
+        write_uint_option(&writer, COAP_OPTION_MAX_AGE, resources[resource].max_age_s);
+    }
+    if (!valid && blockwise) {
+        const bool more = window.offset + block_length < window.total;
+        write_uint_option(&writer, COAP_OPTION_BLOCK2, (number << 4) | (more << 3) | szx);
+        if (number == 0) {
+            write_uint_option(&writer, COAP_OPTION_SIZE2, window.total);
+        }
+    }
+    if (!valid) {
+        write_payload(&writer, payload_buffer, block_length);
+    }
+    send_message(coap_socket, &writer, address);
+}
+
+void coap_receive(const int coap_socket)
+{
+    struct sockaddr_storage source_addr;
+    socklen_t addr_len = sizeof(source_addr);
+    const int rx_len = recvfrom(coap_socket, request_buffer, sizeof(request_buffer), 0,
+        (struct sockaddr *)&source_addr, &addr_len);
+    if (rx_len <= 0 || source_addr.ss_family != AF_INET) {
+        return;
+    }
+
+    struct request request;
+    if (next_message_id == 0) {
+        next_message_id = (uint16_t)esp_timer_get_time();
+    }
+    if (!parse_request(request_buffer, rx_len, &request)) {
+        /* a confirmable message that cannot be parsed is rejected with a reset if its header can be */
+        stats.invalid++;
+        if (rx_len >= COAP_HEADER_SIZE && (request_buffer[0] >> 6) == COAP_VERSION
+                && ((request_buffer[0] >> 4) & 0x03) == COAP_TYPE_CON) {
+            struct writer writer = { .data = message_buffer };
+            write_header(&writer, COAP_TYPE_RST, COAP_EMPTY, (request_buffer[2] << 8) | request_buffer[3], NULL, 0);
+            send_message(coap_socket, &writer, &source_addr);
+        }
+        return;
+    }
+
+    /* an acknowledgement or a reset answers a notification */
+    if (request.type == COAP_TYPE_ACK || request.type == COAP_TYPE_RST) {
+        for (int i = 0; i < CONFIG_COAP_OBSERVERS; i++) {
+            struct observer * observer = &observers[i];
+            if (observer->used && observer->message_id == request.message_id
+                    && same_address(&observer->address, &source_addr)) {
+                if (request.type == COAP_TYPE_RST) {
+                    observer->used = false;
+                    stats.cancelled++;
+                } else {
+                    observer->transmissions = 0;
+                    observer->acked_us = esp_timer_get_time();
+                }
+            }
+        }
+        return;
+    }
+    /* an empty confirmable message is a ping, answered with a reset */
+    if (request.code == COAP_EMPTY) {
+        if (request.type == COAP_TYPE_CON) {
+            struct writer writer = { .data = message_buffer };
+            write_header(&writer, COAP_TYPE_RST, COAP_EMPTY, request.message_id, NULL, 0);
+            send_message(coap_socket, &writer, &source_addr);
+        }
+        return;
+    }
+    /* responses from clients are not expected, requests share the rate limit of the Kasa servers */
+    if ((request.code >> 5) != 0) {
+        return;
+    }
+    if (!ratelimit_admit(&source_addr)) {
+        stats.rejected++;
+        return;
+    }
+    stats.requests++;
+    respond(coap_socket, &request, &source_addr);
+}
+
+static void send_notification(const int coap_socket, struct observer * observer, const bool confirmable)
+{
+    struct writer writer = { .data = message_buffer };
+    const uint32_t etag = (uint32_t)observer->notified;
+    const uint8_t etag_bytes[4] = { etag >> 24, (etag >> 16) & 0xFF, (etag >> 8) & 0xFF, etag & 0xFF };
+    char text[16];
+    const uint32_t length = format_hundredths(text, sizeof(text), observer->notified);
+
+    write_header(&writer, confirmable ? COAP_TYPE_CON : COAP_TYPE_NON, COAP_CONTENT, observer->message_id,
+        observer->token, observer->token_length);
+    write_option(&writer, COAP_OPTION_ETAG, etag_bytes, sizeof(etag_bytes));
+    write_uint_option(&writer, COAP_OPTION_OBSERVE, observer->sequence);
+    write_uint_option(&writer, COAP_OPTION_CONTENT_FORMAT, resources[observer->resource].format);
+    write_uint_option(&writer, COAP_OPTION_MAX_AGE, resources[observer->resource].max_age_s);
+    write_payload(&writer, (const uint8_t *)text, length);
+    send_message(coap_socket, &writer, &observer->address);
+}
+
+void coap_service(const int coap_socket)
+{
+    const bool reading = atomic_exchange(&reading_pending, false);
+    const int64_t now = esp_timer_get_time();
+    if (!reading && now < next_due_us) {
+        return;
+    }
+
+    int32_t values[RESOURCE_COUNT];
+    bool known[RESOURCE_COUNT] = { false };
+    known[RESOURCE_TEMPERATURE] = current_value(RESOURCE_TEMPERATURE, &values[RESOURCE_TEMPERATURE]);
+    known[RESOURCE_HUMIDITY] = current_value(RESOURCE_HUMIDITY, &values[RESOURCE_HUMIDITY]);
+
+    next_due_us = INT64_MAX;
+    for (int i = 0; i < CONFIG_COAP_OBSERVERS; i++) {
+        struct observer * observer = &observers[i];
+        if (!observer->used) {
+            continue;
+        }
+
+        /* a newer value replaces a confirmable notification in flight, taking over its retransmission state */
+        const int32_t value = known[observer->resource] ? values[observer->resource] : observer->notified;
+        const bool changed = abs(value - observer->notified) >= resources[observer->resource].deadband;
+        const bool refresh = now - observer->notified_us >= COAP_REFRESH_S * 1000000LL;
+        if (changed || refresh) {
+            observer->notified = value;
+            observer->notified_us = now;
+            observer->sequence = (observer->sequence + 1) & COAP_OBSERVE_MASK;
+            observer->message_id = next_message_id++;
+            stats.notifications++;
+        }
+        if (observer->transmissions > 0 && now >= observer->retransmit_us) {
+            if (observer->transmissions > COAP_MAX_RETRANSMIT) {
+                ESP_LOGI(log_tag, "Observer stopped acknowledging, dropping it");
+                observer->used = false;
+                stats.timed_out++;
+                continue;
+            }
+            send_notification(coap_socket, observer, true);
+            stats.retransmissions++;
+            observer->transmissions++;
+            observer->timeout_ms *= 2;
+            observer->retransmit_us = now + observer->timeout_ms * 1000LL;
+        } else if (changed || refresh) {
+            const bool confirmable = observer->transmissions > 0
+                || now - observer->acked_us >= COAP_CONFIRM_INTERVAL_S * 1000000LL;
+            if (confirmable && observer->transmissions == 0) {
+                observer->transmissions = 1;
+                observer->timeout_ms = COAP_ACK_TIMEOUT_MS;
+                observer->retransmit_us = now + observer->timeout_ms * 1000LL;
+                stats.confirmable++;
+            }
+            send_notification(coap_socket, observer, confirmable);
+        }
+
+        next_due_us = MIN(next_due_us, observer->notified_us + COAP_REFRESH_S * 1000000LL);
+        if (observer->transmissions > 0) {
+            next_due_us = MIN(next_due_us, observer->retransmit_us);
+        }
+    }
+}
+
+void coap_reading_available(void)
+{
+    atomic_store(&reading_pending, true);
+    wifi_wake_network();
+}
+
+cJSON * coap_to_json(cJSON_Context * json_context)
+{
+    int registered = 0;
+    for (int i = 0; i < CONFIG_COAP_OBSERVERS; i++) {
+        registered += observers[i].used;
+    }
+
+    cJSON * json = cJSON_CreateObjectCtx(json_context);
+    cJSON_AddNumberToObjectCtx(json_context, json, "requests", stats.requests);
+    cJSON_AddNumberToObjectCtx(json_context, json, "rejected", stats.rejected);
+    cJSON_AddNumberToObjectCtx(json_context, json, "invalid", stats.invalid);
+    cJSON_AddNumberToObjectCtx(json_context, json, "observers", registered);
+    cJSON_AddNumberToObjectCtx(json_context, json, "registered", stats.registered);
+    cJSON_AddNumberToObjectCtx(json_context, json, "cancelled", stats.cancelled);
+    cJSON_AddNumberToObjectCtx(json_context, json, "timed_out", stats.timed_out);
+    cJSON_AddNumberToObjectCtx(json_context, json, "notifications", stats.notifications);
+    cJSON_AddNumberToObjectCtx(json_context, json, "confirmable", stats.confirmable);
+    cJSON_AddNumberToObjectCtx(json_context, json, "retransmissions", stats.retransmissions);
+    return json;
+}
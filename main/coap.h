@@ -0,0 +1,64 @@
+/**
+ * @file CoAP server (RFC 7252) with Observe (RFC 7641) and block-wise transfer (RFC 7959) of the readings
+ *
+ * Resources, all GET only:
+ *   /temperature          latest temperature in *C as text/plain, observable
+ *   /humidity             latest relative humidity in % as text/plain, observable
+ *   /history              the day of one-minute samples as CBOR, {"interval":60,"temperature_x10":[...],
+ *                         "humidity_x10":[...]} like sensor.get_history, sent in blocks
+ *   /.well-known/core     the resources in CoRE link format
+ *
+ * Responses are rendered straight from the latest reading and the history into the datagram, a block at a time. Every
+ * response carries an ETag derived from its content, so a client that sends it back gets 2.03 Valid without a payload.
+ * An observer is notified once the value has moved by the deadband of its resource since its last notification, and at
+ * least every COAP_REFRESH_S. Notifications are non-confirmable except one every COAP_CONFIRM_INTERVAL_S, which is
+ * retransmitted until acknowledged and drops the observer if it never is, as does a reset.
+ *
+ * The server runs on the network task, which owns the socket: coap_receive when it is readable, coap_service on every
+ * turn of the loop.
+ *
+ *   coap-client -m get coap://192.168.1.20/temperature
+ *   coap-client -m get -s 600 coap://192.168.1.20/temperature
+ *   coap-client -m get -b 256 coap://192.168.1.20/history > history.cbor
+ */
+
+#ifndef INTELLILIGHT_COAP_H
+#define INTELLILIGHT_COAP_H
+
+/* system includes */
+#include <stdint.h>
+
+/* local includes */
+#include "cJSON.h"
+
+
+/* an observer is sent the current value at least this often, the Max-Age of notifications covers the gap */
+#define COAP_REFRESH_S 600
+/* an observer that has not acknowledged a notification for this long is sent a confirmable one */
+#define COAP_CONFIRM_INTERVAL_S 120
+
+/**
+ * @brief Answer the datagram waiting on the CoAP socket (network task only)
+ * @param coap_socket Non-blocking UDP socket bound to CONFIG_COAP_PORT
+ */
+extern void coap_receive(const int coap_socket);
+
+/**
+ * @brief Send the notifications a new reading calls for and the retransmissions that are due (network task only)
+ * @param coap_socket Non-blocking UDP socket bound to CONFIG_COAP_PORT
+ */
+extern void coap_service(const int coap_socket);
+
+/**
+ * @brief Tell the server that a new reading has been published, it notifies the observers on the network task (any task)
+ */
+extern void coap_reading_available(void);
+
+/**
+ * @brief Build the CoAP counters for diag.get_server_stats
+ * @param json_context cJSON context to create the object with
+ * @return Object with the counters and the observers registered
+ */
+extern cJSON * coap_to_json(cJSON_Context * json_context);
+
+#endif
@@ -1,3 +1,13 @@
 #
 # Main Makefile. This is basically the same as a component makefile .
 #
+
+# Kasa command structs, parser and serializers are generated from the schema at build time
+COMPONENT_OBJS := $(patsubst %.c,%.o,$(notdir $(wildcard $(COMPONENT_PATH)/*.c))) kasa_commands.o
+CFLAGS += -I$(COMPONENT_BUILD_DIR)
+COMPONENT_EXTRA_CLEAN := kasa_commands.h kasa_commands.c
+
+kasa_commands.c kasa_commands.h: $(COMPONENT_PATH)/kasa_commands.schema $(PROJECT_PATH)/tools/kasa_codegen.py
+	$(PYTHON) $(PROJECT_PATH)/tools/kasa_codegen.py $< $(COMPONENT_BUILD_DIR)
+
+tplink_kasa.o kasa_commands.o: kasa_commands.h
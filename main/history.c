@@ -0,0 +1,191 @@
+/**
+ * @file One-minute history of the temperature and humidity readings
+ */
+
+/* system includes */
+#include <math.h>
+#include <sys/param.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/* local includes */
+#include "history.h"
+
+/* samples in tenths, oldest first so that replies can reference them as they are */
+static int16_t temperature_samples[HISTORY_SAMPLES];
+static int16_t humidity_samples[HISTORY_SAMPLES];
+static int sample_count = 0;
+static atomic_uint_least32_t recorded = 0;
+/* replies referencing the samples, which must not move until they have been sent */
+static int holds = 0;
+static int16_t pending_temperature[HISTORY_PENDING_SAMPLES];
+static int16_t pending_humidity[HISTORY_PENDING_SAMPLES];
+/* samples recorded while held, those past HISTORY_PENDING_SAMPLES are not kept and repeat the sample before them */
+static int pending_count = 0;
+static atomic_uint_least32_t filled = 0;
+static SemaphoreHandle_t history_mutex = NULL;
+static StaticSemaphore_t history_mutex_buffer;
+
+static int16_t to_tenths(float value)
+{
+    const float tenths = roundf(value * 10);
+    if (tenths >= INT16_MAX) {
+        return INT16_MAX;
+    } else if (tenths <= INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)tenths;
+}
+
+void history_init(void)
+{
+    history_mutex = xSemaphoreCreateMutexStatic(&history_mutex_buffer);
+}
+
+/* history_lock must be held, and the history must not be */
+static void add_sample(const int16_t temperature, const int16_t humidity)
+{
+    /* a sample a minute, so shifting the whole day along costs nothing worth a ring buffer that replies would have to copy */
+    if (sample_count == HISTORY_SAMPLES) {
+        memmove(temperature_samples, temperature_samples + 1, (HISTORY_SAMPLES - 1) * sizeof(temperature_samples[0]));
+        memmove(humidity_samples, humidity_samples + 1, (HISTORY_SAMPLES - 1) * sizeof(humidity_samples[0]));
+        sample_count--;
+    }
+    temperature_samples[sample_count] = temperature;
+    humidity_samples[sample_count] = humidity;
+    sample_count++;
+    atomic_fetch_add_explicit(&recorded, 1, memory_order_relaxed);
+}
+
+/* history_lock must be held */
+static bool last_sample(int16_t * temperature, int16_t * humidity)
+{
+    if (holds > 0 && pending_count > 0) {
+        const int last = MIN(pending_count, HISTORY_PENDING_SAMPLES) - 1;
+        *temperature = pending_temperature[last];
+        *humidity = pending_humidity[last];
+        return true;
+    } else if (sample_count > 0) {
+        *temperature = temperature_samples[sample_count - 1];
+        *humidity = humidity_samples[sample_count - 1];
+        return true;
+    }
+    return false;
+}
+
+void history_record(float temperature, float humidity)
+{
+    history_lock();
+
+    /* the send timeout bounds each stall of a reply rather than all of it, so a slow client can hold the history
+     * for longer than there is room to keep samples aside */
+    if (holds == 0) {
+        add_sample(to_tenths(temperature), to_tenths(humidity));
+    } else {
+        if (pending_count < HISTORY_PENDING_SAMPLES) {
+            pending_temperature[pending_count] = to_tenths(temperature);
+            pending_humidity[pending_count] = to_tenths(humidity);
+        }
+        pending_count++;
+    }
+
+    history_unlock();
+}
+
+void history_skip(void)
+{
+    history_lock();
+
+    /* there is nothing to repeat before the first sample */
+    int16_t temperature;
+    int16_t humidity;
+    if (last_sample(&temperature, &humidity)) {
+        if (holds == 0) {
+            add_sample(temperature, humidity);
+            atomic_fetch_add_explicit(&filled, 1, memory_order_relaxed);
+        } else {
+            if (pending_count < HISTORY_PENDING_SAMPLES) {
+                pending_temperature[pending_count] = temperature;
+                pending_humidity[pending_count] = humidity;
+                atomic_fetch_add_explicit(&filled, 1, memory_order_relaxed);
+            }
+            pending_count++;
+        }
+    }
+
+    history_unlock();
+}
+
+void history_lock(void)
+{
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+}
+
+void history_unlock(void)
+{
+    xSemaphoreGive(history_mutex);
+}
+
+void history_hold(void)
+{
+    history_lock();
+    holds++;
+    history_unlock();
+}
+
+void history_release(void)
+{
+    history_lock();
+    holds--;
+    if (holds == 0) {
+        for (int i = 0; i < pending_count; i++) {
+            if (i < HISTORY_PENDING_SAMPLES) {
+                add_sample(pending_temperature[i], pending_humidity[i]);
+            } else {
+                /* a sample that was not kept still takes its interval, so that sample n stays n intervals after boot */
+                add_sample(temperature_samples[sample_count - 1], humidity_samples[sample_count - 1]);
+                atomic_fetch_add_explicit(&filled, 1, memory_order_relaxed);
+            }
+        }
+        pending_count = 0;
+    }
+    history_unlock();
+}
+
+int history_samples(const int16_t ** temperature, const int16_t ** humidity)
+{
+    *temperature = temperature_samples;
+    *humidity = humidity_samples;
+    return sample_count;
+}
+
+uint32_t history_version(void)
+{
+    return atomic_load_explicit(&recorded, memory_order_relaxed);
+}
+
+uint32_t history_filled(void)
+{
+    return atomic_load_explicit(&filled, memory_order_relaxed);
+}
+
+cJSON * history_to_json(cJSON_Context * json_context)
+{
+    cJSON * history = cJSON_CreateObjectCtx(json_context);
+    cJSON_AddNumberToObjectCtx(json_context, history, "interval", HISTORY_INTERVAL_S);
+    cJSON_AddNumberToObjectCtx(json_context, history, "filled", history_filled());
+
+    /* packed references: a day of samples is two nodes rather than thousands */
+    cJSON * temperature = cJSON_CreatePackedArrayReferenceCtx(json_context, temperature_samples, sample_count, cJSON_PackedInt16);
+    if ( !cJSON_AddItemToObjectCtx(json_context, history, "temperature_x10", temperature) ) {
+        cJSON_DeleteCtx(json_context, temperature);
+    }
+    cJSON * humidity = cJSON_CreatePackedArrayReferenceCtx(json_context, humidity_samples, sample_count, cJSON_PackedInt16);
+    if ( !cJSON_AddItemToObjectCtx(json_context, history, "humidity_x10", humidity) ) {
+        cJSON_DeleteCtx(json_context, humidity);
+    }
+
+    return history;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file One-minute history of the temperature and humidity readings
+ */
+
+#ifndef INTELLILIGHT_HISTORY_H
+#define INTELLILIGHT_HISTORY_H
+
+/* system includes */
+#include <stdint.h>
+
+/* local includes */
+#include "cJSON.h"
+
+
+/* number of samples kept, one day at one sample per interval */
+#define HISTORY_SAMPLES 1440
+
+/* seconds between samples */
+#define HISTORY_INTERVAL_S 60
+
+/**
+ * @brief Set up the history, must be called before any samples are recorded or read
+ */
+extern void history_init(void);
+
+/* samples kept aside while the history is held, they are added once it is released */
+#define HISTORY_PENDING_SAMPLES 4
+
+/**
+ * @brief Record a sample, dropping the oldest one once the history is full, or keep it aside while the history is held:
+ * past HISTORY_PENDING_SAMPLES the sample is not kept and is added as a repeat of the one before it (see history_filled)
+ * @param temperature Temperature in *C
+ * @param humidity Relative humidity in %
+ */
+extern void history_record(float temperature, float humidity);
+
+/**
+ * @brief Take the interval of a reading that failed with a repeat of the sample before it (see history_filled), so that
+ * sample n stays n intervals after boot once there is a sample
+ */
+extern void history_skip(void);
+
+/**
+ * @brief Stop samples being recorded while the history is read, for reads that do not wait on anything
+ */
+extern void history_lock(void);
+
+/**
+ * @brief Allow samples to be recorded again
+ */
+extern void history_unlock(void);
+
+/**
+ * @brief Keep the samples where they are while a reply that references them is sent, without holding up the tasks
+ * that record or read them: samples recorded meanwhile are kept aside and added on history_release, one per interval
+ * whether they were kept or not
+ */
+extern void history_hold(void);
+
+/**
+ * @brief Let the samples move again once the reply has been sent, adding those recorded while the history was held
+ */
+extern void history_release(void);
+
+/**
+ * @brief Get the samples, oldest first, in tenths of a degree and of a percent (history_lock or history_hold must be
+ *        held)
+ * @param temperature Output temperature samples, valid until history_unlock or history_release
+ * @param humidity Output humidity samples, valid until history_unlock or history_release
+ * @return Number of samples
+ */
+extern int history_samples(const int16_t ** temperature, const int16_t ** humidity);
+
+/**
+ * @brief Get the version of the history, which changes whenever a sample is added to it (any task)
+ * @return Number of samples added since boot
+ */
+extern uint32_t history_version(void);
+
+/**
+ * @brief Get the number of samples that repeat the one before them because they were not kept or the reading failed
+ * (any task)
+ * @return Number of filled samples since boot
+ */
+extern uint32_t history_filled(void);
+
+/**
+ * @brief Build the get_history reply, oldest sample first, in tenths of a degree and of a percent
+ * @param json_context cJSON context to create the reply with
+ * @return Reply object, whose sample arrays reference the history without copying it: history_hold must be held until
+ *         it has been printed
+ */
+extern cJSON * history_to_json(cJSON_Context * json_context);
+
+#endif
@@ -0,0 +1,632 @@
+/**
+ * @file Minimal HTTP/1.1 REST API of the readings, served from the Kasa request pipeline
+ */
+
+/* system includes */
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "history.h"
+#include "http.h"
+#include "sampler.h"
+#include "websocket.h"
+
+#define HTTP_MAX_TARGET 128
+#define HTTP_MAX_ETAG 64
+/* a Sec-WebSocket-Key is the base64 of 16 bytes */
+#define HTTP_WEBSOCKET_KEY_LENGTH 24
+
+static const char *log_tag = "http";
+
+enum route
+{
+    ROUTE_CURRENT = 0,
+    ROUTE_HISTORY,
+    ROUTE_METRICS,
+    ROUTE_WEBSOCKET,
+    ROUTE_ERROR,        /* the body is the reason phrase of the status */
+};
+
+struct request
+{
+    bool head;
+    bool keep_alive;
+    bool trailing;          /* bytes follow the header */
+    bool upgrade;           /* Connection lists upgrade */
+    bool websocket;         /* Upgrade is websocket */
+    int websocket_version;
+    char target[HTTP_MAX_TARGET];
+    char if_none_match[HTTP_MAX_ETAG];
+    char websocket_key[HTTP_WEBSOCKET_KEY_LENGTH + 8];
+};
+
+struct http_stats
+{
+    uint32_t switching;         /* upgrades to WebSocket */
+    uint32_t ok;
+    uint32_t not_modified;
+    uint32_t bad_request;
+    uint32_t not_found;
+    uint32_t method_not_allowed;
+    uint32_t upgrade_required;
+    uint32_t unavailable;
+    uint32_t streamed;          /* responses that did not fit in the slot buffer */
+    uint32_t rate_limited;      /* rejected by the network task */
+    uint32_t too_large;         /* rejected by the network task */
+};
+
+/* everything a response shows that can change while it is rendered, taken once so that both passes agree */
+struct snapshot
+{
+    bool have_reading;
+    sampler_reading_t reading;
+    int64_t now;
+    uint32_t history_samples;
+    uint32_t history_filled;
+    uint32_t reading_failures;
+    size_t heap_free;
+    size_t heap_minimum_free;
+    struct http_stats stats;
+};
+
+/* samples of the history to show, in sample numbers since boot */
+struct history_range
+{
+    uint32_t first;
+    uint32_t end;
+    uint32_t per_bucket;
+};
+
+/**
+ * @brief Destination of a response: counted only on the first pass, so that the header can give its length, then
+ * written to the buffer, which is flushed to the connection whenever it fills up
+ */
+struct sink
+{
+    char * buffer;
+    size_t size;
+    size_t used;
+    size_t total;
+    bool counting;
+    bool streamed;
+    bool failed;
+    const tplink_kasa_stream_t * stream;
+};
+
+/* changes on every boot, so that an ETag from before a reboot never matches the restarted counters */
+static uint32_t boot_id = 0;
+/* counters are read by other tasks without a lock: slightly inconsistent but never wrong for long */
+static struct http_stats stats;
+
+
+static const char * reason(const int status)
+{
+    switch (status) {
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 426: return "Upgrade Required";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+    }
+}
+
+static void sink_write(struct sink * sink, const char * data, size_t length)
+{
+    sink->total += length;
+    if (sink->counting) {
+        return;
+    }
+    while (length > 0 && !sink->failed) {
+        if (sink->used == sink->size) {
+            sink->failed = sink->stream == NULL || !sink->stream->write(sink->stream->userdata, sink->buffer, sink->used);
+            sink->streamed = true;
+            sink->used = 0;
+            continue;
+        }
+        const size_t chunk = MIN(length, sink->size - sink->used);
+        memcpy(sink->buffer + sink->used, data, chunk);
+        sink->used += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+static void sink_printf(struct sink * sink, const char * format, ...)
+{
+    char text[96];
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length > 0) {
+        sink_write(sink, text, MIN((size_t)length, sizeof(text) - 1));
+    }
+}
+
+/* header values are compared without regard to case and surrounding spaces */
+static bool header_is(const char * line, const char * name, const char ** value)
+{
+    const size_t length = strlen(name);
+    if (strncasecmp(line, name, length) != 0 || line[length] != ':') {
+        return false;
+    }
+    *value = line + length + 1;
+    while (**value == ' ' || **value == '\t') {
+        (*value)++;
+    }
+    return true;
+}
+
+/* Connection is a comma separated list, "keep-alive, Upgrade" from some browsers */
+static bool lists_token(const char * value, const char * token)
+{
+    const size_t length = strlen(token);
+    while (*value != 0) {
+        while (*value == ' ' || *value == ',') {
+            value++;
+        }
+        if (strncasecmp(value, token, length) == 0 && (value[length] == 0 || value[length] == ','
+                || value[length] == ' ')) {
+            return true;
+        }
+        while (*value != 0 && *value != ',') {
+            value++;
+        }
+    }
+    return false;
+}
+
+static void copy_value(char * out, const size_t size, const char * value)
+{
+    size_t length = strlen(value);
+    while (length > 0 && (value[length - 1] == ' ' || value[length - 1] == '\t')) {
+        length--;
+    }
+    length = MIN(length, size - 1);
+    memcpy(out, value, length);
+    out[length] = 0;
+}
+
+/**
+ * @brief Parse the request line and the header, which end with an empty line
+ * @return 0 if the request can be routed, or the status to answer it with
+ */
+static int parse_request(char * buffer, const int length, struct request * request)
+{
+    memset(request, 0, sizeof(*request));
+    char * end = strstr(buffer, "\r\n\r\n");
+    if (end == NULL) {
+        return 400;
+    }
+    end[2] = 0;
+
+    char * line = buffer;
+    char * next = strstr(line, "\r\n");
+    *next = 0;
+    char * target = strchr(line, ' ');
+    char * version = target != NULL ? strchr(target + 1, ' ') : NULL;
+    if (version == NULL || strncmp(version + 1, "HTTP/1.", 7) != 0 || version - target - 1 >= HTTP_MAX_TARGET) {
+        return 400;
+    }
+    /* HTTP/1.1 connections are kept alive unless the client says otherwise, 1.0 ones only when it asks */
+    request->keep_alive = version[8] != '0';
+    memcpy(request->target, target + 1, version - target - 1);
+    const bool get = target - line == 3 && strncmp(line, "GET", 3) == 0;
+    request->head = target - line == 4 && strncmp(line, "HEAD", 4) == 0;
+
+    bool body = false;
+    for (line = next + 2; *line != 0; line = next + 2) {
+        next = strstr(line, "\r\n");
+        *next = 0;
+        const char * value;
+        if (header_is(line, "Connection", &value)) {
+            if (lists_token(value, "close")) {
+                request->keep_alive = false;
+            } else if (lists_token(value, "keep-alive")) {
+                request->keep_alive = true;
+            }
+            request->upgrade = lists_token(value, "upgrade");
+        } else if (header_is(line, "Upgrade", &value)) {
+            request->websocket = strncasecmp(value, "websocket", 9) == 0;
+        } else if (header_is(line, "Sec-WebSocket-Key", &value)) {
+            copy_value(request->websocket_key, sizeof(request->websocket_key), value);
+        } else if (header_is(line, "Sec-WebSocket-Version", &value)) {
+            request->websocket_version = atoi(value);
+        } else if (header_is(line, "If-None-Match", &value)) {
+            copy_value(request->if_none_match, sizeof(request->if_none_match), value);
+        } else if (header_is(line, "Content-Length", &value)) {
+            body |= strtoul(value, NULL, 10) > 0;
+        } else if (header_is(line, "Transfer-Encoding", &value)) {
+            body = true;
+        }
+    }
+
+    /* a body or a pipelined request would have to be read past the header, the connection is closed instead */
+    request->trailing = end + 4 != buffer + length;
+    if (body || request->trailing) {
+        request->keep_alive = false;
+    }
+    if (!get && !request->head) {
+        return 405;
+    }
+    return body ? 400 : 0;
+}
+
+/* the ETag matches if it is one of the list, weak or not as If-None-Match compares weakly */
+static bool etag_matches(const char * list, const char * etag)
+{
+    if (strcmp(list, "*") == 0) {
+        return true;
+    }
+    const size_t length = strlen(etag);
+    for (const char * item = list; *item != 0; ) {
+        while (*item == ' ' || *item == ',') {
+            item++;
+        }
+        if (strncmp(item, "W/", 2) == 0) {
+            item += 2;
+        }
+        if (strncmp(item, etag, length) == 0 && (item[length] == 0 || item[length] == ',' || item[length] == ' ')) {
+            return true;
+        }
+        while (*item != 0 && *item != ',') {
+            item++;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Read an unsigned query parameter
+ * @return False if it is present but not a number
+ */
+static bool query_parameter(const char * query, const char * name, uint32_t * value)
+{
+    const size_t length = strlen(name);
+    for (const char * parameter = query; parameter != NULL && *parameter != 0; ) {
+        if (strncmp(parameter, name, length) == 0 && parameter[length] == '=') {
+            char * end;
+            const unsigned long number = strtoul(parameter + length + 1, &end, 10);
+            if (end == parameter + length + 1 || (*end != 0 && *end != '&') || number > UINT32_MAX / 2) {
+                return false;
+            }
+            *value = number;
+            return true;
+        }
+        parameter = strchr(parameter, '&');
+        parameter = parameter != NULL ? parameter + 1 : NULL;
+    }
+    return true;
+}
+
+/**
+ * @brief Turn from, to and res in seconds of uptime into the samples to average, sample n being taken n intervals
+ * after boot (history_hold must be held)
+ * @return False if a parameter is not a number
+ */
+static bool history_range(const char * query, const uint32_t version, const int count, struct history_range * range)
+{
+    uint32_t from = 0;
+    uint32_t to = UINT32_MAX / 2;
+    uint32_t resolution = HISTORY_INTERVAL_S;
+    if (!query_parameter(query, "from", &from) || !query_parameter(query, "to", &to)
+            || !query_parameter(query, "res", &resolution)) {
+        return false;
+    }
+    range->first = MAX(version - count, (from + HISTORY_INTERVAL_S - 1) / HISTORY_INTERVAL_S);
+    range->end = MAX(range->first, MIN(version, (to + HISTORY_INTERVAL_S - 1) / HISTORY_INTERVAL_S));
+    range->per_bucket = MAX(1, (resolution + HISTORY_INTERVAL_S - 1) / HISTORY_INTERVAL_S);
+    return true;
+}
+
+static void render_samples(struct sink * sink, const int16_t * samples, const uint32_t oldest,
+        const struct history_range * range)
+{
+    for (uint32_t bucket = range->first; bucket < range->end; bucket += range->per_bucket) {
+        const uint32_t end = MIN(bucket + range->per_bucket, range->end);
+        int32_t sum = 0;
+        for (uint32_t sample = bucket; sample < end; sample++) {
+            sum += samples[sample - oldest];
+        }
+        sink_printf(sink, bucket == range->first ? "%ld" : ",%ld", lroundf((float)sum / (end - bucket)));
+    }
+}
+
+static void render_history(struct sink * sink, const int16_t * temperature, const int16_t * humidity,
+        const uint32_t oldest, const struct history_range * range)
+{
+    sink_printf(sink, "{\"from\":%u,\"res\":%u,\"temperature_x10\":[", (unsigned)(range->first * HISTORY_INTERVAL_S),
+        (unsigned)(range->per_bucket * HISTORY_INTERVAL_S));
+    render_samples(sink, temperature, oldest, range);
+    sink_printf(sink, "],\"humidity_x10\":[");
+    render_samples(sink, humidity, oldest, range);
+    sink_printf(sink, "]}");
+}
+
+static void render_current(struct sink * sink, const struct snapshot * snapshot)
+{
+    const sampler_reading_t * reading = &snapshot->reading;
+    sink_printf(sink, "{\"temperature\":%.1f,\"humidity\":%.1f,", reading->temperature, reading->humidity);
+    sink_printf(sink, "\"uptime\":%lld,\"age\":%lld,\"count\":%u}", (long long)(reading->timestamp_us / 1000000),
+        (long long)((snapshot->now - reading->timestamp_us) / 1000000), (unsigned)reading->count);
+}
+
+static void metric(struct sink * sink, const char * name, const char * type, const char * help, const double value)
+{
+    sink_printf(sink, "# HELP intellilight_%s %s\n", name, help);
+    sink_printf(sink, "# TYPE intellilight_%s %s\n", name, type);
+    sink_printf(sink, "intellilight_%s %.10g\n", name, value);
+}
+
+static void render_metrics(struct sink * sink, const struct snapshot * snapshot)
+{
+    const sampler_reading_t * reading = &snapshot->reading;
+    const int64_t now = snapshot->now;
+    if (snapshot->have_reading) {
+        metric(sink, "temperature_celsius", "gauge", "Latest temperature reading.", reading->temperature);
+        metric(sink, "humidity_percent", "gauge", "Latest relative humidity reading.", reading->humidity);
+        metric(sink, "reading_age_seconds", "gauge", "Time since the latest reading.",
+            (now - reading->timestamp_us) / 1e6);
+    }
+    metric(sink, "readings_total", "counter", "Sensor readings taken since boot.", reading->count);
+    metric(sink, "reading_failures_total", "counter", "Sensor reads that failed since boot.",
+        snapshot->reading_failures);
+    metric(sink, "history_samples_total", "counter", "Samples recorded in the history since boot.",
+        snapshot->history_samples);
+    metric(sink, "history_filled_total", "counter", "History samples that repeat the one before, not kept or failed.",
+        snapshot->history_filled);
+    metric(sink, "uptime_seconds", "counter", "Time since boot.", now / 1e6);
+    metric(sink, "heap_free_bytes", "gauge", "Free heap.", snapshot->heap_free);
+    metric(sink, "heap_minimum_free_bytes", "gauge", "Lowest free heap since boot.", snapshot->heap_minimum_free);
+
+    const struct http_stats copy = snapshot->stats;
+    sink_printf(sink, "# HELP intellilight_http_responses_total HTTP responses by status.\n");
+    sink_printf(sink, "# TYPE intellilight_http_responses_total counter\n");
+    const struct {
+        int status;
+        uint32_t count;
+    } responses[] = {
+        { 101, copy.switching }, { 200, copy.ok }, { 304, copy.not_modified }, { 400, copy.bad_request }, { 404, copy.not_found },
+        { 405, copy.method_not_allowed }, { 426, copy.upgrade_required }, { 429, copy.rate_limited }, { 431, copy.too_large },
+        { 503, copy.unavailable },
+    };
+    for (int i = 0; i < sizeof(responses) / sizeof(responses[0]); i++) {
+        sink_printf(sink, "intellilight_http_responses_total{code=\"%d\"} %u\n", responses[i].status,
+            (unsigned)responses[i].count);
+    }
+}
+
+static void render_head(struct sink * sink, const int status, const char * content_type, const size_t content_length,
+        const char * etag, const bool keep_alive)
+{
+    sink_printf(sink, "HTTP/1.1 %d %s\r\n", status, reason(status));
+    if (status != 304) {
+        sink_printf(sink, "Content-Type: %s\r\nContent-Length: %u\r\n", content_type, (unsigned)content_length);
+    }
+    if (etag[0] != 0) {
+        sink_printf(sink, "ETag: %s\r\nCache-Control: no-cache\r\n", etag);
+    }
+    if (status == 405) {
+        sink_printf(sink, "Allow: GET, HEAD\r\n");
+    } else if (status == 426) {
+        sink_printf(sink, "Upgrade: websocket\r\nSec-WebSocket-Version: 13\r\n");
+    }
+    sink_printf(sink, keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+}
+
+static void count_status(const int status)
+{
+    switch (status) {
+        case 101: stats.switching++; break;
+        case 200: stats.ok++; break;
+        case 304: stats.not_modified++; break;
+        case 400: stats.bad_request++; break;
+        case 404: stats.not_found++; break;
+        case 405: stats.method_not_allowed++; break;
+        case 426: stats.upgrade_required++; break;
+        case 503: stats.unavailable++; break;
+        default: break;
+    }
+}
+
+bool http_request_complete(const char * buffer, const int length, const int previous)
+{
+    /* the end of the header can straddle two receives */
+    for (int i = MAX(0, previous - 3); i + 4 <= length; i++) {
+        if (memcmp(&buffer[i], "\r\n\r\n", 4) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int http_process_buffer(char * buffer, const int length, const int buffer_size,
+        const tplink_kasa_stream_t * stream, bool * keep_alive, bool * websocket)
+{
+    if (boot_id == 0) {
+        boot_id = esp_random() | 1;
+    }
+
+    /* everything needed from the request is copied out of the buffer before the response is written over it */
+    buffer[length] = 0;
+    struct request request;
+    int status = parse_request(buffer, length, &request);
+    *keep_alive = request.keep_alive && status == 0;
+    *websocket = false;
+
+    char * query = strchr(request.target, '?');
+    if (query != NULL) {
+        *query++ = 0;
+    }
+    enum route route = ROUTE_ERROR;
+    if (status == 0) {
+        status = 200;
+        if (strcmp(request.target, "/api/current") == 0) {
+            route = ROUTE_CURRENT;
+        } else if (strcmp(request.target, "/api/history") == 0) {
+            route = ROUTE_HISTORY;
+        } else if (strcmp(request.target, "/metrics") == 0) {
+            route = ROUTE_METRICS;
+        } else if (strcmp(request.target, "/ws") == 0) {
+            route = ROUTE_WEBSOCKET;
+        } else {
+            status = 404;
+        }
+    }
+
+    /* the ETag is known before anything is rendered, a match costs the header only */
+    char etag[HTTP_MAX_ETAG] = "";
+    struct snapshot snapshot = { 0 };
+    snapshot.have_reading = sampler_latest(&snapshot.reading);
+    const int16_t * temperature = NULL;
+    const int16_t * humidity = NULL;
+    uint32_t oldest = 0;
+    struct history_range range;
+    if (route == ROUTE_CURRENT) {
+        if (snapshot.have_reading) {
+            snprintf(etag, sizeof(etag), "\"%08x-c%u\"", (unsigned)boot_id, (unsigned)snapshot.reading.count);
+        } else {
+            status = 503;
+            route = ROUTE_ERROR;
+        }
+    } else if (route == ROUTE_HISTORY) {
+        /* held until the history has been rendered, as for sensor.get_history */
+        history_hold();
+        const int count = history_samples(&temperature, &humidity);
+        const uint32_t version = history_version();
+        oldest = version - count;
+        if (history_range(query, version, count, &range)) {
+            snprintf(etag, sizeof(etag), "\"%08x-h%u-%u-%u-%u\"", (unsigned)boot_id, (unsigned)version,
+                (unsigned)range.first, (unsigned)range.end, (unsigned)range.per_bucket);
+        } else {
+            history_release();
+            status = 400;
+            route = ROUTE_ERROR;
+        }
+    } else if (route == ROUTE_WEBSOCKET) {
+        /* anything but a GET asking for version 13 is told what it has to ask for */
+        route = ROUTE_ERROR;
+        if (request.head || !request.upgrade || !request.websocket || request.websocket_version != 13) {
+            status = 426;
+        } else if (strlen(request.websocket_key) != HTTP_WEBSOCKET_KEY_LENGTH || request.trailing) {
+            status = 400;
+        } else {
+            /* the network task hands the connection over to the WebSocket server once this is sent */
+            char accept[WEBSOCKET_ACCEPT_SIZE];
+            websocket_accept_key(request.websocket_key, accept);
+            count_status(101);
+            *websocket = true;
+            return snprintf(buffer, buffer_size, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept);
+        }
+    }
+    if (etag[0] != 0 && request.if_none_match[0] != 0 && etag_matches(request.if_none_match, etag)) {
+        status = 304;
+    }
+    count_status(status);
+    snapshot.now = esp_timer_get_time();
+    if (route == ROUTE_METRICS) {
+        snapshot.history_samples = history_version();
+        snapshot.history_filled = history_filled();
+        snapshot.reading_failures = sampler_failures();
+        snapshot.heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        snapshot.heap_minimum_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+        snapshot.stats = stats;
+    }
+
+    const char * content_type = route == ROUTE_METRICS ? "text/plain; version=0.0.4"
+        : route == ROUTE_ERROR ? "text/plain" : "application/json";
+    struct sink sink = { .buffer = buffer, .size = buffer_size, .stream = stream };
+    size_t content_length = 0;
+    /* the first pass measures the body, the second writes the header and, unless HEAD, the body; 304 has none */
+    for (int pass = status == 304 ? 1 : 0; pass < 2; pass++) {
+        sink.counting = pass == 0;
+        sink.total = 0;
+        if (pass == 1) {
+            render_head(&sink, status, content_type, content_length, etag, *keep_alive);
+            if (request.head || status == 304) {
+                break;
+            }
+        }
+        switch (route) {
+            case ROUTE_CURRENT:
+                render_current(&sink, &snapshot);
+                break;
+            case ROUTE_HISTORY:
+                render_history(&sink, temperature, humidity, oldest, &range);
+                break;
+            case ROUTE_METRICS:
+                render_metrics(&sink, &snapshot);
+                break;
+            case ROUTE_WEBSOCKET:
+            case ROUTE_ERROR:
+                sink_printf(&sink, "%s\n", reason(status));
+                break;
+        }
+        content_length = sink.total;
+    }
+    if (route == ROUTE_HISTORY) {
+        history_release();
+    }
+
+    if (!sink.streamed) {
+        return sink.used;
+    }
+    /* the end of a streamed response is sent from here too, the network task then only has the connection to keep */
+    stats.streamed++;
+    if (sink.used > 0 && !sink.failed) {
+        sink.failed = !stream->write(stream->userdata, sink.buffer, sink.used);
+    }
+    if (sink.failed) {
+        ESP_LOGW(log_tag, "Connection failed while streaming the response");
+        *keep_alive = false;
+    }
+    return 0;
+}
+
+int http_reject(char * buffer, const int buffer_size, const int status)
+{
+    if (status == 429) {
+        stats.rate_limited++;
+    } else if (status == 431) {
+        stats.too_large++;
+    } else {
+        stats.unavailable++;
+    }
+    return snprintf(buffer, buffer_size, "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status,
+        reason(status));
+}
+
+cJSON * http_to_json(cJSON_Context * json_context)
+{
+    const struct http_stats copy = stats;
+    cJSON * json = cJSON_CreateObjectCtx(json_context);
+    cJSON_AddNumberToObjectCtx(json_context, json, "switching", copy.switching);
+    cJSON_AddNumberToObjectCtx(json_context, json, "ok", copy.ok);
+    cJSON_AddNumberToObjectCtx(json_context, json, "not_modified", copy.not_modified);
+    cJSON_AddNumberToObjectCtx(json_context, json, "bad_request", copy.bad_request);
+    cJSON_AddNumberToObjectCtx(json_context, json, "not_found", copy.not_found);
+    cJSON_AddNumberToObjectCtx(json_context, json, "method_not_allowed", copy.method_not_allowed);
+    cJSON_AddNumberToObjectCtx(json_context, json, "upgrade_required", copy.upgrade_required);
+    cJSON_AddNumberToObjectCtx(json_context, json, "unavailable", copy.unavailable);
+    cJSON_AddNumberToObjectCtx(json_context, json, "rate_limited", copy.rate_limited);
+    cJSON_AddNumberToObjectCtx(json_context, json, "too_large", copy.too_large);
+    cJSON_AddNumberToObjectCtx(json_context, json, "streamed", copy.streamed);
+    return json;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file Minimal HTTP/1.1 REST API of the readings, served from the Kasa request pipeline
+ *
+ * GET and HEAD only:
+ *   /api/current                       latest reading as JSON
+ *   /api/history?from=&to=&res=        samples from uptime `from` to `to` in seconds, averaged over `res` seconds,
+ *                                      {"from":0,"res":60,"temperature_x10":[...],"humidity_x10":[...]}
+ *   /metrics                           readings and counters in the Prometheus text format
+ *   /ws                                WebSocket stream of the readings, see websocket.h
+ *
+ * Connections are kept alive. A request is received whole into a pipeline slot buffer, so its header must fit in
+ * PIPELINE_BUFFER_SIZE, and answered on the processing task in the same buffer, or streamed to the connection when
+ * the response does not fit. Nothing is allocated. The API responses carry strong ETags built from the version of the
+ * data they show, so a poll that sends If-None-Match with the current ETag gets 304 Not Modified without the body
+ * being rendered.
+ *
+ *   curl -i http://192.168.1.20/api/current
+ *   curl 'http://192.168.1.20/api/history?from=3600&res=600'
+ */
+
+#ifndef INTELLILIGHT_HTTP_H
+#define INTELLILIGHT_HTTP_H
+
+/* system includes */
+#include <stdbool.h>
+
+/* local includes */
+#include "cJSON.h"
+#include "tplink_kasa.h"
+
+
+/* an idle keep-alive connection is closed after this long */
+#define HTTP_KEEPALIVE_TIMEOUT_S 15
+
+/**
+ * @brief Check whether a buffer holds the whole header of a request yet (network task)
+ * @param buffer Data received on the connection so far
+ * @param length Length of the data
+ * @param previous Length of the data already checked before, to not search it again
+ * @return True once the empty line ending the header has been received
+ */
+extern bool http_request_complete(const char * buffer, const int length, const int previous);
+
+/**
+ * @brief Answer a request in its buffer (processing task)
+ * @param buffer Buffer holding the request, the response is written over it
+ * @param length Length of the request, less than buffer_size
+ * @param buffer_size Size of the buffer
+ * @param stream Connection to stream a response that does not fit in the buffer to
+ * @param keep_alive Output, false if the connection has to be closed after the response
+ * @param websocket Output, true if the connection is to be handed to the WebSocket server after the response
+ * @return Length of the response in the buffer, 0 if it was streamed
+ */
+extern int http_process_buffer(char * buffer, const int length, const int buffer_size,
+        const tplink_kasa_stream_t * stream, bool * keep_alive, bool * websocket);
+
+/**
+ * @brief Render a response refusing a request without looking at it, the connection is then closed (network task)
+ * @param buffer Output buffer
+ * @param buffer_size Size of the buffer
+ * @param status 429 when the client is over its rate, 431 when the header does not fit in the buffer, 503 when an
+ * upgrade to WebSocket finds every subscriber taken
+ * @return Length of the response
+ */
+extern int http_reject(char * buffer, const int buffer_size, const int status);
+
+/**
+ * @brief Build the HTTP counters for diag.get_server_stats
+ * @param json_context cJSON context to create the object with
+ * @return Object with the responses by status
+ */
+extern cJSON * http_to_json(cJSON_Context * json_context);
+
+#endif
@@ -0,0 +1,359 @@
+/**
+ * @file Runtime for the generated Kasa command bindings: reads request fields straight into structs and writes replies
+ */
+
+/* system includes */
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* local includes */
+#include "kasa_bind.h"
+
+/* longest number token that is converted, anything longer is not a sensible Kasa parameter */
+#define NUMBER_TOKEN_MAX 32
+
+
+static void skip_whitespace(kasa_bind_reader_t * reader)
+{
+    while (reader->offset < reader->length && (unsigned char)reader->json[reader->offset] <= ' ') {
+        reader->offset++;
+    }
+}
+
+static char peek(kasa_bind_reader_t * reader)
+{
+    skip_whitespace(reader);
+    return (reader->offset < reader->length) ? reader->json[reader->offset] : '\0';
+}
+
+/* advance past a string literal, the reader must be at its opening quote */
+static bool skip_string(kasa_bind_reader_t * reader)
+{
+    for (reader->offset++; reader->offset < reader->length; reader->offset++) {
+        if (reader->json[reader->offset] == '\\') {
+            reader->offset++;
+        } else if (reader->json[reader->offset] == '"') {
+            reader->offset++;
+            return true;
+        }
+    }
+    return false;
+}
+
+static unsigned parse_hex4(const char * input)
+{
+    unsigned value = 0;
+    for (int i = 0; i < 4; i++) {
+        const char c = input[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        }
+    }
+    return value;
+}
+
+/* copy the current number token into a null terminated buffer */
+static bool read_number_token(kasa_bind_reader_t * reader, char * token)
+{
+    size_t len = 0;
+    skip_whitespace(reader);
+    while (reader->offset + len < reader->length && strchr("0123456789+-.eE", reader->json[reader->offset + len]) != NULL) {
+        if (len >= NUMBER_TOKEN_MAX - 1) {
+            return false;
+        }
+        token[len] = reader->json[reader->offset + len];
+        len++;
+    }
+    if (len == 0) {
+        return false;
+    }
+    token[len] = '\0';
+    reader->offset += len;
+    return true;
+}
+
+void kasa_bind_reader_init(kasa_bind_reader_t * reader, const char * json, const size_t length)
+{
+    reader->json = json;
+    reader->length = length;
+    reader->offset = 0;
+}
+
+bool kasa_bind_object_begin(kasa_bind_reader_t * reader)
+{
+    if (peek(reader) != '{') {
+        return false;
+    }
+    reader->offset++;
+    return true;
+}
+
+bool kasa_bind_next_key(kasa_bind_reader_t * reader, const char ** key, size_t * key_len)
+{
+    char c = peek(reader);
+    if (c == ',') {
+        reader->offset++;
+        c = peek(reader);
+    }
+    if (c != '"') {
+        /* end of the object (or of the input) */
+        if (c == '}') {
+            reader->offset++;
+        }
+        return false;
+    }
+
+    const size_t start = reader->offset + 1;
+    if (!skip_string(reader)) {
+        return false;
+    }
+    *key = reader->json + start;
+    *key_len = reader->offset - start - 1;
+
+    if (peek(reader) != ':') {
+        return false;
+    }
+    reader->offset++;
+    return true;
+}
+
+bool kasa_bind_key_equals(const char * key, const size_t key_len, const char * name)
+{
+    return strlen(name) == key_len && memcmp(key, name, key_len) == 0;
+}
+
+bool kasa_bind_skip_value(kasa_bind_reader_t * reader)
+{
+    const char c = peek(reader);
+    if (c == '"') {
+        return skip_string(reader);
+    }
+
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        while (reader->offset < reader->length) {
+            const char current = reader->json[reader->offset];
+            if (current == '"') {
+                if (!skip_string(reader)) {
+                    return false;
+                }
+                continue;
+            }
+            reader->offset++;
+            if (current == '{' || current == '[') {
+                depth++;
+            } else if (current == '}' || current == ']') {
+                if (--depth == 0) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /* number or literal */
+    const size_t start = reader->offset;
+    while (reader->offset < reader->length && strchr(",}] \t\r\n", reader->json[reader->offset]) == NULL) {
+        reader->offset++;
+    }
+    return reader->offset > start;
+}
+
+bool kasa_bind_read_double(kasa_bind_reader_t * reader, double * value)
+{
+    char token[NUMBER_TOKEN_MAX];
+    char * end = NULL;
+    if (!read_number_token(reader, token)) {
+        return false;
+    }
+    *value = strtod(token, &end);
+    return end != token && *end == '\0';
+}
+
+bool kasa_bind_read_int(kasa_bind_reader_t * reader, int * value)
+{
+    double number = 0;
+    if (!kasa_bind_read_double(reader, &number)) {
+        return false;
+    }
+    if (number >= INT_MAX) {
+        *value = INT_MAX;
+    } else if (number <= INT_MIN) {
+        *value = INT_MIN;
+    } else {
+        *value = (int)number;
+    }
+    return true;
+}
+
+bool kasa_bind_read_bool(kasa_bind_reader_t * reader, bool * value)
+{
+    const char c = peek(reader);
+    if (c == 't' || c == 'f') {
+        *value = (c == 't');
+        return kasa_bind_skip_value(reader);
+    }
+
+    double number = 0;
+    if (!kasa_bind_read_double(reader, &number)) {
+        return false;
+    }
+    *value = number != 0;
+    return true;
+}
+
+bool kasa_bind_read_string(kasa_bind_reader_t * reader, char * value, const size_t size)
+{
+    size_t out = 0;
+    if (size == 0 || peek(reader) != '"') {
+        return false;
+    }
+
+    for (reader->offset++; reader->offset < reader->length; reader->offset++) {
+        const char * input = reader->json + reader->offset;
+        char decoded[4];
+        size_t decoded_len = 1;
+
+        if (input[0] == '"') {
+            reader->offset++;
+            value[out] = '\0';
+            return true;
+        }
+
+        if (input[0] != '\\') {
+            decoded[0] = input[0];
+        } else {
+            reader->offset++;
+            switch (input[1]) {
+                case 'b': decoded[0] = '\b'; break;
+                case 'f': decoded[0] = '\f'; break;
+                case 'n': decoded[0] = '\n'; break;
+                case 'r': decoded[0] = '\r'; break;
+                case 't': decoded[0] = '\t'; break;
+                case 'u': {
+                    /* validation has already checked the hex digits and surrogate pairs */
+                    unsigned long codepoint = parse_hex4(input + 2);
+                    reader->offset += 4;
+                    if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+                        codepoint = 0x10000 + (((codepoint & 0x3FF) << 10) | (parse_hex4(input + 8) & 0x3FF));
+                        reader->offset += 6;
+                    }
+                    if (codepoint < 0x80) {
+                        decoded[0] = (char)codepoint;
+                    } else if (codepoint < 0x800) {
+                        decoded[0] = (char)(0xC0 | (codepoint >> 6));
+                        decoded[1] = (char)(0x80 | (codepoint & 0x3F));
+                        decoded_len = 2;
+                    } else if (codepoint < 0x10000) {
+                        decoded[0] = (char)(0xE0 | (codepoint >> 12));
+                        decoded[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+                        decoded[2] = (char)(0x80 | (codepoint & 0x3F));
+                        decoded_len = 3;
+                    } else {
+                        decoded[0] = (char)(0xF0 | (codepoint >> 18));
+                        decoded[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+                        decoded[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+                        decoded[3] = (char)(0x80 | (codepoint & 0x3F));
+                        decoded_len = 4;
+                    }
+                    break;
+                }
+                default: decoded[0] = input[1]; break;
+            }
+        }
+
+        if (out + decoded_len >= size) {
+            return false;
+        }
+        memcpy(value + out, decoded, decoded_len);
+        out += decoded_len;
+    }
+
+    return false;
+}
+
+void kasa_bind_writer_init(kasa_bind_writer_t * writer, char * buffer, const size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->overflow = size == 0;
+    if (size > 0) {
+        buffer[0] = '\0';
+    }
+}
+
+static void write_bytes(kasa_bind_writer_t * writer, const char * bytes, const size_t len)
+{
+    if (writer->overflow || writer->length + len >= writer->size) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->buffer + writer->length, bytes, len);
+    writer->length += len;
+    writer->buffer[writer->length] = '\0';
+}
+
+void kasa_bind_write_raw(kasa_bind_writer_t * writer, const char * text)
+{
+    write_bytes(writer, text, strlen(text));
+}
+
+void kasa_bind_write_int(kasa_bind_writer_t * writer, const int value)
+{
+    char number[12];
+    write_bytes(writer, number, snprintf(number, sizeof(number), "%d", value));
+}
+
+void kasa_bind_write_double(kasa_bind_writer_t * writer, const double value)
+{
+    char number[32];
+    if (!isfinite(value)) {
+        kasa_bind_write_raw(writer, "null");
+        return;
+    }
+    write_bytes(writer, number, snprintf(number, sizeof(number), "%.15g", value));
+}
+
+void kasa_bind_write_bool(kasa_bind_writer_t * writer, const bool value)
+{
+    kasa_bind_write_raw(writer, value ? "true" : "false");
+}
+
+void kasa_bind_write_string(kasa_bind_writer_t * writer, const char * value)
+{
+    write_bytes(writer, "\"", 1);
+    for (const unsigned char * c = (const unsigned char *)value; *c != '\0'; c++) {
+        char escaped[7];
+        switch (*c) {
+            case '"':  write_bytes(writer, "\\\"", 2); break;
+            case '\\': write_bytes(writer, "\\\\", 2); break;
+            case '\b': write_bytes(writer, "\\b", 2); break;
+            case '\f': write_bytes(writer, "\\f", 2); break;
+            case '\n': write_bytes(writer, "\\n", 2); break;
+            case '\r': write_bytes(writer, "\\r", 2); break;
+            case '\t': write_bytes(writer, "\\t", 2); break;
+            default:
+                if (*c < 0x20) {
+                    write_bytes(writer, escaped, snprintf(escaped, sizeof(escaped), "\\u%04x", *c));
+                } else {
+                    write_bytes(writer, (const char *)c, 1);
+                }
+                break;
+        }
+    }
+    write_bytes(writer, "\"", 1);
+}
+
+int kasa_bind_writer_finish(kasa_bind_writer_t * writer)
+{
+    return writer->overflow ? -1 : (int)writer->length;
+}
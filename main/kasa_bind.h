@@ -0,0 +1,128 @@
+/**
+ * @file Runtime for the generated Kasa command bindings: reads request fields straight into structs and writes replies
+ */
+
+#ifndef INTELLILIGHT_KASA_BIND_H
+#define INTELLILIGHT_KASA_BIND_H
+
+/* system includes */
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/**
+ * @brief Cursor over a request that has already passed cJSON_Validate
+ */
+typedef struct
+{
+    const char * json;
+    size_t length;
+    size_t offset;
+} kasa_bind_reader_t;
+
+/**
+ * @brief Output buffer for a reply, overflow is sticky so writes can be chained and checked once
+ */
+typedef struct
+{
+    char * buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} kasa_bind_writer_t;
+
+/**
+ * @brief Start reading a validated JSON document
+ * @param reader Reader to initialise
+ * @param json Document text
+ * @param length Length of the document
+ */
+extern void kasa_bind_reader_init(kasa_bind_reader_t * reader, const char * json, const size_t length);
+
+/**
+ * @brief Enter an object
+ * @param reader Reader positioned at a value
+ * @return False if the value is not an object
+ */
+extern bool kasa_bind_object_begin(kasa_bind_reader_t * reader);
+
+/**
+ * @brief Get the next key of the object being read, leaving the reader at its value
+ * @param reader Reader inside an object
+ * @param key Output pointer to the (undecoded) key text
+ * @param key_len Output length of the key
+ * @return False at the end of the object (the reader is then positioned after it)
+ */
+extern bool kasa_bind_next_key(kasa_bind_reader_t * reader, const char ** key, size_t * key_len);
+
+/**
+ * @brief Compare a key returned by kasa_bind_next_key with a name, case-sensitively
+ */
+extern bool kasa_bind_key_equals(const char * key, const size_t key_len, const char * name);
+
+/**
+ * @brief Skip the value at the reader position
+ */
+extern bool kasa_bind_skip_value(kasa_bind_reader_t * reader);
+
+/**
+ * @brief Read an integer value, saturating to the range of int
+ */
+extern bool kasa_bind_read_int(kasa_bind_reader_t * reader, int * value);
+
+/**
+ * @brief Read a number value as double
+ */
+extern bool kasa_bind_read_double(kasa_bind_reader_t * reader, double * value);
+
+/**
+ * @brief Read a boolean value (true/false, or a number which is true if non-zero as Kasa clients send both)
+ */
+extern bool kasa_bind_read_bool(kasa_bind_reader_t * reader, bool * value);
+
+/**
+ * @brief Read and unescape a string value into a fixed size buffer
+ * @param reader Reader positioned at a string
+ * @param value Output buffer, always null terminated
+ * @param size Size of the output buffer
+ * @return False if the value is not a string or does not fit
+ */
+extern bool kasa_bind_read_string(kasa_bind_reader_t * reader, char * value, const size_t size);
+
+/**
+ * @brief Start writing a reply into a buffer
+ */
+extern void kasa_bind_writer_init(kasa_bind_writer_t * writer, char * buffer, const size_t size);
+
+/**
+ * @brief Append text verbatim
+ */
+extern void kasa_bind_write_raw(kasa_bind_writer_t * writer, const char * text);
+
+/**
+ * @brief Append an integer
+ */
+extern void kasa_bind_write_int(kasa_bind_writer_t * writer, const int value);
+
+/**
+ * @brief Append a number, null if it is not finite
+ */
+extern void kasa_bind_write_double(kasa_bind_writer_t * writer, const double value);
+
+/**
+ * @brief Append true or false
+ */
+extern void kasa_bind_write_bool(kasa_bind_writer_t * writer, const bool value);
+
+/**
+ * @brief Append a quoted, escaped string
+ */
+extern void kasa_bind_write_string(kasa_bind_writer_t * writer, const char * value);
+
+/**
+ * @brief Finish a reply
+ * @return Length of the reply (excluding the null terminator), or -1 if it did not fit
+ */
+extern int kasa_bind_writer_finish(kasa_bind_writer_t * writer);
+
+#endif
@@ -3,10 +3,19 @@
  */
  
 /* system includes */
-#include <esp_log.h>
+#include <string.h>
 
 /* local includes */
-#include "thsensor.h"
+#include "announce.h"
+#include "boot_trace.h"
+#include "history.h"
+#include "memstats.h"
+#include "pipeline.h"
+#include "sampler.h"
+#include "taskstats.h"
+#include "telemetry.h"
+#include "tplink_kasa.h"
+#include "websocket.h"
 #include "wifi.h"
 
 
@@ -15,8 +24,40 @@
  */
 void app_main(void)
 {
-    //wifi_setup(false);
-    
-    float temp = thsensor_read_temperature();
-    ESP_LOGI("main", "Temperature = %.1f*C", temp);
+    boot_trace_mark(BOOT_APP_MAIN);
+
+    /* account all cJSON heap usage from here on */
+    memstats_init();
+    taskstats_init();
+    history_init();
+    websocket_init();
+
+    /* with a broker configured the readings are queued for it from the first one, publishing starts once NVS is up */
+    const bool telemetry = strlen(CONFIG_TELEMETRY_BROKER) > 0;
+    if (telemetry) {
+        telemetry_init();
+    }
+
+    /* requests are processed and the sensor sampled on core 1, the network task runs on core 0 next to WiFi and lwIP */
+    pipeline_init();
+    sampler_start();
+
+    /* association runs in the background once WiFi has started, the device state and reply cache are built meanwhile */
+    wifi_setup(false);
+    if (telemetry) {
+        static const telemetry_config_t telemetry_config = {
+            .broker = CONFIG_TELEMETRY_BROKER,
+            .port = CONFIG_TELEMETRY_BROKER_PORT,
+            .client_id = CONFIG_TELEMETRY_CLIENT_ID,
+            .topic = CONFIG_TELEMETRY_TOPIC,
+            .batch_samples = CONFIG_TELEMETRY_BATCH_SAMPLES,
+            .in_flight = CONFIG_TELEMETRY_IN_FLIGHT,
+        };
+        telemetry_start(&telemetry_config);
+    }
+    if (strlen(CONFIG_ANNOUNCE_GROUP) > 0) {
+        announce_start(CONFIG_ANNOUNCE_GROUP, CONFIG_ANNOUNCE_PORT);
+    }
+    tplink_kasa_init();
+    wifi_application_ready();
 }
@@ -0,0 +1,299 @@
+/**
+ * @file Heap allocation accounting per subsystem and per request
+ */
+
+/* system includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+
+/* local includes */
+#include "memstats.h"
+
+#ifndef CONFIG_MEMSTATS_REQUEST_PEAK_LIMIT
+#define CONFIG_MEMSTATS_REQUEST_PEAK_LIMIT 8192
+#endif
+
+#define MEMSTATS_MAGIC 0xA110
+#define MEMSTATS_SITE_SLOTS 32
+
+static const char *log_tag = "memstats";
+
+static const char * const tag_names[MEMSTATS_TAG_COUNT] = { "cjson", "kasa" };
+
+/* bookkeeping stored in front of every allocation, sized to keep the returned pointer aligned */
+union memstats_header
+{
+    struct
+    {
+        uint32_t size;
+        uint16_t tag;
+        uint16_t magic;
+    } info;
+    max_align_t align;
+};
+
+/* totals over all requests that have been accounted */
+struct request_totals
+{
+    uint32_t count;
+    uint32_t leaking;       /* number of requests that did not free everything */
+    uint32_t leaked_bytes;  /* bytes left allocated at the end of requests */
+    uint32_t over_peak;     /* number of requests that exceeded the configured peak */
+    uint32_t max_peak;      /* highest peak of a single request */
+    uint32_t last_peak;     /* peak of the most recent request */
+};
+
+#ifdef CONFIG_MEMSTATS_SITE_HISTOGRAM
+struct site_slot
+{
+    const void * site;
+    uint32_t allocations;
+    uint32_t bytes;
+};
+static struct site_slot sites[MEMSTATS_SITE_SLOTS];
+#endif
+
+static portMUX_TYPE memstats_lock = portMUX_INITIALIZER_UNLOCKED;
+static memstats_counters_t subsystems[MEMSTATS_TAG_COUNT];
+static struct request_totals requests;
+
+/* request being accounted by the current task (if any) */
+static __thread memstats_request_t * active_request = NULL;
+
+/* call site that cJSON allocations of the current task are charged to (if any) */
+static __thread const void * active_site = NULL;
+
+
+static void counters_add(memstats_counters_t * counters, const uint32_t size)
+{
+    counters->allocations++;
+    counters->bytes += size;
+    counters->live_bytes += size;
+    if (counters->live_bytes > counters->peak_bytes) {
+        counters->peak_bytes = counters->live_bytes;
+    }
+}
+
+static void counters_remove(memstats_counters_t * counters, const uint32_t size)
+{
+    counters->frees++;
+    /* memory allocated before the window opened can be freed inside it, so saturate */
+    counters->live_bytes = (counters->live_bytes > size) ? counters->live_bytes - size : 0;
+}
+
+#ifdef CONFIG_MEMSTATS_SITE_HISTOGRAM
+static void record_site(const void * site, const uint32_t size)
+{
+    /* open addressing on the call site address, silently dropping sites once the table is full */
+    uint32_t slot = ((uintptr_t)site >> 2) % MEMSTATS_SITE_SLOTS;
+    for (int i = 0; i < MEMSTATS_SITE_SLOTS; i++) {
+        struct site_slot * entry = &sites[(slot + i) % MEMSTATS_SITE_SLOTS];
+        if (entry->site == NULL || entry->site == site) {
+            entry->site = site;
+            entry->allocations++;
+            entry->bytes += size;
+            return;
+        }
+    }
+}
+#endif
+
+static void * account_malloc(const memstats_tag_t tag, const size_t size, const void * site)
+{
+    union memstats_header * header = malloc(sizeof(*header) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->info.size = size;
+    header->info.tag = tag;
+    header->info.magic = MEMSTATS_MAGIC;
+
+    portENTER_CRITICAL(&memstats_lock);
+    counters_add(&subsystems[tag], size);
+#ifdef CONFIG_MEMSTATS_SITE_HISTOGRAM
+    if (site != NULL) {
+        record_site(site, size);
+    }
+#endif
+    portEXIT_CRITICAL(&memstats_lock);
+
+    /* the request window belongs to this task, so no lock is needed */
+    if (active_request != NULL) {
+        counters_add(&active_request->counters, size);
+    }
+
+    return header + 1;
+}
+
+static void * CJSON_CDECL cjson_malloc(size_t size)
+{
+    /* the return address would always be inside cJSON, so use the site of the scope the task opened instead */
+    return account_malloc(MEMSTATS_TAG_CJSON, size, active_site);
+}
+
+void memstats_init(void)
+{
+    cJSON_Hooks hooks = { cjson_malloc, memstats_free };
+    cJSON_InitHooks(&hooks);
+}
+
+void * memstats_malloc(const memstats_tag_t tag, const size_t size)
+{
+    if (tag >= MEMSTATS_TAG_COUNT) {
+        return NULL;
+    }
+    return account_malloc(tag, size, __builtin_return_address(0));
+}
+
+void memstats_free(void * pointer)
+{
+    if (pointer == NULL) {
+        return;
+    }
+
+    union memstats_header * header = (union memstats_header *)pointer - 1;
+    if (header->info.magic != MEMSTATS_MAGIC || header->info.tag >= MEMSTATS_TAG_COUNT) {
+        ESP_LOGE(log_tag, "Freeing memory that was not allocated by memstats (%p)", pointer);
+        abort();
+    }
+    const uint32_t size = header->info.size;
+    const memstats_tag_t tag = header->info.tag;
+    header->info.magic = 0;
+
+    portENTER_CRITICAL(&memstats_lock);
+    counters_remove(&subsystems[tag], size);
+    portEXIT_CRITICAL(&memstats_lock);
+
+    if (active_request != NULL) {
+        counters_remove(&active_request->counters, size);
+    }
+
+    free(header);
+}
+
+__attribute__((noinline)) void memstats_site_begin(void)
+{
+    active_site = __builtin_return_address(0);
+}
+
+void memstats_site_end(void)
+{
+    active_site = NULL;
+}
+
+void memstats_request_begin(memstats_request_t * request)
+{
+    memset(request, 0, sizeof(*request));
+    active_request = request;
+}
+
+bool memstats_request_end(memstats_request_t * request)
+{
+    active_request = NULL;
+
+    const memstats_counters_t * counters = &request->counters;
+    const bool leaked = counters->live_bytes > 0;
+    const bool over_peak = counters->peak_bytes > CONFIG_MEMSTATS_REQUEST_PEAK_LIMIT;
+
+    portENTER_CRITICAL(&memstats_lock);
+    requests.count++;
+    requests.last_peak = counters->peak_bytes;
+    if (counters->peak_bytes > requests.max_peak) {
+        requests.max_peak = counters->peak_bytes;
+    }
+    if (leaked) {
+        requests.leaking++;
+        requests.leaked_bytes += counters->live_bytes;
+    }
+    if (over_peak) {
+        requests.over_peak++;
+    }
+    portEXIT_CRITICAL(&memstats_lock);
+
+    if (leaked) {
+        ESP_LOGW(log_tag, "Request leaked %u bytes (%u allocations, %u frees)",
+            (unsigned)counters->live_bytes, (unsigned)counters->allocations, (unsigned)counters->frees);
+    }
+    if (over_peak) {
+        ESP_LOGW(log_tag, "Request peak of %u bytes exceeds limit of %d bytes",
+            (unsigned)counters->peak_bytes, CONFIG_MEMSTATS_REQUEST_PEAK_LIMIT);
+    }
+
+    return !leaked && !over_peak;
+}
+
+void memstats_get(const memstats_tag_t tag, memstats_counters_t * counters)
+{
+    if (tag >= MEMSTATS_TAG_COUNT) {
+        memset(counters, 0, sizeof(*counters));
+        return;
+    }
+    portENTER_CRITICAL(&memstats_lock);
+    *counters = subsystems[tag];
+    portEXIT_CRITICAL(&memstats_lock);
+}
+
+static void add_counters_to_object(cJSON_Context * json_context, cJSON * object, const memstats_counters_t * counters)
+{
+    cJSON_AddNumberToObjectCtx(json_context, object, "allocations", counters->allocations);
+    cJSON_AddNumberToObjectCtx(json_context, object, "frees", counters->frees);
+    cJSON_AddNumberToObjectCtx(json_context, object, "bytes", counters->bytes);
+    cJSON_AddNumberToObjectCtx(json_context, object, "live_bytes", counters->live_bytes);
+    cJSON_AddNumberToObjectCtx(json_context, object, "peak_bytes", counters->peak_bytes);
+}
+
+cJSON * memstats_to_json(cJSON_Context * json_context)
+{
+    /* take a consistent copy first, building the JSON allocates and would otherwise skew the numbers */
+    memstats_counters_t subsystems_copy[MEMSTATS_TAG_COUNT];
+    struct request_totals requests_copy;
+    portENTER_CRITICAL(&memstats_lock);
+    memcpy(subsystems_copy, subsystems, sizeof(subsystems));
+    requests_copy = requests;
+    portEXIT_CRITICAL(&memstats_lock);
+
+    cJSON * stats = cJSON_CreateObjectCtx(json_context);
+    if (stats == NULL) {
+        return NULL;
+    }
+
+    cJSON * json_subsystems = cJSON_AddObjectToObjectCtx(json_context, stats, "subsystems");
+    for (int tag = 0; tag < MEMSTATS_TAG_COUNT; tag++) {
+        add_counters_to_object(json_context, cJSON_AddObjectToObjectCtx(json_context, json_subsystems, tag_names[tag]), &subsystems_copy[tag]);
+    }
+
+    cJSON * json_requests = cJSON_AddObjectToObjectCtx(json_context, stats, "requests");
+    cJSON_AddNumberToObjectCtx(json_context, json_requests, "count", requests_copy.count);
+    cJSON_AddNumberToObjectCtx(json_context, json_requests, "leaking", requests_copy.leaking);
+    cJSON_AddNumberToObjectCtx(json_context, json_requests, "leaked_bytes", requests_copy.leaked_bytes);
+    cJSON_AddNumberToObjectCtx(json_context, json_requests, "over_peak", requests_copy.over_peak);
+    cJSON_AddNumberToObjectCtx(json_context, json_requests, "max_peak", requests_copy.max_peak);
+    cJSON_AddNumberToObjectCtx(json_context, json_requests, "last_peak", requests_copy.last_peak);
+    cJSON_AddNumberToObjectCtx(json_context, json_requests, "peak_limit", CONFIG_MEMSTATS_REQUEST_PEAK_LIMIT);
+
+#ifdef CONFIG_MEMSTATS_SITE_HISTOGRAM
+    struct site_slot sites_copy[MEMSTATS_SITE_SLOTS];
+    portENTER_CRITICAL(&memstats_lock);
+    memcpy(sites_copy, sites, sizeof(sites));
+    portEXIT_CRITICAL(&memstats_lock);
+
+    cJSON * json_sites = cJSON_AddArrayToObjectCtx(json_context, stats, "sites");
+    for (int i = 0; i < MEMSTATS_SITE_SLOTS; i++) {
+        if (sites_copy[i].site == NULL) {
+            continue;
+        }
+        char address[2 + 2 * sizeof(void *) + 1];
+        snprintf(address, sizeof(address), "%p", sites_copy[i].site);
+        cJSON * site = cJSON_CreateObjectCtx(json_context);
+        cJSON_AddStringToObjectCtx(json_context, site, "site", address);
+        cJSON_AddNumberToObjectCtx(json_context, site, "allocations", sites_copy[i].allocations);
+        cJSON_AddNumberToObjectCtx(json_context, site, "bytes", sites_copy[i].bytes);
+        cJSON_AddItemToArray(json_sites, site);
+    }
+#endif
+
+    return stats;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file Heap allocation accounting per subsystem and per request
+ */
+
+#ifndef INTELLILIGHT_MEMSTATS_H
+#define INTELLILIGHT_MEMSTATS_H
+
+/* system includes */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* local includes */
+#include "cJSON.h"
+
+
+/**
+ * @brief Subsystems that allocations are accounted against
+ */
+typedef enum
+{
+    MEMSTATS_TAG_CJSON = 0,
+    MEMSTATS_TAG_KASA,
+    MEMSTATS_TAG_COUNT
+} memstats_tag_t;
+
+/**
+ * @brief Allocation counters for one subsystem or one request
+ */
+typedef struct
+{
+    uint32_t allocations;   /* number of successful allocations */
+    uint32_t frees;         /* number of frees */
+    uint32_t bytes;         /* total bytes ever allocated */
+    uint32_t live_bytes;    /* bytes currently allocated */
+    uint32_t peak_bytes;    /* highest value live_bytes has reached */
+} memstats_counters_t;
+
+/**
+ * @brief Accounting window for a single request, normally on the stack of the serving task
+ */
+typedef struct
+{
+    memstats_counters_t counters;
+} memstats_request_t;
+
+/**
+ * @brief Install the accounting allocator as the cJSON hooks
+ */
+extern void memstats_init(void);
+
+/**
+ * @brief Allocate memory and account it against a subsystem
+ * @param tag Subsystem to charge the allocation to
+ * @param size Number of bytes to allocate
+ * @return Pointer to the allocated memory or NULL on failure
+ */
+extern void * memstats_malloc(const memstats_tag_t tag, const size_t size);
+
+/**
+ * @brief Free memory previously returned by memstats_malloc
+ * @param pointer Memory to free (NULL is ignored)
+ */
+extern void memstats_free(void * pointer);
+
+/**
+ * @brief Charge the cJSON allocations the calling task makes until memstats_site_end to the call of this function in
+ * the allocation site histogram, cJSON allocations outside such a scope are only counted against their subsystem
+ */
+extern void memstats_site_begin(void);
+
+/**
+ * @brief Close the scope opened by memstats_site_begin
+ */
+extern void memstats_site_end(void);
+
+/**
+ * @brief Start accounting all allocations made by the calling task against a request
+ * @param request Request accounting window (zeroed by this call)
+ */
+extern void memstats_request_begin(memstats_request_t * request);
+
+/**
+ * @brief Stop accounting allocations against the calling task's request and fold the result into the request totals
+ * @param request Request accounting window passed to memstats_request_begin
+ * @return True if the request freed everything it allocated and stayed within the configured peak
+ */
+extern bool memstats_request_end(memstats_request_t * request);
+
+/**
+ * @brief Get a copy of the counters of a subsystem
+ * @param tag Subsystem to query
+ * @param counters Output counters
+ */
+extern void memstats_get(const memstats_tag_t tag, memstats_counters_t * counters);
+
+/**
+ * @brief Render all counters (and the allocation site histogram if enabled) as JSON
+ * @param json_context cJSON context to allocate the result from
+ * @return New cJSON object that the caller must delete with the same context
+ */
+extern cJSON * memstats_to_json(cJSON_Context * json_context);
+
+#endif
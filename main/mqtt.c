@@ -0,0 +1,236 @@
+/**
+ * @file Minimal MQTT 3.1.1 client: connect with a clean session, publish with QoS 1, keep alive and read the
+ * acknowledgements, over a TCP connection owned by a single task
+ */
+
+/* system includes */
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <esp_log.h>
+
+/* local includes */
+#include "mqtt.h"
+#include "wifi.h"
+
+/* packet types, in the high nibble of the first byte */
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH_QOS1 0x32
+#define MQTT_PUBACK 0x40
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+#define MQTT_DISCONNECT 0xE0
+
+#define MQTT_PROTOCOL_LEVEL 4
+#define MQTT_CLEAN_SESSION 0x02
+
+static const char *log_tag = "mqtt";
+
+
+static uint8_t * put_u16(uint8_t * out, const uint16_t value)
+{
+    out[0] = value >> 8;
+    out[1] = value;
+    return out + 2;
+}
+
+static uint8_t * put_string(uint8_t * out, const char * string, const uint16_t length)
+{
+    out = put_u16(out, length);
+    memcpy(out, string, length);
+    return out + length;
+}
+
+/* the remaining length is a base-128 varint of 1 to 4 bytes */
+static uint8_t * put_remaining_length(uint8_t * out, uint32_t length)
+{
+    do {
+        uint8_t digit = length % 128;
+        length /= 128;
+        if (length > 0) {
+            digit |= 0x80;
+        }
+        *out++ = digit;
+    } while (length > 0);
+    return out;
+}
+
+static uint32_t remaining_length_size(const uint32_t length)
+{
+    return length < 128 ? 1 : length < 16384 ? 2 : length < 2097152 ? 3 : 4;
+}
+
+static bool send_packet(mqtt_client_t * client, const uint8_t * packet, const uint32_t length)
+{
+    if (!wifi_send_all(client->socket, (const char *)packet, length)) {
+        mqtt_disconnect(client);
+        return false;
+    }
+    client->bytes_sent += length;
+    return true;
+}
+
+static int open_connection(const char * host, const uint16_t port, const uint32_t timeout_ms)
+{
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo * address = NULL;
+    if (getaddrinfo(host, NULL, &hints, &address) != 0 || address == NULL) {
+        ESP_LOGW(log_tag, "Unable to resolve %s", host);
+        return -1;
+    }
+    struct sockaddr_in broker = *(struct sockaddr_in *)address->ai_addr;
+    broker.sin_port = htons(port);
+    freeaddrinfo(address);
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0) {
+        return -1;
+    }
+    /* the connect and the CONNACK are waited for, everything after is non-blocking */
+    struct timeval timeout = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    /* publications are single writes that the broker should see at once */
+    int no_delay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    if (connect(sock, (struct sockaddr *)&broker, sizeof(broker)) != 0) {
+        ESP_LOGW(log_tag, "Unable to connect to %s:%d: errno %d", host, port, errno);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+bool mqtt_connect(mqtt_client_t * client, const char * host, const uint16_t port, const char * client_id,
+    const uint16_t keepalive_s, const uint32_t timeout_ms)
+{
+    client->socket = open_connection(host, port, timeout_ms);
+    client->received = 0;
+    if (client->socket < 0) {
+        return false;
+    }
+
+    const uint16_t id_len = strlen(client_id);
+    const uint32_t remaining = 10 + 2 + id_len;
+    uint8_t * out = client->tx;
+    *out++ = MQTT_CONNECT;
+    out = put_remaining_length(out, remaining);
+    out = put_string(out, "MQTT", 4);
+    *out++ = MQTT_PROTOCOL_LEVEL;
+    *out++ = MQTT_CLEAN_SESSION;
+    out = put_u16(out, keepalive_s);
+    out = put_string(out, client_id, id_len);
+    if (!send_packet(client, client->tx, out - client->tx)) {
+        return false;
+    }
+
+    uint8_t connack[4];
+    uint32_t received = 0;
+    while (received < sizeof(connack)) {
+        const int length = recv(client->socket, connack + received, sizeof(connack) - received, 0);
+        if (length <= 0) {
+            ESP_LOGW(log_tag, "No CONNACK from %s:%d", host, port);
+            mqtt_disconnect(client);
+            return false;
+        }
+        received += length;
+    }
+    if (connack[0] != MQTT_CONNACK || connack[1] != 2 || connack[3] != 0) {
+        ESP_LOGW(log_tag, "Connection refused by %s:%d, return code %d", host, port, connack[3]);
+        close(client->socket);
+        client->socket = -1;
+        return false;
+    }
+
+    fcntl(client->socket, F_SETFL, fcntl(client->socket, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+bool mqtt_publish(mqtt_client_t * client, const char * topic, const char * payload, const uint32_t length,
+    const uint16_t packet_id)
+{
+    const uint16_t topic_len = strlen(topic);
+    const uint32_t remaining = 2 + topic_len + 2 + length;
+    if (1 + remaining_length_size(remaining) + remaining > MQTT_MAX_PACKET) {
+        ESP_LOGE(log_tag, "Publication of %u bytes does not fit in a packet", (unsigned)length);
+        return false;
+    }
+
+    uint8_t * out = client->tx;
+    *out++ = MQTT_PUBLISH_QOS1;
+    out = put_remaining_length(out, remaining);
+    out = put_string(out, topic, topic_len);
+    out = put_u16(out, packet_id);
+    memcpy(out, payload, length);
+    return send_packet(client, client->tx, out + length - client->tx);
+}
+
+bool mqtt_ping(mqtt_client_t * client)
+{
+    const uint8_t ping[] = { MQTT_PINGREQ, 0 };
+    return send_packet(client, ping, sizeof(ping));
+}
+
+mqtt_event_t mqtt_poll(mqtt_client_t * client, uint16_t * packet_id)
+{
+    if (client->socket < 0) {
+        return MQTT_EVENT_CLOSED;
+    }
+
+    /* a PUBACK is four bytes and a PINGRESP two, so a packet is complete once its fixed header says so */
+    if (client->received < 4) {
+        const int length = recv(client->socket, client->rx + client->received, sizeof(client->rx) - client->received, 0);
+        if (length == 0 || (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            ESP_LOGW(log_tag, "Connection to the broker lost");
+            mqtt_disconnect(client);
+            return MQTT_EVENT_CLOSED;
+        }
+        if (length > 0) {
+            client->received += length;
+        }
+    }
+    if (client->received < 2) {
+        return MQTT_EVENT_NONE;
+    }
+
+    uint32_t packet_len;
+    mqtt_event_t event;
+    if (client->rx[0] == MQTT_PUBACK && client->rx[1] == 2) {
+        if (client->received < 4) {
+            return MQTT_EVENT_NONE;
+        }
+        *packet_id = (uint16_t)client->rx[2] << 8 | client->rx[3];
+        packet_len = 4;
+        event = MQTT_EVENT_PUBACK;
+    } else if (client->rx[0] == MQTT_PINGRESP && client->rx[1] == 0) {
+        packet_len = 2;
+        event = MQTT_EVENT_PINGRESP;
+    } else {
+        ESP_LOGW(log_tag, "Unexpected packet 0x%02x from the broker", client->rx[0]);
+        mqtt_disconnect(client);
+        return MQTT_EVENT_CLOSED;
+    }
+
+    client->received -= packet_len;
+    memmove(client->rx, client->rx + packet_len, client->received);
+    return event;
+}
+
+void mqtt_disconnect(mqtt_client_t * client)
+{
+    if (client->socket < 0) {
+        return;
+    }
+    const int sock = client->socket;
+    const uint8_t disconnect[] = { MQTT_DISCONNECT, 0 };
+    send(sock, disconnect, sizeof(disconnect), MSG_DONTWAIT);
+    client->socket = -1;
+    client->received = 0;
+    close(sock);
+}
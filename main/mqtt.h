@@ -0,0 +1,86 @@
+/**
+ * @file Minimal MQTT 3.1.1 client: connect with a clean session, publish with QoS 1, keep alive and read the
+ * acknowledgements, over a TCP connection owned by a single task
+ */
+
+#ifndef INTELLILIGHT_MQTT_H
+#define INTELLILIGHT_MQTT_H
+
+/* system includes */
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* largest packet sent or received, a PUBLISH with its topic and payload must fit */
+#define MQTT_MAX_PACKET 2048
+
+/**
+ * @brief What mqtt_poll has read from the broker
+ */
+typedef enum
+{
+    MQTT_EVENT_NONE = 0,    /* no complete packet yet */
+    MQTT_EVENT_PUBACK,      /* a QoS 1 publication was acknowledged */
+    MQTT_EVENT_PINGRESP,    /* the broker answered a keep-alive */
+    MQTT_EVENT_CLOSED,      /* the connection failed or the broker sent something unexpected */
+} mqtt_event_t;
+
+/**
+ * @brief Connection to a broker
+ */
+typedef struct
+{
+    int socket;             /* -1 while not connected */
+    uint32_t received;      /* bytes of an incomplete packet in rx */
+    uint32_t bytes_sent;    /* bytes written to the connection, packet headers included */
+    uint8_t rx[8];          /* every packet the client expects is at most 4 bytes, so this holds two */
+    uint8_t tx[MQTT_MAX_PACKET];
+} mqtt_client_t;
+
+/**
+ * @brief Connect to a broker and wait for it to accept the session
+ * @param client Client, must not be connected
+ * @param host IPv4 address or host name of the broker
+ * @param port TCP port of the broker
+ * @param client_id Client identifier, unique among the clients of the broker
+ * @param keepalive_s Keep-alive interval the broker enforces, the client must send something this often
+ * @param timeout_ms How long to wait for the connection and the CONNACK
+ * @return False if the broker could not be reached or refused the connection
+ */
+extern bool mqtt_connect(mqtt_client_t * client, const char * host, const uint16_t port, const char * client_id,
+    const uint16_t keepalive_s, const uint32_t timeout_ms);
+
+/**
+ * @brief Send a QoS 1 PUBLISH, without waiting for its acknowledgement
+ * @param client Connected client
+ * @param topic Topic name
+ * @param payload Payload
+ * @param length Length of the payload
+ * @param packet_id Non-zero packet identifier that the PUBACK will carry
+ * @return False if the packet does not fit in MQTT_MAX_PACKET, or if it could not be sent and the connection is closed
+ */
+extern bool mqtt_publish(mqtt_client_t * client, const char * topic, const char * payload, const uint32_t length,
+    const uint16_t packet_id);
+
+/**
+ * @brief Send a PINGREQ, the broker answers with a PINGRESP
+ * @param client Connected client
+ * @return False if it could not be sent, the connection is then closed
+ */
+extern bool mqtt_ping(mqtt_client_t * client);
+
+/**
+ * @brief Read the next packet from the broker without blocking
+ * @param client Connected client
+ * @param packet_id Output packet identifier of a PUBACK
+ * @return What was read, the connection is closed when it is MQTT_EVENT_CLOSED
+ */
+extern mqtt_event_t mqtt_poll(mqtt_client_t * client, uint16_t * packet_id);
+
+/**
+ * @brief Send a DISCONNECT if connected and close the connection
+ * @param client Client
+ */
+extern void mqtt_disconnect(mqtt_client_t * client);
+
+#endif
@@ -0,0 +1,183 @@
+/**
+ * @file Request pipeline between the network task (core 0) and the processing task (core 1)
+ */
+
+/* system includes */
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* local includes */
+#include "http.h"
+#include "memstats.h"
+#include "pipeline.h"
+#include "spsc_queue.h"
+#include "taskstats.h"
+#include "tplink_kasa.h"
+#include "trace.h"
+#include "wifi.h"
+
+/* both queues can hold every slot, so submitting and replying never fail */
+#define PIPELINE_QUEUE_CAPACITY 8
+#define PIPELINE_CORE 1
+#define PIPELINE_PRIORITY 5
+
+#if CONFIG_KASA_REQUEST_SLOTS > PIPELINE_QUEUE_CAPACITY
+#error "CONFIG_KASA_REQUEST_SLOTS must not exceed PIPELINE_QUEUE_CAPACITY"
+#endif
+
+static const char *log_tag = "pipeline";
+
+/* time messages spent queued, written only by the consumer of the queue */
+struct latency_counters
+{
+    uint32_t count;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;
+};
+
+/* everything the pipeline needs is reserved statically, so it cannot fail to start for lack of heap */
+static char slot_buffers[CONFIG_KASA_REQUEST_SLOTS][PIPELINE_BUFFER_SIZE];
+static uint8_t arena_buffer[CONFIG_KASA_CJSON_ARENA_SIZE];
+static StackType_t processing_stack[CONFIG_PROCESSING_TASK_STACK_SIZE];
+static StaticTask_t processing_tcb;
+
+static pipeline_message_t request_storage[PIPELINE_QUEUE_CAPACITY];
+static pipeline_message_t reply_storage[PIPELINE_QUEUE_CAPACITY];
+static spsc_queue_t request_queue;  /* network task -> processing task */
+static spsc_queue_t reply_queue;    /* processing task -> network task */
+static struct latency_counters request_latency;
+static struct latency_counters reply_latency;
+static uint32_t stream_failures;    /* Kasa replies that failed partway through streaming, written by the processing task */
+
+static TaskHandle_t processing_task_handle = NULL;
+
+
+static void latency_record(struct latency_counters * latency, const int64_t queued_us)
+{
+    const uint32_t elapsed = (uint32_t)(esp_timer_get_time() - queued_us);
+    latency->count++;
+    latency->last_us = elapsed;
+    latency->total_us += elapsed;
+    if (elapsed > latency->max_us) {
+        latency->max_us = elapsed;
+    }
+}
+
+static bool stream_write(void * userdata, const char * data, size_t length)
+{
+    return wifi_send_all(*(const int *)userdata, data, length);
+}
+
+static void processing_task(void *pvParameters)
+{
+    /* a single cJSON arena and context serves every request, they are processed one at a time */
+    cJSON_Arena json_arena;
+    cJSON_Context json_context;
+    cJSON_InitArena(&json_arena, arena_buffer, CONFIG_KASA_CJSON_ARENA_SIZE);
+    cJSON_InitContextWithArena(&json_context, &json_arena);
+    json_context.max_depth = TPLINK_KASA_MAX_DEPTH;
+    json_context.max_length = PIPELINE_BUFFER_SIZE;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        pipeline_message_t message;
+        while (spsc_queue_pop(&request_queue, &message)) {
+            latency_record(&request_latency, message.queued_us);
+
+            /* process the buffer and generate a response, accounting its heap usage */
+            const tplink_kasa_stream_t stream = { .write = stream_write, .userdata = &message.connection };
+            memstats_request_t request;
+            memstats_request_begin(&request);
+            TRACE_BEGIN(TRACE_PIPELINE_PROCESS);
+            if (message.http) {
+                message.length = http_process_buffer(pipeline_buffer(message.slot), message.length,
+                    PIPELINE_BUFFER_SIZE, &stream, &message.keep_alive, &message.websocket);
+            } else {
+                message.length = tplink_kasa_process_buffer(&json_context, pipeline_buffer(message.slot), message.length,
+                    PIPELINE_BUFFER_SIZE, message.tcp, message.tcp ? &stream : NULL);
+                /* the failure has been logged, the connection is closed with nothing more sent */
+                if (message.length < 0) {
+                    stream_failures++;
+                    message.length = 0;
+                }
+            }
+            TRACE_END(TRACE_PIPELINE_PROCESS);
+            memstats_request_end(&request);
+            cJSON_ArenaReset(&json_arena);
+
+            message.queued_us = esp_timer_get_time();
+            if (!spsc_queue_push(&reply_queue, &message)) {
+                ESP_LOGE(log_tag, "Reply queue full, slot %d lost", message.slot);
+            }
+            wifi_wake_network();
+        }
+    }
+}
+
+void pipeline_init(void)
+{
+    spsc_queue_init(&request_queue, request_storage, sizeof(request_storage[0]), PIPELINE_QUEUE_CAPACITY);
+    spsc_queue_init(&reply_queue, reply_storage, sizeof(reply_storage[0]), PIPELINE_QUEUE_CAPACITY);
+
+    processing_task_handle = xTaskCreateStaticPinnedToCore(processing_task, "processing", CONFIG_PROCESSING_TASK_STACK_SIZE, NULL,
+        PIPELINE_PRIORITY, processing_stack, &processing_tcb, PIPELINE_CORE);
+    taskstats_register(processing_task_handle, "processing", CONFIG_PROCESSING_TASK_STACK_SIZE);
+}
+
+char * pipeline_buffer(const uint8_t slot)
+{
+    return slot_buffers[slot];
+}
+
+bool pipeline_submit(pipeline_message_t * request)
+{
+    request->queued_us = esp_timer_get_time();
+    if (!spsc_queue_push(&request_queue, request)) {
+        return false;
+    }
+    xTaskNotifyGive(processing_task_handle);
+    return true;
+}
+
+bool pipeline_take_reply(pipeline_message_t * reply)
+{
+    if (!spsc_queue_pop(&reply_queue, reply)) {
+        return false;
+    }
+    latency_record(&reply_latency, reply->queued_us);
+    return true;
+}
+
+static void add_queue_to_object(cJSON_Context * json_context, cJSON * object, spsc_queue_t * queue, const struct latency_counters * latency)
+{
+    cJSON_AddNumberToObjectCtx(json_context, object, "depth", spsc_queue_depth(queue));
+    cJSON_AddNumberToObjectCtx(json_context, object, "max_depth", queue->max_depth);
+    cJSON_AddNumberToObjectCtx(json_context, object, "pushed", queue->pushed);
+    cJSON_AddNumberToObjectCtx(json_context, object, "full", queue->full);
+
+    /* counters are updated by another task, a reading can be slightly inconsistent but never wrong for long */
+    const struct latency_counters copy = *latency;
+    cJSON * json_latency = cJSON_AddObjectToObjectCtx(json_context, object, "latency_us");
+    cJSON_AddNumberToObjectCtx(json_context, json_latency, "last", copy.last_us);
+    cJSON_AddNumberToObjectCtx(json_context, json_latency, "max", copy.max_us);
+    cJSON_AddNumberToObjectCtx(json_context, json_latency, "avg", copy.count > 0 ? (double)(copy.total_us / copy.count) : 0);
+}
+
+cJSON * pipeline_to_json(cJSON_Context * json_context)
+{
+    cJSON * stats = cJSON_CreateObjectCtx(json_context);
+    if (stats == NULL) {
+        return NULL;
+    }
+
+    cJSON_AddNumberToObjectCtx(json_context, stats, "slots", CONFIG_KASA_REQUEST_SLOTS);
+    cJSON_AddNumberToObjectCtx(json_context, stats, "stream_failures", stream_failures);
+    add_queue_to_object(json_context, cJSON_AddObjectToObjectCtx(json_context, stats, "request_queue"), &request_queue, &request_latency);
+    add_queue_to_object(json_context, cJSON_AddObjectToObjectCtx(json_context, stats, "reply_queue"), &reply_queue, &reply_latency);
+
+    return stats;
+}
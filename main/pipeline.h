@@ -0,0 +1,71 @@
+/**
+ * @file Request pipeline between the network task (core 0) and the processing task (core 1)
+ *
+ * The network task receives a request into a free slot buffer and submits it, the processing task answers it in the
+ * same buffer and hands the slot back. Each direction is a lock-free single-producer/single-consumer queue, so neither
+ * side ever waits on a lock held by the other.
+ */
+
+#ifndef INTELLILIGHT_PIPELINE_H
+#define INTELLILIGHT_PIPELINE_H
+
+/* system includes */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* local includes */
+#include "cJSON.h"
+
+
+/* size of each slot buffer, the largest request that can be received */
+#define PIPELINE_BUFFER_SIZE 2000
+
+/**
+ * @brief A request handed to the processing task, or the reply handed back
+ */
+typedef struct
+{
+    uint8_t slot;           /* slot whose buffer holds the request or reply */
+    bool tcp;               /* request came over TCP (has a header, reply may be streamed to connection) */
+    bool http;              /* request is an HTTP one, see http.h */
+    bool keep_alive;        /* HTTP connection stays open for the next request after the reply */
+    bool websocket;         /* HTTP connection is handed to the WebSocket server after the reply */
+    int connection;         /* TCP connection the request came from */
+    int length;             /* length of the request, or of the reply (0 if there is none or it was streamed) */
+    int64_t queued_us;      /* esp_timer time the message was queued, for the latency counters */
+} pipeline_message_t;
+
+/**
+ * @brief Allocate the slot buffers and start the processing task, must be called before the network task starts
+ */
+extern void pipeline_init(void);
+
+/**
+ * @brief Get the buffer of a slot
+ * @param slot Slot number, less than CONFIG_KASA_REQUEST_SLOTS
+ * @return Buffer of PIPELINE_BUFFER_SIZE bytes
+ */
+extern char * pipeline_buffer(const uint8_t slot);
+
+/**
+ * @brief Queue a received request for processing (network task only)
+ * @param request Request, the slot then belongs to the processing task until it comes back in a reply
+ * @return False if the queue is full, which cannot happen while the slots are used as intended
+ */
+extern bool pipeline_submit(pipeline_message_t * request);
+
+/**
+ * @brief Take the next reply (network task only)
+ * @param reply Output reply, its slot belongs to the network task again
+ * @return False if there are no replies waiting
+ */
+extern bool pipeline_take_reply(pipeline_message_t * reply);
+
+/**
+ * @brief Render the queue depth and latency counters and the streamed reply failures as JSON
+ * @param json_context cJSON context to allocate the result from
+ * @return New cJSON object that the caller must delete with the same context
+ */
+extern cJSON * pipeline_to_json(cJSON_Context * json_context);
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * @file Admission control of the network task: a token bucket per client address and a cap on requests in flight
+ */
+
+/* system includes */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "ratelimit.h"
+
+/* buckets are found in a set of this many entries chosen by the address hash, the least recently seen one is evicted */
+#define RATELIMIT_WAYS 4
+#define RATELIMIT_SETS (RATELIMIT_CLIENTS / RATELIMIT_WAYS)
+/* tokens are counted in thousandths so that slow refill rates do not round away */
+#define RATELIMIT_TOKEN 1000
+
+#if RATELIMIT_CLIENTS % RATELIMIT_WAYS != 0
+#error "RATELIMIT_CLIENTS must be a multiple of RATELIMIT_WAYS"
+#endif
+
+static const char *log_tag = "ratelimit";
+
+struct client_bucket
+{
+    uint32_t address;           /* IPv4 address in network order, 0 while the entry is free */
+    uint32_t tokens;            /* in thousandths of a request */
+    int64_t refilled_us;
+    uint32_t last_seen;         /* admission clock when the client last sent a request, for the LRU */
+    uint32_t rejected;
+    bool limited;               /* over budget since its bucket was last full, so it is logged once per episode */
+};
+
+struct ratelimit_counters
+{
+    uint32_t admitted;
+    uint32_t rejected_rate;     /* client over its budget */
+    uint32_t rejected_busy;     /* every request slot in use */
+    uint32_t evicted;
+};
+
+static struct client_bucket buckets[RATELIMIT_CLIENTS];
+static struct ratelimit_counters counters;
+static uint32_t admission_clock = 0;
+
+
+static struct client_bucket * find_bucket(const uint32_t address)
+{
+    /* Fibonacci hashing spreads the addresses of one subnet, which differ only in the last byte, over the sets */
+    const uint32_t set = (ntohl(address) * 2654435761u >> 16) % RATELIMIT_SETS;
+    struct client_bucket * ways = &buckets[set * RATELIMIT_WAYS];
+
+    struct client_bucket * oldest = &ways[0];
+    for (int i = 0; i < RATELIMIT_WAYS; i++) {
+        if (ways[i].address == address) {
+            return &ways[i];
+        }
+        if (ways[i].address == 0 || (oldest->address != 0 && admission_clock - ways[i].last_seen > admission_clock - oldest->last_seen)) {
+            oldest = &ways[i];
+        }
+    }
+
+    /* a new client starts with a full bucket */
+    if (oldest->address != 0) {
+        counters.evicted++;
+    }
+    oldest->address = address;
+    oldest->tokens = CONFIG_KASA_RATE_LIMIT_BURST * RATELIMIT_TOKEN;
+    oldest->refilled_us = esp_timer_get_time();
+    oldest->rejected = 0;
+    oldest->limited = false;
+    return oldest;
+}
+
+bool ratelimit_admit(const struct sockaddr_storage * source)
+{
+    /* only IPv4 clients are told apart */
+    if (CONFIG_KASA_RATE_LIMIT_PER_S == 0 || source->ss_family != AF_INET) {
+        counters.admitted++;
+        return true;
+    }
+
+    const uint32_t address = ((const struct sockaddr_in *)source)->sin_addr.s_addr;
+    struct client_bucket * bucket = find_bucket(address);
+    bucket->last_seen = ++admission_clock;
+
+    const int64_t now = esp_timer_get_time();
+    const uint64_t refill = (uint64_t)(now - bucket->refilled_us) * CONFIG_KASA_RATE_LIMIT_PER_S * RATELIMIT_TOKEN / 1000000;
+    if (refill > 0) {
+        const uint64_t tokens = bucket->tokens + refill;
+        bucket->tokens = tokens < CONFIG_KASA_RATE_LIMIT_BURST * RATELIMIT_TOKEN ? tokens : CONFIG_KASA_RATE_LIMIT_BURST * RATELIMIT_TOKEN;
+        bucket->refilled_us = now;
+        if (bucket->tokens == CONFIG_KASA_RATE_LIMIT_BURST * RATELIMIT_TOKEN) {
+            bucket->limited = false;
+        }
+    }
+
+    if (bucket->tokens < RATELIMIT_TOKEN) {
+        if (!bucket->limited) {
+            char addr_str[16];
+            inet_ntoa_r(((const struct sockaddr_in *)source)->sin_addr, addr_str, sizeof(addr_str));
+            ESP_LOGW(log_tag, "%s is over %d requests/s, rejecting its requests", addr_str, CONFIG_KASA_RATE_LIMIT_PER_S);
+            bucket->limited = true;
+        }
+        bucket->rejected++;
+        counters.rejected_rate++;
+        return false;
+    }
+    bucket->tokens -= RATELIMIT_TOKEN;
+    counters.admitted++;
+    return true;
+}
+
+void ratelimit_reject_busy(void)
+{
+    counters.rejected_busy++;
+}
+
+cJSON * ratelimit_to_json(cJSON_Context * json_context)
+{
+    cJSON * stats = cJSON_CreateObjectCtx(json_context);
+    if (stats == NULL) {
+        return NULL;
+    }
+
+    /* counters are updated by the network task, a reading can be slightly inconsistent but never wrong for long */
+    const struct ratelimit_counters copy = counters;
+    cJSON_AddNumberToObjectCtx(json_context, stats, "per_s", CONFIG_KASA_RATE_LIMIT_PER_S);
+    cJSON_AddNumberToObjectCtx(json_context, stats, "burst", CONFIG_KASA_RATE_LIMIT_BURST);
+    cJSON_AddNumberToObjectCtx(json_context, stats, "admitted", copy.admitted);
+    cJSON_AddNumberToObjectCtx(json_context, stats, "rejected_rate", copy.rejected_rate);
+    cJSON_AddNumberToObjectCtx(json_context, stats, "rejected_busy", copy.rejected_busy);
+    cJSON_AddNumberToObjectCtx(json_context, stats, "evicted", copy.evicted);
+
+    /* the client that has been rejected most since its bucket was created, usually the one to look at */
+    int clients = 0;
+    struct client_bucket worst = { 0 };
+    for (int i = 0; i < RATELIMIT_CLIENTS; i++) {
+        const struct client_bucket bucket = buckets[i];
+        if (bucket.address != 0) {
+            clients++;
+            if (bucket.rejected > worst.rejected) {
+                worst = bucket;
+            }
+        }
+    }
+    cJSON_AddNumberToObjectCtx(json_context, stats, "clients", clients);
+    if (worst.rejected > 0) {
+        char addr_str[16];
+        const struct in_addr address = { .s_addr = worst.address };
+        inet_ntoa_r(address, addr_str, sizeof(addr_str));
+        cJSON * json_worst = cJSON_AddObjectToObjectCtx(json_context, stats, "most_rejected");
+        cJSON_AddStringToObjectCtx(json_context, json_worst, "address", addr_str);
+        cJSON_AddNumberToObjectCtx(json_context, json_worst, "rejected", worst.rejected);
+    }
+
+    return stats;
+}
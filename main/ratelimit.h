@@ -0,0 +1,42 @@
+/**
+ * @file Admission control of the network task: a token bucket per client address and a cap on requests in flight
+ *
+ * Requests are admitted or rejected as soon as their source is known, before anything is decrypted or parsed, so a
+ * client polling too fast or a flood of clients costs little more than reading the datagram or accepting the
+ * connection. Only the network task admits requests, the counters are read from other tasks without locking.
+ */
+
+#ifndef INTELLILIGHT_RATELIMIT_H
+#define INTELLILIGHT_RATELIMIT_H
+
+/* system includes */
+#include <stdbool.h>
+#include <sys/socket.h>
+
+/* local includes */
+#include "cJSON.h"
+
+
+/* clients whose buckets are kept, the least recently seen one makes way for a new client */
+#define RATELIMIT_CLIENTS 16
+
+/**
+ * @brief Charge a request to the bucket of its client (network task only)
+ * @param source Address the request came from
+ * @return False if the client has used up its budget and the request must be rejected
+ */
+extern bool ratelimit_admit(const struct sockaddr_storage * source);
+
+/**
+ * @brief Count a request rejected because every request slot is in use (network task only)
+ */
+extern void ratelimit_reject_busy(void);
+
+/**
+ * @brief Render the admission and rejection counters as JSON
+ * @param json_context cJSON context to allocate the result from
+ * @return New cJSON object that the caller must delete with the same context
+ */
+extern cJSON * ratelimit_to_json(cJSON_Context * json_context);
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * @file Sensor sampling task and the latest reading it publishes
+ */
+
+/* system includes */
+#include <stdatomic.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* local includes */
+#include "announce.h"
+#include "boot_trace.h"
+#include "coap.h"
+#include "history.h"
+#include "sampler.h"
+#include "taskstats.h"
+#include "telemetry.h"
+#include "thsensor.h"
+#include "trace.h"
+#include "websocket.h"
+
+/* the sensor is bit-banged, so it is read on the core that does not service the Wi-Fi interrupts */
+#define SAMPLER_CORE 1
+#define SAMPLER_PRIORITY 4
+
+static const char *log_tag = "sampler";
+
+/* latest reading, published with a sequence lock: the sequence is odd while the reading is being written */
+static atomic_uint_least32_t latest_sequence = 0;
+static sampler_reading_t latest;
+static atomic_uint_least32_t failures = 0;
+
+static StackType_t sampler_stack[CONFIG_SAMPLER_TASK_STACK_SIZE];
+static StaticTask_t sampler_tcb;
+
+
+static void publish(const sampler_reading_t * reading)
+{
+    /* single writer, so the sequence needs no read-modify-write */
+    const uint32_t sequence = atomic_load_explicit(&latest_sequence, memory_order_relaxed);
+    atomic_store_explicit(&latest_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    latest = *reading;
+    atomic_store_explicit(&latest_sequence, sequence + 2, memory_order_release);
+}
+
+bool sampler_latest(sampler_reading_t * reading)
+{
+    uint32_t before;
+    uint32_t after;
+    do {
+        before = atomic_load_explicit(&latest_sequence, memory_order_acquire);
+        *reading = latest;
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&latest_sequence, memory_order_relaxed);
+    } while (before != after || (before & 1) != 0);
+
+    return reading->count > 0;
+}
+
+uint32_t sampler_failures(void)
+{
+    return atomic_load_explicit(&failures, memory_order_relaxed);
+}
+
+static void sampler_task(void *pvParameters)
+{
+    sampler_reading_t reading = { 0 };
+    TickType_t last_sample = xTaskGetTickCount();
+
+    while (true) {
+        /* one transaction per interval, the sensor needs 2 s between them */
+        TRACE_BEGIN(TRACE_SENSOR_READ);
+        const esp_err_t error = thsensor_read(&reading.temperature, &reading.humidity);
+        TRACE_END(TRACE_SENSOR_READ);
+        if (error == ESP_OK) {
+            reading.timestamp_us = esp_timer_get_time();
+            reading.count++;
+            ESP_LOGI(log_tag, "Temperature = %.1f*C, humidity = %.1f%%", reading.temperature, reading.humidity);
+
+            publish(&reading);
+            history_record(reading.temperature, reading.humidity);
+            telemetry_record(&reading);
+            announce_reading(&reading);
+            coap_reading_available();
+            websocket_publish(&reading);
+            if (reading.count == 1) {
+                boot_trace_mark(BOOT_FIRST_SAMPLE);
+            }
+        } else {
+            /* a failed read is not a reading, the history takes its interval with the sample before */
+            atomic_fetch_add_explicit(&failures, 1, memory_order_relaxed);
+            history_skip();
+        }
+
+        vTaskDelayUntil(&last_sample, HISTORY_INTERVAL_S * 1000 / portTICK_RATE_MS);
+    }
+}
+
+void sampler_start(void)
+{
+    TaskHandle_t task = xTaskCreateStaticPinnedToCore(sampler_task, "sampler", CONFIG_SAMPLER_TASK_STACK_SIZE, NULL,
+        SAMPLER_PRIORITY, sampler_stack, &sampler_tcb, SAMPLER_CORE);
+    taskstats_register(task, "sampler", CONFIG_SAMPLER_TASK_STACK_SIZE);
+}
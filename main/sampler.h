@@ -0,0 +1,41 @@
+/**
+ * @file Sensor sampling task and the latest reading it publishes
+ */
+
+#ifndef INTELLILIGHT_SAMPLER_H
+#define INTELLILIGHT_SAMPLER_H
+
+/* system includes */
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/**
+ * @brief One reading of the sensor
+ */
+typedef struct
+{
+    float temperature;      /* *C */
+    float humidity;         /* % */
+    int64_t timestamp_us;   /* esp_timer time the reading was taken */
+    uint32_t count;         /* number of readings taken so far */
+} sampler_reading_t;
+
+/**
+ * @brief Start sampling the sensor into the history, pinned to the processing core
+ */
+extern void sampler_start(void);
+
+/**
+ * @brief Get the latest reading without blocking the sampling task (any task, any core)
+ * @param reading Output reading
+ * @return False if no reading has been taken yet
+ */
+extern bool sampler_latest(sampler_reading_t * reading);
+
+/**
+ * @brief Get the number of sensor reads that failed and were neither published nor recorded (any task)
+ */
+extern uint32_t sampler_failures(void);
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file Lock-free single-producer/single-consumer ring queue for passing fixed size messages between tasks (and cores)
+ */
+
+/* system includes */
+#include <string.h>
+
+/* local includes */
+#include "spsc_queue.h"
+
+
+void spsc_queue_init(spsc_queue_t * queue, void * buffer, const size_t element_size, const uint32_t capacity)
+{
+    queue->buffer = buffer;
+    queue->element_size = element_size;
+    queue->mask = capacity - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->pushed = 0;
+    queue->full = 0;
+    queue->max_depth = 0;
+}
+
+bool spsc_queue_push(spsc_queue_t * queue, const void * element)
+{
+    /* the producer owns head, the tail it sees can only be behind, which makes the queue look fuller than it is */
+    const uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    const uint32_t depth = head - tail;
+    if (depth > queue->mask) {
+        queue->full++;
+        return false;
+    }
+
+    memcpy(queue->buffer + (head & queue->mask) * queue->element_size, element, queue->element_size);
+    /* release: the element is written before the consumer can see the new head */
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    queue->pushed++;
+    if (depth + 1 > queue->max_depth) {
+        queue->max_depth = depth + 1;
+    }
+    return true;
+}
+
+bool spsc_queue_pop(spsc_queue_t * queue, void * element)
+{
+    const uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+
+    memcpy(element, queue->buffer + (tail & queue->mask) * queue->element_size, queue->element_size);
+    /* release: the element has been read before the producer can reuse its slot */
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint32_t spsc_queue_depth(spsc_queue_t * queue)
+{
+    const uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    const uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    return head - tail;
+}
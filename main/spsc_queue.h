@@ -0,0 +1,58 @@
+/**
+ * @file Lock-free single-producer/single-consumer ring queue for passing fixed size messages between tasks (and cores)
+ */
+
+#ifndef INTELLILIGHT_SPSC_QUEUE_H
+#define INTELLILIGHT_SPSC_QUEUE_H
+
+/* system includes */
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * @brief Ring of capacity elements. Exactly one task may push and exactly one task may pop.
+ */
+typedef struct
+{
+    uint8_t * buffer;
+    size_t element_size;
+    uint32_t mask;              /* capacity - 1 */
+    atomic_uint_least32_t head; /* next slot to push into, written by the producer only */
+    atomic_uint_least32_t tail; /* next slot to pop from, written by the consumer only */
+
+    /* statistics, written by the producer only */
+    uint32_t pushed;
+    uint32_t full;              /* pushes refused because the queue was full */
+    uint32_t max_depth;
+} spsc_queue_t;
+
+/**
+ * @brief Set up a queue over a buffer
+ * @param queue Queue to initialise
+ * @param buffer Storage for capacity elements
+ * @param element_size Size of one element
+ * @param capacity Number of elements, must be a power of two
+ */
+extern void spsc_queue_init(spsc_queue_t * queue, void * buffer, const size_t element_size, const uint32_t capacity);
+
+/**
+ * @brief Copy an element into the queue (producer only)
+ * @return False if the queue is full
+ */
+extern bool spsc_queue_push(spsc_queue_t * queue, const void * element);
+
+/**
+ * @brief Copy the oldest element out of the queue (consumer only)
+ * @return False if the queue is empty
+ */
+extern bool spsc_queue_pop(spsc_queue_t * queue, void * element);
+
+/**
+ * @brief Number of elements in the queue, exact when called by the producer or the consumer, a snapshot otherwise
+ */
+extern uint32_t spsc_queue_depth(spsc_queue_t * queue);
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * @file Stack high-water marks of the application tasks and heap headroom, sampled periodically
+ */
+
+/* system includes */
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* local includes */
+#include "taskstats.h"
+
+/* a task with less stack than this left at its deepest is logged, it is close to overflowing */
+#define TASKSTATS_STACK_WARN_BYTES 512
+
+static const char *log_tag = "taskstats";
+
+struct task_sample
+{
+    TaskHandle_t task;
+    const char * name;
+    uint32_t stack_size;
+    uint32_t stack_free_min;    /* stack never used since the task started, in bytes */
+};
+
+struct heap_sample
+{
+    uint32_t free;
+    uint32_t minimum_free;      /* lowest free heap since boot */
+    uint32_t largest_free_block;
+    uint32_t smallest_largest_free_block;  /* lowest largest free block seen, how fragmented the heap has been */
+};
+
+static portMUX_TYPE taskstats_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct task_sample tasks[TASKSTATS_MAX_TASKS];
+static int task_count = 0;
+static struct heap_sample heap = { .smallest_largest_free_block = UINT32_MAX };
+static esp_timer_handle_t sample_timer = NULL;
+
+
+static void sample(void * arg)
+{
+    /* the task table only grows, entries are complete before task_count covers them */
+    portENTER_CRITICAL(&taskstats_lock);
+    const int count = task_count;
+    portEXIT_CRITICAL(&taskstats_lock);
+
+    for (int i = 0; i < count; i++) {
+        /* ESP-IDF stacks are counted in bytes, so the high-water mark is too */
+        const uint32_t stack_free_min = uxTaskGetStackHighWaterMark(tasks[i].task);
+        if (stack_free_min < TASKSTATS_STACK_WARN_BYTES && stack_free_min != tasks[i].stack_free_min) {
+            ESP_LOGW(log_tag, "Task %s has only %u of %u stack bytes left", tasks[i].name, stack_free_min, tasks[i].stack_size);
+        }
+        tasks[i].stack_free_min = stack_free_min;
+    }
+
+    const uint32_t free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    const uint32_t minimum_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    const uint32_t largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    portENTER_CRITICAL(&taskstats_lock);
+    heap.free = free;
+    heap.minimum_free = minimum_free;
+    heap.largest_free_block = largest_free_block;
+    if (largest_free_block < heap.smallest_largest_free_block) {
+        heap.smallest_largest_free_block = largest_free_block;
+    }
+    portEXIT_CRITICAL(&taskstats_lock);
+}
+
+void taskstats_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = sample,
+        .name = "taskstats",
+    };
+    if (esp_timer_create(&timer_args, &sample_timer) != ESP_OK ||
+        esp_timer_start_periodic(sample_timer, CONFIG_TASKSTATS_INTERVAL_S * 1000000ULL) != ESP_OK) {
+        ESP_LOGE(log_tag, "Unable to start sampling");
+    }
+}
+
+void taskstats_register(TaskHandle_t task, const char * name, const uint32_t stack_size)
+{
+    if (task == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&taskstats_lock);
+    if (task_count < TASKSTATS_MAX_TASKS) {
+        tasks[task_count].task = task;
+        tasks[task_count].name = name;
+        tasks[task_count].stack_size = stack_size;
+        tasks[task_count].stack_free_min = stack_size;
+        task_count++;
+    }
+    portEXIT_CRITICAL(&taskstats_lock);
+}
+
+const char * taskstats_name(TaskHandle_t task)
+{
+    const char * name = NULL;
+    portENTER_CRITICAL(&taskstats_lock);
+    for (int i = 0; i < task_count && name == NULL; i++) {
+        if (tasks[i].task == task) {
+            name = tasks[i].name;
+        }
+    }
+    portEXIT_CRITICAL(&taskstats_lock);
+    return name;
+}
+
+cJSON * taskstats_to_json(cJSON_Context * json_context)
+{
+    /* take a consistent copy first, a sample may be being taken on the other core */
+    struct task_sample tasks_copy[TASKSTATS_MAX_TASKS];
+    struct heap_sample heap_copy;
+    portENTER_CRITICAL(&taskstats_lock);
+    const int count = task_count;
+    memcpy(tasks_copy, tasks, sizeof(tasks));
+    heap_copy = heap;
+    portEXIT_CRITICAL(&taskstats_lock);
+
+    cJSON * stats = cJSON_CreateObjectCtx(json_context);
+    if (stats == NULL) {
+        return NULL;
+    }
+
+    cJSON * json_tasks = cJSON_AddArrayToObjectCtx(json_context, stats, "tasks");
+    for (int i = 0; i < count && json_tasks != NULL; i++) {
+        cJSON * task = cJSON_CreateObjectCtx(json_context);
+        cJSON_AddStringToObjectCtx(json_context, task, "name", tasks_copy[i].name);
+        cJSON_AddNumberToObjectCtx(json_context, task, "stack_size", tasks_copy[i].stack_size);
+        cJSON_AddNumberToObjectCtx(json_context, task, "stack_free_min", tasks_copy[i].stack_free_min);
+        cJSON_AddItemToArray(json_tasks, task);
+    }
+
+    cJSON * json_heap = cJSON_AddObjectToObjectCtx(json_context, stats, "heap");
+    cJSON_AddNumberToObjectCtx(json_context, json_heap, "free", heap_copy.free);
+    cJSON_AddNumberToObjectCtx(json_context, json_heap, "minimum_free", heap_copy.minimum_free);
+    cJSON_AddNumberToObjectCtx(json_context, json_heap, "largest_free_block", heap_copy.largest_free_block);
+    cJSON_AddNumberToObjectCtx(json_context, json_heap, "smallest_largest_free_block",
+        heap_copy.smallest_largest_free_block == UINT32_MAX ? 0 : heap_copy.smallest_largest_free_block);
+    cJSON_AddNumberToObjectCtx(json_context, stats, "interval", CONFIG_TASKSTATS_INTERVAL_S);
+
+    return stats;
+}
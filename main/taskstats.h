@@ -0,0 +1,47 @@
+/**
+ * @file Stack high-water marks of the application tasks and heap headroom, sampled periodically
+ */
+
+#ifndef INTELLILIGHT_TASKSTATS_H
+#define INTELLILIGHT_TASKSTATS_H
+
+/* system includes */
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* local includes */
+#include "cJSON.h"
+
+
+/* most tasks that can be registered */
+#define TASKSTATS_MAX_TASKS 8
+
+/**
+ * @brief Start sampling every CONFIG_TASKSTATS_INTERVAL_S seconds
+ */
+extern void taskstats_init(void);
+
+/**
+ * @brief Add a task to the samples, normally right after it has been created
+ * @param task Handle of the task
+ * @param name Name to report the task under, must stay valid for ever
+ * @param stack_size Size of the stack of the task in bytes
+ */
+extern void taskstats_register(TaskHandle_t task, const char * name, const uint32_t stack_size);
+
+/**
+ * @brief Get the name a task was registered under
+ * @param task Handle of the task
+ * @return Name, or NULL if the task is not registered
+ */
+extern const char * taskstats_name(TaskHandle_t task);
+
+/**
+ * @brief Render the latest samples as JSON
+ * @param json_context cJSON context to allocate the result from
+ * @return New cJSON object that the caller must delete with the same context
+ */
+extern cJSON * taskstats_to_json(cJSON_Context * json_context);
+
+#endif
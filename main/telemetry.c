@@ -0,0 +1,501 @@
+/**
+ * @file Telemetry publisher: pushes the sensor readings to an MQTT broker in batches with QoS 1
+ */
+
+/* system includes */
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/param.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+/* local includes */
+#include "mqtt.h"
+#include "spsc_queue.h"
+#include "taskstats.h"
+#include "telemetry.h"
+
+/* the publisher does network I/O, so it runs next to the network task, below it so that requests are served first */
+#define TELEMETRY_CORE 0
+#define TELEMETRY_PRIORITY 3
+/* readings handed over by the sampler and not taken by the publisher yet */
+#define TELEMETRY_INBOX 16
+#define TELEMETRY_KEEPALIVE_S 60
+#define TELEMETRY_CONNECT_TIMEOUT_MS 5000
+/* reconnection attempts back off from the first interval to the last */
+#define TELEMETRY_RETRY_MIN_MS 1000
+#define TELEMETRY_RETRY_MAX_MS 60000
+
+#if CONFIG_TELEMETRY_QUEUE_SAMPLES < TELEMETRY_MESSAGE_SAMPLES
+#error "CONFIG_TELEMETRY_QUEUE_SAMPLES must hold at least one spill block of TELEMETRY_MESSAGE_SAMPLES"
+#endif
+
+static const char *log_tag = "telemetry";
+static const char *nvs_namespace = "telemetry";
+static const char *nvs_key_spill = "spill";
+
+/* a reading as queued, 12 bytes */
+struct sample
+{
+    uint32_t seq;
+    uint32_t uptime_s;
+    int16_t temperature;        /* tenths of *C */
+    uint16_t humidity;          /* tenths of % */
+};
+
+/* a published message awaiting its PUBACK */
+struct message
+{
+    uint16_t packet_id;
+    uint16_t samples;
+    uint16_t length;            /* of the payload */
+    bool spilled;               /* the readings are the oldest spilled block, not the oldest in RAM */
+    bool acked;
+};
+
+/* spilled blocks are numbered from first to first + count - 1, block n is stored under key "b<n % spill blocks>" */
+struct spill_state
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+static telemetry_config_t config;
+static telemetry_stats_t stats;
+
+static sampler_reading_t inbox_storage[TELEMETRY_INBOX];
+static spsc_queue_t inbox;                  /* producer -> publisher task */
+static bool initialised = false;
+/* set by telemetry_flush, the publisher then sends the readings it has taken without waiting for whole batches */
+static atomic_bool flush_requested = false;
+static bool flushing = false;
+
+/* loopback socket telemetry_record sends to, so that the publisher picks a reading up without waiting */
+static int wake_socket = -1;
+static struct sockaddr_in wake_addr;
+
+/* RAM queue with free-running indices: [tail, sent) is published and awaiting PUBACK, [sent, head) is unpublished */
+static struct sample samples[CONFIG_TELEMETRY_QUEUE_SAMPLES];
+static uint32_t head = 0;
+static uint32_t tail = 0;
+static uint32_t sent = 0;
+
+/* messages awaiting PUBACK, oldest first */
+static struct message window[TELEMETRY_MAX_IN_FLIGHT];
+static uint32_t window_count = 0;
+static uint16_t next_packet_id = 1;
+
+static struct spill_state spill;
+static uint32_t spill_sent = 0;             /* blocks from spill.first that are in flight */
+
+/* everything the publisher needs is reserved statically, like the other tasks */
+static mqtt_client_t client = { .socket = -1 };
+static struct sample block[TELEMETRY_MESSAGE_SAMPLES];
+static char payload[MQTT_MAX_PACKET - 128];
+static StackType_t telemetry_stack[CONFIG_TELEMETRY_TASK_STACK_SIZE];
+static StaticTask_t telemetry_tcb;
+
+
+static bool create_wake_socket(void)
+{
+    socklen_t addr_len = sizeof(wake_addr);
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        return false;
+    }
+    memset(&wake_addr, 0, sizeof(wake_addr));
+    wake_addr.sin_family = AF_INET;
+    wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    wake_addr.sin_port = 0;
+    if (bind(sock, (struct sockaddr *)&wake_addr, sizeof(wake_addr)) != 0 ||
+        getsockname(sock, (struct sockaddr *)&wake_addr, &addr_len) != 0) {
+        close(sock);
+        return false;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    wake_socket = sock;
+    return true;
+}
+
+static void spill_key(char * key, const size_t size, const uint32_t block_number)
+{
+    snprintf(key, size, "b%u", (unsigned)(block_number % MAX(CONFIG_TELEMETRY_SPILL_BLOCKS, 1)));
+}
+
+static void spill_store_state(nvs_handle_t handle)
+{
+    nvs_set_blob(handle, nvs_key_spill, &spill, sizeof(spill));
+    stats.spilled_queued = spill.count * TELEMETRY_MESSAGE_SAMPLES;
+}
+
+static void spill_load_state(void)
+{
+    nvs_handle_t handle;
+    size_t length = sizeof(spill);
+    if (nvs_open(nvs_namespace, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(handle, nvs_key_spill, &spill, &length) != ESP_OK || length != sizeof(spill)
+            || spill.count > CONFIG_TELEMETRY_SPILL_BLOCKS) {
+        memset(&spill, 0, sizeof(spill));
+    }
+    nvs_close(handle);
+    stats.spilled_queued = spill.count * TELEMETRY_MESSAGE_SAMPLES;
+    if (spill.count > 0) {
+        ESP_LOGI(log_tag, "%u readings spilled before the restart are waiting", (unsigned)stats.spilled_queued);
+    }
+}
+
+static void copy_from_queue(const uint32_t start, const uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        block[i] = samples[(start + i) % CONFIG_TELEMETRY_QUEUE_SAMPLES];
+    }
+}
+
+/**
+ * @brief Make room in the full RAM queue by moving its oldest readings to NVS, or by dropping them
+ * @return False if the oldest readings are in flight, the new reading has to be dropped instead
+ */
+static bool make_room(void)
+{
+    if (sent != tail) {
+        return false;
+    }
+
+    /* the queue is full, so there is always a whole block to move */
+    copy_from_queue(tail, TELEMETRY_MESSAGE_SAMPLES);
+    tail += TELEMETRY_MESSAGE_SAMPLES;
+    sent = tail;
+
+    nvs_handle_t handle;
+    if (CONFIG_TELEMETRY_SPILL_BLOCKS == 0 || (spill.count == CONFIG_TELEMETRY_SPILL_BLOCKS && spill_sent > 0)
+            || nvs_open(nvs_namespace, NVS_READWRITE, &handle) != ESP_OK) {
+        stats.dropped += TELEMETRY_MESSAGE_SAMPLES;
+        return true;
+    }
+    /* with the spill area full its oldest block is overwritten, those readings are the least useful */
+    if (spill.count == CONFIG_TELEMETRY_SPILL_BLOCKS) {
+        spill.first++;
+        spill.count--;
+        stats.dropped += TELEMETRY_MESSAGE_SAMPLES;
+    }
+    char key[8];
+    spill_key(key, sizeof(key), spill.first + spill.count);
+    if (nvs_set_blob(handle, key, block, sizeof(block)) == ESP_OK) {
+        spill.count++;
+        stats.spilled += TELEMETRY_MESSAGE_SAMPLES;
+    } else {
+        ESP_LOGW(log_tag, "Unable to spill %d readings", TELEMETRY_MESSAGE_SAMPLES);
+        stats.dropped += TELEMETRY_MESSAGE_SAMPLES;
+    }
+    spill_store_state(handle);
+    nvs_commit(handle);
+    nvs_close(handle);
+    return true;
+}
+
+static void take_readings(void)
+{
+    /* taken before the readings, so every reading recorded before the flush is flushed */
+    if (atomic_exchange(&flush_requested, false)) {
+        flushing = true;
+    }
+
+    sampler_reading_t reading;
+    while (spsc_queue_pop(&inbox, &reading)) {
+        stats.recorded++;
+        if (head - tail == CONFIG_TELEMETRY_QUEUE_SAMPLES && !make_room()) {
+            stats.dropped++;
+            continue;
+        }
+        struct sample * sample = &samples[head % CONFIG_TELEMETRY_QUEUE_SAMPLES];
+        sample->seq = reading.count;
+        sample->uptime_s = reading.timestamp_us / 1000000;
+        sample->temperature = lroundf(reading.temperature * 10);
+        sample->humidity = lroundf(reading.humidity * 10);
+        head++;
+    }
+    stats.queued = head - tail;
+}
+
+static bool publish_block(const uint32_t count, const bool spilled)
+{
+    /* tenths are written as integers, without pulling in floating point formatting */
+    size_t length = snprintf(payload, sizeof(payload), "{\"seq\":%u,\"s\":[", (unsigned)block[0].seq);
+    for (uint32_t i = 0; i < count && length < sizeof(payload); i++) {
+        const int temperature = block[i].temperature;
+        const int magnitude = temperature < 0 ? -temperature : temperature;
+        length += snprintf(payload + length, sizeof(payload) - length, "%s[%u,%s%d.%d,%d.%d]", i > 0 ? "," : "",
+            (unsigned)block[i].uptime_s, temperature < 0 ? "-" : "", magnitude / 10, magnitude % 10,
+            block[i].humidity / 10, block[i].humidity % 10);
+    }
+    if (length < sizeof(payload)) {
+        length += snprintf(payload + length, sizeof(payload) - length, "]}");
+    }
+    if (length >= sizeof(payload)) {
+        ESP_LOGE(log_tag, "%u readings do not fit in a message", (unsigned)count);
+        return false;
+    }
+
+    const uint16_t packet_id = next_packet_id;
+    next_packet_id = next_packet_id == UINT16_MAX ? 1 : next_packet_id + 1;
+    if (!mqtt_publish(&client, config.topic, payload, length, packet_id)) {
+        return false;
+    }
+    window[window_count++] = (struct message) {
+        .packet_id = packet_id, .samples = count, .length = length, .spilled = spilled, .acked = false,
+    };
+    stats.messages++;
+    return true;
+}
+
+static bool load_spilled_block(const uint32_t block_number)
+{
+    nvs_handle_t handle;
+    size_t length = sizeof(block);
+    char key[8];
+    spill_key(key, sizeof(key), block_number);
+    if (nvs_open(nvs_namespace, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    const esp_err_t err = nvs_get_blob(handle, key, block, &length);
+    nvs_close(handle);
+    return err == ESP_OK && length == sizeof(block);
+}
+
+static void forget_spilled_block(void)
+{
+    nvs_handle_t handle;
+    char key[8];
+    spill_key(key, sizeof(key), spill.first);
+    spill.first++;
+    spill.count--;
+    if (nvs_open(nvs_namespace, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, key);
+        spill_store_state(handle);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+/* fill the window, spilled blocks first since they hold the oldest readings */
+static void publish_pending(void)
+{
+    while (client.socket >= 0 && window_count < config.in_flight) {
+        if (spill_sent < spill.count) {
+            if (!load_spilled_block(spill.first + spill_sent)) {
+                /* a block that cannot be read is given up once it is the oldest, the ones behind it wait until then */
+                if (spill_sent > 0) {
+                    return;
+                }
+                ESP_LOGW(log_tag, "Spilled block %u cannot be read, dropping it", (unsigned)spill.first);
+                stats.dropped += TELEMETRY_MESSAGE_SAMPLES;
+                forget_spilled_block();
+                continue;
+            }
+            if (!publish_block(TELEMETRY_MESSAGE_SAMPLES, true)) {
+                return;
+            }
+            spill_sent++;
+            continue;
+        }
+
+        /* a backlog goes out in messages as large as possible, otherwise a message waits for a whole batch */
+        const uint32_t unsent = head - sent;
+        if (unsent == 0) {
+            flushing = false;
+            return;
+        }
+        if (unsent < config.batch_samples && !flushing) {
+            return;
+        }
+        const uint32_t count = MIN(unsent, TELEMETRY_MESSAGE_SAMPLES);
+        copy_from_queue(sent, count);
+        if (!publish_block(count, false)) {
+            return;
+        }
+        sent += count;
+    }
+}
+
+static void handle_puback(const uint16_t packet_id)
+{
+    for (uint32_t i = 0; i < window_count; i++) {
+        if (window[i].packet_id == packet_id) {
+            window[i].acked = true;
+            break;
+        }
+    }
+
+    /* brokers acknowledge in order, but the readings are released oldest first whatever the order */
+    while (window_count > 0 && window[0].acked) {
+        if (window[0].spilled) {
+            forget_spilled_block();
+            spill_sent--;
+        } else {
+            tail += window[0].samples;
+        }
+        stats.acked += window[0].samples;
+        stats.acked_messages++;
+        stats.payload_bytes += window[0].length;
+        window_count--;
+        memmove(&window[0], &window[1], window_count * sizeof(window[0]));
+    }
+    stats.queued = head - tail;
+}
+
+/* whatever was in flight is published again on the next connection */
+static void connection_lost(void)
+{
+    window_count = 0;
+    sent = tail;
+    spill_sent = 0;
+}
+
+static void telemetry_task(void *pvParameters)
+{
+    while (!create_wake_socket()) {
+        vTaskDelay(1000 / portTICK_RATE_MS);
+    }
+
+    bool online = false;
+    uint32_t retry_ms = TELEMETRY_RETRY_MIN_MS;
+    int64_t retry_at_us = 0;
+    int64_t last_sent_us = 0;
+    int64_t ping_sent_us = 0;       /* 0 while no keep-alive is outstanding */
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        if (!online && now >= retry_at_us) {
+            online = mqtt_connect(&client, config.broker, config.port, config.client_id, TELEMETRY_KEEPALIVE_S,
+                TELEMETRY_CONNECT_TIMEOUT_MS);
+            now = esp_timer_get_time();
+            if (online) {
+                ESP_LOGI(log_tag, "Connected to %s:%d, %u readings waiting", config.broker, config.port,
+                    (unsigned)(head - tail + spill.count * TELEMETRY_MESSAGE_SAMPLES));
+                stats.connections++;
+                retry_ms = TELEMETRY_RETRY_MIN_MS;
+                last_sent_us = now;
+                ping_sent_us = 0;
+            } else {
+                retry_at_us = now + retry_ms * 1000LL;
+                retry_ms = MIN(retry_ms * 2, TELEMETRY_RETRY_MAX_MS);
+            }
+        }
+
+        /* wait for a reading, an acknowledgement, or at most a second for the keep-alive and reconnection */
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(wake_socket, &readable);
+        int max_fd = wake_socket;
+        if (online) {
+            FD_SET(client.socket, &readable);
+            max_fd = MAX(max_fd, client.socket);
+        }
+        struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+        if (select(max_fd + 1, &readable, NULL, NULL, &timeout) < 0) {
+            ESP_LOGE(log_tag, "Error occurred during select: errno %d", errno);
+            vTaskDelay(1000 / portTICK_RATE_MS);
+            continue;
+        }
+        if (FD_ISSET(wake_socket, &readable)) {
+            char discard[8];
+            while (recv(wake_socket, discard, sizeof(discard), 0) > 0) {
+            }
+        }
+        take_readings();
+
+        if (online && FD_ISSET(client.socket, &readable)) {
+            uint16_t packet_id;
+            mqtt_event_t event;
+            while ((event = mqtt_poll(&client, &packet_id)) != MQTT_EVENT_NONE && event != MQTT_EVENT_CLOSED) {
+                if (event == MQTT_EVENT_PUBACK) {
+                    handle_puback(packet_id);
+                } else {
+                    ping_sent_us = 0;
+                }
+            }
+        }
+
+        const uint32_t bytes_before = client.bytes_sent;
+        publish_pending();
+        now = esp_timer_get_time();
+        if (client.socket >= 0 && ping_sent_us != 0 && now - ping_sent_us > TELEMETRY_KEEPALIVE_S * 1000000LL) {
+            ESP_LOGW(log_tag, "Broker stopped answering");
+            mqtt_disconnect(&client);
+        } else if (client.socket >= 0 && ping_sent_us == 0 && now - last_sent_us > TELEMETRY_KEEPALIVE_S * 500000LL
+                && mqtt_ping(&client)) {
+            ping_sent_us = now;
+        }
+        if (client.bytes_sent != bytes_before) {
+            last_sent_us = now;
+        }
+        stats.wire_bytes += client.bytes_sent;
+        client.bytes_sent = 0;
+
+        if (online && client.socket < 0) {
+            online = false;
+            connection_lost();
+            retry_at_us = now + retry_ms * 1000LL;
+        }
+    }
+}
+
+void telemetry_init(void)
+{
+    spsc_queue_init(&inbox, inbox_storage, sizeof(inbox_storage[0]), TELEMETRY_INBOX);
+    initialised = true;
+}
+
+void telemetry_start(const telemetry_config_t * telemetry_config)
+{
+    config = *telemetry_config;
+    config.batch_samples = MAX(1, MIN(config.batch_samples, TELEMETRY_MESSAGE_SAMPLES));
+    config.in_flight = MAX(1, MIN(config.in_flight, TELEMETRY_MAX_IN_FLIGHT));
+    spill_load_state();
+
+    TaskHandle_t task = xTaskCreateStaticPinnedToCore(telemetry_task, "telemetry", CONFIG_TELEMETRY_TASK_STACK_SIZE, NULL,
+        TELEMETRY_PRIORITY, telemetry_stack, &telemetry_tcb, TELEMETRY_CORE);
+    taskstats_register(task, "telemetry", CONFIG_TELEMETRY_TASK_STACK_SIZE);
+}
+
+static void wake_publisher(void)
+{
+    /* the datagram only needs to arrive, its content is discarded */
+    const char wake = 0;
+    if (wake_socket >= 0) {
+        sendto(wake_socket, &wake, sizeof(wake), 0, (struct sockaddr *)&wake_addr, sizeof(wake_addr));
+    }
+}
+
+bool telemetry_record(const sampler_reading_t * reading)
+{
+    if (!initialised || !spsc_queue_push(&inbox, reading)) {
+        return false;
+    }
+    wake_publisher();
+    return true;
+}
+
+void telemetry_flush(void)
+{
+    atomic_store(&flush_requested, true);
+    wake_publisher();
+}
+
+void telemetry_get_stats(telemetry_stats_t * telemetry_stats)
+{
+    *telemetry_stats = stats;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file Telemetry publisher: pushes the sensor readings to an MQTT broker in batches with QoS 1
+ *
+ * Readings are queued in RAM and published several to a message once a batch of them is waiting, with a window of
+ * messages awaiting their PUBACK. While the broker cannot be reached the queue fills and its oldest readings are spilled
+ * to NVS in blocks, and on reconnection the backlog is drained in messages of up to TELEMETRY_MESSAGE_SAMPLES readings,
+ * spilled blocks first. Each message is compact JSON:
+ *
+ *   {"seq":120,"s":[[7200,21.5,45.0],[7260,21.6,45.2]]}
+ *
+ * with the number of the first reading since boot and, per reading, the uptime in seconds, the temperature in *C and
+ * the relative humidity in %.
+ */
+
+#ifndef INTELLILIGHT_TELEMETRY_H
+#define INTELLILIGHT_TELEMETRY_H
+
+/* system includes */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* local includes */
+#include "sampler.h"
+
+
+/* most readings in one message, the size of a spilled block and of the messages a backlog is drained in */
+#define TELEMETRY_MESSAGE_SAMPLES 64
+/* most messages that can await their PUBACK */
+#define TELEMETRY_MAX_IN_FLIGHT 16
+
+/**
+ * @brief Broker, identity and batching of the publisher
+ */
+typedef struct
+{
+    const char * broker;        /* IPv4 address or host name, must stay valid for ever */
+    uint16_t port;
+    const char * client_id;     /* must stay valid for ever */
+    const char * topic;         /* must stay valid for ever */
+    uint16_t batch_samples;     /* readings published together, 1 to TELEMETRY_MESSAGE_SAMPLES */
+    uint16_t in_flight;         /* messages awaiting their PUBACK, 1 to TELEMETRY_MAX_IN_FLIGHT */
+} telemetry_config_t;
+
+/**
+ * @brief Counters of the publisher, updated by its task
+ */
+typedef struct
+{
+    uint32_t recorded;          /* readings handed to telemetry_record */
+    uint32_t acked;             /* readings the broker has acknowledged */
+    uint32_t dropped;           /* readings lost because the queue and the spill area were full */
+    uint32_t spilled;           /* readings written to NVS */
+    uint32_t queued;            /* readings in RAM not acknowledged yet */
+    uint32_t spilled_queued;    /* readings in NVS not acknowledged yet */
+    uint32_t acked_messages;    /* messages the broker has acknowledged */
+    uint32_t messages;          /* messages published, including those published again after a reconnection */
+    uint32_t connections;       /* successful connections to the broker */
+    uint64_t payload_bytes;     /* JSON bytes of the acknowledged messages */
+    uint64_t wire_bytes;        /* bytes written to the broker, MQTT framing, keep-alives and repeats included */
+} telemetry_stats_t;
+
+/**
+ * @brief Set up the queue that telemetry_record hands readings over in, before the first reading is taken
+ */
+extern void telemetry_init(void);
+
+/**
+ * @brief Start the publisher task, which connects to the broker and keeps reconnecting, once NVS is initialised
+ * @param config Broker, identity and batching
+ */
+extern void telemetry_start(const telemetry_config_t * config);
+
+/**
+ * @brief Queue a reading for publication (one producer task only)
+ * @param reading Reading
+ * @return False if telemetry_init has not been called or the publisher has not taken the previous readings yet
+ */
+extern bool telemetry_record(const sampler_reading_t * reading);
+
+/**
+ * @brief Publish the readings that are waiting for the rest of their batch without waiting for it (any task)
+ */
+extern void telemetry_flush(void);
+
+/**
+ * @brief Get the counters, a snapshot that can be slightly inconsistent when read from another task
+ * @param stats Output counters
+ */
+extern void telemetry_get_stats(telemetry_stats_t * stats);
+
+#endif
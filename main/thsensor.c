@@ -15,22 +15,14 @@
 static const char *log_tag = "thsensor";
 
 
-float thsensor_read_humidity(void)
+esp_err_t thsensor_read(float * temperature, float * humidity)
 {
     am2302_data_t data = am2302_read_data(AM2302_SDA_PIN);
     if (data.error != ESP_OK) {
         ESP_LOGE(log_tag, "Error reading AM2302 T&H sensor");
-        return 0;
+        return data.error;
     }
-    return data.humidity / 10;
-}
-
-float thsensor_read_temperature(void)
-{
-    am2302_data_t data = am2302_read_data(AM2302_SDA_PIN);
-    if (data.error != ESP_OK) {
-        ESP_LOGE(log_tag, "Error reading AM2302 T&H sensor");
-        return 0;
-    }
-    return data.temperature / 10;
+    *temperature = data.temperature / 10.0f;
+    *humidity = data.humidity / 10.0f;
+    return ESP_OK;
 }
@@ -6,19 +6,15 @@
 #define INTELLILIGHT_THSENSOR_H
 
 /* system includes */
-#include <unistd.h>
+#include <esp_err.h>
 
 
 /**
- * @brief Read humidity from sensor
- * @return Humidity value
- */ 
-extern float thsensor_read_humidity(void);
-
-/**
- * @brief Read temperature from sensor
- * @return Temperature value
- */ 
-extern float thsensor_read_temperature(void);
+ * @brief Read temperature and humidity from the sensor in one transaction, at most once every 2 s
+ * @param temperature Output temperature in *C
+ * @param humidity Output relative humidity in %
+ * @return ESP_OK, or the error of the read, in which case the outputs are left alone
+ */
+extern esp_err_t thsensor_read(float * temperature, float * humidity);
 
 #endif
@@ -3,11 +3,29 @@
  */
 
 /* system includes */
+#include <stdio.h>
 #include <string.h>
+#include <sys/param.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 /* local includes */
+#include "boot_trace.h"
+#include "coap.h"
+#include "cJSON_Utils.h"
+#include "history.h"
+#include "http.h"
+#include "kasa_commands.h"
+#include "memstats.h"
+#include "pipeline.h"
+#include "ratelimit.h"
+#include "sampler.h"
+#include "taskstats.h"
 #include "tplink_kasa.h"
+#include "trace.h"
+#include "websocket.h"
 #include "wifi.h"
 
 static const char *log_tag = "tplink-kasa";
@@ -20,93 +38,557 @@ union payload_header
 
 const char cipher_key = 171;
 
-static const char * tplink_kasa_sysinfo = \
-"{ \
-    \"system\": \
-    { \
-        \"get_sysinfo\": \
-        { \
-        \"sw_ver\":\"1.0.0 Build 000001 Rel.000001\", \
-        \"hw_ver\":\"1.0\", \
-        \"model\":\"KL130B(UN)\", \
-        \"deviceId\":\"80121C1874CF2DEA94DF3127F8DDF7D71DD7112F\", \
-        \"oemId\":\"E45F76AD3AF13E60B58D6F68739CD7E5\", \
-        \"hwId\":\"1E97141B9F0E939BD8F9679F0B6167C8\", \
-        \"rssi\":-71, \
-        \"latitude_i\":0, \
-        \"longitude_i\":0, \
-        \"alias\":\"Back Light\", \
-        \"status\":\"new\", \
-        \"description\":\"WiFi BLE Smart Bulb Bridge\", \
-        \"mic_type\":\"IOT.SMARTBULB\", \
-        \"mic_mac\":\"C0C9E3AD7C1D\", \
-        \"dev_state\":\"normal\", \
-        \"is_factory\":false, \
-        \"disco_ver\":\"1.0\", \
-        \"ctrl_protocols\":  \
-        { \
-            \"name\":\"Linkie\", \
-            \"version\":\"1.0\" \
-        }, \
-        \"active_mode\":\"none\", \
-        \"is_dimmable\":1, \
-        \"is_color\":1, \
-        \"is_variable_color_temp\":1, \
-        \"light_state\": \
-        { \
-            \"on_off\":0 \
-        }, \
-        \"err_code\":0 \
-        } \
-    } \
-}";
-
-int tplink_kasa_process_buffer(char * raw_buffer, const int buffer_len, const bool include_header)
+/* the alias is stored in place of the one bound from the request */
+_Static_assert(sizeof(((kasa_system_set_dev_alias_request_t *)0)->alias) == TPLINK_KASA_ALIAS_SIZE, "alias size differs from the schema");
+
+/* this device, and the paths into the state of every device */
+static tplink_kasa_device_t this_device;
+static cJSONUtils_Path * alias_path = NULL;
+static cJSONUtils_Path * on_off_path = NULL;
+
+/**
+ * @brief Encrypt a payload in place
+ * @param payload Plain payload, without header
+ * @param payload_len Length of the payload
+ * @param key Key to start from, cipher_key at the start of a payload or the return value for the previous part of it
+ * @return Key to continue the next part of the payload with
+ */
+static char tplink_kasa_cipher(char * payload, const int payload_len, char key)
+{
+    ESP_LOGD(log_tag, "Decrypted payload (%d bytes): %.*s", payload_len, payload_len, payload);
+
+    /* XOR each byte with the previous encypted byte or 171 for the first byte */
+    for (int i = 0; i < payload_len; i++)
+    {
+        key = payload[i] = payload[i] ^ key;
+    }
+    return key;
+}
+
+/**
+ * @brief Fill in the header in front of an encrypted payload
+ * @param buffer Buffer holding the encrypted payload at offset 4 (with header) or 0 (without)
+ * @param payload_len Length of the encrypted payload
+ * @param include_header True to fill in the header
+ * @return Length of encrypted data including the header
+ */
+static int tplink_kasa_add_header(char * buffer, const int payload_len, const bool include_header)
+{
+    if (!include_header) {
+        return payload_len;
+    }
+
+    /* the first 4 bytes in the encrypted data define the length of the payload, encoded in big endian */
+    /* since ESP32 is little endian, need to swap the endianness */
+    union payload_header header;
+    header.payload_length = payload_len;
+    buffer[0] = header.bytes[3];
+    buffer[1] = header.bytes[2];
+    buffer[2] = header.bytes[1];
+    buffer[3] = header.bytes[0];
+
+    return sizeof(header) + payload_len;
+}
+
+/**
+ * @brief Encrypt a reply that has been written to the buffer after the space for the header
+ * @param buffer Buffer holding the plain reply at offset 4 (with header) or 0 (without)
+ * @param payload_len Length of the plain reply
+ * @param include_header True to fill in the header
+ * @return Length of encrypted data
+ */
+static int tplink_kasa_encrypt_in_place(char * buffer, const int payload_len, const bool include_header)
+{
+    tplink_kasa_cipher(buffer + (include_header ? sizeof(union payload_header) : 0), payload_len, cipher_key);
+    return tplink_kasa_add_header(buffer, payload_len, include_header);
+}
+
+static void tplink_kasa_sysinfo(kasa_system_get_sysinfo_reply_t * sysinfo, const tplink_kasa_device_t * device)
+{
+    cJSON * state = device->state;
+    memset(sysinfo, 0, sizeof(*sysinfo));
+    sysinfo->sw_ver = "1.0.0 Build 000001 Rel.000001";
+    sysinfo->hw_ver = "1.0";
+    sysinfo->model = "KL130B(UN)";
+    sysinfo->deviceId = device->device_id;
+    sysinfo->oemId = "E45F76AD3AF13E60B58D6F68739CD7E5";
+    sysinfo->hwId = "1E97141B9F0E939BD8F9679F0B6167C8";
+    sysinfo->rssi = -71;
+    sysinfo->latitude_i = 0;
+    sysinfo->longitude_i = 0;
+    sysinfo->alias = cJSON_GetStringValue(cJSONUtils_GetPath(state, alias_path));
+    sysinfo->status = "new";
+    sysinfo->description = "WiFi BLE Smart Bulb Bridge";
+    sysinfo->mic_type = "IOT.SMARTBULB";
+    sysinfo->mic_mac = device->mic_mac;
+    sysinfo->dev_state = "normal";
+    sysinfo->is_factory = false;
+    sysinfo->disco_ver = "1.0";
+    sysinfo->ctrl_protocols.name = "Linkie";
+    sysinfo->ctrl_protocols.version = "1.0";
+    sysinfo->active_mode = "none";
+    sysinfo->is_dimmable = 1;
+    sysinfo->is_color = 1;
+    sysinfo->is_variable_color_temp = 1;
+    const cJSON * on_off = cJSONUtils_GetPath(state, on_off_path);
+    sysinfo->light_state.on_off = cJSON_IsNumber(on_off) ? on_off->valueint : 0;
+    sysinfo->err_code = 0;
+}
+
+/**
+ * @brief Copy a payload to the reply cache a word at a time with relaxed atomic stores, which readers may race
+ * @param cache Reply cache
+ * @param payload Payload to copy
+ * @param length Length of the payload
+ */
+static void tplink_kasa_cache_store(atomic_uint_least32_t * cache, const char * payload, const int length)
+{
+    for (int i = 0; i < length; i += sizeof(uint32_t)) {
+        uint32_t word = 0;
+        memcpy(&word, payload + i, MIN(sizeof(word), (size_t) (length - i)));
+        atomic_store_explicit(&cache[i / sizeof(word)], word, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Copy a payload out of the reply cache a word at a time with relaxed atomic loads, the sequence tells whether
+ * the copy is consistent
+ * @param payload Output payload
+ * @param cache Reply cache
+ * @param length Length of the payload
+ */
+static void tplink_kasa_cache_load(char * payload, atomic_uint_least32_t * cache, const int length)
+{
+    for (int i = 0; i < length; i += sizeof(uint32_t)) {
+        const uint32_t word = atomic_load_explicit(&cache[i / sizeof(word)], memory_order_relaxed);
+        memcpy(payload + i, &word, MIN(sizeof(word), (size_t) (length - i)));
+    }
+}
+
+/**
+ * @brief Rebuild the cached system information if the device state has changed since it was built, with the device
+ * lock held
+ * @param device Device to describe
+ */
+static void tplink_kasa_sysinfo_refresh(tplink_kasa_device_t * device)
+{
+    /* the hash is cached in the tree, so this costs nothing unless something changed the state since the last rebuild */
+    const unsigned long state_hash = cJSON_Hash(device->state);
+    if (atomic_load_explicit(&device->sysinfo_cache_len, memory_order_relaxed) > 0
+            && state_hash == device->sysinfo_cache_hash) {
+        return;
+    }
+
+    ESP_LOGD(log_tag, "Device state changed (hash %08lx), rebuilding system information", state_hash);
+    kasa_system_get_sysinfo_reply_t sysinfo;
+    tplink_kasa_sysinfo(&sysinfo, device);
+
+    /* the cipher does not depend on the header, so the payload can be reused over both UDP and TCP */
+    int reply_len = kasa_commands_write_system_get_sysinfo_reply(device->sysinfo_build, TPLINK_KASA_REPLY_CACHE_SIZE,
+        &sysinfo);
+    if (reply_len > 0) {
+        tplink_kasa_cipher(device->sysinfo_build, reply_len, cipher_key);
+        device->sysinfo_cache_hash = state_hash;
+    } else {
+        reply_len = 0;
+    }
+
+    /* copied in while the sequence is odd, the lock makes this the only writer */
+    const uint32_t sequence = atomic_load_explicit(&device->sysinfo_sequence, memory_order_relaxed);
+    atomic_store_explicit(&device->sysinfo_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    tplink_kasa_cache_store(device->sysinfo_cache, device->sysinfo_build, reply_len);
+    atomic_store_explicit(&device->sysinfo_cache_len, reply_len, memory_order_relaxed);
+    atomic_store_explicit(&device->sysinfo_sequence, sequence + 2, memory_order_release);
+}
+
+/**
+ * @brief Write the encrypted system information payload, copied from the cache without taking the device lock
+ * @param device Device to describe
+ * @param reply Output buffer
+ * @param reply_size Size of the output buffer
+ * @return Length of the encrypted payload, or -1 if it does not fit
+ */
+static int tplink_kasa_sysinfo_reply(tplink_kasa_device_t * device, char * reply, const size_t reply_size)
+{
+    uint32_t before;
+    uint32_t after;
+    int reply_len;
+    do {
+        before = atomic_load_explicit(&device->sysinfo_sequence, memory_order_acquire);
+        reply_len = atomic_load_explicit(&device->sysinfo_cache_len, memory_order_relaxed);
+        if (reply_len > 0 && reply_len <= reply_size) {
+            tplink_kasa_cache_load(reply, device->sysinfo_cache, reply_len);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&device->sysinfo_sequence, memory_order_relaxed);
+    } while (before != after || (before & 1) != 0);
+
+    if (reply_len > 0) {
+        return reply_len <= reply_size ? reply_len : -1;
+    }
+
+    /* only a reply too large for the cache is built on request */
+    xSemaphoreTake(device->lock, portMAX_DELAY);
+    kasa_system_get_sysinfo_reply_t sysinfo;
+    tplink_kasa_sysinfo(&sysinfo, device);
+    reply_len = kasa_commands_write_system_get_sysinfo_reply(reply, reply_size, &sysinfo);
+    xSemaphoreGive(device->lock);
+
+    if (reply_len >= 0) {
+        tplink_kasa_cipher(reply, reply_len, cipher_key);
+    }
+    return reply_len;
+}
+
+bool tplink_kasa_device_init(tplink_kasa_device_t * device, const char * device_id, const char * mic_mac, const char * alias, tplink_kasa_sensor_t sensor)
+{
+    memset(device, 0, sizeof(*device));
+    snprintf(device->device_id, sizeof(device->device_id), "%s", device_id);
+    snprintf(device->mic_mac, sizeof(device->mic_mac), "%s", mic_mac);
+    snprintf(device->alias, sizeof(device->alias), "%s", alias);
+    device->sensor = sensor;
+    device->lock = xSemaphoreCreateMutexStatic(&device->lock_buffer);
+
+    memstats_site_begin();
+    device->state = cJSON_CreateObject();
+    if (device->state != NULL) {
+        /* the alias is referenced rather than copied so changing it never allocates */
+        cJSON_AddItemToObject(device->state, "alias", cJSON_CreateStringReference(device->alias));
+        cJSON * light_state = cJSON_AddObjectToObject(device->state, "light_state");
+        cJSON_AddNumberToObject(light_state, "on_off", 0);
+    }
+    memstats_site_end();
+    if (device->state == NULL) {
+        return false;
+    }
+
+    /* allocated up front so serving requests never has to retain memory */
+    device->sysinfo_cache = memstats_malloc(MEMSTATS_TAG_KASA, TPLINK_KASA_REPLY_CACHE_SIZE);
+    device->sysinfo_build = memstats_malloc(MEMSTATS_TAG_KASA, TPLINK_KASA_REPLY_CACHE_SIZE);
+    if (cJSONUtils_GetPath(device->state, on_off_path) == NULL || device->sysinfo_cache == NULL
+            || device->sysinfo_build == NULL) {
+        return false;
+    }
+    tplink_kasa_sysinfo_refresh(device);
+    return true;
+}
+
+void tplink_kasa_init(void)
+{
+    memstats_site_begin();
+    alias_path = cJSONUtils_CompilePath("/alias");
+    on_off_path = cJSONUtils_CompilePath("/light_state/on_off");
+    memstats_site_end();
+
+    /* this builds the reply to discovery now, while WiFi associates, so the first one is a cache hit */
+    if (tplink_kasa_device_init(&this_device, "80121C1874CF2DEA94DF3127F8DDF7D71DD7112F", "C0C9E3AD7C1D", "Back Light", NULL)
+            && atomic_load(&this_device.sysinfo_cache_len) > 0) {
+        boot_trace_mark(BOOT_REPLY_CACHE);
+    }
+}
+
+/* state of one pass of a streamed reply */
+typedef struct
+{
+    const tplink_kasa_stream_t * stream;  /* NULL while only counting */
+    char key;
+    size_t length;
+} tplink_kasa_stream_pass_t;
+
+static cJSON_bool tplink_kasa_stream_chunk(void * userdata, char * data, size_t length)
+{
+    tplink_kasa_stream_pass_t * pass = userdata;
+    if (pass->stream == NULL) {
+        pass->length += length;
+        return true;
+    }
+
+    /* the autokey carries over from the previous chunk, so the stream is identical to encrypting the whole reply */
+    pass->key = tplink_kasa_cipher(data, length, pass->key);
+    if ( !pass->stream->write(pass->stream->userdata, data, length) ) {
+        return false;
+    }
+    pass->length += length;
+    return true;
+}
+
+/**
+ * @brief Print, encrypt and send a reply chunk by chunk, so its size is not limited by the buffer
+ * @param json Reply to send
+ * @param chunk Buffer to print into, the request in it is no longer needed
+ * @param chunk_size Size of the buffer
+ * @param stream Connection to send the header and payload to
+ * @return True if the whole reply was sent
+ */
+static bool tplink_kasa_stream(const cJSON * json, char * chunk, const int chunk_size, const tplink_kasa_stream_t * stream)
 {
+    /* the header carries the payload length, so the reply is printed twice: once to count it and once to send it */
+    tplink_kasa_stream_pass_t pass = { .stream = NULL, .key = cipher_key, .length = 0 };
+    if ( !cJSON_PrintStreamed(json, chunk, chunk_size, false, tplink_kasa_stream_chunk, &pass) ) {
+        ESP_LOGE(log_tag, "Error printing JSON reply");
+        return false;
+    }
+
+    char header[sizeof(union payload_header)];
+    const size_t payload_len = pass.length;
+    tplink_kasa_add_header(header, payload_len, true);
+    if ( !stream->write(stream->userdata, header, sizeof(header)) ) {
+        ESP_LOGE(log_tag, "Streaming reply failed sending its header");
+        return false;
+    }
+
+    pass.stream = stream;
+    pass.length = 0;
+    if ( !cJSON_PrintStreamed(json, chunk, chunk_size, false, tplink_kasa_stream_chunk, &pass) || pass.length != payload_len ) {
+        ESP_LOGE(log_tag, "Streaming reply failed after %u of %u bytes", (unsigned)pass.length, (unsigned)payload_len);
+        return false;
+    }
+
+    ESP_LOGI(log_tag, "Streamed %u byte reply in chunks of up to %d bytes", (unsigned)(sizeof(header) + payload_len), chunk_size - 1);
+    return true;
+}
+
+/**
+ * @brief Send a reply built as a tree, streaming it if there is a connection to stream to
+ * @param json_context cJSON context the result was created with
+ * @param module Module of the command
+ * @param method Method of the command
+ * @param result Result object (err_code 0 is added to it), consumed
+ * @param raw_buffer Buffer for the encrypted reply
+ * @param buffer_size Size of raw_buffer
+ * @param include_header True to prepend the packet with a header
+ * @param stream Connection to stream the reply to, or NULL
+ * @return Length of encrypted reply left in raw_buffer, -1 if streaming it failed
+ */
+static int tplink_kasa_tree_reply(cJSON_Context * json_context, const char * module, const char * method, cJSON * result,
+    char * raw_buffer, const int buffer_size, const bool include_header, const tplink_kasa_stream_t * stream)
+{
+    TRACE_BEGIN(TRACE_KASA_TREE_REPLY);
+    cJSON * response = cJSON_CreateObjectCtx(json_context);
+    cJSON * resp_module = cJSON_AddObjectToObjectCtx(json_context, response, module);
+    /* a result only carries an err_code when it reports an error */
+    if ( !cJSON_HasObjectItem(result, "err_code") ) {
+        cJSON_AddNumberToObjectCtx(json_context, result, "err_code", 0);
+    }
+    if ( !cJSON_AddItemToObjectCtx(json_context, resp_module, method, result) ) {
+        cJSON_DeleteCtx(json_context, result);
+    }
+
+    /* over a connection the reply is streamed, which needs no memory for the printed text whatever its size */
     int encrypted_len = 0;
-    char * json_string = malloc(buffer_len * sizeof(char));
+    TRACE_BEGIN(TRACE_CJSON_PRINT);
+    if (stream != NULL) {
+        encrypted_len = tplink_kasa_stream(response, raw_buffer, buffer_size, stream) ? 0 : -1;
+    } else {
+        encrypted_len = tplink_kasa_encrypt(json_context, response, raw_buffer, buffer_size, include_header);
+    }
+    TRACE_END(TRACE_CJSON_PRINT);
+    cJSON_DeleteCtx(json_context, response);
+    TRACE_END(TRACE_KASA_TREE_REPLY);
+    return encrypted_len;
+}
+
+int tplink_kasa_process_buffer(cJSON_Context * json_context, char * raw_buffer, const int buffer_len, const int buffer_size, const bool include_header, const tplink_kasa_stream_t * stream)
+{
+    return tplink_kasa_process_device_buffer(&this_device, json_context, raw_buffer, buffer_len, buffer_size, include_header, stream);
+}
 
-    /* decrypt the received buffer to a JSON string */
+int tplink_kasa_process_device_buffer(tplink_kasa_device_t * device, cJSON_Context * json_context, char * raw_buffer, const int buffer_len, const int buffer_size, const bool include_header, const tplink_kasa_stream_t * stream)
+{
+    /* decrypt the received buffer in place to a JSON string, the reply overwrites it later anyway */
     raw_buffer[buffer_len] = 0;
-    tplink_kasa_decrypt(raw_buffer, buffer_len, json_string, include_header);
+    char * json_string = raw_buffer;
+    TRACE_BEGIN(TRACE_KASA_DECRYPT);
+    const int json_len = tplink_kasa_decrypt(raw_buffer, buffer_len, json_string, include_header);
+    TRACE_END(TRACE_KASA_DECRYPT);
 
-    /* decode JSON message */
-    cJSON * rx_json_message = cJSON_Parse(json_string);
-    free(json_string);
+    /* drop junk (port scanners, other vendors' discovery) before looking any further, the binding relies on it */
+    cJSON_Validation validation;
+    TRACE_BEGIN(TRACE_KASA_VALIDATE);
+    const bool valid = cJSON_ValidateCtx(json_context, json_string, json_len, &validation) && validation.type == cJSON_Object;
+    TRACE_END(TRACE_KASA_VALIDATE);
+    if ( !valid ) {
+        ESP_LOGW(log_tag, "Dropping malformed request (%d bytes, error at offset %d)", json_len, (int)validation.end);
+        return 0;
+    }
 
-    if (rx_json_message == NULL) {
-        ESP_LOGE(log_tag, "Error decoding JSON message");
+    /* bind the command straight from the request text, everything needed is copied out of it */
+    kasa_command_t command;
+    TRACE_BEGIN(TRACE_KASA_BIND);
+    const bool bound = kasa_commands_parse(json_string, json_len, &command);
+    TRACE_END(TRACE_KASA_BIND);
+    if ( !bound && command.id == KASA_COMMAND_NONE ) {
+        ESP_LOGW(log_tag, "Dropping request without a known command (%d bytes)", json_len);
         return 0;
     }
 
-    /* check for system info request */
-    const cJSON * attr_system = cJSON_GetObjectItem(rx_json_message, "system");
-    if ( cJSON_HasObjectItem(attr_system, "get_sysinfo") ) {
-        ESP_LOGI(log_tag, "System information requested");
+    /* replies are written after the space for the header and encrypted in place */
+    const int header_len = include_header ? sizeof(union payload_header) : 0;
+    char * reply = raw_buffer + header_len;
+    const size_t reply_size = buffer_size - header_len;
+    int reply_len = -1;
 
-        /* generate the JSON response from the template */
-        cJSON * response_template = cJSON_Parse(tplink_kasa_sysinfo);
-        if ( response_template == NULL ) {
-            ESP_LOGE(log_tag, "Error generating system info JSON");
+    /* a missing field, or one too long for its buffer such as an oversize alias, is refused the way devices do */
+    if ( !bound ) {
+        ESP_LOGW(log_tag, "Refusing command with invalid arguments (%d bytes)", json_len);
+        reply_len = kasa_commands_write_error_reply(reply, reply_size, command.id, -3, "invalid argument");
+        if (reply_len < 0) {
+            ESP_LOGE(log_tag, "Reply does not fit in %d byte buffer", buffer_size);
             return 0;
         }
+        return tplink_kasa_encrypt_in_place(raw_buffer, reply_len, include_header);
+    }
+
+    switch (command.id) {
+        case KASA_COMMAND_SYSTEM_GET_SYSINFO: {
+            ESP_LOGI(log_tag, "System information requested");
+
+            TRACE_BEGIN(TRACE_KASA_SYSINFO);
+            reply_len = tplink_kasa_sysinfo_reply(device, reply, reply_size);
+            TRACE_END(TRACE_KASA_SYSINFO);
+            if (reply_len < 0) {
+                break;
+            }
+            return tplink_kasa_add_header(raw_buffer, reply_len, include_header);
+        }
+
+        case KASA_COMMAND_SYSTEM_SET_DEV_ALIAS: {
+            ESP_LOGI(log_tag, "Alias set to \"%s\"", command.request.system_set_dev_alias.alias);
+
+            /* the state references the alias buffer, so the hash has to be invalidated by hand */
+            xSemaphoreTake(device->lock, portMAX_DELAY);
+            strcpy(device->alias, command.request.system_set_dev_alias.alias);
+            cJSON_InvalidateHash(cJSONUtils_GetPath(device->state, alias_path));
+            tplink_kasa_sysinfo_refresh(device);
+            xSemaphoreGive(device->lock);
+
+            const kasa_system_set_dev_alias_reply_t result = { .err_code = 0 };
+            reply_len = kasa_commands_write_system_set_dev_alias_reply(reply, reply_size, &result);
+            break;
+        }
+
+        case KASA_COMMAND_EMETER_GET_DAYSTAT: {
+            ESP_LOGI(log_tag, "Energy statistics requested for %04d-%02d",
+                command.request.emeter_get_daystat.year, command.request.emeter_get_daystat.month);
+
+            /* there is no energy meter, answer the way real bulbs without one do */
+            const kasa_emeter_get_daystat_reply_t result = { .err_code = -1, .err_msg = "module not support" };
+            reply_len = kasa_commands_write_emeter_get_daystat_reply(reply, reply_size, &result);
+            break;
+        }
+
+        case KASA_COMMAND_DIAG_GET_HEAP_STATS: {
+            ESP_LOGI(log_tag, "Heap statistics requested");
+
+            /* the statistics are dynamic, so this reply is still built as a tree */
+            return tplink_kasa_tree_reply(json_context, "diag", "get_heap_stats", memstats_to_json(json_context),
+                raw_buffer, buffer_size, include_header, stream);
+        }
+
+        case KASA_COMMAND_SENSOR_GET_HISTORY: {
+            ESP_LOGI(log_tag, "Sensor history requested");
+
+            /* a day of samples is several times the largest datagram, it is only ever sent over a connection */
+            if ( !include_header ) {
+                cJSON * result = cJSON_CreateObjectCtx(json_context);
+                cJSON_AddNumberToObjectCtx(json_context, result, "err_code", -1);
+                cJSON_AddStringToObjectCtx(json_context, result, "err_msg", "only available over TCP");
+                return tplink_kasa_tree_reply(json_context, "sensor", "get_history", result,
+                    raw_buffer, buffer_size, include_header, stream);
+            }
+
+            /* the reply references the samples, so they must not move until it has been sent */
+            history_hold();
+            reply_len = tplink_kasa_tree_reply(json_context, "sensor", "get_history", history_to_json(json_context),
+                raw_buffer, buffer_size, include_header, stream);
+            history_release();
+            return reply_len;
+        }
+
+        case KASA_COMMAND_SENSOR_GET_READING: {
+            ESP_LOGI(log_tag, "Sensor reading requested");
+
+            /* the sampling task publishes its latest reading, so this never waits for the sensor */
+            sampler_reading_t reading;
+            kasa_sensor_get_reading_reply_t result = { .err_code = -1 };
+            const bool have_reading = device->sensor != NULL ? device->sensor(device, &reading) : sampler_latest(&reading);
+            if (have_reading) {
+                result.temperature = reading.temperature;
+                result.humidity = reading.humidity;
+                result.age_s = (int)((esp_timer_get_time() - reading.timestamp_us) / 1000000);
+                result.err_code = 0;
+            }
+            reply_len = kasa_commands_write_sensor_get_reading_reply(reply, reply_size, &result);
+            break;
+        }
+
+        case KASA_COMMAND_DIAG_GET_TRACE: {
+            ESP_LOGI(log_tag, "Trace requested");
 
-        const int temperature = 0;
-        const int humidity = 0;
+            /* the dump references the rings, so nothing may be recorded until it has been sent */
+            trace_pause();
+            reply_len = tplink_kasa_tree_reply(json_context, "diag", "get_trace", trace_to_json(json_context),
+                raw_buffer, buffer_size, include_header, stream);
+            trace_resume();
+            return reply_len;
+        }
 
-        cJSON * resp_system = cJSON_GetObjectItem(response_template, "system");
-        cJSON * resp_sysinfo = cJSON_GetObjectItem(resp_system, "get_sysinfo");
-        cJSON * resp_state = cJSON_GetObjectItem(resp_sysinfo, "state");
-        cJSON_AddItemToObject(resp_state, "temperature", cJSON_CreateNumber(temperature));
-        cJSON_AddItemToObject(resp_state, "humidity", cJSON_CreateNumber(humidity));
-        cJSON_AddItemToObject(resp_state, "err_code", cJSON_CreateNumber(0));
-        encrypted_len = tplink_kasa_encrypt(response_template, raw_buffer, include_header);
-        cJSON_Delete(response_template);
+        case KASA_COMMAND_DIAG_GET_BOOT_TRACE: {
+            ESP_LOGI(log_tag, "Boot trace requested");
+
+            return tplink_kasa_tree_reply(json_context, "diag", "get_boot_trace", boot_trace_to_json(json_context),
+                raw_buffer, buffer_size, include_header, stream);
+        }
+
+        case KASA_COMMAND_DIAG_GET_TASK_STATS: {
+            ESP_LOGI(log_tag, "Task statistics requested");
+
+            /* stack and heap samples, with the pipeline counters alongside */
+            cJSON * result = taskstats_to_json(json_context);
+            cJSON * pipeline = pipeline_to_json(json_context);
+            if ( !cJSON_AddItemToObjectCtx(json_context, result, "pipeline", pipeline) ) {
+                cJSON_DeleteCtx(json_context, pipeline);
+            }
+            return tplink_kasa_tree_reply(json_context, "diag", "get_task_stats", result,
+                raw_buffer, buffer_size, include_header, stream);
+        }
+
+        case KASA_COMMAND_DIAG_GET_SERVER_STATS: {
+            ESP_LOGI(log_tag, "Server statistics requested");
+
+            /* the admission, CoAP, HTTP and WebSocket counters, apart from the task statistics as together they would
+             * not fit the arena to be printed for a datagram */
+            cJSON * result = cJSON_CreateObjectCtx(json_context);
+            cJSON * ratelimit = ratelimit_to_json(json_context);
+            if ( !cJSON_AddItemToObjectCtx(json_context, result, "ratelimit", ratelimit) ) {
+                cJSON_DeleteCtx(json_context, ratelimit);
+            }
+            cJSON * coap = coap_to_json(json_context);
+            if ( !cJSON_AddItemToObjectCtx(json_context, result, "coap", coap) ) {
+                cJSON_DeleteCtx(json_context, coap);
+            }
+            cJSON * http = http_to_json(json_context);
+            if ( !cJSON_AddItemToObjectCtx(json_context, result, "http", http) ) {
+                cJSON_DeleteCtx(json_context, http);
+            }
+            cJSON * websocket = websocket_to_json(json_context);
+            if ( !cJSON_AddItemToObjectCtx(json_context, result, "websocket", websocket) ) {
+                cJSON_DeleteCtx(json_context, websocket);
+            }
+            return tplink_kasa_tree_reply(json_context, "diag", "get_server_stats", result,
+                raw_buffer, buffer_size, include_header, stream);
+        }
+
+        default:
+            break;
     }
 
-    /* tidy up */
-    cJSON_Delete(rx_json_message);
-    return encrypted_len;
+    if (reply_len < 0) {
+        ESP_LOGE(log_tag, "Reply does not fit in %d byte buffer", buffer_size);
+        return 0;
+    }
+    return tplink_kasa_encrypt_in_place(raw_buffer, reply_len, include_header);
 }
 
 int tplink_kasa_decrypt(const char * encrypted_payload, const int encrypted_len, char * decrypted_payload, const bool include_header)
@@ -138,54 +620,65 @@ int tplink_kasa_decrypt(const char * encrypted_payload, const int encrypted_len,
         header.payload_length = encrypted_len;
     }
 
+    ESP_LOGD(log_tag, "Encrypted payload (%d bytes): %s", encrypted_len, encrypted_payload);
+
     /* XOR each byte with the previous encypted byte or 171 for the first byte */
+    /* (the encrypted byte is read before the decrypted one is written, so this also works in place) */
     for (int i = 0; i < header.payload_length; i++)
     {
-        decrypted_payload[i] = encrypted_payload[i + header_len] ^ key;
-        key = encrypted_payload[i + header_len];
+        const char encrypted = encrypted_payload[i + header_len];
+        decrypted_payload[i] = encrypted ^ key;
+        key = encrypted;
     }
 
     /* stick a null on the end to terminate the string */
     decrypted_payload[header.payload_length] = '\0';
 
-    ESP_LOGD(log_tag, "Encrypted payload (%d bytes): %s", encrypted_len, encrypted_payload);
     ESP_LOGD(log_tag, "Decrypted payload (%d bytes): %s", header.payload_length, decrypted_payload);
 
     return header.payload_length;
 }
 
-int tplink_kasa_encrypt(const cJSON * json, char * encrypted_payload, const bool include_header)
+int tplink_kasa_encrypt(cJSON_Context * json_context, const cJSON * json, char * encrypted_payload, const int encrypted_size, const bool include_header)
 {
-    /* autokey cypher key value */
-    char key = cipher_key;
-
     /* convert JSON object to string and allocate on the HEAP (must free memory when finished) */
-    char * payload = cJSON_PrintUnformatted(json);
-
-    /* the first 4 bytes in the encrypted data define the length of the payload, encoded in big endian */
-    /* since ESP32 is little endian, need to swap the endianness */
-    union payload_header header;
-    header.payload_length = strlen(payload);
-    encrypted_payload[0] = header.bytes[3];
-    encrypted_payload[1] = header.bytes[2];
-    encrypted_payload[2] = header.bytes[1];
-    encrypted_payload[3] = header.bytes[0];
+    char * payload = cJSON_PrintCtx(json_context, json, false);
+    if (payload == NULL) {
+        ESP_LOGE(log_tag, "Error printing JSON reply");
+        return 0;
+    }
 
     /* header length (may or may not be present) */
-    const int header_len = include_header ? sizeof(header) : 0;
-    
-    /* XOR each byte with the previous encypted byte or 171 for the first byte */
-    for (int i = 0; i < strlen(payload); i++)
-    {
-        key = encrypted_payload[i + header_len] = payload[i] ^ key;
+    const int header_len = include_header ? sizeof(union payload_header) : 0;
+    const int payload_len = strlen(payload);
+
+    /* refuse to overrun the output buffer */
+    if (header_len + payload_len > encrypted_size) {
+        ESP_LOGE(log_tag, "Reply of %d bytes does not fit in %d byte buffer", header_len + payload_len, encrypted_size);
+        cJSON_freeCtx(json_context, payload);
+        return 0;
     }
 
-    const int encrypted_len = strlen(payload) + header_len;
+    memcpy(encrypted_payload + header_len, payload, payload_len);
+    cJSON_freeCtx(json_context, payload);
 
-    ESP_LOGD(log_tag, "Decrypted payload (%d bytes): %s", header.payload_length, payload);
-    ESP_LOGD(log_tag, "Encrypted payload (%d bytes): %s", encrypted_len, encrypted_payload);
+    return tplink_kasa_encrypt_in_place(encrypted_payload, payload_len, include_header);
+}
 
-    free(payload);
+void tplink_kasa_encrypt_buffer(uint8_t * buffer, const int length)
+{
+    uint8_t key = cipher_key;
+    for (int i = 0; i < length; i++) {
+        key = buffer[i] ^= key;
+    }
+}
 
-    return encrypted_len;
+void tplink_kasa_decrypt_buffer(uint8_t * buffer, const int length)
+{
+    uint8_t key = cipher_key;
+    for (int i = 0; i < length; i++) {
+        const uint8_t encrypted = buffer[i];
+        buffer[i] = encrypted ^ key;
+        key = encrypted;
+    }
 }
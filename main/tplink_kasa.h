@@ -7,26 +7,116 @@
 
 
 /* system includes */
+#include <stdatomic.h>
 #include <string.h>
 #include <unistd.h>
 
 /* local includes */
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "cJSON.h"
+#include "sampler.h"
 #include "wifi.h"
 
 
+/* deepest nesting accepted in a request, Kasa commands are never more than a few levels deep */
+#define TPLINK_KASA_MAX_DEPTH 8
+
+/* largest encrypted reply kept for reuse while the device state is unchanged */
+#define TPLINK_KASA_REPLY_CACHE_SIZE 1024
+
+/* size of an alias including the terminator, as bound from system.set_dev_alias */
+#define TPLINK_KASA_ALIAS_SIZE 32
+
+typedef struct tplink_kasa_device tplink_kasa_device_t;
+
+/**
+ * @brief Source of the readings a device reports
+ * @param device Device asked for a reading
+ * @param reading Output reading
+ * @return False if there is no reading yet
+ */
+typedef bool (*tplink_kasa_sensor_t)(const tplink_kasa_device_t * device, sampler_reading_t * reading);
+
+/**
+ * @brief One Kasa device: its identity, the state commands change and the cached reply to discovery
+ *
+ * Commands that change the state hold the lock and rebuild the cache before they return. The cache is published with
+ * a sequence lock, so discovery can be answered from any number of tasks or threads without taking the lock.
+ */
+struct tplink_kasa_device
+{
+    char device_id[41];
+    char mic_mac[13];
+    char alias[TPLINK_KASA_ALIAS_SIZE];
+    tplink_kasa_sensor_t sensor;        /* NULL to report the readings of the sampling task */
+    cJSON * state;                      /* what the system information reply is built from */
+    SemaphoreHandle_t lock;             /* serialises the changes to state, alias and the cache */
+    StaticSemaphore_t lock_buffer;
+    atomic_uint_least32_t sysinfo_sequence; /* odd while the cache is being rebuilt */
+    atomic_uint_least32_t * sysinfo_cache;  /* encrypted payload without header in words, empty if it does not fit */
+    atomic_int sysinfo_cache_len;
+    char * sysinfo_build;               /* where the payload is built before it is copied to the cache */
+    unsigned long sysinfo_cache_hash;   /* hash of the state the cache was built from */
+};
+
+/**
+ * @brief Connection a reply can be streamed to instead of being returned in the buffer
+ */
+typedef struct
+{
+    /* send all of data, blocking as needed, and return false if the connection failed */
+    bool (*write)(void * userdata, const char * data, size_t length);
+    void * userdata;
+} tplink_kasa_stream_t;
+
+/**
+ * @brief Set up the device state and reply cache, must be called before any buffers are processed
+ */
+void tplink_kasa_init(void);
+
 /**
- * @brief Process a received buffer of encrypted data
+ * @brief Set up a device in addition to the one tplink_kasa_init sets up (which must have been called), for hosts that
+ * emulate several
+ * @param device Device to set up
+ * @param device_id deviceId, 40 hex digits
+ * @param mic_mac mic_mac, 12 hex digits
+ * @param alias Initial alias
+ * @param sensor Source of readings, NULL for the sampling task
+ * @return False if out of memory
+ */
+bool tplink_kasa_device_init(tplink_kasa_device_t * device, const char * device_id, const char * mic_mac, const char * alias, tplink_kasa_sensor_t sensor);
+
+/**
+ * @brief Process a received buffer of encrypted data on behalf of a device
+ * @param device Device the request was sent to
+ * @param json_context cJSON context (allocator and limits) owned by the calling task
  * @param raw_buffer Buffer to decrypt, interpret and respond to
  * @param buffer_len Length of input buffer
+ * @param buffer_size Total size of raw_buffer, which the encrypted reply must fit in
  * @param include_header True if buffers contain a header
- * @return Length of encrypted reply
+ * @param stream Connection to stream large replies to (which always have a header), or NULL to reply in raw_buffer only
+ * @return Length of encrypted reply left in raw_buffer, 0 if there is none or it has already been streamed, -1 if
+ * streaming it failed
  */
-int tplink_kasa_process_buffer(char * raw_buffer, const int buffer_len, const bool include_header);
+int tplink_kasa_process_device_buffer(tplink_kasa_device_t * device, cJSON_Context * json_context, char * raw_buffer, const int buffer_len, const int buffer_size, const bool include_header, const tplink_kasa_stream_t * stream);
+
+/**
+ * @brief Process a received buffer of encrypted data on behalf of this device
+ * @param json_context cJSON context (allocator and limits) owned by the calling task
+ * @param raw_buffer Buffer to decrypt, interpret and respond to
+ * @param buffer_len Length of input buffer
+ * @param buffer_size Total size of raw_buffer, which the encrypted reply must fit in
+ * @param include_header True if buffers contain a header
+ * @param stream Connection to stream large replies to (which always have a header), or NULL to reply in raw_buffer only
+ * @return Length of encrypted reply left in raw_buffer, 0 if there is none or it has already been streamed, -1 if
+ * streaming it failed
+ */
+int tplink_kasa_process_buffer(cJSON_Context * json_context, char * raw_buffer, const int buffer_len, const int buffer_size, const bool include_header, const tplink_kasa_stream_t * stream);
 
 /**
  * @brief Decrypt using XOR Autokey Cipher with starting key of 171
- * @param encrypted_payload Input payload to decrypt
+ * @param encrypted_payload Input payload to decrypt (may be the same buffer as decrypted_payload)
  * @param encrypted_len Length of input buffer
  * @param decrypted_payload Output decrypted payload
  * @param include_header True if the encrypted payload contains a header
@@ -36,11 +126,27 @@ int tplink_kasa_decrypt(const char * encrypted_payload, const int encrypted_len,
 
 /**
  * @brief Encrypt using XOR Autokey Cipher with starting key of 171
+ * @param json_context cJSON context used to print the payload
  * @param payload Input payload to encrypt as cJSON object
  * @param encrypted_payload Output encrypted payload
+ * @param encrypted_size Size of the output buffer
  * @param include_header True to prepend the packet with a header
- * @return length of encrypted data
+ * @return length of encrypted data, or 0 if it does not fit in the output buffer
+ */
+int tplink_kasa_encrypt(cJSON_Context * json_context, const cJSON * payload, char * encypted_payload, const int encrypted_size, const bool include_header);
+
+/**
+ * @brief Encrypt binary data in place with the same XOR Autokey Cipher, without a header
+ * @param buffer Data to encrypt
+ * @param length Length of the data
+ */
+void tplink_kasa_encrypt_buffer(uint8_t * buffer, const int length);
+
+/**
+ * @brief Decrypt binary data in place that was encrypted with tplink_kasa_encrypt_buffer
+ * @param buffer Data to decrypt
+ * @param length Length of the data
  */
-int tplink_kasa_encrypt(const cJSON * payload, char * encypted_payload, const bool include_header);
+void tplink_kasa_decrypt_buffer(uint8_t * buffer, const int length);
 
 #endif
@@ -0,0 +1,205 @@
+/**
+ * @file Event tracing into per-core ring buffers, compiled in with CONFIG_TRACE_ENABLE
+ */
+
+/* system includes */
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/param.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#ifdef CONFIG_TRACE_ENABLE
+#include <esp_ipc.h>
+#include "xtensa/hal.h"
+#endif
+
+/* local includes */
+#include "taskstats.h"
+#include "trace.h"
+
+#ifdef CONFIG_TRACE_ENABLE
+
+#if (CONFIG_TRACE_BUFFER_EVENTS & (CONFIG_TRACE_BUFFER_EVENTS - 1)) != 0
+#error "CONFIG_TRACE_BUFFER_EVENTS must be a power of two"
+#endif
+
+/* a gap longer than this between two events of a core gets a sync record, so that the 32-bit cycle stamps can always
+ * be chained (they wrap after 2^32 cycles, under 18 s at 240 MHz) */
+#define TRACE_SYNC_CYCLES (1UL << 30)
+/* a sync record is also written every so many records, events older than the oldest sync left in a ring cannot be
+ * placed in time, so this bounds how many are lost when the ring wraps */
+#define TRACE_SYNC_RECORDS 32
+
+/* most distinct tasks named in a dump */
+#define TRACE_MAX_TASKS 16
+
+static const char * const event_names[TRACE_EVENT_COUNT] = {
+    "sync", "network.receive", "network.submit", "network.reply", "pipeline.process", "kasa.decrypt",
+    "kasa.validate", "kasa.bind", "kasa.sysinfo", "kasa.tree_reply", "cjson.print", "sensor.read"
+};
+
+/* one ring per core, as separate arrays of the types cJSON packs so that a dump references them as they are */
+struct trace_ring
+{
+    atomic_uint_least32_t head;     /* records ever reserved, the next goes at head % CONFIG_TRACE_BUFFER_EVENTS */
+    uint32_t last_cycles;           /* cycle stamp of the latest record, to decide when a sync is due */
+    int cycles[CONFIG_TRACE_BUFFER_EVENTS];
+    int tasks[CONFIG_TRACE_BUFFER_EVENTS];      /* task handle, or the low 32 bits of esp_timer time for a sync */
+    short events[CONFIG_TRACE_BUFFER_EVENTS];   /* event << 2 | phase */
+};
+
+/* cycle counter and esp_timer read together on one core, to place its ring in time */
+struct trace_anchor
+{
+    uint32_t cycles;
+    int64_t time_us;
+};
+
+static struct trace_ring rings[portNUM_PROCESSORS];
+static atomic_bool paused = false;
+
+
+static void write_record(struct trace_ring * ring, const uint32_t cycles, const int task, const short event)
+{
+    /* tasks on the same core (and ISRs) may interleave, reserving the position first keeps their records whole */
+    const uint32_t index = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed) & (CONFIG_TRACE_BUFFER_EVENTS - 1);
+    ring->cycles[index] = (int)cycles;
+    ring->tasks[index] = task;
+    ring->events[index] = event;
+    ring->last_cycles = cycles;
+}
+
+void trace_record(const trace_phase_t phase, const trace_event_t event)
+{
+    if (atomic_load_explicit(&paused, memory_order_relaxed)) {
+        return;
+    }
+
+    /* a task that is not pinned can move between reading the core and writing, which at worst misplaces one record */
+    struct trace_ring * ring = &rings[xPortGetCoreID()];
+    const uint32_t cycles = xthal_get_ccount();
+    const uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head % TRACE_SYNC_RECORDS == 0 || cycles - ring->last_cycles > TRACE_SYNC_CYCLES) {
+        write_record(ring, cycles, (int)(uint32_t)esp_timer_get_time(), TRACE_SYNC << 2 | TRACE_PHASE_INSTANT);
+    }
+    write_record(ring, cycles, (int)(uintptr_t)xTaskGetCurrentTaskHandle(), event << 2 | phase);
+}
+
+void trace_pause(void)
+{
+    atomic_store(&paused, true);
+}
+
+void trace_resume(void)
+{
+    atomic_store(&paused, false);
+}
+
+static void capture_anchor(void * arg)
+{
+    struct trace_anchor * anchor = arg;
+    anchor->cycles = xthal_get_ccount();
+    anchor->time_us = esp_timer_get_time();
+}
+
+static void add_tasks_to_array(cJSON_Context * json_context, cJSON * array)
+{
+    int seen[TRACE_MAX_TASKS];
+    int seen_count = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        const uint32_t count = MIN(atomic_load(&rings[core].head), CONFIG_TRACE_BUFFER_EVENTS);
+        for (uint32_t i = 0; i < count && seen_count < TRACE_MAX_TASKS; i++) {
+            const int task = rings[core].tasks[i];
+            bool known = (rings[core].events[i] >> 2) == TRACE_SYNC;
+            for (int j = 0; j < seen_count && !known; j++) {
+                known = seen[j] == task;
+            }
+            if (known) {
+                continue;
+            }
+            seen[seen_count++] = task;
+
+            /* only the tasks registered for statistics have names that are safe to read, others may have been deleted */
+            cJSON * entry = cJSON_CreateObjectCtx(json_context);
+            cJSON_AddNumberToObjectCtx(json_context, entry, "id", task);
+            const char * name = taskstats_name((TaskHandle_t)(uintptr_t)task);
+            if (name != NULL) {
+                cJSON_AddStringToObjectCtx(json_context, entry, "name", name);
+            }
+            cJSON_AddItemToArray(array, entry);
+        }
+    }
+}
+
+static void add_packed_to_object(cJSON_Context * json_context, cJSON * object, const char * name, const void * data, const int count, const int element_type)
+{
+    /* packed references: a whole ring is one node, printed straight from the ring */
+    cJSON * array = cJSON_CreatePackedArrayReferenceCtx(json_context, data, count, element_type);
+    if ( !cJSON_AddItemToObjectCtx(json_context, object, name, array) ) {
+        cJSON_DeleteCtx(json_context, array);
+    }
+}
+
+cJSON * trace_to_json(cJSON_Context * json_context)
+{
+    cJSON * dump = cJSON_CreateObjectCtx(json_context);
+    if (dump == NULL) {
+        return NULL;
+    }
+
+    cJSON_AddNumberToObjectCtx(json_context, dump, "enabled", 1);
+    cJSON_AddNumberToObjectCtx(json_context, dump, "cpu_mhz", CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+    cJSON_AddNumberToObjectCtx(json_context, dump, "capacity", CONFIG_TRACE_BUFFER_EVENTS);
+    cJSON * names = cJSON_AddArrayToObjectCtx(json_context, dump, "events");
+    for (int event = 0; event < TRACE_EVENT_COUNT && names != NULL; event++) {
+        cJSON_AddItemToArray(names, cJSON_CreateStringCtx(json_context, event_names[event]));
+    }
+    add_tasks_to_array(json_context, cJSON_AddArrayToObjectCtx(json_context, dump, "tasks"));
+
+    cJSON * cores = cJSON_AddArrayToObjectCtx(json_context, dump, "cores");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        const struct trace_ring * ring = &rings[core];
+        const uint32_t head = atomic_load(&ring->head);
+        const int count = MIN(head, CONFIG_TRACE_BUFFER_EVENTS);
+
+        /* the cycle counters of the cores are not related, so each is read on its own core */
+        struct trace_anchor anchor = { 0 };
+        esp_ipc_call_blocking(core, capture_anchor, &anchor);
+
+        cJSON * json_core = cJSON_CreateObjectCtx(json_context);
+        cJSON_AddNumberToObjectCtx(json_context, json_core, "head", head);
+        cJSON_AddNumberToObjectCtx(json_context, json_core, "anchor_cycles", anchor.cycles);
+        cJSON_AddNumberToObjectCtx(json_context, json_core, "anchor_us", (double)anchor.time_us);
+        add_packed_to_object(json_context, json_core, "cycles", ring->cycles, count, cJSON_PackedInt32);
+        add_packed_to_object(json_context, json_core, "tasks", ring->tasks, count, cJSON_PackedInt32);
+        add_packed_to_object(json_context, json_core, "events", ring->events, count, cJSON_PackedInt16);
+        cJSON_AddItemToArray(cores, json_core);
+    }
+
+    return dump;
+}
+
+#else
+
+void trace_record(const trace_phase_t phase, const trace_event_t event)
+{
+}
+
+void trace_pause(void)
+{
+}
+
+void trace_resume(void)
+{
+}
+
+cJSON * trace_to_json(cJSON_Context * json_context)
+{
+    cJSON * dump = cJSON_CreateObjectCtx(json_context);
+    cJSON_AddNumberToObjectCtx(json_context, dump, "enabled", 0);
+    return dump;
+}
+
+#endif
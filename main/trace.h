@@ -0,0 +1,80 @@
+/**
+ * @file Event tracing into per-core ring buffers, compiled in with CONFIG_TRACE_ENABLE
+ *
+ * Events are begin/end pairs and instants stamped with the 32-bit cycle counter of the core they happen on. Each core
+ * writes its own ring and keeps the latest CONFIG_TRACE_BUFFER_EVENTS events. diag.get_trace dumps the rings and
+ * tools/trace2chrome.py turns the dump into a Chrome/Perfetto trace.
+ */
+
+#ifndef INTELLILIGHT_TRACE_H
+#define INTELLILIGHT_TRACE_H
+
+/* local includes */
+#include "cJSON.h"
+
+
+/**
+ * @brief Traced events, the names in trace.c must be kept in the same order
+ */
+typedef enum
+{
+    TRACE_SYNC = 0,             /* written by the tracer itself, carries the esp_timer time */
+    TRACE_NETWORK_RECEIVE,
+    TRACE_NETWORK_SUBMIT,
+    TRACE_NETWORK_REPLY,
+    TRACE_PIPELINE_PROCESS,
+    TRACE_KASA_DECRYPT,
+    TRACE_KASA_VALIDATE,
+    TRACE_KASA_BIND,
+    TRACE_KASA_SYSINFO,
+    TRACE_KASA_TREE_REPLY,
+    TRACE_CJSON_PRINT,
+    TRACE_SENSOR_READ,
+    TRACE_EVENT_COUNT
+} trace_event_t;
+
+/**
+ * @brief Kind of record
+ */
+typedef enum
+{
+    TRACE_PHASE_BEGIN = 0,
+    TRACE_PHASE_END,
+    TRACE_PHASE_INSTANT
+} trace_phase_t;
+
+#ifdef CONFIG_TRACE_ENABLE
+#define TRACE_BEGIN(event) trace_record(TRACE_PHASE_BEGIN, (event))
+#define TRACE_END(event) trace_record(TRACE_PHASE_END, (event))
+#define TRACE_INSTANT(event) trace_record(TRACE_PHASE_INSTANT, (event))
+#else
+#define TRACE_BEGIN(event) do { } while (0)
+#define TRACE_END(event) do { } while (0)
+#define TRACE_INSTANT(event) do { } while (0)
+#endif
+
+/**
+ * @brief Record an event on the ring of the current core, use the TRACE_ macros instead (any task, any core)
+ * @param phase Kind of record
+ * @param event Event
+ */
+extern void trace_record(const trace_phase_t phase, const trace_event_t event);
+
+/**
+ * @brief Stop recording so that the rings can be dumped, they are referenced by the dump rather than copied
+ */
+extern void trace_pause(void);
+
+/**
+ * @brief Record again after a dump
+ */
+extern void trace_resume(void);
+
+/**
+ * @brief Render the rings as JSON, tracing must be paused until the result has been printed
+ * @param json_context cJSON context to allocate the result from
+ * @return New cJSON object that the caller must delete with the same context
+ */
+extern cJSON * trace_to_json(cJSON_Context * json_context);
+
+#endif
@@ -0,0 +1,411 @@
+/**
+ * @file WebSocket (RFC 6455) stream of the readings, upgraded from the HTTP server at /ws
+ */
+
+/* system includes */
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "mbedtls/base64.h"
+#include "mbedtls/sha1.h"
+
+/* local includes */
+#include "spsc_queue.h"
+#include "websocket.h"
+#include "wifi.h"
+
+/* a reading frame, its payload is under 126 bytes so that the two byte header needs no extended length */
+#define WEBSOCKET_FRAME_SIZE 96
+/* frames from the sampler that the network task has not taken yet, a power of two */
+#define WEBSOCKET_PUBLISH_CAPACITY 8
+/* bytes that must go out before the next reading frame: the rest of a partly sent one and the control frames */
+#define WEBSOCKET_PENDING_SIZE 256
+/* the largest frame a subscriber may send, a control frame with its header, mask and 125 byte payload */
+#define WEBSOCKET_RECEIVE_SIZE (2 + 4 + 125)
+
+#define WEBSOCKET_FIN 0x80
+#define WEBSOCKET_RESERVED 0x70
+#define WEBSOCKET_MASKED 0x80
+#define OPCODE_TEXT 0x1
+#define OPCODE_CLOSE 0x8
+#define OPCODE_PING 0x9
+#define OPCODE_PONG 0xA
+
+/* close status codes */
+#define CLOSE_PROTOCOL_ERROR 1002
+#define CLOSE_UNSUPPORTED_DATA 1003
+
+static const char *log_tag = "websocket";
+static const char *handshake_guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+struct frame
+{
+    uint8_t length;
+    uint8_t data[WEBSOCKET_FRAME_SIZE];
+};
+
+struct subscriber
+{
+    bool used;
+    bool blocked;           /* the last send found the socket buffer full, wait until it is writable */
+    bool closing;           /* a close frame is pending, the connection is closed once it has been sent */
+    int socket;
+    uint32_t next;          /* sequence of the next frame of the ring to send */
+    int64_t heard_us;       /* esp_timer time a frame was last received */
+    int64_t pinged_us;      /* esp_timer time of the unanswered ping, 0 if there is none */
+    int pending_length;
+    int received_length;
+    uint8_t pending[WEBSOCKET_PENDING_SIZE];
+    uint8_t received[WEBSOCKET_RECEIVE_SIZE];
+    struct sockaddr_storage source_addr;
+};
+
+struct websocket_stats
+{
+    uint32_t published;     /* frames rendered, written by the sampler task */
+    uint32_t overrun;       /* frames the network task did not take in time, written by the sampler task */
+    uint32_t subscribed;
+    uint32_t sent;          /* frames sent, counted once per subscriber */
+    uint32_t dropped;       /* frames skipped for subscribers that could not keep up */
+    uint32_t pings;
+    uint32_t timed_out;     /* subscribers dropped for not answering a ping */
+    uint32_t closed;
+};
+
+static struct frame publish_storage[WEBSOCKET_PUBLISH_CAPACITY];
+static spsc_queue_t publish_queue;  /* sampler task -> network task */
+
+/* the last frames, frame n being at n % CONFIG_WEBSOCKET_QUEUE_FRAMES */
+static struct frame ring[CONFIG_WEBSOCKET_QUEUE_FRAMES];
+static uint32_t ring_sequence = 0;  /* frames put in the ring so far */
+
+static struct subscriber subscribers[CONFIG_WEBSOCKET_SUBSCRIBERS];
+/* counters are read by other tasks without a lock: slightly inconsistent but never wrong for long */
+static struct websocket_stats stats;
+
+
+void websocket_init(void)
+{
+    spsc_queue_init(&publish_queue, publish_storage, sizeof(publish_storage[0]), WEBSOCKET_PUBLISH_CAPACITY);
+}
+
+void websocket_accept_key(const char * key, char * accept)
+{
+    char text[96];
+    uint8_t digest[20];
+    size_t length;
+    const int text_length = snprintf(text, sizeof(text), "%s%s", key, handshake_guid);
+    mbedtls_sha1_ret((const unsigned char *)text, MIN(text_length, sizeof(text) - 1), digest);
+    mbedtls_base64_encode((unsigned char *)accept, WEBSOCKET_ACCEPT_SIZE, &length, digest, sizeof(digest));
+}
+
+void websocket_publish(const sampler_reading_t * reading)
+{
+    struct frame frame;
+    char * payload = (char *)&frame.data[2];
+    const int size = sizeof(frame.data) - 2;
+    const float temperature = reading->temperature;
+    int length = snprintf(payload, size, "{\"n\":%u,\"up\":%lld,\"t\":%.1f,\"h\":%.1f", (unsigned)reading->count,
+        (long long)(reading->timestamp_us / 1000000), temperature, reading->humidity);
+#ifdef CONFIG_WEBSOCKET_DERIVED
+    /* Magnus formula for the saturation vapour pressure in hPa, good to 0.1 *C of dew point from -40 to 50 *C */
+    const float magnus = 17.62f * temperature / (243.12f + temperature);
+    const float gamma = logf(MAX(reading->humidity, 0.1f) / 100.0f) + magnus;
+    const float dew_point = 243.12f * gamma / (17.62f - gamma);
+    const float vapour_pressure = reading->humidity / 100.0f * 6.112f * expf(magnus);
+    const float absolute_humidity = 216.7f * vapour_pressure / (273.15f + temperature);
+    length += snprintf(payload + length, size - length, ",\"dp\":%.1f,\"ah\":%.2f", dew_point, absolute_humidity);
+#endif
+    length += snprintf(payload + length, size - length, "}");
+    frame.data[0] = WEBSOCKET_FIN | OPCODE_TEXT;
+    frame.data[1] = length;
+    frame.length = length + 2;
+
+    /* the frame is only ever lost when the network task is not running, there is nobody to send it to then */
+    if (!spsc_queue_push(&publish_queue, &frame)) {
+        stats.overrun++;
+        return;
+    }
+    stats.published++;
+    wifi_wake_network();
+}
+
+bool websocket_full(void)
+{
+    for (int i = 0; i < CONFIG_WEBSOCKET_SUBSCRIBERS; i++) {
+        if (!subscribers[i].used) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void drop(struct subscriber * subscriber)
+{
+    shutdown(subscriber->socket, 0);
+    close(subscriber->socket);
+    subscriber->used = false;
+    stats.closed++;
+}
+
+/**
+ * @brief Queue a control frame to go out before the next reading frame
+ * @return False if the subscriber has not taken enough of what it was sent to make room for it
+ */
+static bool queue_control(struct subscriber * subscriber, const uint8_t opcode, const uint8_t * payload,
+        const uint8_t length)
+{
+    if (subscriber->pending_length + 2 + length > WEBSOCKET_PENDING_SIZE) {
+        return false;
+    }
+    uint8_t * frame = &subscriber->pending[subscriber->pending_length];
+    frame[0] = WEBSOCKET_FIN | opcode;
+    frame[1] = length;
+    if (length > 0) {
+        memcpy(&frame[2], payload, length);
+    }
+    subscriber->pending_length += 2 + length;
+    return true;
+}
+
+/* close the connection after a close frame with the status, what the subscriber sends meanwhile is ignored */
+static bool fail(struct subscriber * subscriber, const uint16_t status)
+{
+    const uint8_t payload[] = { status >> 8, status & 0xff };
+    ESP_LOGW(log_tag, "Closing subscriber with status %u", status);
+    subscriber->closing = true;
+    subscriber->received_length = 0;
+    return queue_control(subscriber, OPCODE_CLOSE, payload, sizeof(payload));
+}
+
+/**
+ * @brief Send the pending bytes and the frames of the ring the subscriber has not been sent, until the socket is full
+ * @return False if the connection has to be dropped
+ */
+static bool flush(struct subscriber * subscriber)
+{
+    while (true) {
+        const uint8_t * data;
+        int length;
+        bool from_ring = false;
+        if (subscriber->pending_length > 0) {
+            data = subscriber->pending;
+            length = subscriber->pending_length;
+        } else if (subscriber->closing) {
+            /* the close frame is out */
+            return false;
+        } else if (subscriber->next == ring_sequence) {
+            return true;
+        } else {
+            /* a subscriber more than the ring behind skips its oldest frames, the ring has overwritten them */
+            if (ring_sequence - subscriber->next > CONFIG_WEBSOCKET_QUEUE_FRAMES) {
+                stats.dropped += ring_sequence - CONFIG_WEBSOCKET_QUEUE_FRAMES - subscriber->next;
+                subscriber->next = ring_sequence - CONFIG_WEBSOCKET_QUEUE_FRAMES;
+            }
+            const struct frame * frame = &ring[subscriber->next % CONFIG_WEBSOCKET_QUEUE_FRAMES];
+            data = frame->data;
+            length = frame->length;
+            from_ring = true;
+        }
+
+        const int written = send(subscriber->socket, data, length, 0);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                subscriber->blocked = true;
+                return true;
+            }
+            return false;
+        }
+        if (from_ring) {
+            /* the rest of a frame has to follow it before anything else, and the ring may move on meanwhile */
+            memcpy(subscriber->pending, data + written, length - written);
+            subscriber->pending_length = length - written;
+            subscriber->next++;
+            stats.sent++;
+        } else {
+            memmove(subscriber->pending, subscriber->pending + written, subscriber->pending_length - written);
+            subscriber->pending_length -= written;
+        }
+    }
+}
+
+/**
+ * @brief Receive and answer the frames of a subscriber, only control frames are expected
+ * @return False if the connection has to be dropped
+ */
+static bool receive(struct subscriber * subscriber, const int64_t now)
+{
+    uint8_t * buffer = subscriber->received;
+    const int rx_len = recv(subscriber->socket, buffer + subscriber->received_length,
+        WEBSOCKET_RECEIVE_SIZE - subscriber->received_length, 0);
+    if (rx_len < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    } else if (rx_len == 0) {
+        return false;
+    }
+    subscriber->heard_us = now;
+    if (subscriber->closing) {
+        return true;
+    }
+    subscriber->received_length += rx_len;
+
+    while (subscriber->received_length >= 2) {
+        const uint8_t opcode = buffer[0] & 0x0f;
+        const uint8_t length = buffer[1] & 0x7f;
+        if ((buffer[1] & WEBSOCKET_MASKED) == 0 || (buffer[0] & WEBSOCKET_RESERVED) != 0) {
+            return fail(subscriber, CLOSE_PROTOCOL_ERROR);
+        }
+        if (opcode < OPCODE_CLOSE) {
+            return fail(subscriber, CLOSE_UNSUPPORTED_DATA);
+        }
+        if ((buffer[0] & WEBSOCKET_FIN) == 0 || length > 125 || opcode > OPCODE_PONG) {
+            return fail(subscriber, CLOSE_PROTOCOL_ERROR);
+        }
+        if (subscriber->received_length < 6 + length) {
+            break;
+        }
+
+        uint8_t * payload = &buffer[6];
+        for (int i = 0; i < length; i++) {
+            payload[i] ^= buffer[2 + i % 4];
+        }
+        if (opcode == OPCODE_PING) {
+            if (!queue_control(subscriber, OPCODE_PONG, payload, length)) {
+                return false;
+            }
+        } else if (opcode == OPCODE_PONG) {
+            subscriber->pinged_us = 0;
+        } else {
+            /* the closing handshake echoes the status, the connection is closed once the echo is out */
+            subscriber->closing = true;
+            subscriber->received_length = 0;
+            return queue_control(subscriber, OPCODE_CLOSE, payload, MIN(length, 2));
+        }
+
+        subscriber->received_length -= 6 + length;
+        memmove(buffer, buffer + 6 + length, subscriber->received_length);
+    }
+    return true;
+}
+
+void websocket_subscribe(const int socket, const struct sockaddr_storage * source_addr)
+{
+    for (int i = 0; i < CONFIG_WEBSOCKET_SUBSCRIBERS; i++) {
+        struct subscriber * subscriber = &subscribers[i];
+        if (subscriber->used) {
+            continue;
+        }
+        subscriber->used = true;
+        subscriber->blocked = false;
+        subscriber->closing = false;
+        subscriber->socket = socket;
+        subscriber->source_addr = *source_addr;
+        /* starting with the latest reading */
+        subscriber->next = ring_sequence > 0 ? ring_sequence - 1 : 0;
+        subscriber->heard_us = esp_timer_get_time();
+        subscriber->pinged_us = 0;
+        subscriber->pending_length = 0;
+        subscriber->received_length = 0;
+        stats.subscribed++;
+        ESP_LOGI(log_tag, "Subscriber %d connected", i);
+        if (!flush(subscriber)) {
+            drop(subscriber);
+        }
+        return;
+    }
+    close(socket);
+}
+
+int websocket_prepare(fd_set * readable, fd_set * writable, int max_fd)
+{
+    for (int i = 0; i < CONFIG_WEBSOCKET_SUBSCRIBERS; i++) {
+        if (!subscribers[i].used) {
+            continue;
+        }
+        FD_SET(subscribers[i].socket, readable);
+        if (subscribers[i].blocked) {
+            FD_SET(subscribers[i].socket, writable);
+        }
+        max_fd = MAX(max_fd, subscribers[i].socket);
+    }
+    return max_fd;
+}
+
+void websocket_service(const fd_set * readable, const fd_set * writable)
+{
+    /* the new frames overwrite the oldest of the ring, a partly sent frame has been copied out of it */
+    while (spsc_queue_pop(&publish_queue, &ring[ring_sequence % CONFIG_WEBSOCKET_QUEUE_FRAMES])) {
+        ring_sequence++;
+    }
+
+    const int64_t now = esp_timer_get_time();
+    for (int i = 0; i < CONFIG_WEBSOCKET_SUBSCRIBERS; i++) {
+        struct subscriber * subscriber = &subscribers[i];
+        if (!subscriber->used) {
+            continue;
+        }
+        bool alive = true;
+        if (FD_ISSET(subscriber->socket, readable)) {
+            alive = receive(subscriber, now);
+        }
+        if (subscriber->blocked && FD_ISSET(subscriber->socket, writable)) {
+            subscriber->blocked = false;
+        }
+
+        /* a subscriber is pinged once it has been quiet for the interval, then has as long again to answer */
+        if (alive && !subscriber->closing) {
+            if (subscriber->pinged_us != 0 && now - subscriber->pinged_us > WEBSOCKET_PING_INTERVAL_S * 1000000LL) {
+                ESP_LOGI(log_tag, "Subscriber %d did not answer the ping", i);
+                stats.timed_out++;
+                alive = false;
+            } else if (subscriber->pinged_us == 0 && now - subscriber->heard_us > WEBSOCKET_PING_INTERVAL_S * 1000000LL) {
+                alive = queue_control(subscriber, OPCODE_PING, NULL, 0);
+                subscriber->pinged_us = now;
+                stats.pings++;
+            }
+        }
+
+        if (alive && !subscriber->blocked) {
+            alive = flush(subscriber);
+        }
+        if (!alive) {
+            ESP_LOGI(log_tag, "Subscriber %d disconnected", i);
+            drop(subscriber);
+        }
+    }
+}
+
+void websocket_close_all(void)
+{
+    for (int i = 0; i < CONFIG_WEBSOCKET_SUBSCRIBERS; i++) {
+        if (subscribers[i].used) {
+            drop(&subscribers[i]);
+        }
+    }
+}
+
+cJSON * websocket_to_json(cJSON_Context * json_context)
+{
+    int connected = 0;
+    for (int i = 0; i < CONFIG_WEBSOCKET_SUBSCRIBERS; i++) {
+        connected += subscribers[i].used;
+    }
+
+    const struct websocket_stats copy = stats;
+    cJSON * json = cJSON_CreateObjectCtx(json_context);
+    cJSON_AddNumberToObjectCtx(json_context, json, "subscribers", connected);
+    cJSON_AddNumberToObjectCtx(json_context, json, "subscribed", copy.subscribed);
+    cJSON_AddNumberToObjectCtx(json_context, json, "closed", copy.closed);
+    cJSON_AddNumberToObjectCtx(json_context, json, "timed_out", copy.timed_out);
+    cJSON_AddNumberToObjectCtx(json_context, json, "published", copy.published);
+    cJSON_AddNumberToObjectCtx(json_context, json, "overrun", copy.overrun);
+    cJSON_AddNumberToObjectCtx(json_context, json, "sent", copy.sent);
+    cJSON_AddNumberToObjectCtx(json_context, json, "dropped", copy.dropped);
+    cJSON_AddNumberToObjectCtx(json_context, json, "pings", copy.pings);
+    return json;
+}
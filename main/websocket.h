@@ -0,0 +1,96 @@
+/**
+ * @file WebSocket (RFC 6455) stream of the readings, upgraded from the HTTP server at /ws
+ *
+ * Every reading is sent to every subscriber as one text frame,
+ *   {"n":7,"up":420,"t":21.3,"h":44.8,"dp":8.7,"ah":8.24}
+ * reading count, uptime of the reading in seconds, temperature in *C and relative humidity in %, followed with
+ * CONFIG_WEBSOCKET_DERIVED by the dew point in *C and the absolute humidity in g/m3. A subscriber is sent the latest
+ * reading as soon as it connects.
+ *
+ * The frame is rendered once on the sampler task and handed to the network task, which keeps the last
+ * CONFIG_WEBSOCKET_QUEUE_FRAMES in a ring shared by all subscribers. A subscriber's send queue is its position in that
+ * ring: one that cannot keep up skips the oldest frames it has not been sent yet and never holds back the others. A
+ * subscriber that has sent nothing for WEBSOCKET_PING_INTERVAL_S is pinged, and dropped if the pong does not come
+ * within as long again. The stream is one way, a data frame from a subscriber closes the connection.
+ *
+ *   websocat ws://192.168.1.20/ws
+ */
+
+#ifndef INTELLILIGHT_WEBSOCKET_H
+#define INTELLILIGHT_WEBSOCKET_H
+
+/* system includes */
+#include <stdbool.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+/* local includes */
+#include "cJSON.h"
+#include "sampler.h"
+
+
+/* a quiet subscriber is pinged this often, and dropped if it does not answer in as long */
+#define WEBSOCKET_PING_INTERVAL_S 30
+/* Sec-WebSocket-Accept, base64 of a SHA-1 digest and its terminator */
+#define WEBSOCKET_ACCEPT_SIZE 29
+
+/**
+ * @brief Set up the queue of frames from the sampler, must be called before the sampler starts
+ */
+extern void websocket_init(void);
+
+/**
+ * @brief Compute the Sec-WebSocket-Accept of a handshake (any task)
+ * @param key Sec-WebSocket-Key of the request
+ * @param accept Output, WEBSOCKET_ACCEPT_SIZE bytes
+ */
+extern void websocket_accept_key(const char * key, char * accept);
+
+/**
+ * @brief Render a reading into a frame for the subscribers (sampler task)
+ * @param reading Reading just taken
+ */
+extern void websocket_publish(const sampler_reading_t * reading);
+
+/**
+ * @brief Check whether another subscriber can be taken (network task only)
+ * @return False if they are all taken
+ */
+extern bool websocket_full(void);
+
+/**
+ * @brief Take over a connection whose upgrade has been answered (network task only)
+ * @param socket Non-blocking connection, closed by the WebSocket server from now on
+ * @param source_addr Address of the subscriber
+ */
+extern void websocket_subscribe(const int socket, const struct sockaddr_storage * source_addr);
+
+/**
+ * @brief Add the subscriber connections to the sets to wait on (network task only)
+ * @param readable Connections that can have frames to receive
+ * @param writable Connections that are waiting for room to send
+ * @param max_fd Highest descriptor in the sets so far
+ * @return Highest descriptor in the sets
+ */
+extern int websocket_prepare(fd_set * readable, fd_set * writable, int max_fd);
+
+/**
+ * @brief Fan out the new frames, answer the subscribers and ping the quiet ones (network task only)
+ * @param readable Connections that select found readable
+ * @param writable Connections that select found writable
+ */
+extern void websocket_service(const fd_set * readable, const fd_set * writable);
+
+/**
+ * @brief Close every subscriber connection, when the servers stop (network task only)
+ */
+extern void websocket_close_all(void);
+
+/**
+ * @brief Build the WebSocket counters for diag.get_server_stats
+ * @param json_context cJSON context to create the object with
+ * @return Object with the counters and the subscribers connected
+ */
+extern cJSON * websocket_to_json(cJSON_Context * json_context);
+
+#endif
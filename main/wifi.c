@@ -9,16 +9,28 @@
 #include <errno.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <sys/param.h>
+#include <sys/select.h>
 #include "esp_netif.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/task.h"
 #include "esp_wifi.h"
 #include "esp_log.h"
 #include "esp_event.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "nvs_flash.h"
 
 /* local includes */
-#include "tplink_kasa.h"
+#include "boot_trace.h"
+#include "coap.h"
+#include "http.h"
+#include "pipeline.h"
+#include "ratelimit.h"
+#include "taskstats.h"
+#include "trace.h"
+#include "websocket.h"
 #include "wifi.h"
 
 /* constants */
@@ -26,18 +38,141 @@ static const char *log_tag = "wifi";
 static const uint32_t port = 9999;
 static const uint8_t mac_address[] = {0xC0, 0xC9, 0xE3, 0xAD, 0x7C, 0x1D};
 
-/* flag to indicate that server threads are running */
-static bool server_running = false;
+/* network task runs on the core that also runs the WiFi driver and lwIP */
+#define NETWORK_CORE 0
+/* an accepted connection that sends nothing for this long is closed to free its slot */
+#define CONNECTION_RECEIVE_TIMEOUT_MS 5000
 
-/* handles to server threads */
-TaskHandle_t handle_tcp_server = NULL;
-TaskHandle_t handle_udp_server = NULL;
+/* flag to indicate that the servers should be running */
+static volatile bool server_running = false;
+
+/* network task, created on the first start and kept for ever */
+static TaskHandle_t handle_network = NULL;
+static StackType_t network_stack[CONFIG_NETWORK_TASK_STACK_SIZE];
+static StaticTask_t network_tcb;
+
+/* loopback socket the processing task sends to when a reply is ready */
+static int wake_socket = -1;
+static struct sockaddr_in wake_addr;
+
+/* what the network task knows about each pipeline slot */
+enum slot_status
+{
+    SLOT_FREE = 0,
+    SLOT_RECEIVING,     /* TCP connection accepted, waiting for its request */
+    SLOT_PROCESSING,    /* request submitted, the slot belongs to the processing task */
+};
+
+struct slot_state
+{
+    enum slot_status state;
+    bool tcp;
+    int http;               /* HTTP connection the request is received from, -1 for Kasa requests */
+    int received;           /* length of the HTTP request received so far */
+    int connection;
+    int64_t accepted_us;
+    struct sockaddr_storage source_addr;
+};
+
+static struct slot_state slots[CONFIG_KASA_REQUEST_SLOTS];
+
+/* HTTP connections stay open between requests, they only take a slot while a request is received and answered */
+enum http_connection_status
+{
+    HTTP_FREE = 0,
+    HTTP_IDLE,          /* waiting for the next request */
+    HTTP_BUSY,          /* request held in a slot */
+};
+
+struct http_connection
+{
+    enum http_connection_status state;
+    int socket;
+    int64_t active_us;  /* esp_timer time of the last reply, for the keep-alive timeout */
+    struct sockaddr_storage source_addr;
+};
+
+static struct http_connection http_connections[CONFIG_HTTP_CONNECTIONS];
+
+/* servers start once the application is initialised and the network is up, whichever happens last */
+#define READY_APPLICATION 1
+#define READY_NETWORK 2
+#define READY_ALL (READY_APPLICATION | READY_NETWORK)
+static portMUX_TYPE ready_lock = portMUX_INITIALIZER_UNLOCKED;
+static int ready = 0;
+
+/* access point the station last associated with, kept in NVS so that the next boot connects without a full scan */
+struct fast_connect
+{
+    uint8_t bssid[6];
+    uint8_t channel;
+};
+static const char *nvs_namespace = "wifi";
+static const char *nvs_key_fast_connect = "fast_connect";
+static struct fast_connect fast_connect_hint;
+/* the hint is in the station configuration and has not led to a connection yet */
+static bool fast_connect_pending = false;
 
 /**
  * @brief Start TCP/UDP servers on port 9999
  */
 void start_servers(void);
 
+static void set_ready(const int bit)
+{
+    portENTER_CRITICAL(&ready_lock);
+    const bool start = ready != READY_ALL && (ready | bit) == READY_ALL;
+    ready |= bit;
+    portEXIT_CRITICAL(&ready_lock);
+
+    if (start) {
+        start_servers();
+    }
+}
+
+static void clear_ready(const int bit)
+{
+    portENTER_CRITICAL(&ready_lock);
+    ready &= ~bit;
+    portEXIT_CRITICAL(&ready_lock);
+}
+
+void wifi_application_ready(void)
+{
+    set_ready(READY_APPLICATION);
+}
+
+static bool load_fast_connect(struct fast_connect * hint)
+{
+    nvs_handle_t handle;
+    size_t length = sizeof(*hint);
+    if (nvs_open(nvs_namespace, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    const esp_err_t err = nvs_get_blob(handle, nvs_key_fast_connect, hint, &length);
+    nvs_close(handle);
+    return err == ESP_OK && length == sizeof(*hint);
+}
+
+/**
+ * @brief Save the access point to connect to on the next boot
+ * @param hint Access point, or NULL to forget it
+ */
+static void store_fast_connect(const struct fast_connect * hint)
+{
+    nvs_handle_t handle;
+    if (nvs_open(nvs_namespace, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (hint != NULL) {
+        nvs_set_blob(handle, nvs_key_fast_connect, hint, sizeof(*hint));
+    } else {
+        nvs_erase_key(handle, nvs_key_fast_connect);
+    }
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
 static void event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
     ESP_LOGI(log_tag, "event ID %d", event_id);
@@ -54,16 +189,43 @@ static void event_handler(void* arg, esp_event_base_t event_base, int32_t event_
         // 3) re-create them if necessary
         ESP_LOGE(log_tag, "WiFi disconnected, reconnecting...");
         server_running = false;
-        vTaskDelay(1000 / portTICK_RATE_MS);
+        clear_ready(READY_NETWORK);
+        if (fast_connect_pending) {
+            // the access point of the last boot could not be joined, forget it and scan like a first boot
+            ESP_LOGW(log_tag, "Remembered access point unavailable, scanning");
+            fast_connect_pending = false;
+            memset(&fast_connect_hint, 0, sizeof(fast_connect_hint));
+            store_fast_connect(NULL);
+            wifi_config_t wifi_config;
+            esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+            wifi_config.sta.bssid_set = false;
+            wifi_config.sta.channel = 0;
+            esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+        } else {
+            vTaskDelay(1000 / portTICK_RATE_MS);
+        }
         esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        // associated with the access point, remember it for the next boot (only writing flash when it changed)
+        wifi_event_sta_connected_t* event = (wifi_event_sta_connected_t*) event_data;
+        boot_trace_mark(BOOT_WIFI_CONNECTED);
+        fast_connect_pending = false;
+        struct fast_connect hint;
+        memcpy(hint.bssid, event->bssid, sizeof(hint.bssid));
+        hint.channel = event->channel;
+        if (memcmp(&hint, &fast_connect_hint, sizeof(hint)) != 0) {
+            fast_connect_hint = hint;
+            store_fast_connect(&hint);
+        }
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         // ESP has successfully connected to the configured wifi access point
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-        start_servers();
+        boot_trace_mark(BOOT_GOT_IP);
+        set_ready(READY_NETWORK);
         ESP_LOGI(log_tag, "ESP acquired IP address:" IPSTR, IP2STR(&event->ip_info.ip));
     } else if (event_id == WIFI_EVENT_AP_STACONNECTED) {
         // a wifi device has connected to the access point of the ESP
-        start_servers();
+        set_ready(READY_NETWORK);
         wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
         ESP_LOGI(log_tag, "station "MACSTR" join, AID=%d", MAC2STR(event->mac), event->aid);
     }
@@ -83,11 +245,14 @@ static esp_err_t configure_nvs_flash(void)
 void wifi_setup(bool access_point)
 {
     ESP_ERROR_CHECK(configure_nvs_flash());
+    boot_trace_mark(BOOT_NVS);
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
+    boot_trace_mark(BOOT_NETIF);
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    boot_trace_mark(BOOT_WIFI_INIT);
 
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL, NULL));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, NULL));
@@ -127,158 +292,565 @@ void wifi_setup(bool access_point)
             },
         };
 
+        /* go straight to the access point of the last boot if it is known, a failure falls back to scanning */
+        if (load_fast_connect(&fast_connect_hint)) {
+            memcpy(wifi_config.sta.bssid, fast_connect_hint.bssid, sizeof(fast_connect_hint.bssid));
+            wifi_config.sta.bssid_set = true;
+            wifi_config.sta.channel = fast_connect_hint.channel;
+            fast_connect_pending = true;
+        }
+
         ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
         ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
         ESP_ERROR_CHECK(esp_wifi_set_mac(WIFI_IF_STA, &mac_address[0]));
     }
     
     ESP_ERROR_CHECK(esp_wifi_start());
+    boot_trace_mark(BOOT_WIFI_START);
 }
 
-static void server_task(void *pvParameters)
+bool wifi_send_all(int connection, const char * data, size_t length)
+{
+    while (length > 0) {
+        int written = send(connection, data, length, 0);
+        if (written < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ESP_LOGE(log_tag, "Error occurred during TCP send: errno %d", errno);
+                return false;
+            }
+
+            /* the send buffer is full, wait for the client to acknowledge some of it rather than spinning */
+            fd_set writable;
+            FD_ZERO(&writable);
+            FD_SET(connection, &writable);
+            struct timeval timeout;
+            timeout.tv_sec = CONFIG_KASA_SEND_TIMEOUT_MS / 1000;
+            timeout.tv_usec = (CONFIG_KASA_SEND_TIMEOUT_MS % 1000) * 1000;
+            if (select(connection + 1, NULL, &writable, NULL, &timeout) <= 0) {
+                ESP_LOGE(log_tag, "Client stopped receiving, dropping reply with %u bytes unsent", (unsigned)length);
+                return false;
+            }
+            continue;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+const uint8_t * wifi_mac_address(void)
+{
+    return mac_address;
+}
+
+void wifi_wake_network(void)
+{
+    /* the datagram only needs to arrive, its content is discarded */
+    const char wake = 0;
+    if (wake_socket >= 0) {
+        sendto(wake_socket, &wake, sizeof(wake), 0, (struct sockaddr *)&wake_addr, sizeof(wake_addr));
+    }
+}
+
+/**
+ * @brief Create the loopback UDP socket that the processing task uses to wake the network task out of select()
+ * @return False if it could not be created
+ */
+static bool create_wake_socket(void)
+{
+    socklen_t addr_len = sizeof(wake_addr);
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        return false;
+    }
+    memset(&wake_addr, 0, sizeof(wake_addr));
+    wake_addr.sin_family = AF_INET;
+    wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    wake_addr.sin_port = 0;
+    if (bind(sock, (struct sockaddr *)&wake_addr, sizeof(wake_addr)) != 0 ||
+        getsockname(sock, (struct sockaddr *)&wake_addr, &addr_len) != 0) {
+        close(sock);
+        return false;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    wake_socket = sock;
+    return true;
+}
+
+static int open_server_socket(const int socket_type, const uint16_t port)
 {
-    char addr_str[128];
-    const int socket_type = (int)pvParameters;
-    const bool is_tcp_server = socket_type == SOCK_STREAM;
-    const bool is_udp_server = socket_type == SOCK_DGRAM;
-    struct sockaddr_storage source_addr;
-    socklen_t addr_len = sizeof(source_addr);
     struct sockaddr_storage dest_addr;
     struct sockaddr_in *dest_addr_ip4 = (struct sockaddr_in *)&dest_addr;
+    memset(&dest_addr, 0, sizeof(dest_addr));
     dest_addr_ip4->sin_addr.s_addr = htonl(INADDR_ANY);
     dest_addr_ip4->sin_family = AF_INET;
     dest_addr_ip4->sin_port = htons(port);
 
-    /* TCP timeout settings */
-    int keepAlive = 1;
-    int keepIdle = 5;
-    int keepInterval = 5;
-    int keepCount = 3;
-
-    /* allocate receive buffer */
-    const int buffer_len = 2000;
-    char * raw_buffer = malloc(buffer_len * sizeof(char));
-
     /* create TCP/UDP socket */
     int my_sock = socket(AF_INET, socket_type, IPPROTO_IP);
     if (my_sock < 0) {
         ESP_LOGE(log_tag, "Unable to create socket: errno %d", errno);
-        return;
+        return -1;
     }
     int opt = 1;
     setsockopt(my_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    ESP_LOGI(log_tag, "Socket created");
-
-    /* set UDP receive timeout */
-    if (is_udp_server) {
-        struct timeval timeout;
-        timeout.tv_sec = 5;
-        timeout.tv_usec = 0;
-        setsockopt(my_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
-    }
 
-    /* configure TCP socket as non-blocking */
-    if (is_tcp_server) {
-        fcntl(my_sock, F_SETFL, fcntl(my_sock, F_GETFL) | O_NONBLOCK);
-    }
+    /* select() says when there is something to read, so the sockets never block */
+    fcntl(my_sock, F_SETFL, fcntl(my_sock, F_GETFL) | O_NONBLOCK);
 
     /* bind to TCP/UDP port */
     int err = bind(my_sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
     if (err != 0) {
         ESP_LOGE(log_tag, "Socket unable to bind: errno %d", errno);
-        goto CLEAN_UP;
+        close(my_sock);
+        return -1;
     }
-    ESP_LOGI(log_tag, "Socket bound, port %d", port);
+    ESP_LOGI(log_tag, "Socket bound, port %d/%s", port, socket_type == SOCK_STREAM ? "TCP" : "UDP");
 
     /* for TCP server, set socket into listening mode */
-    if (is_tcp_server && (listen(my_sock, 1) != 0)) {
+    if (socket_type == SOCK_STREAM && (listen(my_sock, 1) != 0)) {
         ESP_LOGE(log_tag, "Error listening on TCP socket: errno %d", errno);
+        close(my_sock);
+        return -1;
+    }
+    return my_sock;
+}
+
+static int find_free_slot(void)
+{
+    for (int slot = 0; slot < CONFIG_KASA_REQUEST_SLOTS; slot++) {
+        if (slots[slot].state == SLOT_FREE) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+static void log_connection(const struct slot_state * slot)
+{
+    char addr_str[128] = "";
+    if (slot->source_addr.ss_family == PF_INET) {
+        inet_ntoa_r(((struct sockaddr_in *)&slot->source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
+    }
+    ESP_LOGI(log_tag, "Connection from %s:%d/%s", addr_str, slot->http >= 0 ? CONFIG_HTTP_PORT : port,
+        slot->http >= 0 ? "HTTP" : slot->tcp ? "TCP" : "UDP");
+}
+
+static void close_http_connection(const int index)
+{
+    shutdown(http_connections[index].socket, 0);
+    close(http_connections[index].socket);
+    http_connections[index].state = HTTP_FREE;
+}
+
+static void close_connection(const uint8_t slot)
+{
+    if (slots[slot].http >= 0) {
+        close_http_connection(slots[slot].http);
+    } else {
+        shutdown(slots[slot].connection, 0);
+        close(slots[slot].connection);
+    }
+    slots[slot].state = SLOT_FREE;
+}
+
+static void submit_slot(const uint8_t slot, const int length)
+{
+    pipeline_message_t request = {
+        .slot = slot,
+        .tcp = slots[slot].tcp,
+        .http = slots[slot].http >= 0,
+        .connection = slots[slot].connection,
+        .length = length,
+    };
+    log_connection(&slots[slot]);
+    boot_trace_mark(BOOT_FIRST_REQUEST);
+    TRACE_INSTANT(TRACE_NETWORK_SUBMIT);
+    slots[slot].state = SLOT_PROCESSING;
+    if (!pipeline_submit(&request)) {
+        ESP_LOGE(log_tag, "Request queue full, dropping request");
+        if (slots[slot].tcp) {
+            close_connection(slot);
+        }
+        slots[slot].state = SLOT_FREE;
+    }
+}
+
+static void receive_udp(const int udp_socket, const int slot)
+{
+    /* with every slot in use the datagram is only read to drop it, its first byte is enough */
+    char discard[1];
+    struct sockaddr_storage source_addr;
+    socklen_t addr_len = sizeof(source_addr);
+    int rx_len = recvfrom(udp_socket, slot >= 0 ? pipeline_buffer(slot) : discard,
+        slot >= 0 ? PIPELINE_BUFFER_SIZE - 1 : sizeof(discard), 0, (struct sockaddr *)&source_addr, &addr_len);
+    if (rx_len <= 0) {
+        return;
+    }
+    if (slot < 0) {
+        ratelimit_reject_busy();
+        return;
+    }
+    if (!ratelimit_admit(&source_addr)) {
+        return;
+    }
+    slots[slot].source_addr = source_addr;
+    slots[slot].tcp = false;
+    slots[slot].http = -1;
+    submit_slot(slot, rx_len);
+}
+
+static void accept_tcp(const int tcp_socket, const int slot)
+{
+    /* TCP timeout settings */
+    int keepAlive = 1;
+    int keepIdle = 5;
+    int keepInterval = 5;
+    int keepCount = 3;
+
+    struct sockaddr_storage source_addr;
+    socklen_t addr_len = sizeof(source_addr);
+    int connection = accept(tcp_socket, (struct sockaddr *)&source_addr, &addr_len);
+    if (connection < 0) {
+        return;
+    }
+    /* rejected connections are closed before anything is read from them */
+    if (slot < 0 || !ratelimit_admit(&source_addr)) {
+        if (slot < 0) {
+            ratelimit_reject_busy();
+        }
+        close(connection);
+        return;
+    }
+    /* client connection has been accepted, kepp it alive */
+    setsockopt(connection, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
+    setsockopt(connection, IPPROTO_TCP, 5, &keepIdle, sizeof(int));
+    setsockopt(connection, IPPROTO_TCP, 5, &keepInterval, sizeof(int));
+    setsockopt(connection, IPPROTO_TCP, 3, &keepCount, sizeof(int));
+    /* replies are sent non-blocking so that a client which stops reading cannot stall the server for ever */
+    fcntl(connection, F_SETFL, fcntl(connection, F_GETFL) | O_NONBLOCK);
+
+    /* the slot is held for the connection until its request arrives */
+    slots[slot].source_addr = source_addr;
+    slots[slot].tcp = true;
+    slots[slot].http = -1;
+    slots[slot].connection = connection;
+    slots[slot].accepted_us = esp_timer_get_time();
+    slots[slot].state = SLOT_RECEIVING;
+}
+
+static void receive_tcp(const uint8_t slot)
+{
+    int rx_len = recv(slots[slot].connection, pipeline_buffer(slot), PIPELINE_BUFFER_SIZE - 1, 0);
+    if (rx_len < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;
+        }
+        ESP_LOGE(log_tag, "Error occurred during TCP receive: errno %d", errno);
+        close_connection(slot);
+        return;
+    } else if (rx_len == 0) {
+        ESP_LOGI(log_tag, "Connection closed");
+        close_connection(slot);
+        return;
+    }
+    submit_slot(slot, rx_len);
+}
+
+static void accept_http(const int http_socket)
+{
+    struct sockaddr_storage source_addr;
+    socklen_t addr_len = sizeof(source_addr);
+    int connection = accept(http_socket, (struct sockaddr *)&source_addr, &addr_len);
+    if (connection < 0) {
+        return;
+    }
+    for (int index = 0; index < CONFIG_HTTP_CONNECTIONS; index++) {
+        if (http_connections[index].state == HTTP_FREE) {
+            /* admission is checked for each request rather than for the connection */
+            fcntl(connection, F_SETFL, fcntl(connection, F_GETFL) | O_NONBLOCK);
+            http_connections[index].socket = connection;
+            http_connections[index].source_addr = source_addr;
+            http_connections[index].active_us = esp_timer_get_time();
+            http_connections[index].state = HTTP_IDLE;
+            return;
+        }
+    }
+    ratelimit_reject_busy();
+    close(connection);
+}
+
+/**
+ * @brief Receive what has arrived of an HTTP request, submitting it once its header is complete
+ * @param slot Slot holding the request
+ */
+static void receive_http(const uint8_t slot)
+{
+    struct slot_state * state = &slots[slot];
+    char * buffer = pipeline_buffer(slot);
+    int rx_len = recv(state->connection, buffer + state->received, PIPELINE_BUFFER_SIZE - 1 - state->received, 0);
+    if (rx_len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    } else if (rx_len <= 0) {
+        /* the client closing an idle keep-alive connection is the usual way for it to end */
+        close_connection(slot);
+        return;
+    }
+    const int previous = state->received;
+    state->received += rx_len;
+    /* a rejected request is read whole first, so that closing the connection does not reset it before the reply */
+    if (http_request_complete(buffer, state->received, previous)) {
+        if (ratelimit_admit(&state->source_addr)) {
+            submit_slot(slot, state->received);
+        } else {
+            wifi_send_all(state->connection, buffer, http_reject(buffer, PIPELINE_BUFFER_SIZE, 429));
+            close_connection(slot);
+        }
+    } else if (state->received == PIPELINE_BUFFER_SIZE - 1) {
+        wifi_send_all(state->connection, buffer, http_reject(buffer, PIPELINE_BUFFER_SIZE, 431));
+        close_connection(slot);
+    }
+}
+
+/**
+ * @brief Take a slot for the next request of an idle HTTP connection that has become readable
+ * @param index HTTP connection
+ * @param slot Free slot
+ */
+static void start_http_request(const int index, const uint8_t slot)
+{
+    struct http_connection * connection = &http_connections[index];
+    connection->state = HTTP_BUSY;
+    slots[slot].source_addr = connection->source_addr;
+    slots[slot].tcp = true;
+    slots[slot].http = index;
+    slots[slot].received = 0;
+    slots[slot].connection = connection->socket;
+    slots[slot].accepted_us = esp_timer_get_time();
+    slots[slot].state = SLOT_RECEIVING;
+    receive_http(slot);
+}
+
+static void send_replies(const int udp_socket)
+{
+    pipeline_message_t reply;
+    while (pipeline_take_reply(&reply)) {
+        struct slot_state * slot = &slots[reply.slot];
+        TRACE_BEGIN(TRACE_NETWORK_REPLY);
+
+        /* send a response back to the client, a streamed TCP reply has already been sent */
+        ESP_LOGI(log_tag, "Replying with %d bytes", reply.length);
+        if (!slot->tcp) {
+            if (reply.length > 0) {
+                int err = sendto(udp_socket, pipeline_buffer(reply.slot), reply.length, 0,
+                    (struct sockaddr *)&slot->source_addr, sizeof(slot->source_addr));
+                if (err < 0) {
+                    ESP_LOGE(log_tag, "Error occurred during UDP send: errno %d", errno);
+                }
+            }
+            slot->state = SLOT_FREE;
+        } else if (slot->http >= 0) {
+            /* the subscribers are only known here, an upgrade that finds them all taken is refused instead */
+            if (reply.websocket && websocket_full()) {
+                reply.length = http_reject(pipeline_buffer(reply.slot), PIPELINE_BUFFER_SIZE, 503);
+                reply.websocket = false;
+                reply.keep_alive = false;
+            }
+            /* a streamed HTTP reply has told whether the connection stays usable through keep_alive */
+            const bool sent = reply.length == 0
+                || wifi_send_all(slot->connection, pipeline_buffer(reply.slot), reply.length);
+            if (sent && reply.websocket) {
+                websocket_subscribe(slot->connection, &slot->source_addr);
+                http_connections[slot->http].state = HTTP_FREE;
+                slot->state = SLOT_FREE;
+            } else if (sent && reply.keep_alive) {
+                http_connections[slot->http].state = HTTP_IDLE;
+                http_connections[slot->http].active_us = esp_timer_get_time();
+                slot->state = SLOT_FREE;
+            } else {
+                close_connection(reply.slot);
+            }
+        } else {
+            wifi_send_all(slot->connection, pipeline_buffer(reply.slot), reply.length);
+            close_connection(reply.slot);
+        }
+        TRACE_END(TRACE_NETWORK_REPLY);
+        boot_trace_mark(BOOT_FIRST_REPLY);
+    }
+}
+
+/**
+ * @brief Serve TCP and UDP requests until server_running is cleared
+ */
+static void serve(void)
+{
+    int tcp_socket = open_server_socket(SOCK_STREAM, port);
+    int udp_socket = open_server_socket(SOCK_DGRAM, port);
+    /* CoAP answers from the readings directly, its small replies never go through the pipeline */
+    int coap_socket = CONFIG_COAP_PORT > 0 ? open_server_socket(SOCK_DGRAM, CONFIG_COAP_PORT) : -1;
+    int http_socket = CONFIG_HTTP_PORT > 0 ? open_server_socket(SOCK_STREAM, CONFIG_HTTP_PORT) : -1;
+    if (tcp_socket < 0 || udp_socket < 0 || (CONFIG_COAP_PORT > 0 && coap_socket < 0)
+        || (CONFIG_HTTP_PORT > 0 && http_socket < 0) || (wake_socket < 0 && !create_wake_socket())) {
         goto CLEAN_UP;
     }
+    boot_trace_mark(BOOT_SERVERS);
 
-    /* receive loop */
-    server_running = true;
     while (server_running)
     {
-        int rx_len = 0;
-        int connection = 0;
-
-        /* for UDP server, periodically try to read a buffer of data from the socket */
-        if (is_udp_server) {
-            rx_len = recvfrom(my_sock, raw_buffer, buffer_len - 1, 0, (struct sockaddr *)&source_addr, &addr_len);
-            if (rx_len < 0) {
-                vTaskDelay(500 / portTICK_RATE_MS);
-                continue;
-            }
+        /* hand back the slots that the processing task has finished with */
+        send_replies(udp_socket);
+        if (coap_socket >= 0) {
+            coap_service(coap_socket);
         }
 
-        /* for TCP server, wait to accept client connection */
-        if (is_tcp_server) {
-            connection = accept(my_sock, (struct sockaddr *)&source_addr, &addr_len);
-            if (connection < 0) {
-                vTaskDelay(500 / portTICK_RATE_MS);
-                continue;
+        /* new requests are read even when every slot is in use, they are then rejected rather than left queued */
+        fd_set readable;
+        fd_set writable;
+        FD_ZERO(&readable);
+        FD_ZERO(&writable);
+        FD_SET(wake_socket, &readable);
+        FD_SET(tcp_socket, &readable);
+        FD_SET(udp_socket, &readable);
+        int max_fd = MAX(wake_socket, MAX(tcp_socket, udp_socket));
+        if (coap_socket >= 0) {
+            FD_SET(coap_socket, &readable);
+            max_fd = MAX(max_fd, coap_socket);
+        }
+        if (http_socket >= 0) {
+            FD_SET(http_socket, &readable);
+            max_fd = MAX(max_fd, http_socket);
+        }
+        for (int slot = 0; slot < CONFIG_KASA_REQUEST_SLOTS; slot++) {
+            if (slots[slot].state == SLOT_RECEIVING) {
+                FD_SET(slots[slot].connection, &readable);
+                max_fd = MAX(max_fd, slots[slot].connection);
             }
-            /* client connection has been accepted, kepp it alive */
-            setsockopt(connection, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
-            setsockopt(connection, IPPROTO_TCP, 5, &keepIdle, sizeof(int));
-            setsockopt(connection, IPPROTO_TCP, 5, &keepInterval, sizeof(int));
-            setsockopt(connection, IPPROTO_TCP, 3, &keepCount, sizeof(int));
-            /* get a buffer of data */
-            rx_len = recv(connection, raw_buffer, buffer_len - 1, 0);
-            if (rx_len < 0) {
-                ESP_LOGE(log_tag, "Error occurred during TCP receive: errno %d", errno);
-                continue;
-            } else if (rx_len == 0) {
-                ESP_LOGI(log_tag, "Connection closed");
-                continue;
+        }
+        /* idle HTTP connections are only read when their request can be given a slot, otherwise it waits in TCP */
+        const bool slot_free = find_free_slot() >= 0;
+        for (int index = 0; index < CONFIG_HTTP_CONNECTIONS; index++) {
+            if (slot_free && http_connections[index].state == HTTP_IDLE) {
+                FD_SET(http_connections[index].socket, &readable);
+                max_fd = MAX(max_fd, http_connections[index].socket);
             }
         }
 
-        /* connection has now been made, so get the client IP address */
-        if (source_addr.ss_family == PF_INET) {
-            inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
-        }
-        ESP_LOGI(log_tag, "Connection from %s:%d/%s", addr_str, port, is_tcp_server ? "TCP" : "UDP");
+        max_fd = websocket_prepare(&readable, &writable, max_fd);
 
-        /* process the buffer and generate a response */
-        int reply_len = tplink_kasa_process_buffer(raw_buffer, rx_len, is_tcp_server);
+        /* wake at least once a second to notice that the servers should stop */
+        struct timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        if (select(max_fd + 1, &readable, &writable, NULL, &timeout) < 0) {
+            ESP_LOGE(log_tag, "Error occurred during select: errno %d", errno);
+            break;
+        }
 
-        /* send a response back to the client */
-        ESP_LOGI(log_tag, "Replying with %d bytes", reply_len);
-        if (is_udp_server) {
-            int err = sendto(my_sock, raw_buffer, reply_len, 0, (struct sockaddr *)&source_addr, sizeof(source_addr));
-            if (err < 0) {
-                ESP_LOGE(log_tag, "Error occurred during UDP send: errno %d", errno);
+        if (FD_ISSET(wake_socket, &readable)) {
+            char discard[8];
+            while (recv(wake_socket, discard, sizeof(discard), 0) > 0) {
             }
         }
-        if (is_tcp_server) {
-            int to_write = reply_len;
-            while (to_write > 0) {
-                int written = send(connection, raw_buffer + (reply_len - to_write), to_write, 0);
-                if (written < 0) {
-                    ESP_LOGE(log_tag, "Error occurred during TCP send: errno %d", errno);
-                    break;
+
+        /* the new readings go out to the subscribers as soon as the sampler wakes the task */
+        websocket_service(&readable, &writable);
+
+        const int64_t now = esp_timer_get_time();
+        for (int slot = 0; slot < CONFIG_KASA_REQUEST_SLOTS; slot++) {
+            if (slots[slot].state != SLOT_RECEIVING) {
+                continue;
+            }
+            if (FD_ISSET(slots[slot].connection, &readable)) {
+                TRACE_BEGIN(TRACE_NETWORK_RECEIVE);
+                if (slots[slot].http >= 0) {
+                    receive_http(slot);
+                } else {
+                    receive_tcp(slot);
                 }
-                to_write -= written;
+                TRACE_END(TRACE_NETWORK_RECEIVE);
+            } else if (now - slots[slot].accepted_us > CONNECTION_RECEIVE_TIMEOUT_MS * 1000LL) {
+                ESP_LOGI(log_tag, "Connection sent no request, closing");
+                close_connection(slot);
+            }
+        }
+
+        if (FD_ISSET(udp_socket, &readable)) {
+            TRACE_BEGIN(TRACE_NETWORK_RECEIVE);
+            receive_udp(udp_socket, find_free_slot());
+            TRACE_END(TRACE_NETWORK_RECEIVE);
+        }
+        if (coap_socket >= 0 && FD_ISSET(coap_socket, &readable)) {
+            TRACE_BEGIN(TRACE_NETWORK_RECEIVE);
+            coap_receive(coap_socket);
+            TRACE_END(TRACE_NETWORK_RECEIVE);
+        }
+        for (int index = 0; index < CONFIG_HTTP_CONNECTIONS; index++) {
+            if (http_connections[index].state != HTTP_IDLE) {
+                continue;
             }
-            shutdown(connection, 0);
-            close(connection);
+            const int slot = slot_free ? find_free_slot() : -1;
+            if (slot >= 0 && FD_ISSET(http_connections[index].socket, &readable)) {
+                TRACE_BEGIN(TRACE_NETWORK_RECEIVE);
+                start_http_request(index, slot);
+                TRACE_END(TRACE_NETWORK_RECEIVE);
+            } else if (now - http_connections[index].active_us > HTTP_KEEPALIVE_TIMEOUT_S * 1000000LL) {
+                close_http_connection(index);
+            }
+        }
+        /* the UDP and HTTP requests may have taken the free slot */
+        if (FD_ISSET(tcp_socket, &readable)) {
+            accept_tcp(tcp_socket, find_free_slot());
+        }
+        if (http_socket >= 0 && FD_ISSET(http_socket, &readable)) {
+            accept_http(http_socket);
         }
     }
 
 CLEAN_UP:
-    free(raw_buffer);
-    close(my_sock);
-    if (is_tcp_server) ESP_LOGI(log_tag, "TCP server ended");
-    if (is_udp_server) ESP_LOGI(log_tag, "UDP server ended");
-    vTaskDelete(NULL);
+    /* connections still waiting for their request are dropped, slots being processed come back as replies later */
+    for (int slot = 0; slot < CONFIG_KASA_REQUEST_SLOTS; slot++) {
+        if (slots[slot].state == SLOT_RECEIVING) {
+            close_connection(slot);
+        }
+    }
+    for (int index = 0; index < CONFIG_HTTP_CONNECTIONS; index++) {
+        if (http_connections[index].state == HTTP_IDLE) {
+            close_http_connection(index);
+        }
+    }
+    websocket_close_all();
+    if (tcp_socket >= 0) close(tcp_socket);
+    if (udp_socket >= 0) close(udp_socket);
+    if (coap_socket >= 0) close(coap_socket);
+    if (http_socket >= 0) close(http_socket);
+    ESP_LOGI(log_tag, "TCP/UDP servers ended");
+}
+
+static void network_task(void *pvParameters)
+{
+    while (true) {
+        serve();
+        if (server_running) {
+            /* the sockets failed, try again later */
+            vTaskDelay(1000 / portTICK_RATE_MS);
+            continue;
+        }
+        /* wait for start_servers to be called again */
+        while (!server_running) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
 }
 
 void start_servers(void)
-{   
-    /* start a TCP server on port 9999 for control commands (e.g. colour/on/off) */
-    xTaskCreate(server_task, "tcp_server", 4096, (void*)SOCK_STREAM, 5, &handle_tcp_server);
-    /* start a UDP server on port 9999 for get_sysinfo commands */
-    xTaskCreate(server_task, "udp_server", 4096, (void*)SOCK_DGRAM, 5, &handle_udp_server);
+{
+    server_running = true;
+    if (handle_network == NULL) {
+        /* a single task on the protocol core serves TCP and UDP on port 9999, requests are processed on the other core */
+        handle_network = xTaskCreateStaticPinnedToCore(network_task, "network", CONFIG_NETWORK_TASK_STACK_SIZE, NULL, 5,
+            network_stack, &network_tcb, NETWORK_CORE);
+        taskstats_register(handle_network, "network", CONFIG_NETWORK_TASK_STACK_SIZE);
+    } else {
+        xTaskNotifyGive(handle_network);
+    }
 }
@@ -19,4 +19,29 @@
  */
 extern void wifi_setup(bool access_point);
 
+/**
+ * @brief Report that the application can serve requests, the servers start once the network is up as well
+ */
+extern void wifi_application_ready(void);
+
+/**
+ * @brief Send a whole buffer over a non-blocking TCP connection
+ * @param connection Connected socket
+ * @param data Data to send
+ * @param length Length of the data
+ * @return False if the connection failed or the client did not take data for CONFIG_KASA_SEND_TIMEOUT_MS
+ */
+extern bool wifi_send_all(int connection, const char * data, size_t length);
+
+/**
+ * @brief Get the MAC address of the station interface
+ * @return Six bytes, valid for ever
+ */
+extern const uint8_t * wifi_mac_address(void);
+
+/**
+ * @brief Wake the network task so that it picks up a reply without waiting for its select() timeout (any task)
+ */
+extern void wifi_wake_network(void);
+
 #endif
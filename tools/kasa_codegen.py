@@ -0,0 +1,525 @@
+#!/usr/bin/env python3
+"""
+Generate C structs, a request parser and reply serializers from a schema of Kasa commands.
+
+The schema is a list of commands, each a module and method name with optional request
+parameters and an optional reply, for example:
+
+    # comment
+    system.set_dev_alias {alias:string[32]} -> {err_code:int}
+    emeter.get_daystat {year:int, month:int} -> {err_code:int, err_msg:string}
+
+Field types are int, bool, double, string[N] and nested {...} objects. Request strings
+are copied into char[N] buffers (N defaults to 32), reply strings are const char pointers.
+A field name ending in ? is optional in a request, otherwise the request is rejected when
+it is missing. A rejected request still tells which command it was, so that it can be
+answered with kasa_commands_write_error_reply. Keys are matched case-sensitively. Module names may contain dots (smartlife.iot.common.emeter.get_realtime),
+the method is always the last component.
+
+Usage: kasa_codegen.py <schema> <output directory>
+Writes kasa_commands.h and kasa_commands.c which depend on kasa_bind.h.
+"""
+
+import os
+import re
+import sys
+
+DEFAULT_STRING_SIZE = 32
+
+TOKEN = re.compile(r'\s*(?:(#[^\n]*)|(->)|([A-Za-z_][A-Za-z0-9_]*)|([0-9]+)|([{}\[\]:,.?]))')
+
+
+class SchemaError(Exception):
+    pass
+
+
+class Field:
+    def __init__(self, name, kind, size=None, fields=None, optional=False):
+        self.name = name
+        self.kind = kind
+        self.size = size
+        self.fields = fields
+        self.optional = optional
+
+
+class Command:
+    def __init__(self, module, method, request, reply):
+        self.module = module
+        self.method = method
+        self.request = request
+        self.reply = reply
+        self.ident = identifier(module + '_' + method)
+
+
+def identifier(name):
+    return re.sub(r'[^A-Za-z0-9_]', '_', name)
+
+
+def tokenize(text):
+    tokens = []
+    line = 1
+    pos = 0
+    while pos < len(text):
+        match = TOKEN.match(text, pos)
+        if match is None or match.end() == pos:
+            if text[pos:].strip() == '':
+                break
+            raise SchemaError('line %d: unexpected character %r' % (line, text[pos]))
+        line += text.count('\n', pos, match.end())
+        pos = match.end()
+        if match.group(1) is None:
+            tokens.append((match.group(match.lastindex), line))
+    return tokens
+
+
+class Parser:
+    def __init__(self, tokens):
+        self.tokens = tokens
+        self.pos = 0
+
+    def peek(self):
+        return self.tokens[self.pos][0] if self.pos < len(self.tokens) else None
+
+    def take(self, expected=None):
+        if self.pos >= len(self.tokens):
+            raise SchemaError('unexpected end of schema')
+        token, line = self.tokens[self.pos]
+        if expected is not None and token != expected:
+            raise SchemaError('line %d: expected %r, got %r' % (line, expected, token))
+        self.pos += 1
+        return token
+
+    def name(self):
+        token = self.take()
+        if not re.match(r'[A-Za-z_]', token):
+            raise SchemaError('line %d: expected a name, got %r' % (self.tokens[self.pos - 1][1], token))
+        return token
+
+    def commands(self):
+        commands = []
+        while self.peek() is not None:
+            parts = [self.name()]
+            while self.peek() == '.':
+                self.take('.')
+                parts.append(self.name())
+            if len(parts) < 2:
+                raise SchemaError('command %r needs a module and a method' % parts[0])
+            request = self.object() if self.peek() == '{' else []
+            reply = []
+            if self.peek() == '->':
+                self.take('->')
+                reply = self.object()
+            commands.append(Command('.'.join(parts[:-1]), parts[-1], request, reply))
+        return commands
+
+    def object(self):
+        fields = []
+        self.take('{')
+        while self.peek() != '}':
+            if fields:
+                self.take(',')
+            name = self.name()
+            optional = False
+            if self.peek() == '?':
+                self.take('?')
+                optional = True
+            self.take(':')
+            field = self.type(name)
+            field.optional = optional
+            fields.append(field)
+        self.take('}')
+        return fields
+
+    def type(self, name):
+        if self.peek() == '{':
+            return Field(name, 'object', fields=self.object())
+        kind = self.name()
+        if kind == 'string':
+            size = DEFAULT_STRING_SIZE
+            if self.peek() == '[':
+                self.take('[')
+                size = int(self.take())
+                self.take(']')
+            return Field(name, 'string', size=size)
+        if kind not in ('int', 'bool', 'double'):
+            raise SchemaError('field %r has unknown type %r' % (name, kind))
+        return Field(name, kind)
+
+
+def c_string(text):
+    return '"' + text.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def struct_members(fields, reply, indent):
+    lines = []
+    for field in fields:
+        name = identifier(field.name)
+        if field.kind == 'object':
+            lines.append(indent + 'struct')
+            lines.append(indent + '{')
+            lines.extend(struct_members(field.fields, reply, indent + '    '))
+            lines.append(indent + '} %s;' % name)
+        elif field.kind == 'string':
+            lines.append(indent + (('const char * %s;' % name) if reply else ('char %s[%d];' % (name, field.size))))
+        else:
+            lines.append(indent + '%s %s;' % (field.kind, name))
+    return lines
+
+
+def generate_header(commands, schema_name):
+    out = []
+    out.append('/**')
+    out.append(' * @file Kasa command structs and bindings, generated by tools/kasa_codegen.py from %s (do not edit)' % schema_name)
+    out.append(' */')
+    out.append('')
+    out.append('#ifndef INTELLILIGHT_KASA_COMMANDS_H')
+    out.append('#define INTELLILIGHT_KASA_COMMANDS_H')
+    out.append('')
+    out.append('/* system includes */')
+    out.append('#include <stdbool.h>')
+    out.append('#include <stddef.h>')
+    out.append('')
+    out.append('')
+    out.append('/**')
+    out.append(' * @brief Commands described by the schema')
+    out.append(' */')
+    out.append('typedef enum')
+    out.append('{')
+    out.append('    KASA_COMMAND_NONE = 0,')
+    for command in commands:
+        out.append('    KASA_COMMAND_%s,' % command.ident.upper())
+    out.append('} kasa_command_id_t;')
+    out.append('')
+
+    for command in commands:
+        for fields, suffix, reply in ((command.request, 'request', False), (command.reply, 'reply', True)):
+            if not fields:
+                continue
+            out.append('/**')
+            out.append(' * @brief %s of %s.%s' % (suffix.capitalize(), command.module, command.method))
+            out.append(' */')
+            out.append('typedef struct')
+            out.append('{')
+            out.extend(struct_members(fields, reply, '    '))
+            out.append('} kasa_%s_%s_t;' % (command.ident, suffix))
+            out.append('')
+
+    out.append('/**')
+    out.append(' * @brief A parsed command and its request parameters')
+    out.append(' */')
+    out.append('typedef struct')
+    out.append('{')
+    out.append('    kasa_command_id_t id;')
+    out.append('    union')
+    out.append('    {')
+    members = [c for c in commands if c.request]
+    for command in members:
+        out.append('        kasa_%s_request_t %s;' % (command.ident, command.ident))
+    if not members:
+        out.append('        char unused;')
+    out.append('    } request;')
+    out.append('} kasa_command_t;')
+    out.append('')
+    out.append('/**')
+    out.append(' * @brief Find the first command in a request and bind its parameters')
+    out.append(' * @param json Request text, which must already have passed cJSON_Validate')
+    out.append(' * @param length Length of the request')
+    out.append(' * @param command Output command, id is the command found even if its parameters could not be bound and')
+    out.append(' * KASA_COMMAND_NONE if there is none')
+    out.append(' * @return True if a command was found and all its required parameters were present, of the right type and')
+    out.append(' * fit their buffers')
+    out.append(' */')
+    out.append('extern bool kasa_commands_parse(const char * json, const size_t length, kasa_command_t * command);')
+    out.append('')
+    out.append('/**')
+    out.append(' * @brief Write the reply of a command that reports an error, {module:{method:{err_code, err_msg}}}')
+    out.append(' * @return Length of the reply, or -1 if there is no command or it does not fit in the buffer')
+    out.append(' */')
+    out.append('extern int kasa_commands_write_error_reply(char * buffer, const size_t size, const kasa_command_id_t id,')
+    out.append('    const int err_code, const char * err_msg);')
+
+    for command in commands:
+        if not command.reply:
+            continue
+        out.append('')
+        out.append('/**')
+        out.append(' * @brief Write the reply to %s.%s' % (command.module, command.method))
+        out.append(' * @return Length of the reply, or -1 if it does not fit in the buffer')
+        out.append(' */')
+        out.append('extern int kasa_commands_write_%s_reply(char * buffer, const size_t size, const kasa_%s_reply_t * reply);'
+                   % (command.ident, command.ident))
+
+    out.append('')
+    out.append('#endif')
+    return '\n'.join(out) + '\n'
+
+
+def emit_parsers(out, name, type_name, fields):
+    """emit parsers for an object, nested objects are parsed inline to avoid naming their anonymous types"""
+    required = 0
+    for index, field in enumerate(fields):
+        if not field.optional:
+            required |= 1 << index
+    if len(fields) > 32:
+        raise SchemaError('%s has more than 32 fields' % name)
+
+    out.append('static bool parse_%s(kasa_bind_reader_t * reader, %s * value)' % (name, type_name))
+    out.append('{')
+    out.append('    const char * key;')
+    out.append('    size_t key_len;')
+    out.append('')
+    out.extend(object_body(fields, 'value->', '    ', 0))
+    out.append('    return true;')
+    out.append('}')
+    out.append('')
+
+
+def object_body(fields, prefix, indent, depth):
+    """statements binding the object at the reader position into the members under prefix"""
+    present = 'present%d' % depth
+    required = 0
+    for index, field in enumerate(fields):
+        if not field.optional:
+            required |= 1 << index
+    lines = []
+    lines.append(indent + 'unsigned long %s = 0;' % present)
+    lines.append(indent + 'if (!kasa_bind_object_begin(reader)) {')
+    lines.append(indent + '    return false;')
+    lines.append(indent + '}')
+    lines.append(indent + 'while (kasa_bind_next_key(reader, &key, &key_len)) {')
+    for index, field in enumerate(fields):
+        member = prefix + identifier(field.name)
+        keyword = 'if' if index == 0 else '} else if'
+        lines.append(indent + '    %s (kasa_bind_key_equals(key, key_len, %s)) {' % (keyword, c_string(field.name)))
+        if field.kind == 'object':
+            lines.append(indent + '        {')
+            lines.extend(object_body(field.fields, member + '.', indent + '            ', depth + 1))
+            lines.append(indent + '        }')
+        else:
+            if field.kind == 'string':
+                call = 'kasa_bind_read_string(reader, %s, sizeof(%s))' % (member, member)
+            else:
+                call = 'kasa_bind_read_%s(reader, &%s)' % (field.kind, member)
+            lines.append(indent + '        if (!%s) {' % call)
+            lines.append(indent + '            return false;')
+            lines.append(indent + '        }')
+        lines.append(indent + '        %s |= 1UL << %d;' % (present, index))
+    if fields:
+        lines.append(indent + '    } else if (!kasa_bind_skip_value(reader)) {')
+    else:
+        lines.append(indent + '    if (!kasa_bind_skip_value(reader)) {')
+    lines.append(indent + '        return false;')
+    lines.append(indent + '    }')
+    lines.append(indent + '}')
+    lines.append(indent + 'if ((%s & 0x%XUL) != 0x%XUL) {' % (present, required, required))
+    lines.append(indent + '    return false;')
+    lines.append(indent + '}')
+    return lines
+
+
+class Writer:
+    """collects writer calls, merging adjacent literal text into single kasa_bind_write_raw calls"""
+
+    def __init__(self, indent):
+        self.indent = indent
+        self.lines = []
+        self.literal = ''
+
+    def raw(self, text):
+        self.literal += text
+
+    def call(self, statement):
+        self.flush()
+        self.lines.append(self.indent + statement)
+
+    def flush(self):
+        if self.literal:
+            self.lines.append(self.indent + 'kasa_bind_write_raw(&writer, %s);' % c_string(self.literal))
+            self.literal = ''
+
+
+def write_object(writer, fields, prefix):
+    writer.raw('{')
+    for index, field in enumerate(fields):
+        member = prefix + identifier(field.name)
+        writer.raw((',' if index else '') + c_string(field.name) + ':')
+        if field.kind == 'object':
+            write_object(writer, field.fields, member + '.')
+        elif field.kind == 'string':
+            writer.call('kasa_bind_write_string(&writer, %s != NULL ? %s : "");' % (member, member))
+        else:
+            writer.call('kasa_bind_write_%s(&writer, %s);' % (field.kind, member))
+    writer.raw('}')
+
+
+def generate_source(commands, schema_name):
+    out = []
+    out.append('/**')
+    out.append(' * @file Kasa command structs and bindings, generated by tools/kasa_codegen.py from %s (do not edit)' % schema_name)
+    out.append(' */')
+    out.append('')
+    out.append('/* system includes */')
+    out.append('#include <string.h>')
+    out.append('')
+    out.append('/* local includes */')
+    out.append('#include "kasa_bind.h"')
+    out.append('#include "kasa_commands.h"')
+    out.append('')
+    out.append('')
+
+    for command in commands:
+        if command.request:
+            emit_parsers(out, command.ident + '_request', 'kasa_%s_request_t' % command.ident, command.request)
+
+    modules = []
+    for command in commands:
+        if command.module not in modules:
+            modules.append(command.module)
+
+    for module in modules:
+        out.append('/* returns 1 if a command was bound, 0 if the module has none (the reader is then after it), -1 on bad parameters */')
+        out.append('static int parse_module_%s(kasa_bind_reader_t * reader, kasa_command_t * command)' % identifier(module))
+        out.append('{')
+        out.append('    const char * key;')
+        out.append('    size_t key_len;')
+        out.append('')
+        out.append('    if (!kasa_bind_object_begin(reader)) {')
+        out.append('        return kasa_bind_skip_value(reader) ? 0 : -1;')
+        out.append('    }')
+        out.append('    while (kasa_bind_next_key(reader, &key, &key_len)) {')
+        for command in commands:
+            if command.module != module:
+                continue
+            out.append('        if (kasa_bind_key_equals(key, key_len, %s)) {' % c_string(command.method))
+            out.append('            command->id = KASA_COMMAND_%s;' % command.ident.upper())
+            if command.request:
+                out.append('            return parse_%s_request(reader, &command->request.%s) ? 1 : -1;'
+                           % (command.ident, command.ident))
+            else:
+                out.append('            return kasa_bind_skip_value(reader) ? 1 : -1;')
+            out.append('        }')
+        out.append('        if (!kasa_bind_skip_value(reader)) {')
+        out.append('            return -1;')
+        out.append('        }')
+        out.append('    }')
+        out.append('    return 0;')
+        out.append('}')
+        out.append('')
+
+    out.append('bool kasa_commands_parse(const char * json, const size_t length, kasa_command_t * command)')
+    out.append('{')
+    out.append('    kasa_bind_reader_t reader;')
+    out.append('    const char * key;')
+    out.append('    size_t key_len;')
+    out.append('')
+    out.append('    memset(command, 0, sizeof(*command));')
+    out.append('    kasa_bind_reader_init(&reader, json, length);')
+    out.append('    if (!kasa_bind_object_begin(&reader)) {')
+    out.append('        return false;')
+    out.append('    }')
+    out.append('    while (kasa_bind_next_key(&reader, &key, &key_len)) {')
+    out.append('        int found = 0;')
+    for index, module in enumerate(modules):
+        keyword = 'if' if index == 0 else '} else if'
+        out.append('        %s (kasa_bind_key_equals(key, key_len, %s)) {' % (keyword, c_string(module)))
+        out.append('            found = parse_module_%s(&reader, command);' % identifier(module))
+    out.append('        } else if (!kasa_bind_skip_value(&reader)) {')
+    out.append('            found = -1;')
+    out.append('        }')
+    out.append('        if (found != 0) {')
+    out.append('            return found > 0;')
+    out.append('        }')
+    out.append('    }')
+    out.append('    return false;')
+    out.append('}')
+    out.append('')
+
+    out.append('/* module and method of every command, indexed by its id */')
+    out.append('static const char * const command_names[][2] = {')
+    out.append('    { NULL, NULL },')
+    for command in commands:
+        out.append('    { %s, %s },' % (c_string(command.module), c_string(command.method)))
+    out.append('};')
+    out.append('')
+    out.append('int kasa_commands_write_error_reply(char * buffer, const size_t size, const kasa_command_id_t id,')
+    out.append('    const int err_code, const char * err_msg)')
+    out.append('{')
+    out.append('    kasa_bind_writer_t writer;')
+    out.append('')
+    out.append('    if (id == KASA_COMMAND_NONE || (size_t)id >= sizeof(command_names) / sizeof(command_names[0])) {')
+    out.append('        return -1;')
+    out.append('    }')
+    out.append('    kasa_bind_writer_init(&writer, buffer, size);')
+    out.append('    kasa_bind_write_raw(&writer, "{");')
+    out.append('    kasa_bind_write_string(&writer, command_names[id][0]);')
+    out.append('    kasa_bind_write_raw(&writer, ":{");')
+    out.append('    kasa_bind_write_string(&writer, command_names[id][1]);')
+    out.append('    kasa_bind_write_raw(&writer, ":{\\"err_code\\":");')
+    out.append('    kasa_bind_write_int(&writer, err_code);')
+    out.append('    kasa_bind_write_raw(&writer, ",\\"err_msg\\":");')
+    out.append('    kasa_bind_write_string(&writer, err_msg);')
+    out.append('    kasa_bind_write_raw(&writer, "}}}");')
+    out.append('    return kasa_bind_writer_finish(&writer);')
+    out.append('}')
+
+    for command in commands:
+        if not command.reply:
+            continue
+        out.append('')
+        out.append('int kasa_commands_write_%s_reply(char * buffer, const size_t size, const kasa_%s_reply_t * reply)'
+                   % (command.ident, command.ident))
+        out.append('{')
+        out.append('    kasa_bind_writer_t writer;')
+        out.append('')
+        out.append('    kasa_bind_writer_init(&writer, buffer, size);')
+        writer = Writer('    ')
+        writer.raw('{%s:{%s:' % (c_string(command.module), c_string(command.method)))
+        write_object(writer, command.reply, 'reply->')
+        writer.raw('}}')
+        writer.flush()
+        out.extend(writer.lines)
+        out.append('    return kasa_bind_writer_finish(&writer);')
+        out.append('}')
+
+    return '\n'.join(out) + '\n'
+
+
+def write_if_changed(path, text):
+    """leave unchanged outputs alone so their timestamps do not trigger rebuilds"""
+    if os.path.exists(path):
+        with open(path) as existing:
+            if existing.read() == text:
+                return
+    with open(path, 'w') as output:
+        output.write(text)
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write('usage: %s <schema> <output directory>\n' % argv[0])
+        return 2
+
+    with open(argv[1]) as schema:
+        text = schema.read()
+    try:
+        commands = Parser(tokenize(text)).commands()
+    except SchemaError as error:
+        sys.stderr.write('%s: %s\n' % (argv[1], error))
+        return 1
+
+    idents = [c.ident for c in commands]
+    duplicates = set(i for i in idents if idents.count(i) > 1)
+    if duplicates:
+        sys.stderr.write('%s: duplicate commands %s\n' % (argv[1], ', '.join(sorted(duplicates))))
+        return 1
+
+    schema_name = os.path.basename(argv[1])
+    if not os.path.isdir(argv[2]):
+        os.makedirs(argv[2])
+    write_if_changed(os.path.join(argv[2], 'kasa_commands.h'), generate_header(commands, schema_name))
+    write_if_changed(os.path.join(argv[2], 'kasa_commands.c'), generate_source(commands, schema_name))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""
+Measure how the throughput of the host kasa_server scales with its number of worker threads.
+
+For every thread count from 1 to the maximum the server is started on that many CPUs, and load
+processes (kasa_load, one connection per TCP request or UDP datagrams) run on the CPUs left over,
+so the load generator does not compete with the workers. Both are taken from the build directory
+of the host CMake project. Each line of the result is one thread count, with the throughput summed
+over the load processes and the worst p99 latency any of them saw.
+
+Usage: server_scaling.py <build_dir> [--threads N] [--backend epoll|uring] [--udp]
+                         [--load-processes N] [--concurrency N] [--duration S] [--port P]
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import time
+
+RESULT = re.compile(r'(\d+) replies, (\d+) failed in [\d.]+ s, (\d+) requests/s')
+LATENCY = re.compile(r'p50 (\d+) p90 \d+ p99 (\d+)')
+
+
+def cpu_list(cpus):
+    return ','.join(str(cpu) for cpu in cpus)
+
+
+def run_point(args, threads, server_cpus, load_cpus, load_processes):
+    server = subprocess.Popen(['taskset', '-c', cpu_list(server_cpus), os.path.join(args.build_dir, 'kasa_server'),
+                               '-b', args.backend, '-t', str(threads), '-p', str(args.port), '-s', '0'],
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        # the sampler takes its first reading and the workers arm their sockets
+        time.sleep(1)
+        command = [os.path.join(args.build_dir, 'kasa_load'), '-c', str(args.concurrency), '-d', str(args.duration)]
+        if args.udp:
+            command.append('-u')
+        command += ['127.0.0.1', str(args.port)]
+        loads = [subprocess.Popen(['taskset', '-c', cpu_list(load_cpus)] + command, stdout=subprocess.PIPE, text=True)
+                 for _ in range(load_processes)]
+        throughput = failed = p50 = p99 = 0
+        for load in loads:
+            output, _ = load.communicate()
+            result = RESULT.search(output)
+            latency = LATENCY.search(output)
+            if result is None:
+                raise RuntimeError('unexpected kasa_load output: %r' % output)
+            failed += int(result.group(2))
+            throughput += int(result.group(3))
+            if latency is not None:
+                p50 = max(p50, int(latency.group(1)))
+                p99 = max(p99, int(latency.group(2)))
+        return throughput, failed, p50, p99
+    finally:
+        server.send_signal(2)
+        server.wait()
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(usage=__doc__)
+    parser.add_argument('build_dir')
+    parser.add_argument('--threads', type=int, default=0, help='largest thread count, default half the CPUs')
+    parser.add_argument('--backend', choices=('epoll', 'uring'), default='epoll')
+    parser.add_argument('--udp', action='store_true')
+    parser.add_argument('--load-processes', type=int, default=0, help='default one per CPU left for the load')
+    parser.add_argument('--concurrency', type=int, default=64, help='requests in flight per load process')
+    parser.add_argument('--duration', type=int, default=5)
+    parser.add_argument('--port', type=int, default=9999)
+    args = parser.parse_args(argv[1:])
+
+    cpus = sorted(os.sched_getaffinity(0))
+    if args.threads <= 0:
+        args.threads = max(1, len(cpus) // 2)
+    if args.threads >= len(cpus):
+        sys.stderr.write('warning: %d CPUs, the load shares them with the workers\n' % len(cpus))
+
+    print('%s %s, %d in flight per load process' % (args.backend, 'udp' if args.udp else 'tcp', args.concurrency))
+    print('threads  requests/s  speedup  p50 us  p99 us  failed')
+    base = None
+    for threads in range(1, args.threads + 1):
+        server_cpus = cpus[:threads]
+        load_cpus = cpus[threads:] or cpus
+        processes = args.load_processes if args.load_processes > 0 else len(load_cpus)
+        throughput, failed, p50, p99 = run_point(args, threads, server_cpus, load_cpus, processes)
+        base = base or throughput or 1
+        print('%7d  %10d  %6.2fx  %6d  %6d  %6d' % (threads, throughput, throughput / base, p50, p99, failed))
+        sys.stdout.flush()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
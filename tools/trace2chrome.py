@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+"""
+Convert a diag.get_trace dump into Chrome trace event JSON for chrome://tracing or Perfetto.
+
+The dump is the reply to {"diag":{"get_trace":null}}, either saved to a file (the whole reply or
+just the get_trace object) or fetched from the device over TCP with --host. Each core's ring
+holds 32-bit cycle counter stamps, which are chained from one event to the next and placed in
+time by the sync records the device writes every 32 records and after every long gap, or
+failing that by the anchor read when the dump was taken. Events older than the oldest sync
+record of a core cannot be placed and are dropped.
+
+Usage: trace2chrome.py <dump.json> <output.json>
+       trace2chrome.py --host <address> <output.json>
+"""
+
+import json
+import socket
+import struct
+import sys
+
+PORT = 9999
+CIPHER_KEY = 171
+PHASES = {0: 'B', 1: 'E', 2: 'i'}
+SYNC_EVENT = 0
+
+
+def encrypt(text):
+    key = CIPHER_KEY
+    out = bytearray()
+    for byte in text.encode():
+        key ^= byte
+        out.append(key)
+    return bytes(out)
+
+
+def decrypt(data):
+    key = CIPHER_KEY
+    out = bytearray()
+    for byte in data:
+        out.append(key ^ byte)
+        key = byte
+    return out.decode()
+
+
+def fetch(host):
+    payload = encrypt('{"diag":{"get_trace":null}}')
+    with socket.create_connection((host, PORT), timeout=10) as connection:
+        connection.sendall(struct.pack('>I', len(payload)) + payload)
+        received = bytearray()
+        while True:
+            chunk = connection.recv(65536)
+            if not chunk:
+                break
+            received += chunk
+    if len(received) < 4:
+        raise ValueError('no reply from %s' % host)
+    length = struct.unpack('>I', received[:4])[0]
+    return json.loads(decrypt(received[4:4 + length]))
+
+
+def unwrap32(value):
+    return value & 0xFFFFFFFF
+
+
+def signed32(value):
+    value &= 0xFFFFFFFF
+    return value - 0x100000000 if value & 0x80000000 else value
+
+
+def place_core(core, cycles_per_us, capacity):
+    """Return (records, dropped) where records are (time_us, event, phase, task) in ring order."""
+    head = core['head']
+    count = min(head, capacity)
+    oldest = head - count
+    records = []
+    for k in range(count):
+        index = (oldest + k) % capacity
+        code = core['events'][index]
+        records.append((unwrap32(core['cycles'][index]), code >> 2, code & 3, unwrap32(core['tasks'][index])))
+    if not records:
+        return [], 0
+
+    anchor_us = core['anchor_us']
+    placed = []
+    dropped = 0
+    time_us = None
+    syncs = [k for k, record in enumerate(records) if record[1] == SYNC_EVENT]
+    if syncs:
+        dropped = syncs[0]
+    else:
+        # no sync survives: the newest record is assumed to be less than one counter wrap before the anchor,
+        # and the chain is walked back from it to the oldest record
+        newest = len(records) - 1
+        time_us = anchor_us - unwrap32(core['anchor_cycles'] - records[newest][0]) / cycles_per_us
+        for k in range(newest, 0, -1):
+            time_us -= signed32(records[k][0] - records[k - 1][0]) / cycles_per_us
+
+    for k in range(dropped, len(records)):
+        cycles, event, phase, task = records[k]
+        if event == SYNC_EVENT:
+            # the task field of a sync holds the low 32 bits of the esp_timer time
+            time_us = anchor_us - unwrap32(int(anchor_us) - task)
+            continue
+        if k > dropped:
+            time_us += signed32(cycles - records[k - 1][0]) / cycles_per_us
+        placed.append((time_us, event, phase, task))
+    return placed, dropped
+
+
+def convert(dump):
+    if 'diag' in dump:
+        dump = dump['diag']['get_trace']
+    if not dump.get('enabled'):
+        raise ValueError('tracing is not enabled in this firmware (CONFIG_TRACE_ENABLE)')
+
+    names = dump['events']
+    task_names = {unwrap32(task['id']): task.get('name') for task in dump['tasks']}
+    cycles_per_us = float(dump['cpu_mhz'])
+    trace_events = [{'name': 'process_name', 'ph': 'M', 'pid': 0, 'args': {'name': 'device'}}]
+    threads = set()
+
+    for core_number, core in enumerate(dump['cores']):
+        records, dropped = place_core(core, cycles_per_us, dump['capacity'])
+        if dropped:
+            sys.stderr.write('core %d: %d events before the oldest sync dropped\n' % (core_number, dropped))
+
+        open_events = {}
+        for time_us, event, phase, task in records:
+            name = names[event] if event < len(names) else 'event %d' % event
+            threads.add(task)
+            if phase == 1:
+                # an end whose begin was overwritten has nothing to close
+                if open_events.get((task, event), 0) == 0:
+                    continue
+                open_events[(task, event)] -= 1
+            elif phase == 0:
+                open_events[(task, event)] = open_events.get((task, event), 0) + 1
+            entry = {'name': name, 'ph': PHASES.get(phase, 'i'), 'ts': time_us, 'pid': 0, 'tid': task,
+                     'args': {'core': core_number}}
+            if phase == 2:
+                entry['s'] = 't'
+            trace_events.append(entry)
+
+    for task in threads:
+        name = task_names.get(task) or 'task 0x%08x' % task
+        trace_events.append({'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': task, 'args': {'name': name}})
+
+    return {'traceEvents': trace_events, 'displayTimeUnit': 'ms'}
+
+
+def main(argv):
+    if len(argv) == 4 and argv[1] == '--host':
+        dump = fetch(argv[2])
+    elif len(argv) == 3:
+        with open(argv[1]) as f:
+            dump = json.load(f)
+    else:
+        sys.stderr.write(__doc__)
+        return 2
+
+    try:
+        chrome = convert(dump)
+    except (KeyError, ValueError) as e:
+        sys.stderr.write('%s\n' % e)
+        return 1
+
+    with open(argv[-1], 'w') as f:
+        json.dump(chrome, f)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))